@@ -7,6 +7,17 @@
 #define __ACTION_H
 
 #include <stdio.h>
+#include <set>
+#include <string>
+
+#include "povxml2c.h"
+
+using std::set;
+using std::string;
+
+class Xml2cContext;
+class Xml2cReplay;
+class Xml2cCost;
 
 enum {
    ECHO_NO,
@@ -16,8 +27,35 @@ enum {
 
 class Action {
 
+protected:
+   //the conversion this action belongs to
+   Xml2cContext *ctx;
+
 public:
+   //line of the defining element in the xml document, 0 if synthesized
+   int line;
+   //variables no later action uses, released once this one has run
+   set<string> releases;
+
+   Action(Xml2cContext *_ctx) : ctx(_ctx), line(0) {};
+   virtual ~Action() {};
    virtual void generate(FILE *outfile) = 0;
+   //one of povxml2c_action_type
+   virtual int actionType() = 0;
+   //variables consumed and assigned when the action runs, for scheduling
+   virtual void uses(set<string> &vars) {};
+   virtual void defines(set<string> &vars) {};
+   //the subset of defines always replaced, not kept when the action fails
+   virtual void overwrites(set<string> &vars) {defines(vars);};
+   //stop assigning var, which nothing reads; false if the assignment stays
+   virtual bool dropDefinition(const string &var) {return false;};
+   //execute against a live service instead of generating code, false if
+   //the action did not go as the PoV expects
+   virtual bool replay(Xml2cReplay *r) = 0;
+   //emit the body of this action's case in the resumable backend's pov_step
+   virtual void generateStep(FILE *outfile) = 0;
+   //add what running the action costs, without running it
+   virtual void cost(Xml2cCost *c) {};
 
 };
 
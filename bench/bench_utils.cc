@@ -0,0 +1,173 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+/*
+ Microbenchmarks for the utilities every conversion spends its time in.
+ Results are written to stdout as a single JSON object so that they can be
+ collected by bench/run_bench.py and tracked over time.
+
+ Usage: bench_utils [-s SECONDS] [-n PAYLOAD_BYTES]
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include <pcre.h>
+
+#include <string>
+
+using std::string;
+
+#include "utils.h"
+
+#define DEFAULT_SECONDS 0.5
+#define DEFAULT_PAYLOAD 4096
+
+static double minSeconds = DEFAULT_SECONDS;
+static bool firstResult = true;
+
+//defeats dead code elimination of benchmarked calls
+static volatile uintptr_t sink;
+
+static double now() {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, uint64_t iterations, double elapsed, size_t bytesPerOp) {
+   double nsPerOp = elapsed * 1e9 / iterations;
+   double mbPerSec = bytesPerOp * (double)iterations / elapsed / (1024.0 * 1024.0);
+   printf("%s\n    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.1f, \"bytes_per_op\": %zu, \"mb_per_s\": %.2f}",
+          firstResult ? "" : ",", name, (unsigned long long)iterations, nsPerOp, bytesPerOp, mbPerSec);
+   firstResult = false;
+}
+
+/*
+ * Run body in batches until minSeconds have passed, doubling the batch
+ * size each round so that the clock is read rarely for fast bodies.
+ */
+template <typename F>
+static void run(const char *name, size_t bytesPerOp, F body) {
+   uint64_t iterations = 0;
+   uint64_t batch = 1;
+   double start = now();
+   double elapsed;
+   do {
+      for (uint64_t i = 0; i < batch; i++) {
+         body();
+      }
+      iterations += batch;
+      if (batch < (1 << 20)) {
+         batch *= 2;
+      }
+      elapsed = now() - start;
+   } while (elapsed < minSeconds);
+   report(name, iterations, elapsed, bytesPerOp);
+}
+
+static string makeHex(size_t len) {
+   static const char digits[] = "0123456789abcdef";
+   string hex;
+   for (size_t i = 0; i < len; i++) {
+      hex += digits[(i * 7) & 15];
+      hex += digits[(i * 13) & 15];
+   }
+   return hex;
+}
+
+//mostly printable text with a sprinkling of escapes
+static string makeAscii(size_t len) {
+   string asc;
+   for (size_t i = 0; i < len; i++) {
+      if ((i % 16) == 15) {
+         asc += "\\x0a";
+      }
+      else if ((i % 32) == 7) {
+         asc += "\\t";
+      }
+      else {
+         asc += (char)('A' + i % 26);
+      }
+   }
+   return asc;
+}
+
+int main(int argc, char **argv) {
+   int opt;
+   size_t payload = DEFAULT_PAYLOAD;
+   while ((opt = getopt(argc, argv, "s:n:")) != -1) {
+      switch (opt) {
+         case 's':
+            minSeconds = atof(optarg);
+            break;
+         case 'n':
+            payload = strtoul(optarg, NULL, 10);
+            break;
+         default:
+            fprintf(stderr, "usage: %s [-s seconds] [-n payload-bytes]\n", argv[0]);
+            exit(1);
+      }
+   }
+
+   string hex = makeHex(payload);
+   string asc = makeAscii(payload);
+
+   string doc = "<data>" + asc + "</data>";
+   xmlDocPtr xml = xmlReadMemory(doc.c_str(), doc.length(), "", NULL, XML_PARSE_NONET);
+   xmlNode *dataNode = xmlDocGetRootElement(xml);
+
+   FILE *devnull = fopen("/dev/null", "w");
+   uint8_t *bin = new uint8_t[payload];
+   for (size_t i = 0; i < payload; i++) {
+      bin[i] = (uint8_t)(i * 31);
+   }
+
+   printf("{\n  \"payload_bytes\": %zu,\n  \"benchmarks\": [", payload);
+
+   run("parseHexBinary", hex.length(), [&]() {
+      uint32_t len;
+      uint8_t *res = parseHexBinary(hex.c_str(), &len);
+      sink = (uintptr_t)res[0];
+      delete [] res;
+   });
+
+   run("unescapeAscii", asc.length(), [&]() {
+      uint32_t len;
+      uint8_t *res = unescapeAscii(asc.c_str(), &len);
+      sink = (uintptr_t)res[0];
+      delete [] res;
+   });
+
+   run("printAsHexString", payload, [&]() {
+      printAsHexString(devnull, bin, payload);
+   });
+
+   run("getNodeText", asc.length(), [&]() {
+      uint32_t len;
+      char *text = getNodeText(dataNode, &len);
+      sink = (uintptr_t)text;
+      xmlFree(text);
+   });
+
+   static char pattern[] = "^Welcome to ([A-Za-z ]+) version [0-9]+\\.[0-9]+\\x0a";
+   run("init_regex", sizeof(pattern) - 1, [&]() {
+      pcre *re = init_regex(pattern);
+      sink = (uintptr_t)re;
+      pcre_free(re);
+   });
+
+   printf("\n  ]\n}\n");
+
+   fclose(devnull);
+   delete [] bin;
+   xmlFreeDoc(xml);
+   return 0;
+}
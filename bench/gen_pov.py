@@ -0,0 +1,136 @@
+#!/usr/bin/python
+
+"""
+Synthetic PoV generator.  Produces documents conforming to cfe-pov.dtd with
+a controlled number of actions, payload sizes, hex/ascii mix, variables and
+regexes, for benchmarking pov-xml2c.  Output is deterministic for a given
+seed.
+
+usage: gen_pov.py [options] -o DIR
+"""
+
+import os
+import sys
+import random
+import argparse
+
+HEADER = ('<?xml version="1.0" standalone="no" ?>\n'
+          '<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+          '<cfepov>\n<cbid>service</cbid>\n<replay>\n')
+FOOTER = '</replay>\n</cfepov>\n'
+
+REGEXES = [r'^Welcome to ([A-Za-z ]+)\x0a',
+           r'([0-9]+) items? remaining',
+           r'token=([0-9a-f]{8})',
+           r'^(OK|ERR) .*$']
+
+
+def hex_payload(rng, size):
+    return ''.join('%02x' % rng.randrange(256) for _ in range(size))
+
+
+def ascii_payload(rng, size):
+    out = []
+    for _ in range(size):
+        c = rng.randrange(256)
+        if c == 0x5c:
+            out.append('\\\\')
+        elif 0x20 <= c < 0x7f and c not in (0x3c, 0x26):
+            out.append(chr(c))
+        elif c == 0x0a:
+            out.append('\\n')
+        else:
+            out.append('\\x%02x' % c)
+    return ''.join(out)
+
+
+def data(rng, size, hex_ratio):
+    if rng.random() < hex_ratio:
+        return '<data format="hex">%s</data>' % hex_payload(rng, size)
+    return '<data>%s</data>' % ascii_payload(rng, size)
+
+
+def generate(rng, actions=100, payload=64, hex_ratio=0.5, variables=4,
+             regexes=0.25, type2=False):
+    """ return the text of a single synthetic PoV """
+    parts = [HEADER]
+    if type2:
+        parts.append('<negotiate><type2 /></negotiate>\n')
+    else:
+        parts.append('<negotiate><type1><ipmask>0xfefefefe</ipmask>'
+                     '<regmask>0xfefefefe</regmask><regnum>0</regnum>'
+                     '</type1></negotiate>\n')
+    names = []
+    for i in range(variables):
+        name = 'VAR%d' % i
+        parts.append('<decl><var>%s</var><value>%s</value></decl>\n'
+                     % (name, data(rng, max(1, payload // 4), hex_ratio)))
+        names.append(name)
+    for i in range(actions):
+        size = max(1, int(rng.expovariate(1.0 / payload)))
+        if i % 2 == 0:
+            body = data(rng, size, hex_ratio)
+            if names and rng.random() < 0.2:
+                body += '<var>%s</var>' % rng.choice(names)
+            parts.append('<write>%s</write>\n' % body)
+        elif rng.random() < regexes:
+            parts.append('<read><delim>\\n</delim><match><pcre>%s</pcre>'
+                         '</match>' % rng.choice(REGEXES).replace('<', '&lt;'))
+            if names:
+                parts.append('<assign><var>%s</var><pcre group="1">%s</pcre>'
+                             '</assign>' % (rng.choice(names), REGEXES[1]))
+            parts.append('</read>\n')
+        else:
+            parts.append('<read><length>%d</length><match>%s</match></read>\n'
+                         % (size, data(rng, size, hex_ratio)))
+    if type2:
+        parts.append('<submit><var>TYPE2_VALUE</var></submit>\n')
+    parts.append(FOOTER)
+    return ''.join(parts)
+
+
+def add_arguments(parser):
+    parser.add_argument('-n', '--count', type=int, default=20,
+                        help='number of documents')
+    parser.add_argument('-a', '--actions', type=int, default=200,
+                        help='reads and writes per document')
+    parser.add_argument('-p', '--payload', type=int, default=64,
+                        help='mean payload size in bytes')
+    parser.add_argument('-x', '--hex-ratio', type=float, default=0.5,
+                        help='fraction of payloads encoded as hex')
+    parser.add_argument('-V', '--variables', type=int, default=4,
+                        help='variables declared per document')
+    parser.add_argument('-r', '--regexes', type=float, default=0.25,
+                        help='fraction of reads matched with a regex')
+    parser.add_argument('-s', '--seed', type=int, default=1,
+                        help='random seed')
+
+
+def write_corpus(outdir, args):
+    """ write args.count documents into outdir, return their paths """
+    rng = random.Random(args.seed)
+    if not os.path.isdir(outdir):
+        os.makedirs(outdir)
+    paths = []
+    for i in range(args.count):
+        path = os.path.join(outdir, 'synthetic_%05d.xml' % i)
+        with open(path, 'w') as f:
+            f.write(generate(rng, args.actions, args.payload, args.hex_ratio,
+                             args.variables, args.regexes, type2=(i % 2 == 1)))
+        paths.append(path)
+    return paths
+
+
+def main():
+    parser = argparse.ArgumentParser(description='generate synthetic PoVs')
+    add_arguments(parser)
+    parser.add_argument('-o', '--outdir', required=True,
+                        help='directory to write documents into')
+    args = parser.parse_args()
+    for path in write_corpus(args.outdir, args):
+        print(path)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
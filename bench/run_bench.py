@@ -0,0 +1,141 @@
+#!/usr/bin/python
+
+"""
+Benchmark driver for make bench.  Runs the utility microbenchmarks, then
+converts a synthetic corpus end to end with pov-xml2c, and writes one JSON
+report: microbenchmark results, throughput in MB/s and documents/s, and the
+peak RSS of any single conversion.
+
+usage: run_bench.py [options] [-o REPORT]
+"""
+
+import os
+import sys
+import json
+import time
+import shutil
+import platform
+import argparse
+import tempfile
+import subprocess
+
+import gen_pov
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+TOP_DIR = os.path.dirname(BENCH_DIR)
+
+
+def revision():
+    """ the source revision being measured, if known """
+    try:
+        out = subprocess.check_output(['git', 'describe', '--always',
+                                       '--dirty'], cwd=TOP_DIR,
+                                      stderr=subprocess.STDOUT)
+        return out.decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def microbenchmarks(binary, seconds, payload):
+    out = subprocess.check_output([binary, '-s', str(seconds),
+                                   '-n', str(payload)])
+    return json.loads(out.decode())
+
+
+def convert(binary, path):
+    """ run one conversion, return (status, wall seconds, peak rss kB) """
+    # the child's ru_maxrss would include this interpreter, so take peak
+    # RSS from the converter's own statistics
+    stats = tempfile.NamedTemporaryFile(suffix='.json')
+    with open(os.devnull, 'w') as devnull:
+        start = time.time()
+        status = subprocess.call([binary, '--stats', 'json', '--stats-file',
+                                  stats.name, '-x', path], stdout=devnull,
+                                 stderr=devnull)
+        elapsed = time.time() - start
+    try:
+        rss = json.load(stats)['peak_rss_kb']
+    except ValueError:
+        rss = 0
+    stats.close()
+    return status, elapsed, rss
+
+
+def end_to_end(binary, paths, rounds):
+    total_bytes = sum(os.path.getsize(p) for p in paths) * rounds
+    failures = 0
+    peak_rss = 0
+    latencies = []
+    start = time.time()
+    for _ in range(rounds):
+        for path in paths:
+            status, elapsed, rss = convert(binary, path)
+            if status != 0:
+                failures += 1
+            latencies.append(elapsed)
+            peak_rss = max(peak_rss, rss)
+    elapsed = time.time() - start
+    latencies.sort()
+    return {
+        'documents': len(paths) * rounds,
+        'failures': failures,
+        'bytes': total_bytes,
+        'seconds': round(elapsed, 4),
+        'mb_per_s': round(total_bytes / elapsed / (1024.0 * 1024.0), 2),
+        'docs_per_s': round(len(latencies) / elapsed, 2),
+        'latency_ms_p50': round(latencies[len(latencies) // 2] * 1000, 3),
+        'latency_ms_max': round(latencies[-1] * 1000, 3),
+        'peak_rss_kb': peak_rss,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description='benchmark pov-xml2c')
+    gen_pov.add_arguments(parser)
+    parser.add_argument('-b', '--binary',
+                        default=os.path.join(TOP_DIR, 'pov-xml2c'))
+    parser.add_argument('-m', '--micro',
+                        default=os.path.join(BENCH_DIR, 'bench_utils'))
+    parser.add_argument('-t', '--seconds', type=float, default=0.5,
+                        help='minimum time per microbenchmark')
+    parser.add_argument('-R', '--rounds', type=int, default=3,
+                        help='passes over the corpus')
+    parser.add_argument('-c', '--corpus',
+                        help='keep the generated corpus in this directory')
+    parser.add_argument('-o', '--output', help='report file, default stdout')
+    args = parser.parse_args()
+
+    corpus = args.corpus or tempfile.mkdtemp(prefix='pov-xml2c-bench.')
+    try:
+        paths = gen_pov.write_corpus(corpus, args)
+        report = {
+            'timestamp': int(time.time()),
+            'host': platform.node(),
+            'revision': revision(),
+            'corpus': {
+                'documents': args.count,
+                'actions': args.actions,
+                'payload': args.payload,
+                'hex_ratio': args.hex_ratio,
+                'variables': args.variables,
+                'regexes': args.regexes,
+                'seed': args.seed,
+            },
+            'micro': microbenchmarks(args.micro, args.seconds, args.payload),
+            'end_to_end': end_to_end(args.binary, paths, args.rounds),
+        }
+    finally:
+        if args.corpus is None:
+            shutil.rmtree(corpus)
+
+    text = json.dumps(report, indent=2, sort_keys=True) + '\n'
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+    return 1 if report['end_to_end']['failures'] else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,459 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <libxml/tree.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "cache.h"
+#include "logging.h"
+
+using std::vector;
+using std::pair;
+using std::sort;
+
+#define CACHE_SUFFIX ".c"
+#define CACHE_TMP_PREFIX ".tmp."
+//temp files older than this were abandoned by a crashed writer
+#define CACHE_STALE_TMP 3600
+//first line of an entry, followed by the length of the caller's record
+#define CACHE_MAGIC "xml2c-cache-1"
+//running estimate of the bytes in the directory, see addSize
+#define CACHE_SIZE_FILE ".size"
+
+/*
+ * Minimal SHA-256 (FIPS 180-4), sufficient for naming cache entries
+ */
+struct Sha256 {
+   uint32_t h[8];
+   uint8_t block[64];
+   uint64_t total;
+   uint32_t used;
+
+   Sha256();
+   void update(const void *data, size_t len);
+   void final(uint8_t digest[32]);
+   void transform();
+};
+
+static const uint32_t sha256_k[64] = {
+   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+   0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+   0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+   0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+   0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+   0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+Sha256::Sha256() {
+   static const uint32_t init[8] = {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+   };
+   memcpy(h, init, sizeof(h));
+   total = 0;
+   used = 0;
+}
+
+void Sha256::transform() {
+   uint32_t w[64];
+   for (int i = 0; i < 16; i++) {
+      w[i] = (block[i * 4] << 24) | (block[i * 4 + 1] << 16) | (block[i * 4 + 2] << 8) | block[i * 4 + 3];
+   }
+   for (int i = 16; i < 64; i++) {
+      uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+   }
+   uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+   for (int i = 0; i < 64; i++) {
+      uint32_t s1 = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+      uint32_t ch = (e & f) ^ (~e & g);
+      uint32_t t1 = hh + s1 + ch + sha256_k[i] + w[i];
+      uint32_t s0 = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+      uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+      uint32_t t2 = s0 + maj;
+      hh = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+   }
+   h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+   h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+}
+
+void Sha256::update(const void *data, size_t len) {
+   const uint8_t *p = (const uint8_t*)data;
+   total += len;
+   while (len > 0) {
+      uint32_t n = 64 - used;
+      if (n > len) {
+         n = len;
+      }
+      memcpy(block + used, p, n);
+      used += n;
+      p += n;
+      len -= n;
+      if (used == 64) {
+         transform();
+         used = 0;
+      }
+   }
+}
+
+void Sha256::final(uint8_t digest[32]) {
+   uint64_t bits = total * 8;
+   uint8_t pad = 0x80;
+   update(&pad, 1);
+   pad = 0;
+   while (used != 56) {
+      update(&pad, 1);
+   }
+   uint8_t len[8];
+   for (int i = 0; i < 8; i++) {
+      len[i] = bits >> (56 - 8 * i);
+   }
+   update(len, 8);
+   for (int i = 0; i < 8; i++) {
+      digest[i * 4] = h[i] >> 24;
+      digest[i * 4 + 1] = h[i] >> 16;
+      digest[i * 4 + 2] = h[i] >> 8;
+      digest[i * 4 + 3] = h[i];
+   }
+}
+
+/*
+ * Length prefix every token so the canonical form is unambiguous
+ * regardless of the content of text and attribute values
+ */
+static void appendToken(string &out, char tag, const char *text, size_t len) {
+   char prefix[32];
+   snprintf(prefix, sizeof(prefix), "%c%zu:", tag, len);
+   out += prefix;
+   out.append(text, len);
+}
+
+static bool isBlank(const xmlChar *text) {
+   if (text != NULL) {
+      for (; *text; text++) {
+         if (*text != ' ' && *text != '\t' && *text != '\r' && *text != '\n') {
+            return false;
+         }
+      }
+   }
+   return true;
+}
+
+static void canonicalNode(string &out, xmlNode *n) {
+   const char *name = (const char*)n->name;
+   appendToken(out, 'E', name, strlen(name));
+
+   vector< pair<string, string> > attrs;
+   for (xmlAttr *a = n->properties; a != NULL; a = a->next) {
+      xmlChar *value = xmlNodeListGetString(n->doc, a->children, 1);
+      attrs.push_back(pair<string, string>((const char*)a->name, value ? (const char*)value : ""));
+      xmlFree(value);
+   }
+   sort(attrs.begin(), attrs.end());
+   for (vector< pair<string, string> >::iterator i = attrs.begin(); i != attrs.end(); i++) {
+      appendToken(out, 'A', i->first.data(), i->first.size());
+      appendToken(out, 'V', i->second.data(), i->second.size());
+   }
+
+   bool hasElements = false;
+   for (xmlNode *c = n->children; c != NULL; c = c->next) {
+      if (c->type == XML_ELEMENT_NODE) {
+         hasElements = true;
+         break;
+      }
+   }
+
+   //adjacent text and CDATA nodes are coalesced into a single text token
+   string text;
+   for (xmlNode *c = n->children; c != NULL; c = c->next) {
+      switch (c->type) {
+         case XML_ELEMENT_NODE:
+            if (text.size() > 0) {
+               appendToken(out, 'T', text.data(), text.size());
+               text.clear();
+            }
+            canonicalNode(out, c);
+            break;
+         case XML_TEXT_NODE:
+         case XML_CDATA_SECTION_NODE:
+            //whitespace between elements is formatting, not content
+            if (!hasElements || !isBlank(c->content)) {
+               text += (const char*)c->content;
+            }
+            break;
+         case XML_ENTITY_REF_NODE: {
+            xmlChar *value = xmlNodeGetContent(c);
+            if (value != NULL) {
+               text += (const char*)value;
+               xmlFree(value);
+            }
+            break;
+         }
+         default:
+            //comments and processing instructions carry no PoV content
+            break;
+      }
+   }
+   if (text.size() > 0) {
+      appendToken(out, 'T', text.data(), text.size());
+   }
+   out += ')';
+}
+
+string canonicalForm(xmlNode *root) {
+   string out;
+   if (root != NULL) {
+      canonicalNode(out, root);
+   }
+   return out;
+}
+
+Xml2cCache::Xml2cCache(const char *cacheDir, uint64_t maxBytes) : dir(cacheDir), maxSize(maxBytes) {
+   if (mkdir(cacheDir, 0777) != 0 && errno != EEXIST) {
+      log_error("Failed to create cache directory");
+   }
+}
+
+string Xml2cCache::makeKey(const string &canon, const string &options) {
+   Sha256 sha;
+   uint8_t digest[32];
+   char hex[65];
+   uint64_t len = options.size();
+   //length prefix the options so they can't run into the document
+   sha.update(&len, sizeof(len));
+   sha.update(options.data(), options.size());
+   sha.update(canon.data(), canon.size());
+   sha.final(digest);
+   for (int i = 0; i < 32; i++) {
+      snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+   }
+   return string(hex, 64);
+}
+
+string Xml2cCache::entryPath(const string &key) {
+   return dir + "/" + key + CACHE_SUFFIX;
+}
+
+char *Xml2cCache::lookup(const string &key, size_t *len, string *record) {
+   string path = entryPath(key);
+   int fd = open(path.c_str(), O_RDONLY);
+   if (fd < 0) {
+      return NULL;
+   }
+   struct stat sb;
+   char *src = NULL;
+   if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode)) {
+      src = (char*)malloc(sb.st_size + 1);
+      size_t got = 0;
+      while (src != NULL && got < (size_t)sb.st_size) {
+         ssize_t n = read(fd, src + got, sb.st_size - got);
+         if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+               continue;
+            }
+            free(src);
+            src = NULL;
+            break;
+         }
+         got += n;
+      }
+      if (src != NULL) {
+         src[got] = 0;
+         //the record precedes the source, entries without one are a miss
+         size_t mlen = strlen(CACHE_MAGIC " ");
+         char *end = src;
+         unsigned long long recLen = 0;
+         if (strncmp(src, CACHE_MAGIC " ", mlen) == 0) {
+            recLen = strtoull(src + mlen, &end, 10);
+         }
+         size_t hlen = end - src + 1;
+         if (end == src || *end != '\n' || recLen > got - hlen) {
+            free(src);
+            src = NULL;
+         }
+         else {
+            if (record != NULL) {
+               record->assign(src + hlen, recLen);
+            }
+            *len = got - hlen - recLen;
+            memmove(src, src + hlen + recLen, *len + 1);
+            //mark as recently used for the LRU ordering
+            futimens(fd, NULL);
+         }
+      }
+   }
+   close(fd);
+   return src;
+}
+
+static bool writeAll(int fd, const char *buf, size_t len) {
+   size_t done = 0;
+   while (done < len) {
+      ssize_t n = write(fd, buf + done, len - done);
+      if (n < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return false;
+      }
+      done += n;
+   }
+   return true;
+}
+
+bool Xml2cCache::store(const string &key, const char *src, size_t len, const string &record) {
+   char suffix[64];
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   snprintf(suffix, sizeof(suffix), "%d.%ld%06ld", (int)getpid(), (long)tv.tv_sec, (long)tv.tv_usec);
+   string tmp = dir + "/" + CACHE_TMP_PREFIX + key + "." + suffix;
+
+   int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+   if (fd < 0) {
+      log_error("Failed to create cache entry");
+      return false;
+   }
+   char head[64];
+   int hlen = snprintf(head, sizeof(head), CACHE_MAGIC " %llu\n", (unsigned long long)record.size());
+   if (!writeAll(fd, head, hlen) || !writeAll(fd, record.data(), record.size()) || !writeAll(fd, src, len)) {
+      log_error("Failed to write cache entry");
+      close(fd);
+      unlink(tmp.c_str());
+      return false;
+   }
+   close(fd);
+   //an entry replaced by the rename no longer counts
+   struct stat sb;
+   string path = entryPath(key);
+   int64_t added = hlen + record.size() + len;
+   if (stat(path.c_str(), &sb) == 0) {
+      added -= sb.st_size;
+   }
+   //readers only ever see complete entries
+   if (rename(tmp.c_str(), path.c_str()) != 0) {
+      log_error("Failed to publish cache entry");
+      unlink(tmp.c_str());
+      return false;
+   }
+   if (addSize(added) > maxSize) {
+      evict();
+   }
+   return true;
+}
+
+/*
+ * The size file keeps a running total of the entries so that a store need
+ * not scan the directory.  Concurrent converters update it under an flock.
+ * It is only an estimate, entries removed by hand are counted until the next
+ * eviction, which rewrites it with the size it finds.  With set, the total is
+ * replaced rather than added to.  Returns the new total.
+ */
+uint64_t Xml2cCache::addSize(int64_t delta, bool set) {
+   string path = dir + "/" + CACHE_SIZE_FILE;
+   int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+   if (fd < 0) {
+      //without the estimate every store has to scan
+      return set ? delta : UINT64_MAX;
+   }
+   flock(fd, LOCK_EX);
+   char buf[32];
+   ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+   buf[n > 0 ? n : 0] = 0;
+   int64_t total = set ? delta : strtoll(buf, NULL, 10) + delta;
+   if (total < 0) {
+      total = 0;
+   }
+   n = snprintf(buf, sizeof(buf), "%lld\n", (long long)total);
+   if (pwrite(fd, buf, n, 0) != n || ftruncate(fd, n) != 0) {
+      log_error("Failed to update cache size");
+   }
+   flock(fd, LOCK_UN);
+   close(fd);
+   return total;
+}
+
+struct CacheEntry {
+   string path;
+   struct timespec mtime;
+   uint64_t size;
+
+   //entries used within the same second are still told apart
+   bool operator<(const CacheEntry &e) const {
+      return mtime.tv_sec != e.mtime.tv_sec ? mtime.tv_sec < e.mtime.tv_sec : mtime.tv_nsec < e.mtime.tv_nsec;
+   }
+};
+
+void Xml2cCache::evict() {
+   DIR *d = opendir(dir.c_str());
+   if (d == NULL) {
+      return;
+   }
+   vector<CacheEntry> entries;
+   uint64_t total = 0;
+   time_t now = time(NULL);
+   size_t slen = strlen(CACHE_SUFFIX);
+   struct dirent *de;
+   while ((de = readdir(d)) != NULL) {
+      string path = dir + "/" + de->d_name;
+      struct stat sb;
+      if (stat(path.c_str(), &sb) != 0 || !S_ISREG(sb.st_mode)) {
+         continue;
+      }
+      if (strncmp(de->d_name, CACHE_TMP_PREFIX, strlen(CACHE_TMP_PREFIX)) == 0) {
+         if (now - sb.st_mtime > CACHE_STALE_TMP) {
+            unlink(path.c_str());
+         }
+         continue;
+      }
+      size_t nlen = strlen(de->d_name);
+      if (nlen <= slen || strcmp(de->d_name + nlen - slen, CACHE_SUFFIX) != 0) {
+         continue;
+      }
+      CacheEntry e;
+      e.path = path;
+      e.mtime = sb.st_mtim;
+      e.size = sb.st_size;
+      entries.push_back(e);
+      total += e.size;
+   }
+   closedir(d);
+
+   //make room for a while, rather than scanning again on the next store
+   uint64_t target = maxSize - maxSize / 4;
+   if (total > maxSize) {
+      sort(entries.begin(), entries.end());
+      for (vector<CacheEntry>::iterator i = entries.begin(); i != entries.end() && total > target; i++) {
+         //another process may have beaten us to it, which is fine
+         unlink(i->path.c_str());
+         total -= i->size;
+      }
+   }
+   addSize(total, true);
+}
@@ -0,0 +1,57 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_CACHE_H
+#define __XML2C_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <libxml/tree.h>
+#include <string>
+
+using std::string;
+
+#define DEFAULT_CACHE_SIZE (64 * 1024 * 1024)
+
+/*
+ * Canonical form of a parsed PoV document.  Comments, processing instructions
+ * and whitespace-only text between elements are dropped and attributes are
+ * sorted, so documents that differ only in formatting produce the same string.
+ */
+string canonicalForm(xmlNode *root);
+
+/*
+ * Content addressed store of generated C source.  Entries are named by the
+ * hex SHA-256 of the canonical document, the converter version and the options
+ * that affect code generation.  Entries are published with rename(2) so any
+ * number of concurrent converters may share one directory.  The total size of
+ * the directory is bounded by evicting the least recently used entries, once a
+ * running estimate of it passes the limit.
+ */
+class Xml2cCache {
+private:
+   string dir;
+   uint64_t maxSize;
+
+   string entryPath(const string &key);
+   uint64_t addSize(int64_t delta, bool set = false);
+
+   //disable copy
+   Xml2cCache(const Xml2cCache &c) {};
+   const Xml2cCache &operator=(const Xml2cCache &c) {return *this;}
+
+public:
+   Xml2cCache(const char *cacheDir, uint64_t maxBytes = DEFAULT_CACHE_SIZE);
+
+   static string makeKey(const string &canon, const string &options);
+
+   //returns malloc'ed source and its length, or NULL on a miss.  An entry
+   //also holds a record the caller stored alongside the source.
+   char *lookup(const string &key, size_t *len, string *record = NULL);
+   bool store(const string &key, const char *src, size_t len, const string &record = "");
+   void evict();
+};
+
+#endif
@@ -12,19 +12,45 @@
 
 #include "logging.h"
 
-static unsigned int msg_no = 0;
+static __thread unsigned int msg_no = 0;
+static __thread LogSink *log_sink = NULL;
+
+void setLogSink(LogSink *sink) {
+   log_sink = sink;
+   msg_no = 0;
+}
+
+static void vlog_emit(int severity, const char *fmt, va_list ap) {
+   if (log_sink != NULL) {
+      char *text;
+      if (vasprintf(&text, fmt, ap) != -1) {
+         log_sink->message(severity, text);
+         free(text);
+      }
+   }
+   else {
+      vfprintf(stderr, fmt, ap);
+   }
+}
+
+static void log_emit(int severity, const char *fmt, ...) {
+   va_list ap;
+   va_start(ap, fmt);
+   vlog_emit(severity, fmt, ap);
+   va_end(ap);
+}
 
 void log_ok(const char *msg, ...) {
    char *fmt;
    if (asprintf(&fmt, "ok %u - %s", ++msg_no, msg) != -1) {
       va_list ap;
       va_start(ap, msg);
-      vfprintf(stderr, fmt, ap);
+      vlog_emit(LOG_OK, fmt, ap);
       va_end(ap);
       free(fmt);
    }
    else {
-      fprintf(stderr, "not ok %u - asprintf failure in log_ok.\n", ++msg_no);
+      log_emit(LOG_FAIL, "not ok %u - asprintf failure in log_ok.\n", ++msg_no);
    }
 }
 
@@ -33,15 +59,22 @@ void log_fail(const char *msg, ...) {
    if (asprintf(&fmt, "not ok %u - %s", ++msg_no, msg) != -1) {
       va_list ap;
       va_start(ap, msg);
-      vfprintf(stderr, fmt, ap);
+      vlog_emit(LOG_FAIL, fmt, ap);
       va_end(ap);
       free(fmt);
    }
    else {
-      fprintf(stderr, "not ok %u - asprintf failure in log_fail.\n", ++msg_no);
+      log_emit(LOG_FAIL, "not ok %u - asprintf failure in log_fail.\n", ++msg_no);
    }
 }
 
+void log_note(const char *msg, ...) {
+   va_list ap;
+   va_start(ap, msg);
+   vlog_emit(LOG_NOTE, msg, ap);
+   va_end(ap);
+}
+
 void log_error(const char *prefix) {
    char errmsg[1024];
    errmsg[0] = 0;
@@ -60,13 +93,12 @@ void log(const char *msg, ...) {
    if (asprintf(&fmt, "# %s", msg) != -1) {
       va_list ap;
       va_start(ap, msg);
-      vfprintf(stderr, fmt, ap);
+      vlog_emit(LOG_DEBUG, fmt, ap);
       va_end(ap);
       free(fmt);
    }
    else {
-      fprintf(stderr, "not ok %u - asprintf failure in log.\n", ++msg_no);
+      log_emit(LOG_FAIL, "not ok %u - asprintf failure in log.\n", ++msg_no);
    }
 #endif
 }
-
@@ -6,12 +6,33 @@
 #ifndef __LOGGING_H
 #define __LOGGING_H
 
+enum {
+   LOG_OK,
+   LOG_FAIL,
+   LOG_NOTE,
+   LOG_DEBUG
+};
+
+/*
+ * Messages go to stderr unless a sink has been installed for the calling
+ * thread, in which case the fully formatted message is handed to the sink.
+ */
+class LogSink {
+public:
+   virtual ~LogSink() {};
+   virtual void message(int severity, const char *text) = 0;
+};
+
+//installing a sink also restarts TAP message numbering for the thread
+void setLogSink(LogSink *sink);
+
 void enableDebug();
 void disableDebug();
 
 void log_error(const char *prefix);
 void log_ok(const char *msg, ...);
 void log_fail(const char *msg, ...);
+void log_note(const char *msg, ...);
 void log(const char *msg, ...);
 
 #endif
@@ -0,0 +1,246 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+/*
+ libpovxml2c - reentrant interface to the pov-xml2c converter.
+
+ Every conversion runs against an explicit context that holds its options,
+ id counters and diagnostics, so independent contexts may be used from
+ different threads at the same time.  A context may be reused for any
+ number of conversions; diagnostics describe the most recent one.
+
+    povxml2c_ctx *ctx = povxml2c_new();
+    char *src;
+    size_t len;
+    if (povxml2c_convert(ctx, xml, xml_len, &src, &len) == 0) {
+       ...
+       povxml2c_free_buffer(src);
+    }
+    for (size_t i = 0; i < povxml2c_diag_count(ctx); i++) {
+       const povxml2c_diag *d = povxml2c_diag_get(ctx, i);
+       ...
+    }
+    povxml2c_free(ctx);
+*/
+
+#ifndef __POVXML2C_H
+#define __POVXML2C_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct povxml2c_ctx povxml2c_ctx;
+typedef struct povxml2c_bundle povxml2c_bundle;
+
+enum povxml2c_option {
+   POVXML2C_OPT_VERIFY_ONLY,  /* nonzero: validate and build only, no source */
+   POVXML2C_OPT_ECHO,         /* nonzero: honor read/write echo attributes */
+   POVXML2C_OPT_TIMEOUT,      /* seconds allowed for parsing and building, 0 for none */
+   POVXML2C_OPT_CACHE_SIZE,   /* bytes, bound on the cache directory */
+   POVXML2C_OPT_MAX_INPUT,    /* bytes, largest document accepted, 0 for no limit */
+   POVXML2C_OPT_PROBE_FD,     /* fd the generated PoV writes timing probes to, -1 for none */
+   POVXML2C_OPT_EXTERNAL_DATA, /* nonzero: accept <data file= offset= length=>, outside the DTD */
+   POVXML2C_OPT_EARLY_WRITES, /* reads a write may be issued ahead of, 0 keeps document order */
+   POVXML2C_OPT_BACKEND,      /* povxml2c_backend, shape of the generated source */
+   POVXML2C_OPT_FIXED_READS,  /* nonzero: a delimited read matched exactly in full reads that many bytes */
+   POVXML2C_OPT_MAX_NODES,    /* elements, comments, PIs and entity references in a document, 0 for no limit */
+   POVXML2C_OPT_MAX_DEPTH,    /* deepest element nesting, 0 for no limit */
+   POVXML2C_OPT_MAX_PAYLOAD,  /* bytes decoded from hex and escaped ascii, 0 for no limit */
+   POVXML2C_OPT_MAX_ALLOC,    /* bytes allocated by a conversion, 0 for no limit, needs a counting host */
+   POVXML2C_OPT_RELEASE_VARS, /* nonzero: release variables after their last use, drop assignments never read */
+   POVXML2C_OPT_DEADLINE_MS   /* milliseconds allowed for parsing and building, 0 for none, the earlier of this and TIMEOUT applies */
+};
+
+enum povxml2c_backend {
+   POVXML2C_BACKEND_MAIN,     /* a DECREE main() performing the actions in order */
+   POVXML2C_BACKEND_RESUMABLE /* a hosted pov_step() state machine, many sessions per thread */
+};
+
+enum povxml2c_severity {
+   POVXML2C_DIAG_OK,          /* TAP "ok" line */
+   POVXML2C_DIAG_FAIL,        /* TAP "not ok" line */
+   POVXML2C_DIAG_NOTE,        /* converter or libxml2 message */
+   POVXML2C_DIAG_DEBUG        /* TAP "#" comment */
+};
+
+typedef struct povxml2c_diag {
+   int severity;              /* povxml2c_severity */
+   int line;                  /* line in the xml document, 0 if unknown */
+   const char *message;       /* formatted as pov-xml2c prints it, newline terminated */
+} povxml2c_diag;
+
+enum povxml2c_phase {
+   POVXML2C_PHASE_INIT,       /* libxml2 and DTD setup, charged to the first context */
+   POVXML2C_PHASE_PARSE,      /* reading the document */
+   POVXML2C_PHASE_VALIDATE,   /* validation against the DTD */
+   POVXML2C_PHASE_CACHE,      /* canonical form, cache lookup and store */
+   POVXML2C_PHASE_BUILD,      /* building actions from the document */
+   POVXML2C_PHASE_GENERATE,   /* emitting C source */
+   POVXML2C_PHASES
+};
+
+enum povxml2c_action_type {
+   POVXML2C_ACTION_WRITE,
+   POVXML2C_ACTION_READ,
+   POVXML2C_ACTION_DECL,
+   POVXML2C_ACTION_DELAY,
+   POVXML2C_ACTION_NEGOTIATE,
+   POVXML2C_ACTION_SUBMIT,
+   POVXML2C_ACTION_TYPES
+};
+
+/*
+ * Statistics for the last conversion on a context, or a sum of them built
+ * with povxml2c_stats_add.
+ */
+typedef struct povxml2c_stats {
+   unsigned long long conversions;
+   double wall[POVXML2C_PHASES];        /* seconds */
+   double cpu[POVXML2C_PHASES];         /* seconds of cpu time on the converting thread */
+   unsigned long long actions[POVXML2C_ACTION_TYPES];
+   unsigned long long allocations;      /* 0 unless the host counts allocations */
+   unsigned long long payload_bytes;    /* bytes decoded from hex and escaped ascii */
+   unsigned long long source_bytes;     /* bytes of C source emitted */
+   unsigned long long regexes;          /* regular expressions compiled */
+   long peak_rss_kb;                    /* process high water mark */
+   unsigned long long round_trips;      /* read to write turnarounds in the generated PoV */
+   unsigned long long round_trips_removed; /* turnarounds saved by early writes */
+   unsigned long long undefined_vars;   /* variables used before any action assigns them */
+   unsigned long long vars_released;    /* releases after a variable's last use */
+   unsigned long long dead_stores;      /* declarations and read assigns dropped as never read */
+} povxml2c_stats;
+
+/*
+ * Static estimate of what running a PoV costs, from povxml2c_cost_estimate.
+ * Reads whose length depends on the service are counted at the fewest bytes
+ * they can return and in unknown_reads.  regex_risk is the worst
+ * backtracking risk of any regex, 0 for none or a plain pattern, 1 for an
+ * unbounded repeat, 2 for several or a back reference, 3 for an unbounded
+ * repeat nested in another repeat; risky_regexes counts those of 2 and up.
+ */
+typedef struct povxml2c_cost {
+   unsigned long long bytes_written;
+   unsigned long long bytes_read;
+   unsigned long long transmits;        /* transmit_all calls */
+   unsigned long long receives;         /* receive calls, at the fewest */
+   unsigned long long delay_ms;
+   unsigned long long regexes;
+   unsigned long long risky_regexes;
+   int regex_risk;
+   unsigned long long var_peak_bytes;   /* most variable bytes held at once */
+   unsigned long long source_bytes;     /* C source the PoV generates */
+   unsigned long long unknown_reads;
+} povxml2c_cost;
+
+const char *povxml2c_version(void);
+
+/*
+ * One time initialization of libxml2 and the shared DTD.  Called implicitly,
+ * but long running hosts may call it up front.  Note that it restricts the
+ * process wide libxml2 external entity loader to the PoV DTD.  Returns 0 if
+ * the DTD was loaded.
+ */
+int povxml2c_init(void);
+
+povxml2c_ctx *povxml2c_new(void);
+void povxml2c_free(povxml2c_ctx *ctx);
+
+int povxml2c_set_option(povxml2c_ctx *ctx, int option, long long value);
+/* NULL disables the cache */
+int povxml2c_set_cache_dir(povxml2c_ctx *ctx, const char *dir);
+/* directory external data references are relative to, NULL for the cwd */
+int povxml2c_set_base_dir(povxml2c_ctx *ctx, const char *dir);
+
+/*
+ * Convert the xml document in xml[0..len), which may be gzip or xz
+ * compressed.  Returns one of the REASON_* exit
+ * codes of pov-xml2c, 0 on success.  On success *out receives a NUL terminated
+ * buffer holding the generated source, *out_len its length excluding the NUL.
+ * The caller owns the buffer and releases it with povxml2c_free_buffer.
+ * *out is NULL after a failed conversion or a verify only conversion.
+ */
+int povxml2c_convert(povxml2c_ctx *ctx, const char *xml, size_t len, char **out, size_t *out_len);
+/* as above, but the document is streamed from fd, which may be a pipe */
+int povxml2c_convert_fd(povxml2c_ctx *ctx, int fd, char **out, size_t *out_len);
+void povxml2c_free_buffer(char *buf);
+
+/*
+ * Interpret the PoV built by the last successful conversion on ctx against a
+ * running service instead of compiling it.  to_service feeds the service's
+ * input and from_service carries its output.  Conversions served from the
+ * cache build nothing, so convert with POVXML2C_OPT_VERIFY_ONLY first.  Each
+ * action is reported with its timing as a TAP diagnostic, replacing those of
+ * the conversion.  Returns 0 if every read and match went as the PoV expects,
+ * 50 (REASON_REPLAY_FAIL) otherwise.
+ */
+int povxml2c_replay(povxml2c_ctx *ctx, int to_service, int from_service);
+
+/*
+ * As povxml2c_replay, but against len bytes of recorded service output
+ * instead of a running service.  Reads consume the transcript, delays are
+ * skipped and nothing is sent; the report gives the bytes each write would
+ * send and the value of each variable as it is assigned.
+ */
+int povxml2c_simulate(povxml2c_ctx *ctx, const char *transcript, size_t len);
+
+/*
+ * The PoV built by the last successful conversion on ctx generated as
+ * separate translation units, for PoVs too large to compile well as one
+ * main().  ctx must use the main backend without probes, and as for
+ * povxml2c_replay should convert with POVXML2C_OPT_VERIFY_ONLY.  Unit 0 is
+ * the driver pov_main.c, units 1 to count - 2 are pov_chunk_NNNNN.c, each
+ * a function performing at most actions consecutive actions, and the last
+ * is pov.mk, a makefile fragment linking them into pov.  A unit depends
+ * only on its own actions.  povxml2c_split_source returns the file name and
+ * contents of unit idx in buffers released with povxml2c_free_buffer.
+ */
+size_t povxml2c_split_count(povxml2c_ctx *ctx, unsigned int actions);
+int povxml2c_split_source(povxml2c_ctx *ctx, unsigned int actions, size_t idx,
+                          char **name, char **out, size_t *out_len);
+
+/*
+ * Estimate the cost of the PoV built by the last successful conversion on
+ * ctx without running it, which as for povxml2c_replay should convert with
+ * POVXML2C_OPT_VERIFY_ONLY.  povxml2c_cost_json describes the estimate in a
+ * buffer released with povxml2c_free_buffer.
+ */
+int povxml2c_cost_estimate(povxml2c_ctx *ctx, povxml2c_cost *cost);
+char *povxml2c_cost_json(const povxml2c_cost *c);
+
+/*
+ * Several PoVs generated into one C file per challenge.  Each document added
+ * is built with the options of ctx, which must use the main backend, and
+ * becomes a function in the bundle for its <cbid>, named for the dispatcher
+ * by name.  Static data is shared by all PoVs of a bundle.  Returns a
+ * REASON_* code like povxml2c_convert, leaving the bundle as it was on
+ * failure; diagnostics are on ctx.  povxml2c_bundle_source renders bundle
+ * idx, one per distinct <cbid> in order of first appearance, into a buffer
+ * released with povxml2c_free_buffer.
+ */
+povxml2c_bundle *povxml2c_bundle_new(void);
+void povxml2c_bundle_free(povxml2c_bundle *bundle);
+int povxml2c_bundle_add(povxml2c_bundle *bundle, povxml2c_ctx *ctx, const char *name,
+                        const char *xml, size_t len);
+size_t povxml2c_bundle_count(const povxml2c_bundle *bundle);
+const char *povxml2c_bundle_cbid(const povxml2c_bundle *bundle, size_t idx);
+int povxml2c_bundle_source(povxml2c_bundle *bundle, size_t idx, char **out, size_t *out_len);
+
+size_t povxml2c_diag_count(const povxml2c_ctx *ctx);
+const povxml2c_diag *povxml2c_diag_get(const povxml2c_ctx *ctx, size_t idx);
+
+const povxml2c_stats *povxml2c_get_stats(const povxml2c_ctx *ctx);
+/* accumulate s into total, peak_rss_kb becomes the larger of the two */
+void povxml2c_stats_add(povxml2c_stats *total, const povxml2c_stats *s);
+/* JSON object describing s, released with povxml2c_free_buffer */
+char *povxml2c_stats_json(const povxml2c_stats *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
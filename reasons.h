@@ -15,6 +15,14 @@
 #define REASON_LIBXML_FAIL  19
 #define REASON_PARSE_TIMEOUT 30
 #define REASON_INVALID_PARSE_TIMEOUT 31
+#define REASON_DEADLINE     32
+#define REASON_SERVER_FAIL  33
+#define REASON_INPUT_LIMIT  40
+#define REASON_NODE_LIMIT   41
+#define REASON_DEPTH_LIMIT  42
+#define REASON_PAYLOAD_LIMIT 43
+#define REASON_ALLOC_LIMIT  44
+#define REASON_REPLAY_FAIL  50
 
 #endif
 
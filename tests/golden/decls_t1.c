@@ -0,0 +1,55 @@
+#include <libpov.h>
+int main(void) {
+   negotiate_type1(0x3f3f3f3f, 0x3f3f3f3f, 6);
+   do {
+      //*** variable declaration for FOO
+      static unsigned char dvar_00000000[] = 
+         "\x66\x6f\x6f";
+      static unsigned int dvar_00000000_len = 3;
+      unsigned char *var_00000 = NULL;
+      unsigned int var_00000_len = 0;
+      var_00000 = append_buf(var_00000, &var_00000_len, dvar_00000000, dvar_00000000_len);
+      putenv("FOO", var_00000, var_00000_len);
+      free(var_00000);
+   } while (0);
+   do {
+      //*** variable declaration for BAR
+      unsigned char *var_00001 = NULL;
+      unsigned int var_00001_len = 0;
+      var_00001 = append_var("FOO", var_00001, &var_00001_len);
+      putenv("BAR", var_00001, var_00001_len);
+      free(var_00001);
+   } while (0);
+   do {
+      //*** variable declaration for BAZ
+      unsigned char *var_00002 = NULL;
+      unsigned int var_00002_len = 0;
+      var_00002 = append_slice("BAR", 1, 10, var_00002, &var_00002_len);
+      putenv("BAZ", var_00002, var_00002_len);
+      free(var_00002);
+   } while (0);
+   do {
+      //*** variable declaration for VAR1
+      unsigned char *var_00003 = NULL;
+      unsigned int var_00003_len = 0;
+      var_00003 = append_slice("BAZ", 0, 10, var_00003, &var_00003_len);
+      putenv("VAR1", var_00003, var_00003_len);
+      free(var_00003);
+   } while (0);
+   do {
+      //*** variable declaration for VAR2
+      unsigned char *var_00004 = NULL;
+      unsigned int var_00004_len = 0;
+      var_00004 = append_slice("VAR1", 10, 2147483647, var_00004, &var_00004_len);
+      putenv("VAR2", var_00004, var_00004_len);
+      free(var_00004);
+   } while (0);
+   do {
+      //*** variable declaration for VAR3
+      unsigned char *var_00005 = NULL;
+      unsigned int var_00005_len = 0;
+      var_00005 = append_slice("VAR2", 0, -2, var_00005, &var_00005_len);
+      putenv("VAR3", var_00005, var_00005_len);
+      free(var_00005);
+   } while (0);
+}
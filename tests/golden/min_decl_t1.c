@@ -0,0 +1,15 @@
+#include <libpov.h>
+int main(void) {
+   negotiate_type1(0x3f3f3f3f, 0x3f3f3f3f, 6);
+   do {
+      //*** variable declaration for FOO
+      static unsigned char dvar_00000000[] = 
+         "\x66\x6f\x6f";
+      static unsigned int dvar_00000000_len = 3;
+      unsigned char *var_00000 = NULL;
+      unsigned int var_00000_len = 0;
+      var_00000 = append_buf(var_00000, &var_00000_len, dvar_00000000, dvar_00000000_len);
+      putenv("FOO", var_00000, var_00000_len);
+      free(var_00000);
+   } while (0);
+}
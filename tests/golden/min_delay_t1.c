@@ -0,0 +1,6 @@
+#include <libpov.h>
+int main(void) {
+   negotiate_type1(0x3f3f3f3f, 0x3f3f3f3f, 6);
+   //*** delay
+   delay(1);
+}
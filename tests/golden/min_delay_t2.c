@@ -0,0 +1,8 @@
+#include <libpov.h>
+int main(void) {
+   negotiate_type2();
+   //*** delay
+   delay(1);
+   //*** submitting type 2 POV results
+   submit_type2(NULL);
+}
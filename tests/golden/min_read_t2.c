@@ -0,0 +1,18 @@
+#include <libpov.h>
+int main(void) {
+   negotiate_type2();
+   do {
+      unsigned char *read_00000;
+      unsigned int read_00000_len;
+      unsigned int read_00000_ptr = 0;
+      //**** length read
+      read_00000_len = 68;
+      read_00000 = (unsigned char*)malloc(read_00000_len);
+      int read_00000_res = length_read(0, read_00000, read_00000_len);
+      if (read_00000_res) {} //silence unused variable warning
+      free(read_00000);
+      if (read_00000_ptr) {}  //silence unused variable warning if any
+   } while (0);
+   //*** submitting type 2 POV results
+   submit_type2(NULL);
+}
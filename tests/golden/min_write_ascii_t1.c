@@ -0,0 +1,55 @@
+#include <libpov.h>
+//**** pov-xml2c scatter-gather transmit
+typedef struct {
+   unsigned char *base;
+   size_t len;
+} pov_iovec;
+static size_t pov_transmit_iov(int fd, pov_iovec *iov, unsigned int count) {
+   size_t total = 0;
+   unsigned int used = 0;
+   unsigned int last = 0;
+   unsigned int i;
+   for (i = 0; i < count; i++) {
+      if (iov[i].base != NULL && iov[i].len > 0) {
+         total += iov[i].len;
+         last = i;
+         used++;
+      }
+   }
+   if (used == 1) {
+      transmit_all(fd, iov[last].base, iov[last].len);
+   }
+   else if (used > 1) {
+      unsigned char *buf = (unsigned char*)malloc(total);
+      size_t pos = 0;
+      for (i = 0; i < count; i++) {
+         if (iov[i].base != NULL && iov[i].len > 0) {
+            if (buf == NULL) {
+               transmit_all(fd, iov[i].base, iov[i].len);
+            }
+            else {
+               memcpy(buf + pos, iov[i].base, iov[i].len);
+               pos += iov[i].len;
+            }
+         }
+      }
+      if (buf != NULL) {
+         transmit_all(fd, buf, total);
+         free(buf);
+      }
+   }
+   return total;
+}
+int main(void) {
+   negotiate_type1(0x3f3f3f3f, 0x3f3f3f3f, 6);
+   do {
+      //*** writing data
+      static unsigned char write_00000_00000[] = 
+         "\x66\x6f\x6f";
+      static unsigned int write_00000_00000_len = 3;
+      pov_iovec write_00000_iov[1];
+      write_00000_iov[0].base = write_00000_00000;
+      write_00000_iov[0].len = write_00000_00000_len;
+      pov_transmit_iov(1, write_00000_iov, 1);
+   } while (0);
+}
@@ -0,0 +1,259 @@
+#include <libpov.h>
+//**** pov-xml2c fused reads
+#define POV_EXPECT_MAX 0x40000000u
+static int pov_expect_grow(unsigned char **buf, unsigned int *cap, unsigned int need) {
+   unsigned int size = *cap < 64 ? 64 : *cap;
+   unsigned char *grown;
+   if (need <= *cap) {
+      return 1;
+   }
+   if (need > POV_EXPECT_MAX) {
+      return 0;
+   }
+   while (size < need) {
+      size *= 2;
+   }
+   grown = (unsigned char*)realloc(*buf, size);
+   if (grown == NULL) {
+      return 0;
+   }
+   *buf = grown;
+   *cap = size;
+   return 1;
+}
+static int pov_expect_length(int fd, const unsigned char *expect, unsigned int elen, unsigned int len,
+                             unsigned int *rx, unsigned char **miss) {
+   unsigned char chunk[4096];
+   unsigned int got = 0;
+   unsigned int cmp;
+   size_t n;
+   *miss = NULL;
+   while (got < len) {
+      n = len - got;
+      if (*miss == NULL && n > sizeof(chunk)) {
+         n = sizeof(chunk);
+      }
+      if (receive(fd, *miss != NULL ? *miss + got : chunk, n, &n) != 0 || n == 0) {
+         break;
+      }
+      cmp = got < elen ? elen - got : 0;
+      if (*miss == NULL && memcmp(chunk, expect + got, cmp < n ? cmp : n) != 0) {
+         *miss = (unsigned char*)malloc(len);
+         if (*miss == NULL) {
+            *rx = 0;
+            return 0;
+         }
+         memcpy(*miss, expect, got);
+         memcpy(*miss + got, chunk, n);
+      }
+      got += n;
+   }
+   *rx = got;
+   return *miss == NULL && got >= elen;
+}
+static int pov_expect_delimited(int fd, const unsigned char *expect, unsigned int elen,
+                                const unsigned char *delim, unsigned int dlen, unsigned char *ring,
+                                unsigned int *rx, unsigned char **miss) {
+   unsigned int got = 0;
+   unsigned int cap = 0;
+   unsigned int i;
+   unsigned char c;
+   size_t n;
+   *miss = NULL;
+   while (receive(fd, &c, 1, &n) == 0 && n == 1) {
+      if (*miss == NULL && got < elen && c != expect[got]) {
+         if (!pov_expect_grow(miss, &cap, got + 1)) {
+            *rx = 0;
+            return 0;
+         }
+         memcpy(*miss, expect, got);
+      }
+      if (*miss != NULL) {
+         if (!pov_expect_grow(miss, &cap, got + 1)) {
+            break;
+         }
+         (*miss)[got] = c;
+      }
+      ring[got % dlen] = c;
+      got++;
+      if (got < dlen) {
+         continue;
+      }
+      for (i = 0; i < dlen && ring[(got - dlen + i) % dlen] == delim[i]; i++) {
+      }
+      if (i == dlen) {
+         break;
+      }
+   }
+   *rx = got;
+   return *miss == NULL && got >= elen;
+}
+int main(void) {
+   negotiate_type2();
+   do {
+      unsigned char *read_00000;
+      unsigned int read_00000_len;
+      unsigned int read_00000_ptr = 0;
+      //**** length read
+      read_00000_len = 68;
+      read_00000 = (unsigned char*)malloc(read_00000_len);
+      int read_00000_res = length_read(0, read_00000, read_00000_len);
+      if (read_00000_res) {} //silence unused variable warning
+      free(read_00000);
+      if (read_00000_ptr) {}  //silence unused variable warning if any
+   } while (0);
+   do {
+      unsigned char *read_00001;
+      unsigned int read_00001_len;
+      unsigned int read_00001_ptr = 0;
+      //**** delimited read
+      static unsigned char read_00001_delim[] = 
+         "\x0a";
+      read_00001 = NULL;
+      read_00001_len = 0;
+      int read_00001_res = delimited_read(0, &read_00001, &read_00001_len, read_00001_delim, 1);
+      if (read_00001_res) {} //silence unused variable warning
+      //**** read assign to var "TYPE2_VALUE" from slice
+      unsigned int read_00001_avail = read_00001_len - read_00001_ptr;
+      unsigned int read_00001_from = read_00001_avail < 3u ? read_00001_avail : 3u;
+      unsigned int read_00001_to = read_00001_avail;
+      putenv("TYPE2_VALUE", read_00001 + read_00001_from, read_00001_to - read_00001_from);
+      free(read_00001);
+      if (read_00001_ptr) {}  //silence unused variable warning if any
+   } while (0);
+   do {
+      unsigned char *read_00002;
+      unsigned int read_00002_len;
+      unsigned int read_00002_ptr = 0;
+      //**** delimited read
+      static unsigned char read_00002_delim[] = 
+         "\x0a";
+      read_00002 = NULL;
+      read_00002_len = 0;
+      int read_00002_res = delimited_read(0, &read_00002, &read_00002_len, read_00002_delim, 1);
+      if (read_00002_res) {} //silence unused variable warning
+      //**** read assign to var "FOO" from slice
+      unsigned int read_00002_avail = read_00002_len - read_00002_ptr;
+      unsigned int read_00002_from = read_00002_avail > 5u ? read_00002_avail - 5u : 0;
+      unsigned int read_00002_to = read_00002_avail;
+      putenv("FOO", read_00002 + read_00002_from, read_00002_to - read_00002_from);
+      free(read_00002);
+      if (read_00002_ptr) {}  //silence unused variable warning if any
+   } while (0);
+   do {
+      unsigned char *read_00003;
+      unsigned int read_00003_len;
+      unsigned int read_00003_ptr = 0;
+      //**** delimited read
+      static unsigned char read_00003_delim[] = 
+         "\x0a";
+      read_00003 = NULL;
+      read_00003_len = 0;
+      int read_00003_res = delimited_read(0, &read_00003, &read_00003_len, read_00003_delim, 1);
+      if (read_00003_res) {} //silence unused variable warning
+      //**** read assign to var "BAR" from slice
+      unsigned int read_00003_avail = read_00003_len - read_00003_ptr;
+      unsigned int read_00003_from = 0;
+      unsigned int read_00003_to = read_00003_avail > 1u ? read_00003_avail - 1u : 0;
+      putenv("BAR", read_00003 + read_00003_from, read_00003_to - read_00003_from);
+      free(read_00003);
+      if (read_00003_ptr) {}  //silence unused variable warning if any
+   } while (0);
+   do {
+      unsigned char *read_00004;
+      unsigned int read_00004_len;
+      unsigned int read_00004_ptr = 0;
+      //**** delimited read
+      static unsigned char read_00004_delim[] = 
+         "\x0a";
+      read_00004 = NULL;
+      read_00004_len = 0;
+      int read_00004_res = delimited_read(0, &read_00004, &read_00004_len, read_00004_delim, 1);
+      if (read_00004_res) {} //silence unused variable warning
+      //**** read assign to var "BAZ" from slice
+      unsigned int read_00004_avail = read_00004_len - read_00004_ptr;
+      unsigned int read_00004_from = read_00004_avail < 4u ? read_00004_avail : 4u;
+      unsigned int read_00004_to = read_00004_avail > 1u ? read_00004_avail - 1u : 0;
+      if (read_00004_to < read_00004_from) {
+         read_00004_to = read_00004_from;
+      }
+      putenv("BAZ", read_00004 + read_00004_from, read_00004_to - read_00004_from);
+      free(read_00004);
+      if (read_00004_ptr) {}  //silence unused variable warning if any
+   } while (0);
+   do {
+      unsigned char *read_00005;
+      unsigned int read_00005_len;
+      unsigned int read_00005_ptr = 0;
+      //**** delimited read
+      static unsigned char read_00005_delim[] = 
+         "\x0a";
+      read_00005 = NULL;
+      read_00005_len = 0;
+      int read_00005_res = delimited_read(0, &read_00005, &read_00005_len, read_00005_delim, 1);
+      if (read_00005_res) {} //silence unused variable warning
+      /* read match pcre:
+[0-9]+
+*/
+      static char read_00005_00000_regex[] = 
+         "\x5b\x30\x2d\x39\x5d\x2b";
+      static match_result read_00005_00000_match;
+      pcre *read_00005_00000_pcre = init_regex(read_00005_00000_regex);
+      if (read_00005_00000_pcre != NULL) {
+         int rc = regex_match(read_00005_00000_pcre, 0, read_00005 + read_00005_ptr, read_00005_len - read_00005_ptr, &read_00005_00000_match);
+         if (rc > 0) {
+            read_00005_ptr += read_00005_00000_match.match_end - read_00005_00000_match.match_start;
+         }
+         else {
+            //this is a pov so what does this even mean?
+            //why would we quit on failed match, just keep sending stuff.
+         }
+         pcre_free(read_00005_00000_pcre);
+      }
+      else {
+         //this is a pov so what does this even mean?
+         //why would we quit on failed regex compile, just keep sending stuff.
+      }
+      free(read_00005);
+      if (read_00005_ptr) {}  //silence unused variable warning if any
+   } while (0);
+   do {
+      //**** delimited read compared as it is received
+      static unsigned char read_00006_expect[] = 
+         "\x61\x62\x63\x64\x65\x66\x67\x68\x69\x6a\x6b";
+      static unsigned char read_00006_delim[] = 
+         "\x0a";
+      unsigned char read_00006_ring[1];
+      unsigned int read_00006_rx;
+      unsigned char *read_00006_miss;
+      unsigned char *read_00006 = read_00006_expect;
+      unsigned int read_00006_len = 11;
+      if (!pov_expect_delimited(0, read_00006_expect, 11, read_00006_delim, 1, read_00006_ring, &read_00006_rx, &read_00006_miss)) {
+         read_00006 = read_00006_miss != NULL ? read_00006_miss : read_00006_expect;
+         read_00006_len = read_00006_rx;
+      }
+      unsigned int read_00006_ptr = 0;
+      //**** read match data
+      read_00006_ptr += data_match(read_00006 + read_00006_ptr, read_00006_len - read_00006_ptr, read_00006_expect + 0, 11);
+      free(read_00006_miss);
+      if (read_00006_ptr) {}  //silence unused variable warning if any
+   } while (0);
+   do {
+      unsigned char *read_00007;
+      unsigned int read_00007_len;
+      unsigned int read_00007_ptr = 0;
+      //**** delimited read
+      static unsigned char read_00007_delim[] = 
+         "\x0a";
+      read_00007 = NULL;
+      read_00007_len = 0;
+      int read_00007_res = delimited_read(0, &read_00007, &read_00007_len, read_00007_delim, 1);
+      if (read_00007_res) {} //silence unused variable warning
+      //**** read match var FOO
+      read_00007_ptr += var_match(read_00007 + read_00007_ptr, read_00007_len - read_00007_ptr, "FOO");
+      free(read_00007);
+      if (read_00007_ptr) {}  //silence unused variable warning if any
+   } while (0);
+   //*** submitting type 2 POV results
+   submit_type2("TYPE2_VALUE");
+}
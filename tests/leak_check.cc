@@ -0,0 +1,230 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+/*
+ Converts every document named on the command line, together with a set of
+ documents that fail in each of the element parsers, ROUNDS times in one
+ process through libpovxml2c.  Built against an AddressSanitizer copy of the
+ library by make leakcheck: LeakSanitizer fails the run on any allocation
+ left unreachable at exit, and the bytes still allocated after the first
+ round must not grow over the remaining rounds.
+
+ Usage: leak_check ROUNDS xml-file...
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+using std::string;
+using std::vector;
+
+#include "povxml2c.h"
+
+//from sanitizer/allocator_interface.h, which not every toolchain installs
+extern "C" size_t __sanitizer_get_current_allocated_bytes(void);
+
+//growth tolerated between the first and last round, for allocator slack
+#define GROWTH_SLACK 65536
+
+#define HEADER "<?xml version=\"1.0\" standalone=\"no\" ?>\n" \
+               "<!DOCTYPE cfepov SYSTEM \"/usr/share/cgc-docs/cfe-pov.dtd\">\n" \
+               "<cfepov><cbid>service</cbid><replay>\n"
+#define TYPE2 "<negotiate><type2 /></negotiate>\n"
+#define FOOTER "</replay></cfepov>\n"
+
+struct Doc {
+   const char *name;
+   string xml;
+   bool fails;
+};
+
+//valid against the dtd, each rejected by a different part of the converter
+static const char *failing[][2] = {
+   {"malformed", "<cfepov>"},
+   {"type1 ipmask", HEADER "<negotiate><type1><ipmask>x</ipmask><regmask>1</regmask><regnum>1</regnum></type1></negotiate>\n" FOOTER},
+   {"type1 regnum", HEADER "<negotiate><type1><ipmask>1</ipmask><regmask>1</regmask><regnum>9</regnum></type1></negotiate>\n" FOOTER},
+   {"delay", HEADER TYPE2 "<delay>soon</delay>\n" FOOTER},
+   {"read length", HEADER TYPE2 "<read><length>ten</length></read>\n" FOOTER},
+   {"read length var", HEADER TYPE2 "<read><length isvar=\"true\">len</length><timeout>x</timeout></read>\n" FOOTER},
+   {"read delim", HEADER TYPE2 "<read><delim format=\"hex\">zz</delim><match><data>a</data></match></read>\n" FOOTER},
+   {"read match", HEADER TYPE2 "<read><delim>\\n</delim><match><data>a</data><pcre>(</pcre><data format=\"hex\">zz</data></match></read>\n" FOOTER},
+   {"read assign", HEADER TYPE2 "<read><delim>\\n</delim><assign><var>v</var><pcre group=\"3\">(a)</pcre></assign></read>\n" FOOTER},
+   {"read slice", HEADER TYPE2 "<read><delim>\\n</delim><assign><var>v</var><slice begin=\"x\"/></assign><timeout>-</timeout></read>\n" FOOTER},
+   {"write", HEADER TYPE2 "<write><data>ok</data><var>v</var><data format=\"hex\">zz</data></write>\n" FOOTER},
+   {"decl", HEADER TYPE2 "<decl><var>v</var><value><data>a</data><substr><var>w</var><begin>x</begin></substr></value></decl>\n" FOOTER},
+   {"external", HEADER TYPE2 "<write><data file=\"missing.bin\"/></write>\n" FOOTER},
+};
+
+//a gzip copy of xml, cut short by trim bytes
+static string gzipped(const string &xml, size_t trim) {
+   z_stream zs;
+   memset(&zs, 0, sizeof(zs));
+   deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+   string out(deflateBound(&zs, xml.size()), 0);
+   zs.next_in = (Bytef*)xml.data();
+   zs.avail_in = xml.size();
+   zs.next_out = (Bytef*)&out[0];
+   zs.avail_out = out.size();
+   deflate(&zs, Z_FINISH);
+   out.resize(zs.total_out > trim ? zs.total_out - trim : 0);
+   deflateEnd(&zs);
+   return out;
+}
+
+static bool readFile(const char *name, string &contents) {
+   FILE *f = fopen(name, "r");
+   if (f == NULL) {
+      return false;
+   }
+   char buf[4096];
+   size_t n;
+   while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+      contents.append(buf, n);
+   }
+   fclose(f);
+   return true;
+}
+
+static bool convert(povxml2c_ctx *ctx, const Doc &d) {
+   char *src = NULL;
+   size_t len;
+   int rc = povxml2c_convert(ctx, d.xml.data(), d.xml.size(), &src, &len);
+   povxml2c_free_buffer(src);
+   for (size_t i = 0; i < povxml2c_diag_count(ctx); i++) {
+      povxml2c_diag_get(ctx, i);
+   }
+   if ((rc != 0) != d.fails) {
+      fprintf(stderr, "leak_check: %s converted with status %d\n", d.name, rc);
+      return false;
+   }
+   return true;
+}
+
+//the units of the PoV built by the last conversion, as --split writes them
+static void split(povxml2c_ctx *ctx) {
+   for (size_t i = 0; i < povxml2c_split_count(ctx, 2); i++) {
+      char *name = NULL;
+      char *src = NULL;
+      size_t len;
+      povxml2c_split_source(ctx, 2, i, &name, &src, &len);
+      povxml2c_free_buffer(name);
+      povxml2c_free_buffer(src);
+   }
+}
+
+//the cost estimate of the PoV built by the last conversion, as --cost does
+static void cost(povxml2c_ctx *ctx) {
+   povxml2c_cost c;
+   if (povxml2c_cost_estimate(ctx, &c) == 0) {
+      povxml2c_free_buffer(povxml2c_cost_json(&c));
+   }
+}
+
+/*
+ * One round: each document through a fresh context releasing variables and
+ * through the long lived one, with the main and resumable backends, split
+ * into chunks and estimated, then all of them into a bundle.
+ */
+static bool runRound(povxml2c_ctx *reused, vector<Doc> &docs, const char *baseDir) {
+   bool ok = true;
+   povxml2c_bundle *bundle = povxml2c_bundle_new();
+   for (size_t i = 0; i < docs.size(); i++) {
+      povxml2c_ctx *ctx = povxml2c_new();
+      povxml2c_set_option(ctx, POVXML2C_OPT_EXTERNAL_DATA, 1);
+      povxml2c_set_option(ctx, POVXML2C_OPT_RELEASE_VARS, 1);
+      povxml2c_set_base_dir(ctx, baseDir);
+      ok = convert(ctx, docs[i]) && ok;
+      split(ctx);
+      cost(ctx);
+      povxml2c_set_option(ctx, POVXML2C_OPT_BACKEND, POVXML2C_BACKEND_RESUMABLE);
+      ok = convert(ctx, docs[i]) && ok;
+      povxml2c_free(ctx);
+
+      ok = convert(reused, docs[i]) && ok;
+      povxml2c_bundle_add(bundle, reused, docs[i].name, docs[i].xml.data(), docs[i].xml.size());
+   }
+   for (size_t i = 0; i < povxml2c_bundle_count(bundle); i++) {
+      char *src = NULL;
+      size_t len;
+      povxml2c_bundle_source(bundle, i, &src, &len);
+      povxml2c_free_buffer(src);
+   }
+   povxml2c_bundle_free(bundle);
+   return ok;
+}
+
+int main(int argc, char **argv) {
+   if (argc < 2) {
+      fprintf(stderr, "usage: %s ROUNDS xml-file...\n", argv[0]);
+      return 1;
+   }
+   int rounds = atoi(argv[1]);
+   vector<Doc> docs;
+   for (int i = 2; i < argc; i++) {
+      Doc d = {argv[i], "", false};
+      if (!readFile(argv[i], d.xml)) {
+         fprintf(stderr, "leak_check: unable to read %s\n", argv[i]);
+         return 1;
+      }
+      docs.push_back(d);
+   }
+   for (size_t i = 0; i < sizeof(failing) / sizeof(failing[0]); i++) {
+      Doc d = {failing[i][0], failing[i][1], true};
+      docs.push_back(d);
+   }
+
+   //external data resolved against a scratch directory
+   char baseDir[] = "/tmp/leak_check.XXXXXX";
+   if (mkdtemp(baseDir) == NULL) {
+      perror("leak_check: mkdtemp");
+      return 1;
+   }
+   string payload = string(baseDir) + "/payload.bin";
+   FILE *f = fopen(payload.c_str(), "w");
+   fputs("external payload", f);
+   fclose(f);
+   Doc ext = {"external data", HEADER TYPE2 "<write><data file=\"payload.bin\" offset=\"2\"/></write>\n" FOOTER, false};
+   docs.push_back(ext);
+
+   //streamed through the decompressor, whole and truncated
+   if (argc > 2) {
+      Doc gz = {"gzip", gzipped(docs[0].xml, 0), false};
+      Doc cut = {"gzip truncated", gzipped(docs[0].xml, 16), true};
+      docs.push_back(gz);
+      docs.push_back(cut);
+   }
+
+   povxml2c_init();
+   povxml2c_ctx *reused = povxml2c_new();
+   povxml2c_set_option(reused, POVXML2C_OPT_EXTERNAL_DATA, 1);
+   povxml2c_set_base_dir(reused, baseDir);
+   bool ok = true;
+   size_t baseline = 0;
+   for (int r = 0; r < rounds && ok; r++) {
+      ok = runRound(reused, docs, baseDir);
+      if (r == 0) {
+         baseline = __sanitizer_get_current_allocated_bytes();
+      }
+   }
+   size_t final = __sanitizer_get_current_allocated_bytes();
+   povxml2c_free(reused);
+   unlink(payload.c_str());
+   rmdir(baseDir);
+
+   printf("%d rounds of %zu documents, %zu bytes allocated after the first round, %zu after the last\n",
+          rounds, docs.size(), baseline, final);
+   if (final > baseline + GROWTH_SLACK) {
+      fprintf(stderr, "leak_check: %zu bytes retained over %d rounds\n", final - baseline, rounds - 1);
+      ok = false;
+   }
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,259 @@
+#!/usr/bin/python
+
+"""
+Regression gate for pov-xml2c.  Converts every tests/*.povxml fixture plus a
+set of large generated fixtures and
+
+  - compares the generated C against the goldens in tests/golden, so that
+    optimizations cannot silently change semantics
+  - enforces the per fixture wall time, peak RSS and output size budgets in
+    tests/budgets.json
+
+With --ab it instead compares two pov-xml2c binaries on the same corpus and
+reports the fixtures whose conversion times differ significantly.
+
+usage: regress.py [-b BINARY] [--update-goldens]
+       regress.py --ab BINARY_A BINARY_B [-n RUNS]
+"""
+
+import os
+import sys
+import json
+import math
+import time
+import glob
+import random
+import shutil
+import hashlib
+import argparse
+import tempfile
+import subprocess
+
+TESTS_DIR = os.path.dirname(os.path.abspath(__file__))
+TOP_DIR = os.path.dirname(TESTS_DIR)
+GOLDEN_DIR = os.path.join(TESTS_DIR, "golden")
+BUDGETS = os.path.join(TESTS_DIR, "budgets.json")
+
+sys.path.insert(0, os.path.join(TOP_DIR, "bench"))
+import gen_pov
+
+# large fixtures are regenerated on every run, so only a digest of their
+# golden output is kept
+GENERATED = [
+    ("gen_writes", dict(actions=4000, payload=256, hex_ratio=0.5,
+                        variables=0, regexes=0.0, type2=False, seed=1)),
+    ("gen_reads", dict(actions=4000, payload=64, hex_ratio=0.2,
+                       variables=8, regexes=0.3, type2=True, seed=2)),
+    ("gen_payload", dict(actions=200, payload=16384, hex_ratio=0.8,
+                         variables=2, regexes=0.1, type2=False, seed=3)),
+]
+
+
+def corpus(workdir):
+    """ [(name, path)] for every fixture, generating the large ones """
+    fixtures = []
+    for path in sorted(glob.glob(os.path.join(TESTS_DIR, "*.povxml"))):
+        fixtures.append((os.path.basename(path)[:-len(".povxml")], path))
+    for name, params in GENERATED:
+        params = dict(params)
+        rng = random.Random(params.pop("seed"))
+        path = os.path.join(workdir, name + ".xml")
+        with open(path, "w") as f:
+            f.write(gen_pov.generate(rng, **params))
+        fixtures.append((name, path))
+    return fixtures
+
+
+def run(binary, path):
+    """ convert path, return (status, output, wall seconds, peak rss kB) """
+    out = tempfile.TemporaryFile()
+    # the child's ru_maxrss would include this interpreter, so take peak
+    # RSS from the converter's own statistics
+    stats = tempfile.NamedTemporaryFile(suffix=".json")
+    with open(os.devnull, "w") as devnull:
+        start = time.time()
+        status = subprocess.call([binary, "--stats", "json", "--stats-file",
+                                  stats.name, "-x", path], stdout=out,
+                                 stderr=devnull)
+        elapsed = time.time() - start
+    out.seek(0)
+    source = out.read()
+    out.close()
+    try:
+        rss = json.load(stats)["peak_rss_kb"]
+    except ValueError:
+        rss = 0
+    stats.close()
+    return status, source, elapsed, rss
+
+
+def golden_path(name, generated):
+    return os.path.join(GOLDEN_DIR, name + (".sha256" if generated else ".c"))
+
+
+def check_golden(name, source, generated, update):
+    path = golden_path(name, generated)
+    expected = source
+    if generated:
+        expected = (hashlib.sha256(source).hexdigest() + "\n").encode()
+    if update:
+        with open(path, "wb") as f:
+            f.write(expected)
+        return None
+    if not os.path.exists(path):
+        return "no golden output, run with --update-goldens"
+    with open(path, "rb") as f:
+        if f.read() != expected:
+            return "generated source differs from %s" % os.path.relpath(path, TOP_DIR)
+    return None
+
+
+def check_budget(budget, elapsed, rss, size):
+    problems = []
+    if elapsed * 1000 > budget["wall_ms"]:
+        problems.append("wall time %.1f ms exceeds budget of %d ms"
+                        % (elapsed * 1000, budget["wall_ms"]))
+    if rss > budget["rss_kb"]:
+        problems.append("peak RSS %d kB exceeds budget of %d kB"
+                        % (rss, budget["rss_kb"]))
+    if size > budget["output_bytes"]:
+        problems.append("output of %d bytes exceeds budget of %d bytes"
+                        % (size, budget["output_bytes"]))
+    return problems
+
+
+def gate(args):
+    with open(BUDGETS) as f:
+        budgets = json.load(f)
+    generated = set(name for name, _ in GENERATED)
+    workdir = tempfile.mkdtemp(prefix="pov-xml2c-regress.")
+    failures = 0
+    try:
+        fixtures = corpus(workdir)
+        print("1..%d" % len(fixtures))
+        for i, (name, path) in enumerate(fixtures):
+            status, source, elapsed, rss = run(args.binary, path)
+            problems = []
+            if status != 0:
+                problems.append("exit status %d" % status)
+            else:
+                problem = check_golden(name, source, name in generated,
+                                       args.update_goldens)
+                if problem:
+                    problems.append(problem)
+                budget = dict(budgets["default"])
+                budget.update(budgets.get(name, {}))
+                problems += check_budget(budget, elapsed, rss, len(source))
+            if problems:
+                failures += 1
+                print("not ok %d - %s" % (i + 1, name))
+                for p in problems:
+                    print("# %s" % p)
+            else:
+                print("ok %d - %s # %.1f ms, %d kB, %d bytes"
+                      % (i + 1, name, elapsed * 1000, rss, len(source)))
+    finally:
+        shutil.rmtree(workdir)
+    return 1 if failures else 0
+
+
+def mann_whitney(a, b):
+    """ two sided p value of the Mann-Whitney U test, normal approximation """
+    ranked = sorted([(v, 0) for v in a] + [(v, 1) for v in b])
+    ranks = [0.0] * len(ranked)
+    i = 0
+    while i < len(ranked):
+        j = i
+        while j + 1 < len(ranked) and ranked[j + 1][0] == ranked[i][0]:
+            j += 1
+        for k in range(i, j + 1):
+            ranks[k] = (i + j) / 2.0 + 1
+        i = j + 1
+    r1 = sum(r for r, (_, g) in zip(ranks, ranked) if g == 0)
+    n1, n2 = len(a), len(b)
+    u = r1 - n1 * (n1 + 1) / 2.0
+    mu = n1 * n2 / 2.0
+    sigma = math.sqrt(n1 * n2 * (n1 + n2 + 1) / 12.0)
+    if sigma == 0:
+        return 1.0
+    z = (abs(u - mu) - 0.5) / sigma
+    return math.erfc(max(z, 0) / math.sqrt(2))
+
+
+def median(values):
+    values = sorted(values)
+    return values[len(values) // 2]
+
+
+def ab(args):
+    binary_a, binary_b = args.ab
+    workdir = tempfile.mkdtemp(prefix="pov-xml2c-ab.")
+    results = []
+    significant = 0
+    try:
+        for name, path in corpus(workdir):
+            times = ([], [])
+            rss = ([], [])
+            outputs = [None, None]
+            for r in range(args.runs):
+                # alternate so that drift in machine load hits both equally
+                order = (0, 1) if r % 2 == 0 else (1, 0)
+                for which in order:
+                    status, source, elapsed, kb = run(args.ab[which], path)
+                    times[which].append(elapsed * 1000)
+                    rss[which].append(kb)
+                    outputs[which] = (status, hashlib.sha256(source).hexdigest())
+            p = mann_whitney(times[0], times[1])
+            a_ms, b_ms = median(times[0]), median(times[1])
+            change = (b_ms - a_ms) / a_ms * 100 if a_ms else 0.0
+            sig = p < args.alpha
+            significant += sig
+            results.append({
+                "fixture": name,
+                "a_ms": round(a_ms, 3),
+                "b_ms": round(b_ms, 3),
+                "change_pct": round(change, 2),
+                "p_value": round(p, 5),
+                "significant": sig,
+                "a_rss_kb": max(rss[0]),
+                "b_rss_kb": max(rss[1]),
+                "same_output": outputs[0] == outputs[1],
+            })
+    finally:
+        shutil.rmtree(workdir)
+    report = {"a": binary_a, "b": binary_b, "runs": args.runs,
+              "alpha": args.alpha, "significant": significant,
+              "fixtures": results}
+    json.dump(report, sys.stdout, indent=2, sort_keys=True)
+    sys.stdout.write("\n")
+    for r in results:
+        if r["significant"]:
+            sys.stderr.write("%s: %+.1f%% (%.3f ms -> %.3f ms, p=%.4f)\n"
+                             % (r["fixture"], r["change_pct"], r["a_ms"],
+                                r["b_ms"], r["p_value"]))
+        if not r["same_output"]:
+            sys.stderr.write("%s: binaries generate different source\n"
+                             % r["fixture"])
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="pov-xml2c regression gate")
+    parser.add_argument("-b", "--binary",
+                        default=os.path.join(TOP_DIR, "pov-xml2c"))
+    parser.add_argument("--update-goldens", action="store_true",
+                        help="rewrite goldens from the current binary")
+    parser.add_argument("--ab", nargs=2, metavar=("BINARY_A", "BINARY_B"),
+                        help="compare two binaries instead of gating")
+    parser.add_argument("-n", "--runs", type=int, default=15,
+                        help="runs per fixture and binary in A/B mode")
+    parser.add_argument("--alpha", type=float, default=0.01,
+                        help="significance level in A/B mode")
+    args = parser.parse_args()
+    if args.ab:
+        return ab(args)
+    return gate(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -5,10 +5,888 @@ import sys
 import unittest
 import time
 import subprocess
+import ctypes
+import glob
+import gzip
+import lzma
+import shutil
+import socket
+import tempfile
+import threading
+
+TESTS_DIR = os.path.dirname(os.path.abspath(__file__))
+TOP_DIR = os.path.dirname(TESTS_DIR)
+
+
+class povxml2c_diag(ctypes.Structure):
+    _fields_ = [("severity", ctypes.c_int),
+                ("line", ctypes.c_int),
+                ("message", ctypes.c_char_p)]
+
+
+class povxml2c_stats(ctypes.Structure):
+    _fields_ = [("conversions", ctypes.c_ulonglong),
+                ("wall", ctypes.c_double * 6),
+                ("cpu", ctypes.c_double * 6),
+                ("actions", ctypes.c_ulonglong * 6),
+                ("allocations", ctypes.c_ulonglong),
+                ("payload_bytes", ctypes.c_ulonglong),
+                ("source_bytes", ctypes.c_ulonglong),
+                ("regexes", ctypes.c_ulonglong),
+                ("peak_rss_kb", ctypes.c_long),
+                ("round_trips", ctypes.c_ulonglong),
+                ("round_trips_removed", ctypes.c_ulonglong),
+                ("undefined_vars", ctypes.c_ulonglong),
+                ("vars_released", ctypes.c_ulonglong),
+                ("dead_stores", ctypes.c_ulonglong)]
+
+
+class povxml2c_cost(ctypes.Structure):
+    _fields_ = [("bytes_written", ctypes.c_ulonglong),
+                ("bytes_read", ctypes.c_ulonglong),
+                ("transmits", ctypes.c_ulonglong),
+                ("receives", ctypes.c_ulonglong),
+                ("delay_ms", ctypes.c_ulonglong),
+                ("regexes", ctypes.c_ulonglong),
+                ("risky_regexes", ctypes.c_ulonglong),
+                ("regex_risk", ctypes.c_int),
+                ("var_peak_bytes", ctypes.c_ulonglong),
+                ("source_bytes", ctypes.c_ulonglong),
+                ("unknown_reads", ctypes.c_ulonglong)]
+
+
+class PovXml2c(object):
+    """ ctypes loader for libpovxml2c, see povxml2c.h """
+
+    OPT_VERIFY_ONLY = 0
+    OPT_ECHO = 1
+    OPT_TIMEOUT = 2
+    OPT_CACHE_SIZE = 3
+    OPT_MAX_INPUT = 4
+    OPT_PROBE_FD = 5
+    OPT_EXTERNAL_DATA = 6
+    OPT_EARLY_WRITES = 7
+    OPT_BACKEND = 8
+    OPT_FIXED_READS = 9
+    OPT_MAX_NODES = 10
+    OPT_MAX_DEPTH = 11
+    OPT_MAX_PAYLOAD = 12
+    OPT_MAX_ALLOC = 13
+    OPT_RELEASE_VARS = 14
+    OPT_DEADLINE_MS = 15
+
+    BACKEND_MAIN = 0
+    BACKEND_RESUMABLE = 1
+
+    def __init__(self, path=None):
+        if path is None:
+            path = os.environ.get("LIBPOVXML2C",
+                                  os.path.join(TOP_DIR, "libpovxml2c.so"))
+        self.lib = ctypes.CDLL(path)
+        lib = self.lib
+        lib.povxml2c_version.restype = ctypes.c_char_p
+        lib.povxml2c_new.restype = ctypes.c_void_p
+        lib.povxml2c_free.argtypes = [ctypes.c_void_p]
+        lib.povxml2c_set_option.argtypes = [ctypes.c_void_p, ctypes.c_int,
+                                            ctypes.c_longlong]
+        lib.povxml2c_set_cache_dir.argtypes = [ctypes.c_void_p,
+                                               ctypes.c_char_p]
+        lib.povxml2c_set_base_dir.argtypes = [ctypes.c_void_p,
+                                              ctypes.c_char_p]
+        lib.povxml2c_convert.argtypes = [ctypes.c_void_p, ctypes.c_char_p,
+                                         ctypes.c_size_t,
+                                         ctypes.POINTER(ctypes.c_void_p),
+                                         ctypes.POINTER(ctypes.c_size_t)]
+        lib.povxml2c_replay.argtypes = [ctypes.c_void_p, ctypes.c_int,
+                                        ctypes.c_int]
+        lib.povxml2c_simulate.argtypes = [ctypes.c_void_p, ctypes.c_char_p,
+                                          ctypes.c_size_t]
+        lib.povxml2c_free_buffer.argtypes = [ctypes.c_void_p]
+        lib.povxml2c_diag_count.argtypes = [ctypes.c_void_p]
+        lib.povxml2c_diag_count.restype = ctypes.c_size_t
+        lib.povxml2c_diag_get.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+        lib.povxml2c_diag_get.restype = ctypes.POINTER(povxml2c_diag)
+        lib.povxml2c_get_stats.argtypes = [ctypes.c_void_p]
+        lib.povxml2c_get_stats.restype = ctypes.POINTER(povxml2c_stats)
+        lib.povxml2c_bundle_new.restype = ctypes.c_void_p
+        lib.povxml2c_bundle_free.argtypes = [ctypes.c_void_p]
+        lib.povxml2c_bundle_add.argtypes = [ctypes.c_void_p, ctypes.c_void_p,
+                                            ctypes.c_char_p, ctypes.c_char_p,
+                                            ctypes.c_size_t]
+        lib.povxml2c_bundle_count.argtypes = [ctypes.c_void_p]
+        lib.povxml2c_bundle_count.restype = ctypes.c_size_t
+        lib.povxml2c_bundle_cbid.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+        lib.povxml2c_bundle_cbid.restype = ctypes.c_char_p
+        lib.povxml2c_bundle_source.argtypes = [ctypes.c_void_p, ctypes.c_size_t,
+                                               ctypes.POINTER(ctypes.c_void_p),
+                                               ctypes.POINTER(ctypes.c_size_t)]
+        lib.povxml2c_split_count.argtypes = [ctypes.c_void_p, ctypes.c_uint]
+        lib.povxml2c_split_count.restype = ctypes.c_size_t
+        lib.povxml2c_split_source.argtypes = [ctypes.c_void_p, ctypes.c_uint,
+                                              ctypes.c_size_t,
+                                              ctypes.POINTER(ctypes.c_void_p),
+                                              ctypes.POINTER(ctypes.c_void_p),
+                                              ctypes.POINTER(ctypes.c_size_t)]
+        lib.povxml2c_cost_estimate.argtypes = [ctypes.c_void_p,
+                                               ctypes.POINTER(povxml2c_cost)]
+        self.ctx = lib.povxml2c_new()
+
+    def close(self):
+        if self.ctx:
+            self.lib.povxml2c_free(self.ctx)
+            self.ctx = None
+
+    def set_base_dir(self, path):
+        return self.lib.povxml2c_set_base_dir(self.ctx, path)
+
+    def set_option(self, option, value):
+        return self.lib.povxml2c_set_option(self.ctx, option, value)
+
+    def convert(self, xml):
+        """ returns (status, source or None, [(severity, line, message)]) """
+        out = ctypes.c_void_p()
+        out_len = ctypes.c_size_t()
+        status = self.lib.povxml2c_convert(self.ctx, xml, len(xml),
+                                           ctypes.byref(out),
+                                           ctypes.byref(out_len))
+        source = None
+        if out.value:
+            source = ctypes.string_at(out.value, out_len.value)
+            self.lib.povxml2c_free_buffer(out)
+        diags = []
+        for i in range(self.lib.povxml2c_diag_count(self.ctx)):
+            d = self.lib.povxml2c_diag_get(self.ctx, i).contents
+            diags.append((d.severity, d.line, d.message))
+        return status, source, diags
+
+    def replay(self, to_fd, from_fd):
+        """ returns (status, [(severity, line, message)]) """
+        status = self.lib.povxml2c_replay(self.ctx, to_fd, from_fd)
+        diags = []
+        for i in range(self.lib.povxml2c_diag_count(self.ctx)):
+            d = self.lib.povxml2c_diag_get(self.ctx, i).contents
+            diags.append((d.severity, d.line, d.message))
+        return status, diags
+
+    def simulate(self, transcript):
+        """ returns (status, [(severity, line, message)]) """
+        status = self.lib.povxml2c_simulate(self.ctx, transcript,
+                                            len(transcript))
+        diags = []
+        for i in range(self.lib.povxml2c_diag_count(self.ctx)):
+            d = self.lib.povxml2c_diag_get(self.ctx, i).contents
+            diags.append((d.severity, d.line, d.message))
+        return status, diags
+
+    def stats(self):
+        return self.lib.povxml2c_get_stats(self.ctx).contents
+
+    def bundle(self, docs):
+        """ bundles [(name, xml)], returns (status, {cbid: source}) """
+        bundle = self.lib.povxml2c_bundle_new()
+        sources = {}
+        try:
+            for name, xml in docs:
+                status = self.lib.povxml2c_bundle_add(bundle, self.ctx, name,
+                                                      xml, len(xml))
+                if status != 0:
+                    return status, sources
+            for i in range(self.lib.povxml2c_bundle_count(bundle)):
+                out = ctypes.c_void_p()
+                out_len = ctypes.c_size_t()
+                status = self.lib.povxml2c_bundle_source(bundle, i,
+                                                         ctypes.byref(out),
+                                                         ctypes.byref(out_len))
+                if status != 0:
+                    return status, sources
+                cbid = self.lib.povxml2c_bundle_cbid(bundle, i)
+                sources[cbid] = ctypes.string_at(out.value, out_len.value)
+                self.lib.povxml2c_free_buffer(out)
+        finally:
+            self.lib.povxml2c_bundle_free(bundle)
+        return 0, sources
+
+
+    def split(self, actions):
+        """ splits the last conversion, returns (status, [(name, source)]) """
+        units = []
+        for i in range(self.lib.povxml2c_split_count(self.ctx, actions)):
+            name = ctypes.c_void_p()
+            out = ctypes.c_void_p()
+            out_len = ctypes.c_size_t()
+            status = self.lib.povxml2c_split_source(self.ctx, actions, i,
+                                                    ctypes.byref(name),
+                                                    ctypes.byref(out),
+                                                    ctypes.byref(out_len))
+            if status != 0:
+                return status, units
+            units.append((ctypes.string_at(name.value),
+                          ctypes.string_at(out.value, out_len.value)))
+            self.lib.povxml2c_free_buffer(name)
+            self.lib.povxml2c_free_buffer(out)
+        return 0, units
+
+    def cost(self):
+        """ estimates the last conversion, returns (status, povxml2c_cost) """
+        c = povxml2c_cost()
+        status = self.lib.povxml2c_cost_estimate(self.ctx, ctypes.byref(c))
+        return status, c
+
+
+def have_library():
+    return os.path.exists(os.environ.get("LIBPOVXML2C",
+                                         os.path.join(TOP_DIR, "libpovxml2c.so")))
+
 
 class test_pov_xml2c(unittest.TestCase):
     def test_template(self):
         self.assertTrue("unit tests should be written for this package")
 
+
+def have_binary():
+    return os.path.exists(os.path.join(TOP_DIR, "pov-xml2c"))
+
+
+@unittest.skipUnless(have_binary(), "pov-xml2c has not been built")
+class test_cli(unittest.TestCase):
+    def run_cli(self, args):
+        """ returns (status, stdout, stderr) """
+        proc = subprocess.Popen([os.path.join(TOP_DIR, "pov-xml2c")] + args,
+                                stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        out, err = proc.communicate()
+        return proc.returncode, out, err
+
+    def test_negotiated_vars_are_assigned(self):
+        for name in ("POV_00000.xml", "POV_00001.xml"):
+            status, out, err = self.run_cli(
+                ["-x", os.path.join(TOP_DIR, "examples", name)])
+            self.assertEqual(status, 0, err)
+            self.assertFalse(b"before it is assigned" in err, err)
+
+    def test_split_shrinks(self):
+        xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+               b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+               b'<cfepov><cbid>service</cbid><replay>\n'
+               b'<negotiate><type1><ipmask>0</ipmask><regmask>0</regmask><regnum>0</regnum></type1></negotiate>\n'
+               b'%s'
+               b'</replay></cfepov>\n')
+        tmp = tempfile.mkdtemp()
+        try:
+            name = os.path.join(tmp, "pov.xml")
+            out = os.path.join(tmp, "out")
+            os.mkdir(out)
+            chunks = []
+            for writes in (9, 3):
+                with open(name, "wb") as f:
+                    f.write(xml % (b'<write><data>x</data></write>\n' * writes))
+                status, stdout, err = self.run_cli(["--split", out, "--split-actions", "2", "-x", name])
+                self.assertEqual(status, 0, err)
+                chunks.append(sorted(n for n in os.listdir(out) if n.startswith("pov_chunk_")))
+            # the negotiation and the writes, two to a chunk
+            self.assertEqual(chunks[0], ["pov_chunk_%05d.c" % i for i in range(5)])
+            # the chunks of the longer PoV are gone, and no temp files remain
+            self.assertEqual(chunks[1], ["pov_chunk_00000.c", "pov_chunk_00001.c"])
+            self.assertEqual(sorted(os.listdir(out)), sorted(chunks[1] + ["pov.mk", "pov_main.c"]))
+        finally:
+            shutil.rmtree(tmp)
+
+    def test_client_matches_cli(self):
+        client = os.path.join(TOP_DIR, "pov-xml2c-client")
+        if not os.path.exists(client):
+            self.skipTest("pov-xml2c-client has not been built")
+        tmp = tempfile.mkdtemp()
+        sock = os.path.join(tmp, "sock")
+        server = subprocess.Popen([os.path.join(TOP_DIR, "pov-xml2c"), "-S", sock, "--allow-dir", TESTS_DIR],
+                                  stderr=subprocess.DEVNULL)
+        try:
+            for i in range(100):
+                if os.path.exists(sock):
+                    break
+                time.sleep(0.01)
+            xml = os.path.join(TESTS_DIR, "reads_t2.povxml")
+            for args in ([], ["--fixed-reads", "--release-vars"], ["--early-writes=2", "--probes", "3"],
+                         ["--backend", "resumable"], ["--max-nodes", "5"], ["-m", "100"], ["-v"]):
+                local = self.run_cli(args + ["-x", xml])
+                proc = subprocess.Popen([client, "-S", sock] + args + ["-x", xml],
+                                        stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+                out, err = proc.communicate()
+                self.assertEqual((proc.returncode, out, err), local, args)
+            # paths and caches are confined to the directories the server allows
+            proc = subprocess.Popen([client, "-S", sock, "-P", "-x", xml],
+                                    stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+            out, err = proc.communicate()
+            self.assertEqual((proc.returncode, out, err), self.run_cli(["-x", xml]))
+            for args in (["-P", "-x", os.path.join(tmp, "sock")], ["-c", tmp, "-x", xml]):
+                proc = subprocess.Popen([client, "-S", sock] + args,
+                                        stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+                out, err = proc.communicate()
+                self.assertEqual(proc.returncode, 14, args)
+                self.assertIn(b"outside the directories the server allows", err)
+            # modes that run the PoV or convert many stay with pov-xml2c
+            proc = subprocess.Popen([client, "-S", sock, "--cost", "table", xml],
+                                    stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+            proc.communicate()
+            self.assertEqual(proc.returncode, 14)
+        finally:
+            server.terminate()
+            server.wait()
+            shutil.rmtree(tmp)
+
+
+@unittest.skipUnless(have_library(), "libpovxml2c.so has not been built")
+class test_libpovxml2c(unittest.TestCase):
+    def setUp(self):
+        self.conv = PovXml2c()
+
+    def tearDown(self):
+        self.conv.close()
+
+    def test_fixtures(self):
+        for name in sorted(glob.glob(os.path.join(TESTS_DIR, "*.povxml"))):
+            with open(name, "rb") as f:
+                xml = f.read()
+            status, source, diags = self.conv.convert(xml)
+            self.assertEqual(status, 0, "%s: %r" % (name, diags))
+            self.assertTrue(source.startswith(b"#include <libpov.h>"))
+
+    def test_context_reuse_is_deterministic(self):
+        name = os.path.join(TESTS_DIR, "reads_t2.povxml")
+        with open(name, "rb") as f:
+            xml = f.read()
+        first = self.conv.convert(xml)
+        second = self.conv.convert(xml)
+        self.assertEqual(first, second)
+
+    def test_verify_only(self):
+        self.conv.set_option(PovXml2c.OPT_VERIFY_ONLY, 1)
+        with open(os.path.join(TESTS_DIR, "min_read_t1.povxml"), "rb") as f:
+            status, source, diags = self.conv.convert(f.read())
+        self.assertEqual(status, 0)
+        self.assertEqual(source, None)
+
+    def test_malformed(self):
+        status, source, diags = self.conv.convert(b"<cfepov>")
+        self.assertEqual(status, 11)   # REASON_XML_BAD
+        self.assertEqual(source, None)
+        self.assertTrue(len(diags) > 0)
+
+    def test_stats(self):
+        with open(os.path.join(TESTS_DIR, "decls_t1.povxml"), "rb") as f:
+            status, source, diags = self.conv.convert(f.read())
+        self.assertEqual(status, 0)
+        stats = self.conv.stats()
+        self.assertEqual(stats.conversions, 1)
+        # write, read, decl, delay, negotiate, submit
+        self.assertEqual(list(stats.actions), [0, 0, 6, 0, 1, 0])
+        self.assertEqual(stats.source_bytes, len(source))
+        self.assertEqual(stats.payload_bytes, 3)
+
+    def test_cache_hit(self):
+        xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+               b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+               b'<cfepov><cbid>service</cbid><replay>\n'
+               b'<negotiate><type2 /></negotiate>\n'
+               b'<write><data>hi</data></write>\n'
+               b'<write><var>nope</var></write>\n'
+               b'</replay></cfepov>\n')
+        tmp = tempfile.mkdtemp()
+        try:
+            self.conv.lib.povxml2c_set_cache_dir(self.conv.ctx, tmp.encode())
+            stored = self.conv.convert(xml)
+            stats = self.conv.stats()
+            counters = (list(stats.actions), stats.payload_bytes,
+                        stats.undefined_vars)
+            # the hit reports what the conversion that stored it did
+            self.assertEqual(self.conv.convert(xml), stored)
+            stats = self.conv.stats()
+            self.assertEqual((list(stats.actions), stats.payload_bytes,
+                              stats.undefined_vars), counters)
+            self.assertEqual(stats.undefined_vars, 1)
+            # nothing was built to estimate
+            status, cost = self.conv.cost()
+            self.assertEqual(status, 12)   # REASON_XML_CONTENT
+        finally:
+            shutil.rmtree(tmp)
+
+    def test_probes(self):
+        with open(os.path.join(TESTS_DIR, "reads_t2.povxml"), "rb") as f:
+            xml = f.read()
+        status, plain, diags = self.conv.convert(xml)
+        self.assertFalse(b"pov_probe" in plain)
+        self.conv.set_option(PovXml2c.OPT_PROBE_FD, 5)
+        status, probed, diags = self.conv.convert(xml)
+        self.assertEqual(status, 0)
+        self.assertTrue(b"transmit_all(5, buf" in probed)
+        # negotiate and every read are probed
+        self.assertEqual(probed.count(b"   pov_probe_begin("),
+                         probed.count(b"   pov_probe_end();"))
+        self.assertTrue(probed.count(b"   pov_probe_begin(") > 1)
+
+    def test_max_input(self):
+        with open(os.path.join(TESTS_DIR, "min_read_t1.povxml"), "rb") as f:
+            xml = f.read()
+        self.conv.set_option(PovXml2c.OPT_MAX_INPUT, len(xml) - 1)
+        status, source, diags = self.conv.convert(xml)
+        self.assertEqual(status, 40)   # REASON_INPUT_LIMIT
+        self.assertEqual(source, None)
+        self.conv.set_option(PovXml2c.OPT_MAX_INPUT, len(xml))
+        self.assertEqual(self.conv.convert(xml)[0], 0)
+
+    def test_limits(self):
+        xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+               b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+               b'<cfepov><cbid>service</cbid><replay>\n'
+               b'<negotiate><type2 /></negotiate>\n'
+               b'%s'
+               b'</replay></cfepov>\n')
+        writes = xml % (b'<write><data format="hex">00112233</data></write>\n' * 10)
+        # cfepov, cbid, replay, negotiate, type2 and two elements per write
+        self.conv.set_option(PovXml2c.OPT_MAX_NODES, 25)
+        self.assertEqual(self.conv.convert(writes)[0], 0)
+        self.conv.set_option(PovXml2c.OPT_MAX_NODES, 24)
+        status, source, diags = self.conv.convert(writes)
+        self.assertEqual(status, 41)
+        self.assertTrue(b"exceeds the 24 node limit" in diags[-1][2])
+        # stopped as soon as the cap is crossed, whatever follows
+        self.assertEqual(self.conv.convert(writes.replace(b"</cfepov>", b""))[0], 41)
+        self.conv.set_option(PovXml2c.OPT_MAX_NODES, 0)
+
+        self.conv.set_option(PovXml2c.OPT_MAX_DEPTH, 4)
+        self.assertEqual(self.conv.convert(writes)[0], 0)
+        self.assertEqual(self.conv.convert(xml % b'<write><data><x><y/></x></data></write>')[0], 42)
+        self.conv.set_option(PovXml2c.OPT_MAX_DEPTH, 0)
+
+        self.conv.set_option(PovXml2c.OPT_MAX_PAYLOAD, 40)
+        self.assertEqual(self.conv.convert(writes)[0], 0)
+        self.conv.set_option(PovXml2c.OPT_MAX_PAYLOAD, 39)
+        status, source, diags = self.conv.convert(writes)
+        self.assertEqual((status, source), (43, None))
+        # decoding stops at the cap, not at the end of the element
+        status, source, diags = self.conv.convert(xml % (b'<write><data>%s</data></write>\n' % (b"A" * 4096)))
+        self.assertEqual(status, 43)
+        self.assertEqual(self.conv.stats().payload_bytes, 40)
+        self.assertTrue(b"exceeds the 39 byte limit" in diags[-1][2])
+
+        # this host does not count allocations
+        self.assertEqual(self.conv.set_option(PovXml2c.OPT_MAX_ALLOC, 1 << 20), 14)
+        self.assertEqual(self.conv.set_option(PovXml2c.OPT_MAX_ALLOC, 0), 0)
+
+    def test_compressed(self):
+        with open(os.path.join(TESTS_DIR, "reads_t2.povxml"), "rb") as f:
+            xml = f.read()
+        expected = self.conv.convert(xml)
+        self.assertEqual(expected[0], 0)
+        for packed in (gzip.compress(xml), lzma.compress(xml),
+                       gzip.compress(xml[:100]) + gzip.compress(xml[100:])):
+            self.assertEqual(self.conv.convert(packed), expected)
+        # the limit applies to the decompressed document
+        self.conv.set_option(PovXml2c.OPT_MAX_INPUT, len(xml) - 1)
+        self.assertEqual(self.conv.convert(gzip.compress(xml))[0], 40)
+        self.conv.set_option(PovXml2c.OPT_MAX_INPUT, 0)
+        self.assertEqual(self.conv.convert(gzip.compress(xml)[:-20])[0], 11)
+        # zstd is recognized but not supported
+        status, source, diags = self.conv.convert(b"\x28\xb5\x2f\xfd" + xml)
+        self.assertEqual(status, 11)
+        self.assertTrue(any(b"zstd" in d[2] for d in diags))
+
+    def test_content_error(self):
+        xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+               b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+               b'<cfepov><cbid>service</cbid><replay>\n'
+               b'<negotiate><type2 /></negotiate>\n'
+               b'<read><delim format="hex">zz</delim></read>\n'
+               b'</replay></cfepov>\n')
+        status, source, diags = self.conv.convert(xml)
+        self.assertEqual(status, 12)   # REASON_XML_CONTENT
+        fails = [d for d in diags if d[0] == 1]
+        self.assertEqual(fails[0][1], 5)
+        self.assertTrue(fails[0][2].startswith(b"not ok 1 - "))
+
+    def test_external_data(self):
+        workdir = tempfile.mkdtemp(prefix="pov-xml2c-test.")
+        try:
+            with open(os.path.join(workdir, "payload.bin"), "wb") as f:
+                f.write(b"\x00\x01ABCD\xff")
+            xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+                   b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+                   b'<cfepov><cbid>service</cbid><replay>\n'
+                   b'<negotiate><type2 /></negotiate>\n'
+                   b'<write><data file="%s" offset="1" length="5"/></write>\n'
+                   b'</replay></cfepov>\n')
+            # rejected unless enabled
+            status, source, diags = self.conv.convert(xml % b"payload.bin")
+            self.assertNotEqual(status, 0)
+            self.conv.set_option(PovXml2c.OPT_EXTERNAL_DATA, 1)
+            self.conv.set_base_dir(workdir.encode())
+            status, source, diags = self.conv.convert(xml % b"payload.bin")
+            self.assertEqual(status, 0)
+            self.assertTrue(b'"\\x01\\x41\\x42\\x43\\x44"' in source)
+            # paths may not leave the PoV directory
+            status, source, diags = self.conv.convert(xml % b"../payload.bin")
+            self.assertNotEqual(status, 0)
+            status, source, diags = self.conv.convert(xml % b"missing.bin")
+            self.assertNotEqual(status, 0)
+        finally:
+            shutil.rmtree(workdir)
+
+    def test_early_writes(self):
+        xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+               b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+               b'<cfepov><cbid>service</cbid><replay>\n'
+               b'<negotiate><type2 /></negotiate>\n'
+               b'<read><delim>\\n</delim><assign><var>tok</var>'
+               b'<slice begin="0" end="-1"/></assign></read>\n'
+               b'<write><data>one</data></write>\n'
+               b'<read><delim>\\n</delim></read>\n'
+               b'<write><var>tok</var></write>\n'
+               b'</replay></cfepov>\n')
+        status, ordered, diags = self.conv.convert(xml)
+        self.assertEqual(self.conv.stats().round_trips, 2)
+        self.assertEqual(self.conv.stats().round_trips_removed, 0)
+        self.conv.set_option(PovXml2c.OPT_EARLY_WRITES, 4)
+        status, early, diags = self.conv.convert(xml)
+        self.assertEqual(status, 0)
+        # "one" goes out first, the write of tok still waits for its read
+        # but no longer for the second read
+        self.assertTrue(early.index(b"\\x6f\\x6e\\x65") <
+                        early.index(b"delimited read"))
+        self.assertTrue(early.index(b"assign to var") <
+                        early.index(b'getenv("tok"'))
+        self.assertEqual(self.conv.stats().round_trips, 1)
+        self.assertEqual(self.conv.stats().round_trips_removed, 1)
+        self.assertEqual(sorted(ordered.splitlines()),
+                         sorted(early.splitlines()))
+
+    def test_bundle(self):
+        xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+               b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+               b'<cfepov><cbid>%s</cbid><replay>\n'
+               b'<negotiate><type2 /></negotiate>\n'
+               b'<write><data>payload</data></write>\n'
+               b'<read><delim>\\n</delim><match><data>%s</data></match></read>\n'
+               b'</replay></cfepov>\n')
+        status, sources = self.conv.bundle([
+            (b"first", xml % (b"service", b"one")),
+            (b"second", xml % (b"service", b"two")),
+            (b"other", xml % (b"CROMU_00001", b"one")),
+            (b"broken", b"<cfepov>")])
+        self.assertEqual(status, 11)   # REASON_XML_BAD
+        status, sources = self.conv.bundle([
+            (b"first", xml % (b"service", b"one")),
+            (b"second", xml % (b"service", b"two")),
+            (b"other", xml % (b"CROMU_00001", b"one"))])
+        self.assertEqual(status, 0)
+        self.assertEqual(sorted(sources), [b"CROMU_00001", b"service"])
+        source = sources[b"service"]
+        self.assertTrue(source.startswith(b"#include <libpov.h>"))
+        # the shared payload is emitted once and referenced by both PoVs
+        payload = b"\\x70\\x61\\x79\\x6c\\x6f\\x61\\x64"
+        self.assertEqual(source.count(payload), 1)
+        self.assertTrue(b'{"first", pov_00000},' in source)
+        self.assertTrue(b'{"second", pov_00001},' in source)
+        self.assertEqual(source.count(b"int main("), 1)
+        self.assertFalse(b"pov_00001" in sources[b"CROMU_00001"])
+
+    def test_split(self):
+        xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+               b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+               b'<cfepov><cbid>service</cbid><replay>\n'
+               b'<negotiate><type2 /></negotiate>\n'
+               b'<write><data>one</data></write>\n'
+               b'<read><delim>\\n</delim><timeout>10</timeout></read>\n'
+               b'<write><data>%s</data></write>\n'
+               b'<delay>1</delay>\n'
+               b'<write><data>three</data></write>\n'
+               b'</replay></cfepov>\n')
+        self.conv.set_option(PovXml2c.OPT_VERIFY_ONLY, 1)
+        self.assertEqual(self.conv.convert(xml % b"two")[0], 0)
+        # negotiate, write / read, write / delay, write / submit
+        status, units = self.conv.split(2)
+        self.assertEqual(status, 0)
+        self.assertEqual([u[0] for u in units],
+                         [b"pov_main.c", b"pov_chunk_00000.c", b"pov_chunk_00001.c",
+                          b"pov_chunk_00002.c", b"pov_chunk_00003.c", b"pov.mk"])
+        main = units[0][1]
+        self.assertEqual(main.count(b"int main("), 1)
+        self.assertTrue(b"   pov_chunk_00003();\n}\n" in main)
+        # each chunk carries only the runtimes its own actions use
+        self.assertFalse(b"pov_timed_delimited_read" in units[1][1])
+        self.assertTrue(b"pov_timed_delimited_read" in units[2][1])
+        self.assertFalse(b"pov_transmit_iov" in units[4][1])
+        self.assertTrue(b"void pov_chunk_00003(void) {" in units[4][1])
+        self.assertTrue(b"$(POV_SPLIT_DIR)pov_chunk_00003.o\n" in units[5][1])
+
+        # changing an action in place changes only its own chunk
+        self.assertEqual(self.conv.convert(xml % b"TWO")[0], 0)
+        status, changed = self.conv.split(2)
+        self.assertEqual([a == b for a, b in zip(units, changed)],
+                         [True, True, False, True, True, True])
+
+        self.assertEqual(self.conv.split(0), (0, []))
+        self.conv.set_option(PovXml2c.OPT_PROBE_FD, 5)
+        self.assertEqual(self.conv.convert(xml % b"two")[0], 0)
+        self.assertEqual(self.conv.split(2)[0], 14)   # REASON_INVALID_OPT
+
+    def test_read_timeout(self):
+        xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+               b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+               b'<cfepov><cbid>service</cbid><replay>\n'
+               b'<negotiate><type2 /></negotiate>\n'
+               b'<read><delim>\\n</delim>%s</read>\n'
+               b'<read><length>4</length></read>\n'
+               b'</replay></cfepov>\n')
+        status, source, diags = self.conv.convert(xml % b"")
+        self.assertFalse(b"pov_timed" in source)
+        status, source, diags = self.conv.convert(xml % b"<timeout>250</timeout>")
+        self.assertEqual(status, 0)
+        self.assertTrue(b"fdwait(" in source)
+        self.assertTrue(b"pov_timed_delimited_read(0, &read_00000, &read_00000_len, "
+                        b"read_00000_delim, 1, 250);" in source)
+        # only the read with a timeout changes
+        self.assertTrue(b"length_read(0, read_00001, read_00001_len);" in source)
+
+    def test_fused_reads(self):
+        xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+               b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+               b'<cfepov><cbid>service</cbid><replay>\n'
+               b'<negotiate><type2 /></negotiate>\n'
+               b'<read><length>4</length><match><data>wxyz</data></match></read>\n'
+               b'<read><delim>\\n</delim><match><data>Welcome </data><data>home\\n</data></match></read>\n'
+               b'<read><delim>\\n</delim><match><data>abc</data></match></read>\n'
+               b'<read><delim>\\n</delim><match><pcre>a+</pcre></match></read>\n'
+               b'</replay></cfepov>\n')
+        status, source, diags = self.conv.convert(xml)
+        self.assertEqual(status, 0)
+        self.assertTrue(b"pov_expect_length(0, read_00000_expect, 4, 4, &read_00000_rx, "
+                        b"&read_00000_miss)" in source)
+        self.assertTrue(b"pov_expect_delimited(0, read_00001_expect, 13, read_00001_delim, 1, "
+                        b"read_00001_ring, &read_00001_rx, &read_00001_miss)" in source)
+        # each match part sees the expected bytes, or everything received on
+        # a mismatch, as it does in an unfused read
+        self.assertTrue(b"data_match(read_00001 + read_00001_ptr, read_00001_len - read_00001_ptr, "
+                        b"read_00001_expect + 0, 8);" in source)
+        self.assertTrue(b"read_00001_expect + 8, 5);" in source)
+        self.assertTrue(b"pov_expect_delimited(0, read_00002_expect, 3, " in source)
+        # a pcre still needs the whole line
+        self.assertTrue(b"delimited_read(0, &read_00003, " in source)
+        # only a full match ending at the first delimiter becomes a length read
+        self.conv.set_option(PovXml2c.OPT_FIXED_READS, 1)
+        status, source, diags = self.conv.convert(xml)
+        self.assertTrue(b"pov_expect_length(0, read_00001_expect, 13, 13, " in source)
+        self.assertTrue(b"pov_expect_delimited(0, read_00002_expect, 3, " in source)
+        # the resumable backend reads the fixed length into its buffer
+        self.conv.set_option(PovXml2c.OPT_BACKEND, PovXml2c.BACKEND_RESUMABLE)
+        status, source, diags = self.conv.convert(xml)
+        self.assertEqual(status, 0)
+        self.assertFalse(b"pov_expect_" in source)
+
+    def test_release_vars(self):
+        xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+               b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+               b'<cfepov><cbid>service</cbid><replay>\n'
+               b'<negotiate><type2 /></negotiate>\n'
+               b'<decl><var>big</var><value><data>AAAAAAAAAAAAAAAA</data></value></decl>\n'
+               b'<decl><var>copy</var><value><var>big</var></value></decl>\n'
+               b'<write><var>big</var></write>\n'
+               b'<read><delim>\\n</delim><match><data>ok\\n</data></match>'
+               b'<assign><var>tok</var><slice begin="0"/></assign></read>\n'
+               b'<read><delim>\\n</delim><assign><var>tok</var><slice begin="0"/></assign></read>\n'
+               b'<write><var>tok</var><var>nope</var></write>\n'
+               b'<read><length>4</length><assign><var>secret</var><slice begin="0"/></assign></read>\n'
+               b'<submit><var>secret</var></submit>\n'
+               b'</replay></cfepov>\n')
+        status, source, diags = self.conv.convert(xml)
+        self.assertEqual(status, 0)
+        self.assertEqual(self.conv.stats().undefined_vars, 1)
+        self.assertTrue(any(line == 10 and b"nope" in msg for sev, line, msg in diags))
+        self.assertFalse(b"not used again" in source)
+        self.assertTrue(b"declaration for copy" in source)
+
+        self.conv.set_option(PovXml2c.OPT_RELEASE_VARS, 1)
+        status, source, diags = self.conv.convert(xml)
+        self.assertEqual(status, 0)
+        # copy is never read, the first tok is overwritten before it is
+        self.assertEqual(self.conv.stats().dead_stores, 2)
+        self.assertFalse(b"declaration for copy" in source)
+        self.assertTrue(b"pov_expect_delimited(0, read_00000_expect, 3, " in source)
+        # released once, after the last use, and never after the last action
+        self.assertEqual(self.conv.stats().vars_released, 2)
+        self.assertEqual(source.count(b'putenv("big", (const unsigned char*)"", 0);'), 1)
+        self.assertTrue(source.index(b'getenv("big"') <
+                        source.index(b'putenv("big", (const unsigned char*)"", 0);') <
+                        source.index(b"read_00000"))
+        self.assertTrue(b'putenv("tok", (const unsigned char*)"", 0);' in source)
+        self.assertFalse(b'putenv("nope"' in source)
+        self.assertFalse(b'putenv("secret", (const unsigned char*)""' in source)
+
+        status, cost = self.conv.cost()
+        self.assertEqual(cost.var_peak_bytes, 16)
+
+        self.conv.set_option(PovXml2c.OPT_BACKEND, PovXml2c.BACKEND_RESUMABLE)
+        status, source, diags = self.conv.convert(xml)
+        self.assertEqual(status, 0)
+        self.assertTrue(b"pov_set_var(s, 0, NULL, 0);  //big is not used again" in source)
+
+    def test_cost(self):
+        xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+               b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+               b'<cfepov><cbid>service</cbid><replay>\n'
+               b'<negotiate><type2 /></negotiate>\n'
+               b'<decl><var>name</var><value><data>abcdef</data></value></decl>\n'
+               b'<write><data>hi </data><var>name</var></write>\n'
+               b'<delay>20</delay><delay>5</delay>\n'
+               b'<read><length>300</length><match><data>x</data></match>'
+               b'<assign><var>rest</var><slice begin="10" /></assign></read>\n'
+               b'<read><delim>\n</delim><match><data>ok\n</data></match></read>\n'
+               b'<read><delim>\n</delim><match><pcre>%s</pcre></match></read>\n'
+               b'</replay></cfepov>\n')
+        self.conv.set_option(PovXml2c.OPT_VERIFY_ONLY, 1)
+        self.assertEqual(self.conv.cost()[0], 12)   # nothing converted yet
+        self.assertEqual(self.conv.convert(xml % b"abc")[0], 0)
+        status, c = self.conv.cost()
+        self.assertEqual(status, 0)
+        # one send per write, however many segments it has
+        self.assertEqual((c.bytes_written, c.transmits), (9, 1))
+        self.assertEqual(c.delay_ms, 25)
+        # the last line is known to be no shorter than its delimiter
+        self.assertEqual((c.bytes_read, c.unknown_reads), (304, 1))
+        self.assertEqual(c.receives, 1 + 3 + 1)
+        # rest holds the 289 bytes after the match and the slice
+        self.assertEqual(c.var_peak_bytes, 6 + 289)
+        self.assertEqual((c.regexes, c.regex_risk), (1, 0))
+        # generated as it would be without verify only
+        self.conv.set_option(PovXml2c.OPT_VERIFY_ONLY, 0)
+        self.assertEqual(len(self.conv.convert(xml % b"abc")[1]), c.source_bytes)
+
+        self.conv.set_option(PovXml2c.OPT_VERIFY_ONLY, 1)
+        for expr, risk in [(b"a+b", 1), (b".*x.*", 2), (b"(\\w)\\1", 2),
+                           (b"(a+)+$", 3), (b"(ab*){2,}", 3), (b"[(+)]*", 1),
+                           (b"a{1,5}", 0)]:
+            self.assertEqual(self.conv.convert(xml % expr)[0], 0, expr)
+            status, c = self.conv.cost()
+            self.assertEqual(c.regex_risk, risk, expr)
+            self.assertEqual(c.risky_regexes, 1 if risk >= 2 else 0, expr)
+
+    def test_replay(self):
+        xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+               b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+               b'<cfepov><cbid>service</cbid><replay>\n'
+               b'<negotiate><type2 /></negotiate>\n'
+               b'<read><delim>\\n</delim><assign><var>v</var><slice begin="0" end="-1"/></assign></read>\n'
+               b'<write><data>x=</data><var>v</var><data>\\n</data></write>\n'
+               b'<read><length>6</length><match><data>x=%s\\n</data></match></read>\n'
+               b'</replay></cfepov>\n')
+        service = "read l; echo \"$l\""
+        self.conv.set_option(PovXml2c.OPT_VERIFY_ONLY, 1)
+        for banner, expected in ((b"abc", 0), (b"xyz", 50)):
+            status, source, diags = self.conv.convert(xml % banner)
+            self.assertEqual(status, 0)
+            proc = subprocess.Popen(["/bin/sh", "-c", "echo abc; " + service],
+                                    stdin=subprocess.PIPE,
+                                    stdout=subprocess.PIPE)
+            status, diags = self.conv.replay(proc.stdin.fileno(),
+                                             proc.stdout.fileno())
+            proc.stdin.close()
+            proc.wait()
+            proc.stdout.close()
+            self.assertEqual(status, expected)
+            results = [d for d in diags if d[0] in (0, 1)]
+            self.assertEqual(len(results), 5)
+            # the failed match is reported against its line
+            failed = [d for d in results if d[0] == 1]
+            self.assertEqual([d[1] for d in failed], [7] if expected else [])
+            self.assertTrue(b"ms)" in results[-1][2])
+
+    def test_simulate(self):
+        xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+               b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+               b'<cfepov><cbid>service</cbid><replay>\n'
+               b'<negotiate><type2 /></negotiate>\n'
+               b'<read><delim>\\n</delim>'
+               b'<assign><var>tok</var><pcre group="1">token=([0-9]+)</pcre></assign></read>\n'
+               b'<decl><var>reply</var><value><data>id </data><var>tok</var></value></decl>\n'
+               b'<write><var>reply</var><data>\\n</data></write>\n'
+               b'<delay>60000</delay>\n'
+               b'<read><length>2</length><match><data>ok</data></match></read>\n'
+               b'</replay></cfepov>\n')
+        self.conv.set_option(PovXml2c.OPT_VERIFY_ONLY, 1)
+        status, source, diags = self.conv.convert(xml)
+        self.assertEqual(status, 0)
+        status, diags = self.conv.simulate(b"token=1234\nok trailing")
+        self.assertEqual(status, 0)
+        messages = b"".join(d[2] for d in diags)
+        self.assertTrue(b'tok = "1234"' in messages)
+        self.assertTrue(b'sends "id 1234\\n"' in messages)
+        self.assertTrue(b"9 of 22 transcript bytes were not read" in messages)
+        # a transcript the PoV does not match fails on the line of the read
+        status, diags = self.conv.simulate(b"token=1234\nno")
+        self.assertEqual(status, 50)
+        self.assertEqual([d[1] for d in diags if d[0] == 1], [9])
+
+    def test_resumable_backend(self):
+        xml = (b'<?xml version="1.0" standalone="no" ?>\n'
+               b'<!DOCTYPE cfepov SYSTEM "/usr/share/cgc-docs/cfe-pov.dtd">\n'
+               b'<cfepov><cbid>service</cbid><replay>\n'
+               b'<negotiate><type2 /></negotiate>\n'
+               b'<read><delim>\\n</delim><assign><var>v</var><slice begin="0" end="-1"/></assign></read>\n'
+               b'<write><data>x=</data><var>v</var><data>\\n</data></write>\n'
+               b'<read><length>6</length><match><data>x=%s\\n</data></match></read>\n'
+               b'<delay>1</delay>\n'
+               b'</replay></cfepov>\n')
+        self.conv.set_option(PovXml2c.OPT_BACKEND, PovXml2c.BACKEND_RESUMABLE)
+        status, source, diags = self.conv.convert(xml % b"abc")
+        self.assertEqual(status, 0)
+        self.assertFalse(b"libpov.h" in source)
+        self.assertTrue(b"int pov_step(pov_session *s, unsigned long long now)" in source)
+        self.assertTrue(b"#define POV_VARS 1\n" in source)
+        # the constant slice is inlined and the read buffer handed to v
+        self.assertTrue(b"unsigned int read_00000_to = read_00000_avail > 1u ? read_00000_avail - 1u : 0;\n" in source)
+        self.assertTrue(b"pov_adopt(s, 0, read_00000_from, read_00000_to);\n" in source)
+        for state in range(5):
+            self.assertTrue(b"case %d: {" % state in source)
+        self.assertEqual(self.conv.set_option(PovXml2c.OPT_BACKEND, 2), 14)   # REASON_INVALID_OPT
+
+        if shutil.which("gcc") is None:
+            self.skipTest("no C compiler")
+        workdir = tempfile.mkdtemp(prefix="pov-xml2c-test.")
+        listener = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        try:
+            path = os.path.join(workdir, "service.sock")
+            listener.bind(path)
+            listener.listen(64)
+
+            def serve():
+                while True:
+                    try:
+                        conn, _ = listener.accept()
+                    except OSError:
+                        return
+                    f = conn.makefile("rwb")
+                    f.write(b"abc\n")
+                    f.flush()
+                    f.write(f.readline())
+                    f.close()
+                    conn.close()
+            threading.Thread(target=serve, daemon=True).start()
+
+            for banner, expected in ((b"abc", 0), (b"xyz", 1)):
+                status, source, diags = self.conv.convert(xml % banner)
+                src = os.path.join(workdir, "pov.c")
+                exe = os.path.join(workdir, "pov")
+                with open(src, "wb") as f:
+                    f.write(source)
+                subprocess.check_call(["gcc", "-DPOV_DRIVER", "-o", exe, src])
+                proc = subprocess.Popen([exe, "unix:" + path, "40", "8"],
+                                        stdout=subprocess.PIPE)
+                out = proc.communicate(timeout=30)[0]
+                self.assertEqual(proc.returncode, expected)
+                self.assertTrue(out.startswith(b"sessions 40, connect errors 0, "
+                                               b"sessions with failed matches %d,"
+                                               % (40 * expected)))
+        finally:
+            listener.close()
+            shutil.rmtree(workdir)
+
+
 if __name__ == '__main__':
     unittest.main()
@@ -19,6 +19,8 @@
 #include "utils.h"
 #include "logging.h"
 
+__thread UtilCounters utilCounters;
+
 pcre *init_regex(char *pattern) {
    pcre *regex;
    const char *error;
@@ -31,9 +33,22 @@ pcre *init_regex(char *pattern) {
       log_fail("regex compilation for: %s\n# failed at offset %d: %s\n", pattern, erroffset, error);
       throw (int)INVALID_REGEX;
    }
+   utilCounters.regexesCompiled++;
    return regex;
 }
 
+/*
+ * True once pending more decoded bytes would pass the payload cap, in which
+ * case they are counted so that the caller's context sees the cap crossed
+ */
+static bool overDecodedLimit(uint64_t pending) {
+   if (utilCounters.decodedLimit != 0 && utilCounters.decodedBytes + pending > utilCounters.decodedLimit) {
+      utilCounters.decodedBytes += pending;
+      return true;
+   }
+   return false;
+}
+
 static int hexValue(char ch) {
    if (isxdigit(ch)) {
       if (isdigit(ch)) {
@@ -83,8 +98,13 @@ uint8_t *parseHexBinary(const char *hex, uint32_t *len) {
          }
          i += 2;
          (*len)++;
+         if (overDecodedLimit(*len)) {
+            delete [] res;
+            throw (int)LIMIT_EXCEEDED;
+         }
       }      
    }
+   utilCounters.decodedBytes += *len;
    return res;
 }
 
@@ -99,9 +119,14 @@ vector<uint8_t> *parseHexBinary(const char *hex) {
             delete res;
             throw ex;
          }
+         if (overDecodedLimit(res->size())) {
+            delete res;
+            throw (int)LIMIT_EXCEEDED;
+         }
          i++;
       }      
    }
+   utilCounters.decodedBytes += res->size();
    return res;
 }
 
@@ -168,8 +193,13 @@ uint8_t *unescapeAscii(const char *asc, uint32_t *len) {
             state = 0;
             break;
       }
+      if (overDecodedLimit(alen)) {
+         delete [] res;
+         throw (int)LIMIT_EXCEEDED;
+      }
    }
    *len = alen;
+   utilCounters.decodedBytes += alen;
    return res;
 }
 
@@ -235,7 +265,12 @@ vector<uint8_t> *unescapeAscii(const char *asc) {
             state = 0;
             break;
       }
+      if (overDecodedLimit(res->size())) {
+         delete res;
+         throw (int)LIMIT_EXCEEDED;
+      }
    }
+   utilCounters.decodedBytes += res->size();
    return res;
 }
 
@@ -270,7 +305,8 @@ char *getAttributeText(xmlNode *n, const char *name) {
 bool getIntAttribute(xmlNode *n, const char *attr, int defValue, int *value) {
    *value = defValue;
    if (n != NULL) {
-      char *attrText = (char*)xmlGetProp(n, (xmlChar*)attr);
+      XmlString text(xmlGetProp(n, (xmlChar*)attr));
+      char *attrText = text.get();
       if (attrText != NULL) {
          char *endptr;
          int res = strtol(attrText, &endptr, 10);
@@ -285,7 +321,6 @@ bool getIntAttribute(xmlNode *n, const char *attr, int defValue, int *value) {
             endptr++;
          }
          *value = res;
-         xmlFree(attrText);
          return true;
       }
    }
@@ -295,7 +330,8 @@ bool getIntAttribute(xmlNode *n, const char *attr, int defValue, int *value) {
 bool getUintAttribute(xmlNode *n, const char *attr, uint32_t defValue, uint32_t *value) {
    *value = defValue;
    if (n != NULL) {
-      char *attrText = (char*)xmlGetProp(n, (xmlChar*)attr);
+      XmlString text(xmlGetProp(n, (xmlChar*)attr));
+      char *attrText = text.get();
       if (attrText != NULL) {
          char *endptr;
          uint32_t res = strtoul(attrText, &endptr, 10);
@@ -310,7 +346,6 @@ bool getUintAttribute(xmlNode *n, const char *attr, uint32_t defValue, uint32_t
             endptr++;
          }
          *value = res;
-         xmlFree(attrText);
          return true;
       }
    }
@@ -324,7 +359,8 @@ int32_t getIntChild(xmlNode *n, const char *tag, int32_t defaultVal) {
    }
    uint32_t len;
    char *endptr;
-   char *data = (char*)getNodeText(c, &len);
+   XmlString text(getNodeText(c, &len));
+   char *data = text.get();
    if (len == 0) {
       log_fail("<%s> element contains no data at line %d\n", c->name, c->line);
       throw (int)INVALID_INT;
@@ -338,7 +374,6 @@ int32_t getIntChild(xmlNode *n, const char *tag, int32_t defaultVal) {
       }
       endptr++;
    }
-   xmlFree(data);
    return res;
 }
 
@@ -349,7 +384,8 @@ uint32_t getUintChild(xmlNode *n, const char *tag, uint32_t defaultVal) {
    }
    uint32_t len;
    char *endptr;
-   char *data = (char*)getNodeText(c, &len);
+   XmlString text(getNodeText(c, &len));
+   char *data = text.get();
    if (len == 0) {
       log_fail("<%s> element contains no data at line %d\n", c->name, c->line);
       throw (int)INVALID_UINT;
@@ -363,7 +399,6 @@ uint32_t getUintChild(xmlNode *n, const char *tag, uint32_t defaultVal) {
       }
       endptr++;
    }
-   xmlFree(data);
    return res;
 }
 
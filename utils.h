@@ -9,6 +9,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <libxml/tree.h>
+#include <libxml/globals.h>
 #include <pcre.h>
 #include <vector>
 
@@ -21,7 +22,102 @@ enum {
    INVALID_REGEX,
    PARSE_ERROR,
    PARSE_TIMEOUT,
-   PLAY_TIMEOUT
+   PLAY_TIMEOUT,
+   //a conversion cap was crossed, Xml2cContext::overLimit has the reason
+   LIMIT_EXCEEDED
+};
+
+/*
+ * Per thread work counters, reported in conversion statistics.  Whoever
+ * runs a conversion on the thread resets them first.
+ */
+struct UtilCounters {
+   uint64_t decodedBytes;
+   uint64_t regexesCompiled;
+   //decoding past this many bytes throws LIMIT_EXCEEDED, 0 for no cap
+   uint64_t decodedLimit;
+};
+
+extern __thread UtilCounters utilCounters;
+
+/*
+ * Owning handles.  The element parsers throw on the first error they find,
+ * so everything they allocate is held by one of these until it belongs to
+ * the finished object, and is released on every way out of the parser.
+ */
+
+//a string or buffer allocated by libxml2, released with xmlFree
+class XmlString {
+private:
+   char *str;
+
+   //disable copy
+   XmlString(const XmlString &s);
+   const XmlString &operator=(const XmlString &s);
+
+public:
+   explicit XmlString(char *s = NULL) : str(s) {};
+   explicit XmlString(xmlChar *s) : str((char*)s) {};
+   ~XmlString() {reset();};
+   char *get() const {return str;};
+   void reset(char *s = NULL) {
+      if (str != NULL) {
+         xmlFree(str);
+      }
+      str = s;
+   };
+};
+
+//an object allocated with new
+template <typename T>
+class Owned {
+private:
+   T *ptr;
+
+   //disable copy
+   Owned(const Owned &o);
+   const Owned &operator=(const Owned &o);
+
+public:
+   explicit Owned(T *p = NULL) : ptr(p) {};
+   ~Owned() {delete ptr;};
+   T *get() const {return ptr;};
+   T *operator->() const {return ptr;};
+   T &operator*() const {return *ptr;};
+   void reset(T *p = NULL) {
+      if (p != ptr) {
+         delete ptr;
+         ptr = p;
+      }
+   };
+   //hand the object to a new owner
+   T *release() {
+      T *p = ptr;
+      ptr = NULL;
+      return p;
+   };
+};
+
+/*
+ * A vector owning the objects its elements point to, deleted by clear() and
+ * on destruction.  erase and insert only move pointers around.
+ */
+template <typename T>
+class OwnedVector : public vector<T*> {
+private:
+   //disable copy
+   OwnedVector(const OwnedVector &v);
+   const OwnedVector &operator=(const OwnedVector &v);
+
+public:
+   OwnedVector() {};
+   ~OwnedVector() {clear();};
+   void clear() {
+      for (typename vector<T*>::iterator i = this->begin(); i != this->end(); i++) {
+         delete *i;
+      }
+      vector<T*>::clear();
+   };
 };
 
 pcre *init_regex(char *pattern);
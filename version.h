@@ -0,0 +1,12 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_VERSION_H
+#define __XML2C_VERSION_H
+
+//bump whenever generated source changes for the same input
+#define XML2C_VERSION "10551-cfe-rc15"
+
+#endif
@@ -1,12 +1,12 @@
 /*
  * Id:             $Id: xml2c.cc 6829 2015-06-12 05:37:32Z cseagle $
- * Last Updated:   $LastChangedDate: 2015-06-12 05:37:32 +0000 (Fri, 12 Jun 2015) $ 
+ * Last Updated:   $LastChangedDate: 2015-06-12 05:37:32 +0000 (Fri, 12 Jun 2015) $
  */
- 
+
 /*
  pov-xml2c is a utility for converting xml PoV specifications into C source
  compatible with the DECREE platform.  When linked against provided support
- libraries, the end result is a DECREE executable that performs all of the 
+ libraries, the end result is a DECREE executable that performs all of the
  actions specified in the input xml specification.
 
  Usage:
@@ -15,6 +15,9 @@
     3. cd into projects
     4. make
     5. generated executable will be found in projects/bin
+
+ This file holds the conversion itself and the libpovxml2c interface to it,
+ see povxml2c.h.  The command line front end lives in xml2c_cli.cc.
 */
 
 #include <stdio.h>
@@ -23,70 +26,280 @@
 #include <time.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/resource.h>
 #include <ctype.h>
 #include <errno.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
+#include <libxml/valid.h>
+#include <libxml/hash.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <signal.h>
+#include <pthread.h>
+#include <limits.h>
 
 #include <vector>
+#include <string>
 
 using std::vector;
+using std::string;
 
 #include "utils.h"
+#include "logging.h"
 #include "xml2c_delay.h"
 #include "xml2c_read.h"
 #include "xml2c_write.h"
 #include "xml2c_var.h"
 #include "xml2c_negotiate.h"
+#include "xml2c_context.h"
+#include "xml2c_probe.h"
+#include "xml2c_schedule.h"
+#include "xml2c_liveness.h"
+#include "xml2c_replay.h"
+#include "xml2c_resumable.h"
+#include "xml2c_bundle.h"
+#include "xml2c_split.h"
+#include "xml2c_inflate.h"
+#include "xml2c_cost.h"
+#include "cache.h"
+#include "version.h"
 
 #include "reasons.h"
 
 #define CGC_REPLAY_DTD "/usr/share/cgc-docs/cfe-pov.dtd"
+#define READ_CHUNK (64 * 1024)
+
+static xmlExternalEntityLoader default_XEE_loader;
+
+//parsed once and shared read only by every conversion
+static xmlDtdPtr sharedDtd = NULL;
+//sharedDtd plus the external data attributes of <data>
+static xmlDtdPtr externalDtd = NULL;
+static pthread_once_t initOnce = PTHREAD_ONCE_INIT;
+//cost of initLibrary, handed to the first context created
+static double libraryInitWall;
+static double libraryInitCpu;
+static int libraryInitClaimed = 0;
+
+static double nowSeconds() {
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double threadCpuSeconds() {
+   struct timespec ts;
+   clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * High water mark of this process image.  ru_maxrss carries over the parent's
+ * usage across fork and exec, VmHWM does not, so prefer it where available.
+ */
+static long peakRssKb() {
+   long kb = -1;
+   FILE *f = fopen("/proc/self/status", "r");
+   if (f != NULL) {
+      char line[256];
+      while (fgets(line, sizeof(line), f) != NULL) {
+         if (sscanf(line, "VmHWM: %ld", &kb) == 1) {
+            break;
+         }
+      }
+      fclose(f);
+   }
+   if (kb < 0) {
+      struct rusage ru;
+      kb = getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : 0;
+   }
+   return kb;
+}
+
+/*
+ * Charges the wall and cpu time of its scope to one conversion phase
+ */
+class PhaseTimer {
+private:
+   povxml2c_stats *stats;
+   int phase;
+   double wall;
+   double cpu;
+
+public:
+   PhaseTimer(povxml2c_stats *s, int p) : stats(s), phase(p), wall(nowSeconds()), cpu(threadCpuSeconds()) {};
+   ~PhaseTimer() {
+      stats->wall[phase] += nowSeconds() - wall;
+      stats->cpu[phase] += threadCpuSeconds() - cpu;
+   }
+};
 
-vector<Action*> pov;
+Xml2cContext::Xml2cContext() {
+   verifyOnly = false;
+   echoEnable = false;
+   parseTimeout = 0;
+   deadlineMs = 0;
+   cacheSize = DEFAULT_CACHE_SIZE;
+   maxInput = 0;
+   probeFd = -1;
+   externalData = false;
+   earlyWrites = 0;
+   backend = POVXML2C_BACKEND_MAIN;
+   fixedReads = false;
+   releaseVars = false;
+   maxNodes = 0;
+   maxDepth = 0;
+   maxPayload = 0;
+   maxAlloc = 0;
+   timedReads = false;
+   fusedReads = false;
+   stepRegexes = false;
+   bundle = NULL;
+   readId = writeId = varId = valueId = 0;
+   currentLine = 0;
+   deadline = 0;
+   allocBase = 0;
+   limitReason = REASON_SUCCESS;
+   initWall = initCpu = 0;
+   memset(&stats, 0, sizeof(stats));
+}
+
+Xml2cContext::~Xml2cContext() {
+   reset();
+}
+
+void Xml2cContext::reset() {
+   pov.clear();
+   cbid.clear();
+   clearDiags();
+   readId = writeId = varId = valueId = 0;
+   timedReads = false;
+   fusedReads = false;
+   varSlots.clear();
+   stepRegexes = false;
+   currentLine = 0;
+   double now = nowSeconds();
+   deadline = parseTimeout > 0 ? now + parseTimeout : 0;
+   if (deadlineMs > 0 && (deadline == 0 || now + deadlineMs / 1000.0 < deadline)) {
+      deadline = now + deadlineMs / 1000.0;
+   }
+   allocBase = xml2cAllocBytes ? xml2cAllocBytes() : 0;
+   limitReason = REASON_SUCCESS;
+   memset(&stats, 0, sizeof(stats));
+}
+
+void Xml2cContext::clearDiags() {
+   diags.clear();
+   diagView.clear();
+}
+
+unsigned int Xml2cContext::varSlot(const string &name) {
+   map<string, unsigned int>::iterator i = varSlots.find(name);
+   if (i != varSlots.end()) {
+      return i->second;
+   }
+   unsigned int slot = varSlots.size();
+   varSlots[name] = slot;
+   return slot;
+}
 
-static int parseTimeout = 10;
+bool Xml2cContext::expired() {
+   return deadline != 0 && nowSeconds() > deadline;
+}
 
-xmlExternalEntityLoader default_XEE_loader;
+bool Xml2cContext::overLimit() {
+   if (limitReason != REASON_SUCCESS) {
+      return true;
+   }
+   if (maxPayload != 0 && utilCounters.decodedBytes > maxPayload) {
+      log_note("pov-xml2c decoded data exceeds the %llu byte limit\n", maxPayload);
+      limitReason = REASON_PAYLOAD_LIMIT;
+   }
+   else if (maxAlloc != 0 && xml2cAllocBytes && xml2cAllocBytes() - allocBase > maxAlloc) {
+      log_note("pov-xml2c conversion allocates more than the %llu byte limit\n", maxAlloc);
+      limitReason = REASON_ALLOC_LIMIT;
+   }
+   return limitReason != REASON_SUCCESS;
+}
 
-static void parse_alarm_handler(int) {
-   throw (int)PARSE_TIMEOUT;
+void Xml2cContext::message(int severity, const char *text) {
+   Xml2cDiag d;
+   d.severity = severity;
+   d.line = currentLine;
+   d.message = text;
+   diags.push_back(d);
+}
+
+const povxml2c_diag *Xml2cContext::diag(size_t idx) {
+   if (idx >= diags.size()) {
+      return NULL;
+   }
+   if (diagView.size() != diags.size()) {
+      diagView.clear();
+      for (vector<Xml2cDiag>::iterator i = diags.begin(); i != diags.end(); i++) {
+         povxml2c_diag d;
+         d.severity = i->severity;
+         d.line = i->line;
+         d.message = i->message.c_str();
+         diagView.push_back(d);
+      }
+   }
+   return &diagView[idx];
 }
 
 /*
  * Iterate over PoV nodes to generate corresponding source
  */
-int generateSource(FILE *outfile) {
+int generateSource(Xml2cContext *ctx, FILE *outfile) {
+   if (ctx->backend == POVXML2C_BACKEND_RESUMABLE) {
+      return generateResumable(ctx, outfile);
+   }
    //all the headers we will need
    fprintf(outfile, "#include <libpov.h>\n");
+   if (ctx->writeId > 0) {
+      generateWriteRuntime(outfile);
+   }
+   if (ctx->timedReads) {
+      generateReadRuntime(outfile);
+   }
+   if (ctx->fusedReads) {
+      generateExpectRuntime(outfile);
+   }
+   if (ctx->probeFd >= 0) {
+      generateProbeRuntime(outfile, ctx->probeFd);
+   }
    fprintf(outfile, "int main(void) {\n");
+   generateActions(ctx, outfile);
+   fprintf(outfile, "}\n");
+   return 0;
+}
 
-   int povType = 0;
+void generateActions(Xml2cContext *ctx, FILE *outfile) {
+   if (ctx->probeFd >= 0) {
+      generateProbeInit(outfile);
+   }
 
-   for (vector<Action*>::iterator i = pov.begin(); i != pov.end(); i++) {
+   unsigned int idx = 0;
+
+   for (vector<Action*>::iterator i = ctx->pov.begin(); i != ctx->pov.end(); i++, idx++) {
       Action *a = *i;
-      Xml2cNegotiate *neg = dynamic_cast<Xml2cNegotiate*>(a);
-      if (neg != NULL) {
-         povType = neg->getType();
-      }
-      else {
-         PovSubmit *sub = dynamic_cast<PovSubmit*>(a);
-         if (sub != NULL) {
-            sub->setType(povType);
-         }
+      bool probed = ctx->probeFd >= 0 && isProbed(a);
+      if (probed) {
+         generateProbeBegin(outfile, idx, a);
       }
-      
       a->generate(outfile);
+      if (probed) {
+         generateProbeEnd(outfile);
+      }
+      generateReleases(outfile, a);
    }
 
-   fprintf(outfile, "}\n");
-   return 0;
-}   
+   if (ctx->probeFd >= 0) {
+      generateProbeDump(outfile);
+   }
+}
 
-bool buildPoV(xmlNode *pov_xml, bool echoEnable) {
+bool buildPoV(Xml2cContext *ctx, xmlNode *pov_xml) {
    bool isType2 = false;
    bool hasSubmit = false;
    xmlNode *serviceNode = findChild(pov_xml, "cbid");
@@ -94,45 +307,78 @@ bool buildPoV(xmlNode *pov_xml, bool echoEnable) {
    //The "seed" element is ignored in PoVs.
    unsigned int len;
    unsigned int errorCount = 0;
-   char *text = getNodeText(serviceNode, &len);
-   xmlFree(text);
+   XmlString text(getNodeText(serviceNode, &len));
+   ctx->cbid = text.get() != NULL ? text.get() : "";
    for (xmlNode *child = povNode->children; child != NULL; child = child->next) {
       char *type = (char*)child->name;
+      size_t built = ctx->pov.size();
+      ctx->currentLine = child->line;
       try {
+         if (ctx->expired()) {
+            throw (int)PARSE_TIMEOUT;
+         }
+         if (ctx->overLimit()) {
+            throw (int)LIMIT_EXCEEDED;
+         }
          if (strcmp(type, "write") == 0) {
-            pov.push_back(new Xml2cWrite(child, echoEnable));
+            ctx->pov.push_back(new Xml2cWrite(child, ctx));
          }
          else if (strcmp(type, "read") == 0) {
-            pov.push_back(new Xml2cRead(child, echoEnable));
+            ctx->pov.push_back(new Xml2cRead(child, ctx));
          }
          else if (strcmp(type, "delay") == 0) {
-            pov.push_back(new Xml2cDelay(child));
+            ctx->pov.push_back(new Xml2cDelay(child, ctx));
          }
          else if (strcmp(type, "decl") == 0) {
-            pov.push_back(new Xml2cVar(child));
+            ctx->pov.push_back(new Xml2cVar(child, ctx));
          }
          else if (strcmp(type, "negotiate") == 0) {
-            Xml2cNegotiate *negotiate = new Xml2cNegotiate(child);
+            Xml2cNegotiate *negotiate = new Xml2cNegotiate(child, ctx);
             isType2 = negotiate->getType() == 2;
-            pov.push_back(negotiate);
+            ctx->pov.push_back(negotiate);
          }
          else if (strcmp(type, "submit") == 0) {
-            pov.push_back(new PovSubmit(child));
+            ctx->pov.push_back(new PovSubmit(child, ctx));
             hasSubmit = true;
          }
+         if (ctx->pov.size() > built) {
+            Action *a = ctx->pov.back();
+            a->line = child->line;
+            ctx->stats.actions[a->actionType()]++;
+         }
       } catch (int ex) {
          errorCount++;
-         if (ex == PARSE_TIMEOUT) {
+         if (ex == PARSE_TIMEOUT || ex == LIMIT_EXCEEDED) {
             throw ex;
          }
       }
    }
+   ctx->currentLine = 0;
+   //the last element decoded too
+   if (ctx->overLimit()) {
+      throw (int)LIMIT_EXCEEDED;
+   }
    //make certain there is always at least a default submit for type 2 povs
    if (isType2 && !hasSubmit) {
-      pov.push_back(new PovSubmit());
+      ctx->pov.push_back(new PovSubmit(ctx));
+      ctx->stats.actions[POVXML2C_ACTION_SUBMIT]++;
+   }
+   //submissions depend on the type negotiated ahead of them
+   int povType = 0;
+   for (vector<Action*>::iterator i = ctx->pov.begin(); i != ctx->pov.end(); i++) {
+      Xml2cNegotiate *neg = dynamic_cast<Xml2cNegotiate*>(*i);
+      if (neg != NULL) {
+         povType = neg->getType();
+      }
+      else {
+         PovSubmit *sub = dynamic_cast<PovSubmit*>(*i);
+         if (sub != NULL) {
+            sub->setType(povType);
+         }
+      }
    }
    return errorCount == 0;
-}   
+}
 
 //assure that we never load external entities
 xmlParserInputPtr null_XEE_loader(const char *URL,  const char *ID, xmlParserCtxtPtr context) {
@@ -144,185 +390,1037 @@ xmlParserInputPtr null_XEE_loader(const char *URL,  const char *ID, xmlParserCtx
    }
 }
 
-//added to support analysis
-void doDoc(xmlParserCtxtPtr ctxt, int xmlFd, xmlDocPtr *retval){
-   /* parse the file, activating the DTD validation option */
-   /* disallow network access */
+static void buildContentModel(void *payload, void *data, const xmlChar *name) {
+   xmlElementPtr elem = (xmlElementPtr)payload;
+   if (elem->type == XML_ELEMENT_DECL && elem->etype == XML_ELEMENT_TYPE_ELEMENT) {
+      xmlValidBuildContentModel((xmlValidCtxtPtr)data, elem);
+   }
+}
+
+/*
+ * <data file="..." offset="..." length="..."/> is outside cfe-pov.dtd, so
+ * documents using it validate against an extended copy of the DTD
+ */
+static xmlDtdPtr buildExternalDtd(xmlDtdPtr dtd) {
+   static const char *attrs[] = {"file", "offset", "length"};
+   xmlDtdPtr ext = xmlCopyDtd(dtd);
+   if (ext == NULL) {
+      return NULL;
+   }
+   xmlValidCtxtPtr vctxt = xmlNewValidCtxt();
+   for (size_t i = 0; i < sizeof(attrs) / sizeof(attrs[0]); i++) {
+      xmlAddAttributeDecl(vctxt, ext, (xmlChar*)"data", (xmlChar*)attrs[i], NULL,
+                          XML_ATTRIBUTE_CDATA, XML_ATTRIBUTE_IMPLIED, NULL, NULL);
+   }
+   if (ext->elements != NULL) {
+      xmlHashScan((xmlHashTablePtr)ext->elements, buildContentModel, vctxt);
+   }
+   xmlFreeValidCtxt(vctxt);
+   return ext;
+}
+
+static void initLibrary() {
+   double wall = nowSeconds();
+   double cpu = threadCpuSeconds();
+   xmlInitParser();
+   //Forbid external entities
+   default_XEE_loader = xmlGetExternalEntityLoader();
+   xmlSetExternalEntityLoader(null_XEE_loader);
+   sharedDtd = xmlParseDTD(NULL, (xmlChar*)CGC_REPLAY_DTD);
+   if (sharedDtd != NULL && sharedDtd->elements != NULL) {
+      //validation builds content models lazily, do it now so that
+      //concurrent conversions only ever read the shared dtd
+      xmlValidCtxtPtr vctxt = xmlNewValidCtxt();
+      xmlHashScan((xmlHashTablePtr)sharedDtd->elements, buildContentModel, vctxt);
+      xmlFreeValidCtxt(vctxt);
+      externalDtd = buildExternalDtd(sharedDtd);
+   }
+   libraryInitWall = nowSeconds() - wall;
+   libraryInitCpu = threadCpuSeconds() - cpu;
+}
 
-   *retval = xmlCtxtReadFd(ctxt, xmlFd, "", NULL, XML_PARSE_NONET);
+static void xmlErrorToLog(void *userData, xmlErrorPtr err) {
+   const char *file = err->file != NULL ? err->file : "";
+   const char *msg = err->message != NULL ? err->message : "unknown error\n";
+   //nothing is formatted for a failed allocation
+   if (err->message == NULL && err->domain != XML_FROM_NONE && err->code == XML_ERR_NO_MEMORY) {
+      msg = "out of memory\n";
+   }
+   int saved = 0;
+   Xml2cContext *ctx = (Xml2cContext*)userData;
+   if (ctx != NULL) {
+      saved = ctx->currentLine;
+      ctx->currentLine = err->line;
+   }
+   log_note("%s:%d: %s", file, err->line, msg);
+   if (ctx != NULL) {
+      ctx->currentLine = saved;
+   }
+}
 
+//added to support analysis
+void doDoc(xmlDocPtr *retval, xmlDtdPtr dtd) {
    if (*retval != NULL) {
-      xmlDtdPtr dtd = xmlParseDTD(NULL, (xmlChar*)CGC_REPLAY_DTD);
       if (dtd == NULL) {
-         fprintf(stderr, "Failed to parse DTD\n");
+         log_note("Failed to parse DTD\n");
          xmlFreeDoc(*retval);
          *retval = NULL;
+         return;
       }
       xmlValidCtxtPtr vctxt = xmlNewValidCtxt();
-      vctxt->userData = (void *) stderr;
-      vctxt->error    = (xmlValidityErrorFunc) fprintf;
-      vctxt->warning  = (xmlValidityWarningFunc) fprintf;
       if (xmlValidateDtd(vctxt, *retval, dtd) == 0) {
-         fprintf(stderr, "Failed to validate xml against DTD\n");
+         log_note("Failed to validate xml against DTD\n");
          xmlFreeDoc(*retval);
          *retval = NULL;
       }
-      xmlFreeDtd(dtd);
+      xmlFreeValidCtxt(vctxt);
+   }
+}
+
+/*
+ * Every option that can change the generated source must be reflected here
+ */
+static string generatorOptions(Xml2cContext *ctx) {
+   char buf[256];
+   snprintf(buf, sizeof(buf), "version=%s;echo=%d;probes=%d;early=%u;backend=%d;fixed=%d;release=%d", XML2C_VERSION,
+            ctx->echoEnable, ctx->probeFd, ctx->earlyWrites, ctx->backend, ctx->fixedReads, ctx->releaseVars);
+   return buf;
+}
+
+static char *generateToBuffer(Xml2cContext *ctx, size_t *len, int *result) {
+   char *src = NULL;
+   FILE *mem = open_memstream(&src, len);
+   if (mem == NULL) {
+      log_error("open_memstream");
+      *result = REASON_LIBXML_FAIL;
+      return NULL;
+   }
+   *result = generateSource(ctx, mem);
+   fclose(mem);
+   if (*result != REASON_SUCCESS) {
+      free(src);
+      src = NULL;
    }
+   return src;
 }
 
-void usage(const char *cmd, int reason) {
-   fprintf(stderr, "usage: %s [options] -x xml-file\n", cmd);
-   fprintf(stderr, "  -h Display this usage statement\n");
-   fprintf(stderr, "  -o Output file name.  Defaults to stdout\n");
-   fprintf(stderr, "  -v verify the xml against cfe-pov.dtd\n");
-   fprintf(stderr, "  -t Timeout alarm value for parsing xml.\n");
-   fprintf(stderr, "  -x xml pov file.\n");
-   exit(reason);
+/*
+ * What building a PoV reports besides its source: the counters the build
+ * phases set and the diagnostics logged from firstDiag on.  It is stored
+ * with the cache entry, so that a hit reports what the conversion that
+ * stored it did.
+ */
+static string buildRecord(Xml2cContext *ctx, size_t firstDiag) {
+   string rec;
+   char buf[64];
+   for (int i = 0; i < POVXML2C_ACTION_TYPES; i++) {
+      snprintf(buf, sizeof(buf), "%llu ", ctx->stats.actions[i]);
+      rec += buf;
+   }
+   snprintf(buf, sizeof(buf), "%llu %llu ", (unsigned long long)utilCounters.decodedBytes,
+            (unsigned long long)utilCounters.regexesCompiled);
+   rec += buf;
+   snprintf(buf, sizeof(buf), "%llu %llu %llu %llu %llu\n", ctx->stats.round_trips,
+            ctx->stats.round_trips_removed, ctx->stats.undefined_vars, ctx->stats.vars_released,
+            ctx->stats.dead_stores);
+   rec += buf;
+   for (size_t i = firstDiag; i < ctx->diags.size(); i++) {
+      snprintf(buf, sizeof(buf), "%d %d %u\n", ctx->diags[i].severity, ctx->diags[i].line,
+               (unsigned int)ctx->diags[i].message.size());
+      rec += buf;
+      rec += ctx->diags[i].message;
+   }
+   return rec;
+}
+
+//false if the record is not one buildRecord wrote
+static bool restoreBuild(Xml2cContext *ctx, const string &rec) {
+   const char *p = rec.c_str();
+   const char *end = p + rec.size();
+   char *next;
+   unsigned long long counters[POVXML2C_ACTION_TYPES + 7];
+   for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+      counters[i] = strtoull(p, &next, 10);
+      if (next == p) {
+         return false;
+      }
+      p = next;
+   }
+   if (*p++ != '\n') {
+      return false;
+   }
+   vector<Xml2cDiag> diags;
+   while (p < end) {
+      Xml2cDiag d;
+      d.severity = strtol(p, &next, 10);
+      d.line = strtol(next, &next, 10);
+      unsigned long len = strtoul(next, &next, 10);
+      if (*next != '\n' || len > (unsigned long)(end - next - 1)) {
+         return false;
+      }
+      d.message.assign(next + 1, len);
+      diags.push_back(d);
+      p = next + 1 + len;
+   }
+   memcpy(ctx->stats.actions, counters, sizeof(ctx->stats.actions));
+   unsigned long long *c = counters + POVXML2C_ACTION_TYPES;
+   utilCounters.decodedBytes = c[0];
+   utilCounters.regexesCompiled = c[1];
+   ctx->stats.round_trips = c[2];
+   ctx->stats.round_trips_removed = c[3];
+   ctx->stats.undefined_vars = c[4];
+   ctx->stats.vars_released = c[5];
+   ctx->stats.dead_stores = c[6];
+   ctx->diags.insert(ctx->diags.end(), diags.begin(), diags.end());
+   return true;
 }
 
-int main(int argc, char **argv) {
-   char *endptr;
-   int opt;
-   int xmlFd = 0;
-   char *outfilename = NULL;
-   char *xmlFile = NULL;
-   char *parseEnd = NULL;
-   bool verifyOnly = false;
-   bool echoEnable = false;
+/*
+ * Build and generate from a validated document
+ */
+static int convertDoc(Xml2cContext *ctx, xmlDocPtr doc, char **out, size_t *outLen) {
    int result = REASON_SUCCESS;
+   xmlNode *pov = xmlDocGetRootElement(doc);
+   if (pov == NULL || strcmp((char*)pov->name, "cfepov") != 0) {
+      //invalid doc
+      log_note("pov-xml2c failed to locate <pov> root node\n");
+      return REASON_XML_CONTENT;
+   }
 
-   while ((opt = getopt(argc, argv, "hvt:x:o:")) != -1) {
-      switch (opt) {
-         case 'v':
-            if (verifyOnly) {
-               fprintf(stderr, "option -v may be specified only once\n");
-               exit(REASON_INVALID_OPT);
-            }
-            verifyOnly = true;
-            break;
-         case 'o':
-            if (outfilename != NULL) {
-               fprintf(stderr, "option -o may be specified only once\n");
-               exit(REASON_INVALID_OPT);
-            }
-            outfilename = optarg;
-            break;
-         case 'x':
-            if (xmlFile) {
-               fprintf(stderr, "option -x may be specified only once\n");
-               exit(REASON_INVALID_OPT);
-            }
-            xmlFile = optarg;
-            break;
-         case 't':
-            if (parseEnd != NULL) {
-               fprintf(stderr, "option -t may be specified only once\n");
-               exit(REASON_INVALID_OPT);
-            }
-            parseTimeout = strtoul(optarg, &parseEnd, 10);
-            if (*parseEnd || parseEnd == optarg) {
-               exit(REASON_INVALID_PARSE_TIMEOUT);
-            }
-            break;
-         case 'h':
-            usage(argv[0], 0);
-            break;
-         default:
-            fprintf(stderr, "invalid option -%c\n", optopt);
-            usage(argv[0], REASON_INVALID_OPT);
+   Xml2cCache *cache = NULL;
+   string cacheKey;
+   //the cache key does not cover the contents of external data files
+   if (ctx->cacheDir.size() > 0 && !ctx->verifyOnly && !ctx->externalData) {
+      PhaseTimer timer(&ctx->stats, POVXML2C_PHASE_CACHE);
+      cache = new Xml2cCache(ctx->cacheDir.c_str(), ctx->cacheSize);
+      cacheKey = Xml2cCache::makeKey(canonicalForm(pov), generatorOptions(ctx));
+      string rec;
+      *out = cache->lookup(cacheKey, outLen, &rec);
+      if (*out != NULL && restoreBuild(ctx, rec)) {
+         //cache hit, no need to build or generate anything
+         delete cache;
+         return REASON_SUCCESS;
+      }
+      free(*out);
+      *out = NULL;
+      *outLen = 0;
+   }
+   size_t firstDiag = ctx->diags.size();
+
+   bool built;
+   {
+      PhaseTimer timer(&ctx->stats, POVXML2C_PHASE_BUILD);
+      built = buildPoV(ctx, pov);
+      if (built) {
+         scheduleEarlyWrites(ctx);
+         analyzeLiveness(ctx);
+      }
+   }
+   if (built) {
+      if (!ctx->verifyOnly) {
+         {
+            PhaseTimer timer(&ctx->stats, POVXML2C_PHASE_GENERATE);
+            *out = generateToBuffer(ctx, outLen, &result);
+         }
+         if (*out != NULL && cache != NULL) {
+            PhaseTimer timer(&ctx->stats, POVXML2C_PHASE_CACHE);
+            cache->store(cacheKey, *out, *outLen, buildRecord(ctx, firstDiag));
+         }
       }
    }
-   
-   if (xmlFile == NULL) {
-      fprintf(stderr, "pov-xml2c: xmlFile argument is missing.\n");
-      exit(REASON_INVALID_OPT);
+   else {
+      log_note("pov-xml2c terminating as a result of PoV specification data error(s).\n");
+      result = REASON_XML_CONTENT;
    }
-   xmlFd = open(xmlFile, O_RDONLY);
-   
-   lseek(xmlFd, 0, SEEK_SET);
+   delete cache;
+   return result;
+}
 
-   //Forbid external entities
-   default_XEE_loader = xmlGetExternalEntityLoader();
-   xmlSetExternalEntityLoader(null_XEE_loader);
+/*
+ * Holds a document to the node, depth and allocation caps of its context as
+ * it is parsed.  The SAX handlers of the parser are wrapped so that the
+ * parser stops at the first element over a cap, before the rest of the
+ * document is read or built into a tree.  Entity content is parsed through
+ * the same handlers, so expansion is counted too.  One guard is active per
+ * thread, as conversions are.
+ */
+class ParseGuard {
+private:
+   Xml2cContext *ctx;
+   int *reason;
+   unsigned long long nodes;
+   unsigned int depth;
+   //the wrapped handlers
+   startElementNsSAX2Func startElementNs;
+   endElementNsSAX2Func endElementNs;
+   charactersSAXFunc characters;
+   charactersSAXFunc cdataBlock;
+   commentSAXFunc comment;
+   processingInstructionSAXFunc processingInstruction;
+   referenceSAXFunc reference;
+
+   static __thread ParseGuard *active;
+
+   bool admit(void *pctxt, bool node);
+   static void onStartElementNs(void *c, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI,
+                                int nbNamespaces, const xmlChar **namespaces, int nbAttributes,
+                                int nbDefaulted, const xmlChar **attributes);
+   static void onEndElementNs(void *c, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI);
+   static void onCharacters(void *c, const xmlChar *ch, int len);
+   static void onCdataBlock(void *c, const xmlChar *ch, int len);
+   static void onComment(void *c, const xmlChar *value);
+   static void onProcessingInstruction(void *c, const xmlChar *target, const xmlChar *data);
+   static void onReference(void *c, const xmlChar *name);
+
+   //disable copy
+   ParseGuard(const ParseGuard &g);
+   const ParseGuard &operator=(const ParseGuard &g);
 
-   xmlParserCtxtPtr ctxt; /* the parser context */
-   xmlDocPtr doc; /* the resulting document tree */
+public:
+   ParseGuard(Xml2cContext *c, int *r) : ctx(c), reason(r), nodes(0), depth(0) {
+      active = this;
+   };
+   ~ParseGuard() {
+      active = NULL;
+   };
+   //wrap the handlers of pctxt, after its options are set
+   void install(xmlParserCtxtPtr pctxt);
+};
 
-   /* create a parser context */
-   ctxt = xmlNewParserCtxt();
-   if (ctxt == NULL) {
-      fprintf(stderr, "pov-xml2c failed to allocate parser context\n");
-      exit(REASON_LIBXML_FAIL);
+__thread ParseGuard *ParseGuard::active = NULL;
+
+void ParseGuard::install(xmlParserCtxtPtr pctxt) {
+   xmlSAXHandlerPtr sax = pctxt->sax;
+   startElementNs = sax->startElementNs;
+   endElementNs = sax->endElementNs;
+   characters = sax->characters;
+   cdataBlock = sax->cdataBlock;
+   comment = sax->comment;
+   processingInstruction = sax->processingInstruction;
+   reference = sax->reference;
+   sax->startElementNs = onStartElementNs;
+   sax->endElementNs = onEndElementNs;
+   //ignorable whitespace is delivered as characters by the tree builder
+   if (sax->ignorableWhitespace == sax->characters) {
+      sax->ignorableWhitespace = onCharacters;
    }
+   sax->characters = onCharacters;
+   sax->cdataBlock = onCdataBlock;
+   sax->comment = onComment;
+   sax->processingInstruction = onProcessingInstruction;
+   sax->reference = onReference;
+}
 
-   signal(SIGALRM, parse_alarm_handler);
-   //timeout for parsing XML / regexes
-   alarm(parseTimeout);
+//false, having stopped the parser, once any cap is crossed
+bool ParseGuard::admit(void *pctxt, bool node) {
+   if (*reason == REASON_SUCCESS) {
+      if (node && ctx->maxNodes != 0 && ++nodes > ctx->maxNodes) {
+         log_note("pov-xml2c document exceeds the %llu node limit\n", ctx->maxNodes);
+         *reason = REASON_NODE_LIMIT;
+      }
+      else if (ctx->maxDepth != 0 && depth > ctx->maxDepth) {
+         log_note("pov-xml2c document nests deeper than %u elements\n", ctx->maxDepth);
+         *reason = REASON_DEPTH_LIMIT;
+      }
+      else if (ctx->overLimit()) {
+         *reason = ctx->limitReason;
+      }
+   }
+   if (*reason != REASON_SUCCESS) {
+      xmlStopParser((xmlParserCtxtPtr)pctxt);
+      return false;
+   }
+   return true;
+}
 
-   try {
-   
-      /* create the document */
-      doDoc(ctxt, xmlFd, &doc);
-   
-      /* free up the parser context. Do this here to close associated file descriptor */
-      xmlFreeParserCtxt(ctxt);
-      /* check if parsing suceeded */
-      if (doc == NULL) {
-         fprintf(stderr, "pov-xml2c failed to parse xml file: %d\n", xmlFd);
-         exit(REASON_XML_BAD);
+void ParseGuard::onStartElementNs(void *c, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI,
+                                  int nbNamespaces, const xmlChar **namespaces, int nbAttributes,
+                                  int nbDefaulted, const xmlChar **attributes) {
+   active->depth++;
+   if (active->admit(c, true) && active->startElementNs != NULL) {
+      active->startElementNs(c, localname, prefix, URI, nbNamespaces, namespaces, nbAttributes, nbDefaulted,
+                             attributes);
+   }
+}
+
+void ParseGuard::onEndElementNs(void *c, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI) {
+   if (active->admit(c, false) && active->endElementNs != NULL) {
+      active->endElementNs(c, localname, prefix, URI);
+   }
+   active->depth--;
+}
+
+void ParseGuard::onCharacters(void *c, const xmlChar *ch, int len) {
+   if (active->admit(c, false) && active->characters != NULL) {
+      active->characters(c, ch, len);
+   }
+}
+
+void ParseGuard::onCdataBlock(void *c, const xmlChar *ch, int len) {
+   if (active->admit(c, false) && active->cdataBlock != NULL) {
+      active->cdataBlock(c, ch, len);
+   }
+}
+
+void ParseGuard::onComment(void *c, const xmlChar *value) {
+   if (active->admit(c, true) && active->comment != NULL) {
+      active->comment(c, value);
+   }
+}
+
+void ParseGuard::onProcessingInstruction(void *c, const xmlChar *target, const xmlChar *data) {
+   if (active->admit(c, true) && active->processingInstruction != NULL) {
+      active->processingInstruction(c, target, data);
+   }
+}
+
+void ParseGuard::onReference(void *c, const xmlChar *name) {
+   if (active->admit(c, true) && active->reference != NULL) {
+      active->reference(c, name);
+   }
+}
+
+/*
+ * Feeds a document to the push parser piece by piece, as it is read or
+ * decompressed, enforcing the input limit on the bytes of the document
+ * itself and the conversion deadline as it goes.
+ */
+class PushFeed : public InflateSink {
+private:
+   Xml2cContext *ctx;
+   xmlParserCtxtPtr pctxt;
+   unsigned long long total;
+   int *reason;
+   ParseGuard guard;
+
+   //disable copy
+   PushFeed(const PushFeed &f);
+   const PushFeed &operator=(const PushFeed &f);
+
+public:
+   PushFeed(Xml2cContext *c, int *r) : ctx(c), pctxt(NULL), total(0), reason(r), guard(c, r) {};
+   ~PushFeed() {
+      if (pctxt != NULL) {
+         if (pctxt->myDoc != NULL) {
+            xmlFreeDoc(pctxt->myDoc);
+         }
+         xmlFreeParserCtxt(pctxt);
+      }
+   };
+
+   bool write(const char *data, size_t n) {
+      total += n;
+      if (ctx->maxInput != 0 && total > ctx->maxInput) {
+         log_note("pov-xml2c input exceeds the %llu byte limit\n", ctx->maxInput);
+         *reason = REASON_INPUT_LIMIT;
+         return false;
+      }
+      if (pctxt == NULL) {
+         pctxt = xmlCreatePushParserCtxt(NULL, NULL, data, n, "");
+         if (pctxt == NULL) {
+            log_note("pov-xml2c failed to allocate parser context\n");
+            *reason = REASON_LIBXML_FAIL;
+            return false;
+         }
+         /* disallow network access */
+         xmlCtxtUseOptions(pctxt, XML_PARSE_NONET);
+         guard.install(pctxt);
       }
       else {
+         xmlParseChunk(pctxt, data, n, 0);
+      }
+      if (*reason != REASON_SUCCESS) {
+         return false;
+      }
+      if (ctx->expired()) {
+         *reason = REASON_PARSE_TIMEOUT;
+         return false;
+      }
+      return true;
+   };
+
+   //end the document, NULL unless it parsed and nothing went wrong
+   xmlDocPtr finish(int *valid) {
+      if (pctxt == NULL) {
+         return NULL;   //empty document
+      }
+      if (*reason == REASON_SUCCESS) {
+         xmlParseChunk(pctxt, NULL, 0, 1);
+      }
+      xmlDocPtr doc = pctxt->myDoc;
+      pctxt->myDoc = NULL;
+      *valid = pctxt->valid;
+      if (doc != NULL && (*reason != REASON_SUCCESS || !pctxt->wellFormed)) {
+         xmlFreeDoc(doc);
+         doc = NULL;
+      }
+      return doc;
+   };
+};
+
+//input the decompressor rejected, or a format it cannot handle
+static void inflateFailed(InflateFormat format, int *reason) {
+   if (*reason != REASON_SUCCESS) {
+      return;   //the parser stopped it
+   }
+   if (format == INFLATE_ZSTD) {
+      log_note("pov-xml2c does not support zstd compressed input\n");
+   }
+   else {
+      log_note("pov-xml2c failed to decompress %s input\n", compressionName(format));
+   }
+   *reason = REASON_XML_BAD;
+}
+
+/*
+ * Parse a document held in memory.  Mapped files are handed straight to the
+ * parser this way without passing through libxml2's I/O layer.  Compressed
+ * documents are decompressed into the push parser a piece at a time.
+ */
+static xmlDocPtr parseMemory(Xml2cContext *ctx, const char *xml, size_t len, int *valid, int *reason) {
+   if (len == 0) {
+      return NULL;   //empty document, as when streamed
+   }
+   InflateFormat format = detectCompression((const uint8_t*)xml, len);
+   if (format != INFLATE_NONE) {
+      Xml2cInflate inflater(format);
+      PushFeed feed(ctx, reason);
+      if (!inflater.feed((const uint8_t*)xml, len, &feed) || !inflater.finish(&feed)) {
+         inflateFailed(format, reason);
+      }
+      return feed.finish(valid);
+   }
+   if (ctx->maxInput != 0 && len > ctx->maxInput) {
+      log_note("pov-xml2c input of %zu bytes exceeds the %llu byte limit\n", len, ctx->maxInput);
+      *reason = REASON_INPUT_LIMIT;
+      return NULL;
+   }
+   xmlParserCtxtPtr pctxt = xmlNewParserCtxt();
+   if (pctxt == NULL) {
+      log_note("pov-xml2c failed to allocate parser context\n");
+      *reason = REASON_LIBXML_FAIL;
+      return NULL;
+   }
+   ParseGuard guard(ctx, reason);
+   guard.install(pctxt);
+   /* disallow network access */
+   xmlDocPtr doc = xmlCtxtReadMemory(pctxt, xml, len, "", NULL, XML_PARSE_NONET);
+   *valid = pctxt->valid;
+   xmlFreeParserCtxt(pctxt);
+   if (doc != NULL && *reason != REASON_SUCCESS) {
+      xmlFreeDoc(doc);
+      doc = NULL;
+   }
+   return doc;
+}
+
+/*
+ * Stream a document from fd through the push parser so that pipes need no
+ * temporary file.  The input limit is enforced as the bytes arrive.  The
+ * first bytes tell whether the stream is compressed, in which case it is
+ * decompressed as it arrives.
+ */
+static xmlDocPtr parseFd(Xml2cContext *ctx, int fd, int *valid, int *reason) {
+   vector<char> buf(READ_CHUNK);
+   PushFeed feed(ctx, reason);
+   Owned<Xml2cInflate> inflater;
+   InflateFormat format = INFLATE_NONE;
+   size_t have = 0;
+   bool detected = false;
+   while (true) {
+      ssize_t n = read(fd, buf.data() + have, buf.size() - have);
+      if (n < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         log_error("pov-xml2c failed to read xml");
+         *reason = REASON_XML_BAD;
+         break;
+      }
+      if (!detected) {
+         //a pipe may deliver fewer bytes than the magic at first
+         have += n;
+         if (n != 0 && have < INFLATE_MAGIC_MAX) {
+            continue;
+         }
+         detected = true;
+         format = detectCompression((const uint8_t*)buf.data(), have);
+         if (format != INFLATE_NONE) {
+            inflater.reset(new Xml2cInflate(format));
+         }
+         n = have;
+      }
+      if (n == 0) {
+         if (inflater.get() != NULL && !inflater.get()->finish(&feed)) {
+            inflateFailed(format, reason);
+         }
+         break;
+      }
+      if (inflater.get() != NULL) {
+         if (!inflater.get()->feed((const uint8_t*)buf.data(), n, &feed)) {
+            inflateFailed(format, reason);
+            break;
+         }
+      }
+      else if (!feed.write(buf.data(), n)) {
+         break;
+      }
+      have = 0;
+   }
+   return feed.finish(valid);
+}
+
+/*
+ * Common driver for the buffer and fd entry points
+ */
+static int convert(povxml2c_ctx *ctx, const char *xml, size_t len, int fd, char **out, size_t *outLen) {
+   int result = REASON_SUCCESS;
+   int valid = 1;
+   *out = NULL;
+   *outLen = 0;
+
+   pthread_once(&initOnce, initLibrary);
+   ctx->reset();
+   setLogSink(ctx);
+   xmlSetStructuredErrorFunc(ctx, xmlErrorToLog);
+
+   xmlDocPtr doc = NULL; /* the resulting document tree */
+
+   ctx->stats.conversions = 1;
+   ctx->stats.wall[POVXML2C_PHASE_INIT] = ctx->initWall;
+   ctx->stats.cpu[POVXML2C_PHASE_INIT] = ctx->initCpu;
+   ctx->initWall = ctx->initCpu = 0;
+   memset(&utilCounters, 0, sizeof(utilCounters));
+   utilCounters.decodedLimit = ctx->maxPayload;
+   unsigned long long allocs = xml2cAllocCount ? xml2cAllocCount() : 0;
+   //libxml2 fails an allocation that would cross the cap
+   if (ctx->maxAlloc != 0 && xml2cAllocLimit) {
+      xml2cAllocLimit(ctx->allocBase + ctx->maxAlloc);
+   }
+
+   try {
+      {
+         PhaseTimer timer(&ctx->stats, POVXML2C_PHASE_PARSE);
+         if (xml != NULL) {
+            doc = parseMemory(ctx, xml, len, &valid, &result);
+         }
+         else {
+            doc = parseFd(ctx, fd, &valid, &result);
+         }
+      }
+      if (result == REASON_SUCCESS) {
+         if (ctx->expired()) {
+            throw (int)PARSE_TIMEOUT;
+         }
+         /* validate against the DTD */
+         {
+            PhaseTimer timer(&ctx->stats, POVXML2C_PHASE_VALIDATE);
+            doDoc(&doc, ctx->externalData ? externalDtd : sharedDtd);
+         }
+         //a refused allocation fails the parse or the validation
+         if (ctx->overLimit()) {
+            throw (int)LIMIT_EXCEEDED;
+         }
+         /* check if parsing suceeded */
+         if (doc == NULL) {
+            log_note("pov-xml2c failed to parse xml file\n");
+            result = REASON_XML_BAD;
+         }
          /* check if validation suceeded */
-         if (ctxt->valid == 0) {
-            fprintf(stderr, "pov-xml2c failed to validate xml file\n");
-            exit(REASON_XML_DTD_FAIL);
+         else if (valid == 0) {
+            log_note("pov-xml2c failed to validate xml file\n");
+            result = REASON_XML_DTD_FAIL;
          }
          else {
-            xmlNode *pov = xmlDocGetRootElement(doc);
-            if (pov != NULL && strcmp((char*)pov->name, "cfepov") == 0) {
-               bool success = buildPoV(pov, echoEnable);
-               alarm(0);  //cancel alarm for xml parsing
-               signal(SIGALRM, SIG_DFL);
-               
-               /* free up the document */
-               xmlFreeDoc(doc);
-               if (success) {
-                  if (!verifyOnly) {
-                     FILE *outfile;
-                     if (outfilename != NULL) {
-                        outfile = fopen(outfilename, "w");
-                        if (outfile == NULL) {
-                           fprintf(stderr, "Failed to open output file\n");
-                           exit(1);
-                        }
-                     }
-                     else {
-                        outfile = stdout;
-                     }
-                     result = generateSource(outfile);
-                     if (outfilename != NULL) {
-                        fclose(outfile);
-                     }
-                  }
-               }
-               else {
-                  fprintf(stderr, "pov-xml2c terminating as a result of PoV specification data error(s).\n");
-                  result = REASON_XML_CONTENT;
-               }
+            if (ctx->expired()) {
+               throw (int)PARSE_TIMEOUT;
             }
-            else {
-               //invalid doc
-               fprintf(stderr, "pov-xml2c failed to locate <pov> root node\n");
-               result = REASON_XML_CONTENT;
+            result = convertDoc(ctx, doc, out, outLen);
+            if (result == REASON_SUCCESS && ctx->overLimit()) {
+               throw (int)LIMIT_EXCEEDED;
             }
          }
       }
    } catch (int ex) {
-      if (ex == PARSE_TIMEOUT) {
-         result = REASON_PARSE_TIMEOUT;
+      if (ex == LIMIT_EXCEEDED) {
+         //a decoder stops at the payload cap before the context has seen it
+         ctx->overLimit();
+         result = ctx->limitReason;
       }
+      else {
+         result = ex == PARSE_TIMEOUT ? REASON_PARSE_TIMEOUT : REASON_XML_CONTENT;
+      }
+      free(*out);
+      *out = NULL;
+      *outLen = 0;
+   }
+   /* free up the document */
+   if (doc != NULL) {
+      xmlFreeDoc(doc);
+   }
+
+   if (ctx->maxAlloc != 0 && xml2cAllocLimit) {
+      xml2cAllocLimit(0);
+   }
+   ctx->stats.allocations = xml2cAllocCount ? xml2cAllocCount() - allocs : 0;
+   ctx->stats.payload_bytes = utilCounters.decodedBytes;
+   ctx->stats.regexes = utilCounters.regexesCompiled;
+   ctx->stats.source_bytes = *outLen;
+   ctx->stats.peak_rss_kb = peakRssKb();
+
+   xmlSetStructuredErrorFunc(NULL, NULL);
+   setLogSink(NULL);
+   return result;
+}
+
+/*
+ * The entry points working from the built actions need a conversion that
+ * built them, which one answered from the cache did not
+ */
+static bool builtPoV(Xml2cContext *ctx) {
+   if (ctx->pov.empty()) {
+      ctx->message(LOG_NOTE, "pov-xml2c has no built PoV, convert with POVXML2C_OPT_VERIFY_ONLY first\n");
+      return false;
    }
-   exit(result);
+   return true;
 }
 
+extern "C" {
+
+const char *povxml2c_version(void) {
+   return XML2C_VERSION;
+}
+
+povxml2c_ctx *povxml2c_new(void) {
+   pthread_once(&initOnce, initLibrary);
+   povxml2c_ctx *ctx = new povxml2c_ctx;
+   if (__sync_bool_compare_and_swap(&libraryInitClaimed, 0, 1)) {
+      ctx->initWall = libraryInitWall;
+      ctx->initCpu = libraryInitCpu;
+   }
+   return ctx;
+}
+
+void povxml2c_free(povxml2c_ctx *ctx) {
+   delete ctx;
+}
+
+int povxml2c_set_option(povxml2c_ctx *ctx, int option, long long value) {
+   switch (option) {
+      case POVXML2C_OPT_VERIFY_ONLY:
+         ctx->verifyOnly = value != 0;
+         break;
+      case POVXML2C_OPT_ECHO:
+         ctx->echoEnable = value != 0;
+         break;
+      case POVXML2C_OPT_TIMEOUT:
+         if (value < 0) {
+            return REASON_INVALID_PARSE_TIMEOUT;
+         }
+         ctx->parseTimeout = value;
+         break;
+      case POVXML2C_OPT_DEADLINE_MS:
+         if (value < 0) {
+            return REASON_INVALID_PARSE_TIMEOUT;
+         }
+         ctx->deadlineMs = value;
+         break;
+      case POVXML2C_OPT_CACHE_SIZE:
+         if (value < 0) {
+            return REASON_INVALID_OPT;
+         }
+         ctx->cacheSize = value;
+         break;
+      case POVXML2C_OPT_MAX_INPUT:
+         if (value < 0) {
+            return REASON_INVALID_OPT;
+         }
+         ctx->maxInput = value;
+         break;
+      case POVXML2C_OPT_PROBE_FD:
+         if (value < -1 || value > INT_MAX) {
+            return REASON_INVALID_OPT;
+         }
+         ctx->probeFd = value;
+         break;
+      case POVXML2C_OPT_EXTERNAL_DATA:
+         ctx->externalData = value != 0;
+         break;
+      case POVXML2C_OPT_EARLY_WRITES:
+         if (value < 0 || value > UINT_MAX) {
+            return REASON_INVALID_OPT;
+         }
+         ctx->earlyWrites = value;
+         break;
+      case POVXML2C_OPT_BACKEND:
+         if (value != POVXML2C_BACKEND_MAIN && value != POVXML2C_BACKEND_RESUMABLE) {
+            return REASON_INVALID_OPT;
+         }
+         ctx->backend = value;
+         break;
+      case POVXML2C_OPT_FIXED_READS:
+         ctx->fixedReads = value != 0;
+         break;
+      case POVXML2C_OPT_RELEASE_VARS:
+         ctx->releaseVars = value != 0;
+         break;
+      case POVXML2C_OPT_MAX_NODES:
+         if (value < 0) {
+            return REASON_INVALID_OPT;
+         }
+         ctx->maxNodes = value;
+         break;
+      case POVXML2C_OPT_MAX_DEPTH:
+         if (value < 0 || value > UINT_MAX) {
+            return REASON_INVALID_OPT;
+         }
+         ctx->maxDepth = value;
+         break;
+      case POVXML2C_OPT_MAX_PAYLOAD:
+         if (value < 0) {
+            return REASON_INVALID_OPT;
+         }
+         ctx->maxPayload = value;
+         break;
+      case POVXML2C_OPT_MAX_ALLOC:
+         //only a host that counts allocations can enforce it
+         if (value < 0 || (value != 0 && !xml2cAllocBytes)) {
+            return REASON_INVALID_OPT;
+         }
+         ctx->maxAlloc = value;
+         break;
+      default:
+         return REASON_INVALID_OPT;
+   }
+   return REASON_SUCCESS;
+}
+
+int povxml2c_set_cache_dir(povxml2c_ctx *ctx, const char *dir) {
+   ctx->cacheDir = dir != NULL ? dir : "";
+   return REASON_SUCCESS;
+}
+
+int povxml2c_set_base_dir(povxml2c_ctx *ctx, const char *dir) {
+   ctx->baseDir = dir != NULL ? dir : "";
+   return REASON_SUCCESS;
+}
+
+int povxml2c_convert(povxml2c_ctx *ctx, const char *xml, size_t len, char **out, size_t *out_len) {
+   if (xml == NULL) {
+      return REASON_XML_MISSING;
+   }
+   return convert(ctx, xml, len, -1, out, out_len);
+}
+
+int povxml2c_convert_fd(povxml2c_ctx *ctx, int fd, char **out, size_t *out_len) {
+   return convert(ctx, NULL, 0, fd, out, out_len);
+}
+
+int povxml2c_replay(povxml2c_ctx *ctx, int to_service, int from_service) {
+   ctx->clearDiags();
+   if (!builtPoV(ctx)) {
+      return REASON_XML_CONTENT;
+   }
+   setLogSink(ctx);
+   Xml2cReplay r(to_service, from_service);
+   int result = replayPoV(ctx, &r);
+   setLogSink(NULL);
+   return result;
+}
+
+int povxml2c_simulate(povxml2c_ctx *ctx, const char *transcript, size_t len) {
+   ctx->clearDiags();
+   if (!builtPoV(ctx)) {
+      return REASON_XML_CONTENT;
+   }
+   setLogSink(ctx);
+   Xml2cReplay r((const uint8_t*)transcript, transcript != NULL ? len : 0);
+   int result = replayPoV(ctx, &r);
+   setLogSink(NULL);
+   return result;
+}
+
+size_t povxml2c_split_count(povxml2c_ctx *ctx, unsigned int actions) {
+   return ctx->pov.empty() ? 0 : splitUnitCount(ctx, actions);
+}
+
+int povxml2c_split_source(povxml2c_ctx *ctx, unsigned int actions, size_t idx,
+                          char **name, char **out, size_t *out_len) {
+   *name = NULL;
+   *out = NULL;
+   *out_len = 0;
+   if (!builtPoV(ctx)) {
+      return REASON_XML_CONTENT;
+   }
+   FILE *mem = open_memstream(out, out_len);
+   if (mem == NULL) {
+      return REASON_LIBXML_FAIL;
+   }
+   string unitName;
+   int result = generateSplitUnit(ctx, actions, idx, &unitName, mem);
+   fclose(mem);
+   if (result != REASON_SUCCESS) {
+      free(*out);
+      *out = NULL;
+      *out_len = 0;
+      return result;
+   }
+   *name = strdup(unitName.c_str());
+   return REASON_SUCCESS;
+}
+
+int povxml2c_cost_estimate(povxml2c_ctx *ctx, povxml2c_cost *cost) {
+   memset(cost, 0, sizeof(*cost));
+   if (!builtPoV(ctx)) {
+      return REASON_XML_CONTENT;
+   }
+   estimateCost(ctx, cost);
+   int result;
+   size_t len = 0;
+   char *src = generateToBuffer(ctx, &len, &result);
+   free(src);
+   cost->source_bytes = len;
+   return result;
+}
+
+char *povxml2c_cost_json(const povxml2c_cost *c) {
+   char *json = NULL;
+   size_t len;
+   FILE *mem = open_memstream(&json, &len);
+   if (mem == NULL) {
+      return NULL;
+   }
+   fprintf(mem, "{\"bytes_written\": %llu, \"bytes_read\": %llu, \"transmits\": %llu, \"receives\": %llu, "
+           "\"delay_ms\": %llu, \"regexes\": %llu, \"risky_regexes\": %llu, \"regex_risk\": %d, "
+           "\"var_peak_bytes\": %llu, \"source_bytes\": %llu, \"unknown_reads\": %llu}",
+           c->bytes_written, c->bytes_read, c->transmits, c->receives, c->delay_ms, c->regexes,
+           c->risky_regexes, c->regex_risk, c->var_peak_bytes, c->source_bytes, c->unknown_reads);
+   fclose(mem);
+   return json;
+}
+
+povxml2c_bundle *povxml2c_bundle_new(void) {
+   return new povxml2c_bundle;
+}
+
+void povxml2c_bundle_free(povxml2c_bundle *bundle) {
+   delete bundle;
+}
+
+int povxml2c_bundle_add(povxml2c_bundle *bundle, povxml2c_ctx *ctx, const char *name,
+                        const char *xml, size_t len) {
+   if (xml == NULL || name == NULL) {
+      return REASON_XML_MISSING;
+   }
+   //build only, the bundle generates the PoV itself
+   bool verifyOnly = ctx->verifyOnly;
+   char *out;
+   size_t outLen;
+   ctx->verifyOnly = true;
+   int result = convert(ctx, xml, len, -1, &out, &outLen);
+   ctx->verifyOnly = verifyOnly;
+   if (result != REASON_SUCCESS) {
+      return result;
+   }
+   setLogSink(ctx);
+   {
+      PhaseTimer timer(&ctx->stats, POVXML2C_PHASE_GENERATE);
+      result = bundle->add(ctx, name);
+   }
+   setLogSink(NULL);
+   return result;
+}
+
+size_t povxml2c_bundle_count(const povxml2c_bundle *bundle) {
+   return bundle->groups.size();
+}
+
+const char *povxml2c_bundle_cbid(const povxml2c_bundle *bundle, size_t idx) {
+   return idx < bundle->groups.size() ? bundle->groups[idx]->cbid.c_str() : NULL;
+}
+
+int povxml2c_bundle_source(povxml2c_bundle *bundle, size_t idx, char **out, size_t *out_len) {
+   *out = bundle->source(idx, out_len);
+   if (*out == NULL) {
+      *out_len = 0;
+      return idx < bundle->groups.size() ? REASON_LIBXML_FAIL : REASON_INVALID_OPT;
+   }
+   return REASON_SUCCESS;
+}
+
+void povxml2c_free_buffer(char *buf) {
+   free(buf);
+}
+
+size_t povxml2c_diag_count(const povxml2c_ctx *ctx) {
+   return ctx->diags.size();
+}
+
+const povxml2c_diag *povxml2c_diag_get(const povxml2c_ctx *ctx, size_t idx) {
+   return const_cast<povxml2c_ctx*>(ctx)->diag(idx);
+}
+
+const povxml2c_stats *povxml2c_get_stats(const povxml2c_ctx *ctx) {
+   return &ctx->stats;
+}
+
+void povxml2c_stats_add(povxml2c_stats *total, const povxml2c_stats *s) {
+   total->conversions += s->conversions;
+   for (int i = 0; i < POVXML2C_PHASES; i++) {
+      total->wall[i] += s->wall[i];
+      total->cpu[i] += s->cpu[i];
+   }
+   for (int i = 0; i < POVXML2C_ACTION_TYPES; i++) {
+      total->actions[i] += s->actions[i];
+   }
+   total->allocations += s->allocations;
+   total->payload_bytes += s->payload_bytes;
+   total->source_bytes += s->source_bytes;
+   total->regexes += s->regexes;
+   total->round_trips += s->round_trips;
+   total->round_trips_removed += s->round_trips_removed;
+   total->undefined_vars += s->undefined_vars;
+   total->vars_released += s->vars_released;
+   total->dead_stores += s->dead_stores;
+   if (s->peak_rss_kb > total->peak_rss_kb) {
+      total->peak_rss_kb = s->peak_rss_kb;
+   }
+}
+
+char *povxml2c_stats_json(const povxml2c_stats *s) {
+   static const char *phases[POVXML2C_PHASES] = {"init", "parse", "validate", "cache", "build", "generate"};
+   static const char *actions[POVXML2C_ACTION_TYPES] = {"write", "read", "decl", "delay", "negotiate", "submit"};
+   char *json = NULL;
+   size_t len;
+   FILE *mem = open_memstream(&json, &len);
+   if (mem == NULL) {
+      return NULL;
+   }
+   double wall = 0;
+   double cpu = 0;
+   fprintf(mem, "{\"conversions\": %llu, \"phases\": {", s->conversions);
+   for (int i = 0; i < POVXML2C_PHASES; i++) {
+      fprintf(mem, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", i ? ", " : "", phases[i],
+              s->wall[i] * 1000, s->cpu[i] * 1000);
+      wall += s->wall[i];
+      cpu += s->cpu[i];
+   }
+   fprintf(mem, "}, \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"actions\": {", wall * 1000, cpu * 1000);
+   for (int i = 0; i < POVXML2C_ACTION_TYPES; i++) {
+      fprintf(mem, "%s\"%s\": %llu", i ? ", " : "", actions[i], s->actions[i]);
+   }
+   fprintf(mem, "}, \"allocations\": %llu, \"payload_bytes\": %llu, \"source_bytes\": %llu, "
+           "\"regexes\": %llu, \"peak_rss_kb\": %ld, \"round_trips\": %llu, \"round_trips_removed\": %llu, "
+           "\"undefined_vars\": %llu, \"vars_released\": %llu, \"dead_stores\": %llu}\n",
+           s->allocations, s->payload_bytes, s->source_bytes, s->regexes, s->peak_rss_kb,
+           s->round_trips, s->round_trips_removed, s->undefined_vars, s->vars_released, s->dead_stores);
+   fclose(mem);
+   return json;
+}
+
+int povxml2c_init(void) {
+   pthread_once(&initOnce, initLibrary);
+   return sharedDtd != NULL ? REASON_SUCCESS : REASON_XML_DTD_FAIL;
+}
+
+}
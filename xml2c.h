@@ -0,0 +1,91 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_H
+#define __XML2C_H
+
+#include "povxml2c.h"
+
+#define DEFAULT_PARSE_TIMEOUT 10
+//largest document the command line accepts unless told otherwise
+#define DEFAULT_MAX_INPUT (1ULL << 30)
+//actions per translation unit with --split
+#define DEFAULT_SPLIT_ACTIONS 512
+
+struct Xml2cOptions {
+   const char *outfilename;
+   const char *xmlFile;
+   const char *cacheDir;
+   unsigned long long cacheSize;
+   unsigned long long maxInput;
+   //--max-nodes, --max-depth, --max-payload and --max-alloc, 0 for none
+   unsigned long long maxNodes;
+   unsigned int maxDepth;
+   unsigned long long maxPayload;
+   unsigned long long maxAlloc;
+   int parseTimeout;
+   //fd for timing probes in the generated PoV, -1 for none
+   int probeFd;
+   bool verifyOnly;
+   bool echoEnable;
+   //reads a write may be issued ahead of, 0 for document order
+   unsigned int earlyWrites;
+   //povxml2c_backend generating the source
+   int backend;
+   //--fixed-reads, see POVXML2C_OPT_FIXED_READS
+   bool fixedReads;
+   //--release-vars, see POVXML2C_OPT_RELEASE_VARS
+   bool releaseVars;
+   //service to interpret the PoV against rather than generating source
+   const char *replay;
+   //recorded service output to interpret the PoV against instead
+   const char *simulate;
+   //directory receiving the PoV as separate translation units, and the
+   //actions in each
+   const char *splitDir;
+   unsigned int splitActions;
+   //<data file=...> references, relative to baseDir
+   bool externalData;
+   const char *baseDir;
+   //--stats json, written to statsFile or stderr
+   bool statsJson;
+   const char *statsFile;
+   //raw povxml2c_stats for a server to aggregate, -1 for none
+   int statsFd;
+};
+
+/*
+ * Command line options.  The conversion itself is configured through the
+ * libpovxml2c context, see povxml2c.h.
+ */
+void initOptions(Xml2cOptions *opts);
+
+//report stats in the format and to the file named by opts
+void writeStats(const povxml2c_stats *stats, Xml2cOptions *opts);
+
+//configure a conversion context from the command line options
+void applyOptions(povxml2c_ctx *ctx, Xml2cOptions *opts);
+
+/*
+ * Replace path with len bytes of data, through a temporary file and a rename,
+ * unless it already holds exactly those.  False with errno set on failure.
+ */
+bool writeIfChanged(const char *path, const char *data, size_t len);
+
+/*
+ * Convert the document read from xmlFd with ctx, mapping a regular file
+ * rather than reading it.  Returns one of the REASON_* codes.
+ */
+int convertMapped(povxml2c_ctx *ctx, int xmlFd, char **src, size_t *srcLen);
+
+/*
+ * Convert the PoV read from xmlFd according to opts, writing source and
+ * diagnostics the way the command line does.  Regular files are mapped,
+ * anything else (pipes, sockets) is streamed.  Returns one of the REASON_*
+ * codes.
+ */
+int convertPoV(int xmlFd, Xml2cOptions *opts);
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+/*
+ Allocation counting for the pov-xml2c binary.  Replaces the global C++
+ allocation operators and routes libxml2 through counting wrappers so that
+ conversion statistics can report how many allocations a conversion made.
+ Only the binary links this file, libpovxml2c never replaces allocators in
+ its host.
+
+ Bytes are counted per thread, as requested rather than as held, so that a
+ conversion can be held to a budget.  Past the thread's limit libxml2's
+ allocations fail, which stops the parser inside the allocation that would
+ have crossed it.  C++ allocations are only counted, the converter checks
+ the count between elements instead.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <new>
+#include <libxml/xmlmemory.h>
+
+#include "xml2c_alloc.h"
+
+static unsigned long long allocations = 0;
+
+static inline void countAllocation() {
+   __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+}
+
+unsigned long long xml2cAllocCount() {
+   return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+}
+
+static __thread unsigned long long threadBytes = 0;
+static __thread unsigned long long threadLimit = 0;
+
+unsigned long long xml2cAllocBytes() {
+   return threadBytes;
+}
+
+void xml2cAllocLimit(unsigned long long bytes) {
+   threadLimit = bytes;
+}
+
+//count size bytes, false if that crosses the limit.  A refused request is
+//still counted, so the converter sees why its parser failed.
+static inline bool reserve(size_t size) {
+   threadBytes += size;
+   return threadLimit == 0 || threadBytes <= threadLimit;
+}
+
+static void *countingMalloc(size_t size) {
+   countAllocation();
+   return reserve(size) ? malloc(size) : NULL;
+}
+
+//only the growth of an existing block counts
+static void *countingRealloc(void *ptr, size_t size) {
+   size_t held = 0;
+   if (ptr == NULL) {
+      countAllocation();
+   }
+   else {
+      held = malloc_usable_size(ptr);
+   }
+   return reserve(size > held ? size - held : 0) ? realloc(ptr, size) : NULL;
+}
+
+static char *countingStrdup(const char *str) {
+   countAllocation();
+   return reserve(strlen(str) + 1) ? strdup(str) : NULL;
+}
+
+void installAllocCounters() {
+   xmlMemSetup(free, countingMalloc, countingRealloc, countingStrdup);
+}
+
+static void *countingNew(size_t size) {
+   countAllocation();
+   threadBytes += size;
+   void *p = malloc(size != 0 ? size : 1);
+   if (p == NULL) {
+      throw std::bad_alloc();
+   }
+   return p;
+}
+
+void *operator new(size_t size) {
+   return countingNew(size);
+}
+
+void *operator new[](size_t size) {
+   return countingNew(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+   countAllocation();
+   threadBytes += size;
+   return malloc(size != 0 ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+   countAllocation();
+   threadBytes += size;
+   return malloc(size != 0 ? size : 1);
+}
+
+void operator delete(void *p) noexcept {
+   free(p);
+}
+
+void operator delete[](void *p) noexcept {
+   free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+   free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+   free(p);
+}
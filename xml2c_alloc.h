@@ -0,0 +1,20 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_ALLOC_H
+#define __XML2C_ALLOC_H
+
+//allocations made by the process so far
+unsigned long long xml2cAllocCount();
+//bytes requested by the calling thread so far
+unsigned long long xml2cAllocBytes();
+//fail the calling thread's libxml2 allocations once xml2cAllocBytes would
+//pass bytes, 0 for no limit
+void xml2cAllocLimit(unsigned long long bytes);
+
+//count libxml2 allocations too, must precede any other libxml2 call
+void installAllocCounters();
+
+#endif
@@ -0,0 +1,227 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "xml2c_bundle.h"
+#include "xml2c_context.h"
+#include "xml2c_read.h"
+#include "xml2c_write.h"
+#include "xml2c_probe.h"
+#include "utils.h"
+#include "logging.h"
+
+#include "reasons.h"
+
+/*
+ * Selects the PoV to run.  DECREE hands a PoV no arguments, so main picks
+ * one at compile time; a harness may instead build the bundle once with
+ * -DPOV_BUNDLE_NO_MAIN and call the dispatchers itself.
+ */
+static const char *bundleDispatcher =
+   "int pov_bundle_run(unsigned int index) {\n"
+   "   if (index >= sizeof(pov_bundle) / sizeof(pov_bundle[0])) {\n"
+   "      return -1;\n"
+   "   }\n"
+   "   pov_bundle[index].run();\n"
+   "   return 0;\n"
+   "}\n"
+   "int pov_bundle_run_name(const char *name) {\n"
+   "   unsigned int i, j;\n"
+   "   for (i = 0; i < sizeof(pov_bundle) / sizeof(pov_bundle[0]); i++) {\n"
+   "      for (j = 0; name[j] != 0 && name[j] == pov_bundle[i].name[j]; j++) {\n"
+   "      }\n"
+   "      if (name[j] == pov_bundle[i].name[j]) {\n"
+   "         return pov_bundle_run(i);\n"
+   "      }\n"
+   "   }\n"
+   "   return -1;\n"
+   "}\n"
+   "#ifndef POV_BUNDLE_NO_MAIN\n"
+   "#ifndef POV_BUNDLE_SELECT\n"
+   "#define POV_BUNDLE_SELECT 0\n"
+   "#endif\n"
+   "int main(void) {\n"
+   "#ifdef POV_BUNDLE_NAME\n"
+   "   return pov_bundle_run_name(POV_BUNDLE_NAME) != 0;\n"
+   "#else\n"
+   "   return pov_bundle_run(POV_BUNDLE_SELECT) != 0;\n"
+   "#endif\n"
+   "}\n"
+   "#endif\n";
+
+BundleGroup::BundleGroup(const string &_cbid) : cbid(_cbid), funcs(NULL), funcsLen(0),
+                                                writes(false), timedReads(false), fusedReads(false), probeFd(-1) {
+   funcStream = open_memstream(&funcs, &funcsLen);
+}
+
+BundleGroup::~BundleGroup() {
+   if (funcStream != NULL) {
+      fclose(funcStream);
+   }
+   free(funcs);
+}
+
+unsigned int BundleGroup::blob(const uint8_t *data, size_t len) {
+   string key((const char*)data, len);
+   map<string, unsigned int>::iterator i = blobIds.find(key);
+   if (i != blobIds.end()) {
+      return i->second;
+   }
+   unsigned int id = blobs.size();
+   blobs.push_back(key);
+   blobIds[key] = id;
+   return id;
+}
+
+Xml2cBundle::~Xml2cBundle() {
+   for (vector<BundleGroup*>::iterator i = groups.begin(); i != groups.end(); i++) {
+      delete *i;
+   }
+}
+
+int Xml2cBundle::add(Xml2cContext *ctx, const char *name) {
+   if (ctx->backend != POVXML2C_BACKEND_MAIN) {
+      log_note("pov-xml2c bundles are generated with the main backend only\n");
+      return REASON_INVALID_OPT;
+   }
+   BundleGroup *group = NULL;
+   for (vector<BundleGroup*>::iterator i = groups.begin(); i != groups.end(); i++) {
+      if ((*i)->cbid == ctx->cbid) {
+         group = *i;
+      }
+   }
+   bool created = group == NULL;
+   if (created) {
+      group = new BundleGroup(ctx->cbid);
+      group->probeFd = ctx->probeFd;
+   }
+   //the probe runtime, and so its fd, is shared by the whole bundle
+   if (ctx->probeFd != group->probeFd) {
+      log_note("pov-xml2c all PoVs of a bundle must use the same probe fd\n");
+      return REASON_INVALID_OPT;
+   }
+
+   //the name ends up in a string literal
+   string safe(name);
+   for (size_t i = 0; i < safe.size(); i++) {
+      if (!isalnum((unsigned char)safe[i]) && strchr("_.-", safe[i]) == NULL) {
+         safe[i] = '_';
+      }
+   }
+   //generated apart so that a failure leaves the group as it was
+   char *func = NULL;
+   size_t funcLen = 0;
+   FILE *out = open_memstream(&func, &funcLen);
+   if (out == NULL || group->funcStream == NULL) {
+      log_error("open_memstream");
+      if (out != NULL) {
+         fclose(out);
+         free(func);
+      }
+      if (created) {
+         delete group;
+      }
+      return REASON_LIBXML_FAIL;
+   }
+   size_t blobs = group->blobs.size();
+   Xml2cBundle *saved = ctx->bundle;
+   ctx->bundle = this;
+   current = group;
+   int result = REASON_SUCCESS;
+   try {
+      fprintf(out, "//**** %s\n", safe.c_str());
+      fprintf(out, "static void pov_%05u(void) {\n", (unsigned int)group->names.size());
+      generateActions(ctx, out);
+      fprintf(out, "}\n");
+   } catch (int ex) {
+      result = REASON_XML_CONTENT;
+   }
+   ctx->bundle = saved;
+   current = NULL;
+   fclose(out);
+
+   if (result == REASON_SUCCESS) {
+      fwrite(func, 1, funcLen, group->funcStream);
+      group->names.push_back(safe);
+      group->writes = group->writes || ctx->writeId > 0;
+      group->timedReads = group->timedReads || ctx->timedReads;
+      group->fusedReads = group->fusedReads || ctx->fusedReads;
+      if (created) {
+         groups.push_back(group);
+      }
+   }
+   else {
+      while (group->blobs.size() > blobs) {
+         group->blobIds.erase(group->blobs.back());
+         group->blobs.pop_back();
+      }
+      if (created) {
+         delete group;
+      }
+   }
+   free(func);
+   return result;
+}
+
+char *Xml2cBundle::source(size_t idx, size_t *len) {
+   if (idx >= groups.size()) {
+      return NULL;
+   }
+   BundleGroup *g = groups[idx];
+   char *src = NULL;
+   FILE *out = open_memstream(&src, len);
+   if (out == NULL) {
+      return NULL;
+   }
+   fflush(g->funcStream);
+
+   fprintf(out, "#include <libpov.h>\n");
+   if (g->writes) {
+      generateWriteRuntime(out);
+   }
+   if (g->timedReads) {
+      generateReadRuntime(out);
+   }
+   if (g->fusedReads) {
+      generateExpectRuntime(out);
+   }
+   if (g->probeFd >= 0) {
+      generateProbeRuntime(out, g->probeFd);
+   }
+   fprintf(out, "//**** pov-xml2c bundle of %zu PoVs for %s\n", g->names.size(), g->cbid.c_str());
+   unsigned int id = 0;
+   for (vector<string>::iterator i = g->blobs.begin(); i != g->blobs.end(); i++, id++) {
+      fprintf(out, "static unsigned char pov_blob_%05u[] = \n", id);
+      printAsHexString(out, (const unsigned char*)i->data(), i->size());
+   }
+   fwrite(g->funcs, 1, g->funcsLen, out);
+   fprintf(out, "static const struct {\n");
+   fprintf(out, "   const char *name;\n");
+   fprintf(out, "   void (*run)(void);\n");
+   fprintf(out, "} pov_bundle[] = {\n");
+   id = 0;
+   for (vector<string>::iterator i = g->names.begin(); i != g->names.end(); i++, id++) {
+      fprintf(out, "   {\"%s\", pov_%05u},\n", i->c_str(), id);
+   }
+   fprintf(out, "};\n");
+   fputs(bundleDispatcher, out);
+   fclose(out);
+   return src;
+}
+
+void generateStaticData(Xml2cContext *ctx, FILE *outfile, const char *type, const char *name,
+                        const uint8_t *data, size_t len) {
+   if (ctx->bundle == NULL || ctx->bundle->current == NULL) {
+      fprintf(outfile, "      static %s %s[] = \n", type, name);
+      printAsHexString(outfile, data, len);
+      return;
+   }
+   unsigned int id = ctx->bundle->current->blob(data, len);
+   fprintf(outfile, "      static %s *%s = (%s*)pov_blob_%05u;\n", type, name, type, id);
+}
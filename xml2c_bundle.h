@@ -0,0 +1,75 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_BUNDLE_H
+#define __XML2C_BUNDLE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <map>
+
+using std::vector;
+using std::string;
+using std::map;
+
+class Xml2cContext;
+
+/*
+ * The PoVs of one challenge, generated into a single C file.  Each PoV is
+ * a static function pov_NNNNN, static data is emitted once per distinct
+ * byte string at file scope, and the shared runtimes are emitted once for
+ * the whole bundle.
+ */
+struct BundleGroup {
+   string cbid;
+   vector<string> names;
+   //distinct static data, in order of first use, and the index of each
+   vector<string> blobs;
+   map<string, unsigned int> blobIds;
+   //the PoV functions generated so far
+   char *funcs;
+   size_t funcsLen;
+   FILE *funcStream;
+   bool writes;
+   bool timedReads;
+   bool fusedReads;
+   int probeFd;
+
+   BundleGroup(const string &_cbid);
+   ~BundleGroup();
+   unsigned int blob(const uint8_t *data, size_t len);
+};
+
+class Xml2cBundle {
+private:
+   //disable copy
+   Xml2cBundle(const Xml2cBundle &b) {};
+   const Xml2cBundle &operator=(const Xml2cBundle &b) {return *this;}
+
+public:
+   vector<BundleGroup*> groups;
+   //group receiving the PoV being generated
+   BundleGroup *current;
+
+   Xml2cBundle() : current(NULL) {};
+   ~Xml2cBundle();
+
+   //generate the PoV built in ctx into the group for its cbid
+   int add(Xml2cContext *ctx, const char *name);
+   //the complete source of group idx, NULL on failure
+   char *source(size_t idx, size_t *len);
+};
+
+/*
+ * Emit the declaration of a function local static array holding data, as
+ *       static TYPE NAME[] = "...";
+ * In a bundle NAME instead points at the bundle's shared copy of the bytes.
+ */
+void generateStaticData(Xml2cContext *ctx, FILE *outfile, const char *type, const char *name,
+                        const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,1017 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+/*
+ Command line front end for libpovxml2c.  Also hosts server mode, whose
+ worker threads read documents through the same convertMapped as a command
+ line conversion.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <ctype.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "povxml2c.h"
+#include "cache.h"
+#include "xml2c.h"
+#include "xml2c_server.h"
+#include "xml2c_alloc.h"
+#include "xml2c_tar.h"
+#include "xml2c_watch.h"
+#include "xml2c_getopt.h"
+#include "logging.h"
+
+#include "reasons.h"
+
+static void parse_alarm_handler(int) {
+   //hard stop in case the library's own deadline checks are not reached
+   static const char msg[] = "pov-xml2c parse timeout\n";
+   if (write(2, msg, sizeof(msg) - 1)) {}
+   _exit(REASON_PARSE_TIMEOUT);
+}
+
+void usage(const char *cmd, int reason) {
+   fprintf(stderr, "usage: %s [options] -x xml-file\n", cmd);
+   fprintf(stderr, "       %s [options] --bundle dir xml-file...\n", cmd);
+   fprintf(stderr, "       %s [options] -S socket\n", cmd);
+   fprintf(stderr, "       %s [options] --watch dir\n", cmd);
+   fprintf(stderr, "       %s [options] --cost table|json xml-file...\n", cmd);
+   fprintf(stderr, "  -h Display this usage statement\n");
+   fprintf(stderr, "  -o Output file name.  Defaults to stdout\n");
+   fprintf(stderr, "  -v verify the xml against cfe-pov.dtd\n");
+   fprintf(stderr, "  -t Timeout alarm value for parsing xml.\n");
+   fprintf(stderr, "  -x xml pov file.  Use - or omit to read from stdin\n");
+   fprintf(stderr, "  -m Maximum xml input size in bytes, 0 for no limit.  Defaults to %llu\n", DEFAULT_MAX_INPUT);
+   fprintf(stderr, "  --max-nodes N  Maximum elements, comments, PIs and entity references in a document\n");
+   fprintf(stderr, "  --max-depth N  Maximum element nesting in a document\n");
+   fprintf(stderr, "  --max-payload N  Maximum bytes decoded from a document's data\n");
+   fprintf(stderr, "  --max-alloc N  Maximum bytes allocated while converting a document\n");
+   fprintf(stderr, "  -c Directory in which to cache generated source.\n");
+   fprintf(stderr, "  -C Maximum cache size in bytes.  Defaults to %u\n", DEFAULT_CACHE_SIZE);
+   fprintf(stderr, "  -S Serve conversion requests on this unix domain socket.\n");
+   fprintf(stderr, "  -j Resident workers, and so concurrent conversions, in server mode.  Defaults to %d\n", DEFAULT_SERVER_WORKERS);
+   fprintf(stderr, "  -d Default per request deadline in milliseconds in server mode.  Defaults to %d\n", DEFAULT_SERVER_DEADLINE);
+   fprintf(stderr, "  --allow-dir DIR  Directory whose files and caches server requests may name, may be repeated\n");
+   fprintf(stderr, "  --stats json  Report per phase timing and resource statistics\n");
+   fprintf(stderr, "  --stats-file  File receiving statistics.  Defaults to stderr\n");
+   fprintf(stderr, "  --probes FD   Generate per action timing probes written to FD by the PoV\n");
+   fprintf(stderr, "  --early-writes[=N]  Issue independent writes ahead of up to N (default 1) earlier reads\n");
+   fprintf(stderr, "  --fixed-reads  Read a delimited line that must match exactly as that many bytes\n");
+   fprintf(stderr, "  --release-vars  Release variables after their last use and drop assignments never read\n");
+   fprintf(stderr, "  --backend NAME  main (default) for a DECREE PoV, resumable for a hosted load test state machine\n");
+   fprintf(stderr, "  --bundle DIR  Generate the PoVs of each challenge into one file, DIR/cbid.c\n");
+   fprintf(stderr, "  --replay CMD  Run the PoV against CMD, or unix:PATH, instead of generating source\n");
+   fprintf(stderr, "  --simulate FILE  Run the PoV against the service output recorded in FILE\n");
+   fprintf(stderr, "  --split DIR   Generate the PoV as separately compiled chunks and a makefile in DIR\n");
+   fprintf(stderr, "  --split-actions N  Actions in each chunk with --split.  Defaults to %d\n", DEFAULT_SPLIT_ACTIONS);
+   fprintf(stderr, "  --cost FORMAT  Estimate what running each PoV costs, as a table or json, without running it\n");
+   fprintf(stderr, "  --watch DIR   Reconvert each PoV in DIR to DIR/name.c whenever it is saved\n");
+   fprintf(stderr, "  --external-data  Accept <data file=\"...\"> references to raw files next to the PoV\n");
+   exit(reason);
+}
+
+FILE *openOutput(const char *outfilename) {
+   FILE *outfile;
+   if (outfilename != NULL) {
+      outfile = fopen(outfilename, "w");
+      if (outfile == NULL) {
+         fprintf(stderr, "Failed to open output file\n");
+         exit(1);
+      }
+   }
+   else {
+      outfile = stdout;
+   }
+   return outfile;
+}
+
+void closeOutput(FILE *outfile, const char *outfilename) {
+   if (outfilename != NULL) {
+      fclose(outfile);
+   }
+   else {
+      fflush(outfile);
+   }
+}
+
+void initOptions(Xml2cOptions *opts) {
+   memset(opts, 0, sizeof(Xml2cOptions));
+   opts->parseTimeout = DEFAULT_PARSE_TIMEOUT;
+   opts->cacheSize = DEFAULT_CACHE_SIZE;
+   opts->maxInput = DEFAULT_MAX_INPUT;
+   opts->statsFd = -1;
+   opts->probeFd = -1;
+   opts->splitActions = DEFAULT_SPLIT_ACTIONS;
+}
+
+/*
+ * Statistics go to their own file so that they never mix with the
+ * generated source or the TAP diagnostics, unless left on stderr.
+ */
+void writeStats(const povxml2c_stats *stats, Xml2cOptions *opts) {
+   char *json = povxml2c_stats_json(stats);
+   if (json == NULL) {
+      return;
+   }
+   FILE *f = stderr;
+   if (opts->statsFile != NULL) {
+      f = fopen(opts->statsFile, "w");
+      if (f == NULL) {
+         log_error(opts->statsFile);
+         povxml2c_free_buffer(json);
+         return;
+      }
+   }
+   fputs(json, f);
+   if (f != stderr) {
+      fclose(f);
+   }
+   povxml2c_free_buffer(json);
+}
+
+/*
+ * Connect to the service a PoV is replayed against: unix:PATH names a
+ * listening unix domain socket, anything else is a shell command whose
+ * stdin and stdout become the PoV's connection.  Returns false on failure.
+ */
+static bool openService(const char *target, int *toFd, int *fromFd, pid_t *pid) {
+   *pid = -1;
+   if (strncmp(target, "unix:", 5) == 0) {
+      struct sockaddr_un addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      if (strlen(target + 5) >= sizeof(addr.sun_path)) {
+         fprintf(stderr, "pov-xml2c: socket path too long: %s\n", target + 5);
+         return false;
+      }
+      strcpy(addr.sun_path, target + 5);
+      int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (fd == -1 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+         fprintf(stderr, "pov-xml2c: unable to connect to %s: %s\n", target + 5, strerror(errno));
+         if (fd != -1) {
+            close(fd);
+         }
+         return false;
+      }
+      *toFd = fd;
+      *fromFd = dup(fd);
+      return true;
+   }
+   int in[2], out[2];
+   if (pipe(in) != 0) {
+      log_error("pipe");
+      return false;
+   }
+   if (pipe(out) != 0) {
+      log_error("pipe");
+      close(in[0]);
+      close(in[1]);
+      return false;
+   }
+   *pid = fork();
+   if (*pid == 0) {
+      dup2(in[0], 0);
+      dup2(out[1], 1);
+      close(in[0]);
+      close(in[1]);
+      close(out[0]);
+      close(out[1]);
+      execl("/bin/sh", "sh", "-c", target, (char*)NULL);
+      _exit(127);
+   }
+   close(in[0]);
+   close(out[1]);
+   if (*pid == -1) {
+      log_error("fork");
+      close(in[1]);
+      close(out[0]);
+      return false;
+   }
+   *toFd = in[1];
+   *fromFd = out[0];
+   return true;
+}
+
+//hang up on the service, reporting how a spawned one ended
+static void closeService(int toFd, int fromFd, pid_t pid) {
+   close(toFd);
+   close(fromFd);
+   if (pid == -1) {
+      return;
+   }
+   int status;
+   pid_t done = 0;
+   //give it a moment to finish on its own after end of input
+   for (int i = 0; i < 20 && done == 0; i++) {
+      done = waitpid(pid, &status, WNOHANG);
+      if (done == 0) {
+         usleep(5000);
+      }
+   }
+   if (done == 0) {
+      kill(pid, SIGKILL);
+      waitpid(pid, &status, 0);
+      fprintf(stderr, "# service killed after the PoV completed\n");
+   }
+   else if (done == pid && WIFSIGNALED(status)) {
+      fprintf(stderr, "# service terminated by signal %d\n", WTERMSIG(status));
+   }
+   else if (done == pid) {
+      fprintf(stderr, "# service exited with status %d\n", WEXITSTATUS(status));
+   }
+}
+
+static int replayConverted(povxml2c_ctx *ctx, const char *target) {
+   int toFd, fromFd;
+   pid_t pid;
+   if (!openService(target, &toFd, &fromFd, &pid)) {
+      return REASON_REPLAY_FAIL;
+   }
+   //a service that hangs up shows up as a failed send, not a signal
+   signal(SIGPIPE, SIG_IGN);
+   int result = povxml2c_replay(ctx, toFd, fromFd);
+   for (size_t i = 0; i < povxml2c_diag_count(ctx); i++) {
+      fputs(povxml2c_diag_get(ctx, i)->message, stderr);
+   }
+   closeService(toFd, fromFd, pid);
+   signal(SIGPIPE, SIG_DFL);
+   return result;
+}
+
+static int simulateConverted(povxml2c_ctx *ctx, const char *transcriptFile) {
+   int fd = open(transcriptFile, O_RDONLY);
+   struct stat sb;
+   if (fd == -1 || fstat(fd, &sb) != 0) {
+      fprintf(stderr, "pov-xml2c: unable to read %s: %s\n", transcriptFile, strerror(errno));
+      if (fd != -1) {
+         close(fd);
+      }
+      return REASON_REPLAY_FAIL;
+   }
+   void *map = NULL;
+   if (sb.st_size > 0) {
+      map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   }
+   close(fd);
+   if (map == MAP_FAILED) {
+      fprintf(stderr, "pov-xml2c: unable to read %s: %s\n", transcriptFile, strerror(errno));
+      return REASON_REPLAY_FAIL;
+   }
+   int result = povxml2c_simulate(ctx, (const char*)map, sb.st_size);
+   for (size_t i = 0; i < povxml2c_diag_count(ctx); i++) {
+      fputs(povxml2c_diag_get(ctx, i)->message, stderr);
+   }
+   if (map != NULL) {
+      munmap(map, sb.st_size);
+   }
+   return result;
+}
+
+//an unchanged file keeps its time, so that make sees it as up to date
+bool writeIfChanged(const char *path, const char *data, size_t len) {
+   int fd = open(path, O_RDONLY);
+   if (fd != -1) {
+      struct stat sb;
+      bool same = false;
+      if (fstat(fd, &sb) == 0 && (size_t)sb.st_size == len) {
+         void *map = len > 0 ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+         if (map != MAP_FAILED) {
+            same = len == 0 || memcmp(map, data, len) == 0;
+            if (map != NULL) {
+               munmap(map, len);
+            }
+         }
+      }
+      close(fd);
+      if (same) {
+         return true;
+      }
+   }
+   //a temp file of its own beside the target, so concurrent writers each
+   //publish a complete file
+   char tmp[PATH_MAX];
+   if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp)) {
+      errno = ENAMETOOLONG;
+      return false;
+   }
+   fd = mkstemp(tmp);
+   if (fd == -1) {
+      return false;
+   }
+   struct stat sb;
+   mode_t mode = stat(path, &sb) == 0 ? sb.st_mode & 0777 : 0644;
+   bool ok = fchmod(fd, mode) == 0;
+   for (size_t done = 0; ok && done < len;) {
+      ssize_t n = write(fd, data + done, len - done);
+      if (n < 0 && errno != EINTR) {
+         ok = false;
+      }
+      else if (n > 0) {
+         done += n;
+      }
+   }
+   ok = close(fd) == 0 && ok;
+   if (!ok || rename(tmp, path) != 0) {
+      int err = errno;
+      unlink(tmp);
+      errno = err;
+      return false;
+   }
+   return true;
+}
+
+/*
+ * Write the translation units of the converted PoV into dir, then remove
+ * chunks left over from an earlier, longer version of the PoV.
+ */
+static int splitConverted(povxml2c_ctx *ctx, const char *dir, unsigned int actions) {
+   int result = REASON_SUCCESS;
+   size_t count = povxml2c_split_count(ctx, actions);
+   for (size_t i = 0; i < count && result == REASON_SUCCESS; i++) {
+      char *name;
+      char *src;
+      size_t srcLen;
+      result = povxml2c_split_source(ctx, actions, i, &name, &src, &srcLen);
+      if (result != REASON_SUCCESS) {
+         break;
+      }
+      char path[PATH_MAX];
+      snprintf(path, sizeof(path), "%s/%s", dir, name);
+      if (!writeIfChanged(path, src, srcLen)) {
+         //as openOutput
+         fprintf(stderr, "pov-xml2c: unable to write %s: %s\n", path, strerror(errno));
+         result = 1;
+      }
+      povxml2c_free_buffer(name);
+      povxml2c_free_buffer(src);
+   }
+   //units are the driver, the chunks and the makefile, so chunks numbered
+   //from count - 2 on belong to an earlier version
+   size_t chunks = count > 2 ? count - 2 : 0;
+   DIR *d = result == REASON_SUCCESS ? opendir(dir) : NULL;
+   if (d != NULL) {
+      struct dirent *de;
+      while ((de = readdir(d)) != NULL) {
+         //pov_chunk_NNNNN.c
+         const char *name = de->d_name;
+         if (strlen(name) == 17 && strncmp(name, "pov_chunk_", 10) == 0 && strspn(name + 10, "0123456789") == 5 &&
+             strcmp(name + 15, ".c") == 0 && strtoul(name + 10, NULL, 10) >= chunks) {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+            unlink(path);
+         }
+      }
+      closedir(d);
+   }
+   return result;
+}
+
+void applyOptions(povxml2c_ctx *ctx, Xml2cOptions *opts) {
+   //replay and split need the built actions, which a cache hit or
+   //generation skips
+   povxml2c_set_option(ctx, POVXML2C_OPT_VERIFY_ONLY,
+                       opts->verifyOnly || opts->replay != NULL || opts->simulate != NULL ||
+                       opts->splitDir != NULL);
+   povxml2c_set_option(ctx, POVXML2C_OPT_ECHO, opts->echoEnable);
+   povxml2c_set_option(ctx, POVXML2C_OPT_TIMEOUT, opts->parseTimeout);
+   povxml2c_set_option(ctx, POVXML2C_OPT_CACHE_SIZE, opts->cacheSize);
+   povxml2c_set_option(ctx, POVXML2C_OPT_MAX_INPUT, opts->maxInput);
+   povxml2c_set_option(ctx, POVXML2C_OPT_MAX_NODES, opts->maxNodes);
+   povxml2c_set_option(ctx, POVXML2C_OPT_MAX_DEPTH, opts->maxDepth);
+   povxml2c_set_option(ctx, POVXML2C_OPT_MAX_PAYLOAD, opts->maxPayload);
+   povxml2c_set_option(ctx, POVXML2C_OPT_MAX_ALLOC, opts->maxAlloc);
+   povxml2c_set_option(ctx, POVXML2C_OPT_PROBE_FD, opts->probeFd);
+   povxml2c_set_option(ctx, POVXML2C_OPT_EXTERNAL_DATA, opts->externalData);
+   povxml2c_set_option(ctx, POVXML2C_OPT_EARLY_WRITES, opts->earlyWrites);
+   povxml2c_set_option(ctx, POVXML2C_OPT_BACKEND, opts->backend);
+   povxml2c_set_option(ctx, POVXML2C_OPT_FIXED_READS, opts->fixedReads);
+   povxml2c_set_option(ctx, POVXML2C_OPT_RELEASE_VARS, opts->releaseVars);
+   povxml2c_set_cache_dir(ctx, opts->cacheDir);
+   povxml2c_set_base_dir(ctx, opts->baseDir);
+}
+
+int convertMapped(povxml2c_ctx *ctx, int xmlFd, char **src, size_t *srcLen) {
+   struct stat sb;
+   if (fstat(xmlFd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0) {
+      //regular files go to the parser straight from the page cache, the
+      //library applies the input limit before touching the mapping
+      void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, xmlFd, 0);
+      if (map != MAP_FAILED) {
+         madvise(map, sb.st_size, MADV_SEQUENTIAL);
+         int result = povxml2c_convert(ctx, (const char*)map, sb.st_size, src, srcLen);
+         munmap(map, sb.st_size);
+         return result;
+      }
+   }
+   return povxml2c_convert_fd(ctx, xmlFd, src, srcLen);
+}
+
+int convertPoV(int xmlFd, Xml2cOptions *opts) {
+   povxml2c_ctx *ctx = povxml2c_new();
+   applyOptions(ctx, opts);
+
+   signal(SIGALRM, parse_alarm_handler);
+   //timeout for parsing XML / regexes
+   alarm(opts->parseTimeout);
+
+   char *src = NULL;
+   size_t srcLen = 0;
+   int result = convertMapped(ctx, xmlFd, &src, &srcLen);
+
+   alarm(0);  //cancel alarm for xml parsing
+   signal(SIGALRM, SIG_DFL);
+
+   for (size_t i = 0; i < povxml2c_diag_count(ctx); i++) {
+      fputs(povxml2c_diag_get(ctx, i)->message, stderr);
+   }
+   if (src != NULL) {
+      FILE *outfile = openOutput(opts->outfilename);
+      fwrite(src, 1, srcLen, outfile);
+      closeOutput(outfile, opts->outfilename);
+      povxml2c_free_buffer(src);
+   }
+   if (result == REASON_SUCCESS && opts->replay != NULL) {
+      result = replayConverted(ctx, opts->replay);
+   }
+   if (result == REASON_SUCCESS && opts->simulate != NULL) {
+      result = simulateConverted(ctx, opts->simulate);
+   }
+   if (result == REASON_SUCCESS && opts->splitDir != NULL) {
+      result = splitConverted(ctx, opts->splitDir, opts->splitActions);
+   }
+   if (opts->statsJson) {
+      writeStats(povxml2c_get_stats(ctx), opts);
+   }
+   if (opts->statsFd != -1) {
+      if (write(opts->statsFd, povxml2c_get_stats(ctx), sizeof(povxml2c_stats))) {}
+   }
+   povxml2c_free(ctx);
+   return result;
+}
+
+//a cbid as a file name, it comes from the document
+static void cbidFileName(const char *cbid, char *name, size_t size) {
+   snprintf(name, size, "%s", cbid[0] != 0 ? cbid : "bundle");
+   for (char *p = name; *p; p++) {
+      if (!isalnum((unsigned char)*p) && *p != '_' && *p != '-' && (*p != '.' || p == name)) {
+         *p = '_';
+      }
+   }
+}
+
+//a PoV is known by its file name without directory or extension
+static string povName(const char *file) {
+   const char *slash = strrchr(file, '/');
+   string name = slash != NULL ? slash + 1 : file;
+   size_t dot = name.rfind('.');
+   if (dot != string::npos && dot != 0) {
+      name.erase(dot);
+   }
+   return name;
+}
+
+//convert one document into the bundle, reporting its diagnostics
+static int addToBundle(povxml2c_bundle *bundle, povxml2c_ctx *ctx, Xml2cOptions *opts,
+                       const char *file, const char *xml, size_t len, povxml2c_stats *total) {
+   alarm(opts->parseTimeout);
+   int result = povxml2c_bundle_add(bundle, ctx, povName(file).c_str(), xml, len);
+   alarm(0);
+   for (size_t d = 0; d < povxml2c_diag_count(ctx); d++) {
+      fputs(povxml2c_diag_get(ctx, d)->message, stderr);
+   }
+   povxml2c_stats_add(total, povxml2c_get_stats(ctx));
+   return result;
+}
+
+//the PoVs of a tar archive, added as they are read from it
+class BundleMembers : public TarHandler {
+private:
+   povxml2c_bundle *bundle;
+   povxml2c_ctx *ctx;
+   Xml2cOptions *opts;
+   povxml2c_stats *total;
+
+public:
+   BundleMembers(povxml2c_bundle *b, povxml2c_ctx *c, Xml2cOptions *o, povxml2c_stats *t) :
+      bundle(b), ctx(c), opts(o), total(t) {};
+   int member(const char *name, const char *data, size_t len) {
+      return addToBundle(bundle, ctx, opts, name, data, len, total);
+   };
+};
+
+/*
+ * Hand each document to handler, from a file or from each PoV in a tar
+ * archive, either of them compressed.  Stops at the first file that cannot be
+ * read or the first member the handler fails.
+ */
+static int eachPoV(povxml2c_ctx *ctx, Xml2cOptions *opts, char **files, int count, TarHandler *handler) {
+   int result = REASON_SUCCESS;
+   signal(SIGALRM, parse_alarm_handler);
+   for (int i = 0; i < count && result == REASON_SUCCESS; i++) {
+      struct stat sb;
+      void *map = MAP_FAILED;
+      int fd = open(files[i], O_RDONLY);
+      if (fd != -1 && fstat(fd, &sb) == 0 && sb.st_size > 0) {
+         map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      }
+      if (fd != -1) {
+         close(fd);
+      }
+      if (map == MAP_FAILED) {
+         fprintf(stderr, "pov-xml2c: unable to read %s: %s\n", files[i], strerror(errno));
+         result = REASON_XML_MISSING;
+         break;
+      }
+      //external data is found next to the PoV, or next to its archive
+      char *path = strdup(files[i]);
+      povxml2c_set_base_dir(ctx, dirname(path));
+      free(path);
+
+      madvise(map, sb.st_size, MADV_SEQUENTIAL);
+      if (isTarArchive((const char*)map, sb.st_size)) {
+         result = readTarArchive((const char*)map, sb.st_size, opts->maxInput, handler);
+      }
+      else {
+         result = handler->member(files[i], (const char*)map, sb.st_size);
+      }
+      munmap(map, sb.st_size);
+   }
+   signal(SIGALRM, SIG_DFL);
+   return result;
+}
+
+/*
+ * Add every file to a bundle, then write one DIR/cbid.c per challenge.
+ * Files may be PoVs or tar archives of PoVs, either of them compressed.
+ * The first document that fails to convert ends the run with its status
+ * and nothing is written.
+ */
+static int bundlePoVs(Xml2cOptions *opts, const char *dir, char **files, int count) {
+   povxml2c_ctx *ctx = povxml2c_new();
+   applyOptions(ctx, opts);
+   povxml2c_bundle *bundle = povxml2c_bundle_new();
+   povxml2c_stats total;
+   memset(&total, 0, sizeof(total));
+   BundleMembers members(bundle, ctx, opts, &total);
+   int result = eachPoV(ctx, opts, files, count, &members);
+
+   for (size_t i = 0; result == REASON_SUCCESS && i < povxml2c_bundle_count(bundle); i++) {
+      char name[NAME_MAX - 1];
+      char path[PATH_MAX];
+      cbidFileName(povxml2c_bundle_cbid(bundle, i), name, sizeof(name));
+      snprintf(path, sizeof(path), "%s/%s.c", dir, name);
+      char *src;
+      size_t srcLen;
+      result = povxml2c_bundle_source(bundle, i, &src, &srcLen);
+      if (result != REASON_SUCCESS) {
+         break;
+      }
+      FILE *outfile = openOutput(path);
+      fwrite(src, 1, srcLen, outfile);
+      fclose(outfile);
+      povxml2c_free_buffer(src);
+   }
+   if (opts->statsJson) {
+      writeStats(&total, opts);
+   }
+   povxml2c_bundle_free(bundle);
+   povxml2c_free(ctx);
+   return result;
+}
+
+//a JSON string, the name comes from a file or archive
+static void jsonString(FILE *out, const char *str) {
+   fputc('"', out);
+   for (const unsigned char *p = (const unsigned char*)str; *p; p++) {
+      if (*p == '"' || *p == '\\') {
+         fprintf(out, "\\%c", *p);
+      }
+      else if (*p < 0x20) {
+         fprintf(out, "\\u%04x", *p);
+      }
+      else {
+         fputc(*p, out);
+      }
+   }
+   fputc('"', out);
+}
+
+/*
+ * One row of the --cost report per PoV.  A PoV that fails to convert is
+ * reported with its status and no cost, and the rest are still estimated.
+ */
+class CostReport : public TarHandler {
+private:
+   povxml2c_ctx *ctx;
+   Xml2cOptions *opts;
+   FILE *out;
+   bool json;
+   size_t rows;
+
+public:
+   //the first failure, the exit status of the run
+   int status;
+
+   CostReport(povxml2c_ctx *c, Xml2cOptions *o, FILE *f, bool j) : ctx(c), opts(o), out(f), json(j),
+      rows(0), status(REASON_SUCCESS) {};
+   int member(const char *name, const char *data, size_t len);
+   void begin();
+   void end();
+};
+
+void CostReport::begin() {
+   if (json) {
+      fprintf(out, "[");
+   }
+   else {
+      fprintf(out, "# %-30s %6s %10s %10s %8s %8s %8s %7s %4s %10s %10s %7s\n", "pov", "status", "written",
+              "read", "tx", "rx", "delay_ms", "regexes", "risk", "peak_var", "source", "unknown");
+   }
+}
+
+void CostReport::end() {
+   if (json) {
+      fprintf(out, "%s]\n", rows > 0 ? "\n" : "");
+   }
+}
+
+int CostReport::member(const char *name, const char *data, size_t len) {
+   char *src = NULL;
+   size_t srcLen;
+   povxml2c_cost c;
+   memset(&c, 0, sizeof(c));
+   alarm(opts->parseTimeout);
+   int result = povxml2c_convert(ctx, data, len, &src, &srcLen);
+   alarm(0);
+   for (size_t d = 0; d < povxml2c_diag_count(ctx); d++) {
+      fputs(povxml2c_diag_get(ctx, d)->message, stderr);
+   }
+   if (result == REASON_SUCCESS) {
+      result = povxml2c_cost_estimate(ctx, &c);
+   }
+   if (status == REASON_SUCCESS) {
+      status = result;
+   }
+   if (json) {
+      char *cost = povxml2c_cost_json(&c);
+      fprintf(out, "%s\n {\"pov\": ", rows > 0 ? "," : "");
+      jsonString(out, name);
+      fprintf(out, ", \"status\": %d, \"cost\": %s}", result, cost);
+      povxml2c_free_buffer(cost);
+   }
+   else {
+      fprintf(out, "%-32s %6d %10llu %10llu %8llu %8llu %8llu %7llu %4d %10llu %10llu %7llu\n", name, result,
+              c.bytes_written, c.bytes_read, c.transmits, c.receives, c.delay_ms, c.regexes, c.regex_risk,
+              c.var_peak_bytes, c.source_bytes, c.unknown_reads);
+   }
+   rows++;
+   return REASON_SUCCESS;
+}
+
+/*
+ * Estimate the cost of every PoV in files, in the same places as --bundle
+ * finds them, as a table or a JSON array.  Returns the status of the first
+ * PoV that failed to convert.
+ */
+static int costPoVs(Xml2cOptions *opts, const char *format, char **files, int count) {
+   povxml2c_ctx *ctx = povxml2c_new();
+   applyOptions(ctx, opts);
+   //the estimate walks the built actions
+   povxml2c_set_option(ctx, POVXML2C_OPT_VERIFY_ONLY, 1);
+   FILE *out = openOutput(opts->outfilename);
+   CostReport report(ctx, opts, out, strcmp(format, "json") == 0);
+   report.begin();
+   int result = eachPoV(ctx, opts, files, count, &report);
+   report.end();
+   closeOutput(out, opts->outfilename);
+   povxml2c_free(ctx);
+   return result != REASON_SUCCESS ? result : report.status;
+}
+
+//a resource cap, 0 for none
+static unsigned long long limitArg(const char *opt, const char *arg, unsigned long long max) {
+   char *end;
+   errno = 0;
+   unsigned long long value = strtoull(arg, &end, 10);
+   if (*end || end == arg || arg[0] == '-' || errno != 0 || value > max) {
+      fprintf(stderr, "invalid %s limit: %s\n", opt, arg);
+      exit(REASON_INVALID_OPT);
+   }
+   return value;
+}
+
+int main(int argc, char **argv) {
+   int opt;
+   int xmlFd = 0;
+   char *parseEnd = NULL;
+   char *cacheEnd = NULL;
+   char *socketPath = NULL;
+   char *workersEnd = NULL;
+   char *deadlineEnd = NULL;
+   char *maxInputEnd = NULL;
+   char *probesEnd = NULL;
+   const char *bundleDir = NULL;
+   const char *costFormat = NULL;
+   const char *watchDir = NULL;
+   int workers = DEFAULT_SERVER_WORKERS;
+   int deadline = DEFAULT_SERVER_DEADLINE;
+   vector<string> allowDirs;
+   Xml2cOptions opts;
+
+   installAllocCounters();
+   initOptions(&opts);
+
+   while ((opt = getopt_long(argc, argv, XML2C_SHORT_OPTS, xml2cLongOpts, NULL)) != -1) {
+      switch (opt) {
+         case OPT_STATS:
+            if (strcmp(optarg, "json") != 0) {
+               fprintf(stderr, "unsupported statistics format: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            opts.statsJson = true;
+            break;
+         case OPT_STATS_FILE:
+            opts.statsFile = optarg;
+            break;
+         case OPT_EXTERNAL_DATA:
+            opts.externalData = true;
+            break;
+         case OPT_FIXED_READS:
+            opts.fixedReads = true;
+            break;
+         case OPT_RELEASE_VARS:
+            opts.releaseVars = true;
+            break;
+         case OPT_REPLAY:
+            opts.replay = optarg;
+            break;
+         case OPT_SIMULATE:
+            opts.simulate = optarg;
+            break;
+         case OPT_BUNDLE:
+            bundleDir = optarg;
+            break;
+         case OPT_WATCH:
+            watchDir = optarg;
+            break;
+         case OPT_ALLOW_DIR:
+            allowDirs.push_back(optarg);
+            break;
+         case OPT_MAX_NODES:
+            opts.maxNodes = limitArg("--max-nodes", optarg, LLONG_MAX);
+            break;
+         case OPT_MAX_DEPTH:
+            opts.maxDepth = limitArg("--max-depth", optarg, UINT_MAX);
+            break;
+         case OPT_MAX_PAYLOAD:
+            opts.maxPayload = limitArg("--max-payload", optarg, LLONG_MAX);
+            break;
+         case OPT_MAX_ALLOC:
+            opts.maxAlloc = limitArg("--max-alloc", optarg, LLONG_MAX);
+            break;
+         case OPT_COST:
+            if (strcmp(optarg, "table") != 0 && strcmp(optarg, "json") != 0) {
+               fprintf(stderr, "unsupported cost format: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            costFormat = optarg;
+            break;
+         case OPT_SPLIT:
+            opts.splitDir = optarg;
+            break;
+         case OPT_SPLIT_ACTIONS: {
+            char *actionsEnd;
+            opts.splitActions = strtoul(optarg, &actionsEnd, 10);
+            if (*actionsEnd || actionsEnd == optarg || opts.splitActions == 0) {
+               fprintf(stderr, "invalid actions per chunk: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            break;
+         }
+         case OPT_BACKEND:
+            if (strcmp(optarg, "main") == 0) {
+               opts.backend = POVXML2C_BACKEND_MAIN;
+            }
+            else if (strcmp(optarg, "resumable") == 0) {
+               opts.backend = POVXML2C_BACKEND_RESUMABLE;
+            }
+            else {
+               fprintf(stderr, "unknown backend: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            break;
+         case OPT_EARLY_WRITES:
+            //on its own, only pass the read immediately ahead of a write
+            opts.earlyWrites = 1;
+            if (optarg != NULL) {
+               char *earlyEnd;
+               opts.earlyWrites = strtoul(optarg, &earlyEnd, 10);
+               if (*earlyEnd || earlyEnd == optarg) {
+                  fprintf(stderr, "invalid early write limit: %s\n", optarg);
+                  exit(REASON_INVALID_OPT);
+               }
+            }
+            break;
+         case OPT_PROBES:
+            if (probesEnd != NULL) {
+               fprintf(stderr, "option --probes may be specified only once\n");
+               exit(REASON_INVALID_OPT);
+            }
+            opts.probeFd = strtoul(optarg, &probesEnd, 10);
+            if (*probesEnd || probesEnd == optarg || opts.probeFd < 0) {
+               fprintf(stderr, "invalid probe fd: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            break;
+         case 'v':
+            if (opts.verifyOnly) {
+               fprintf(stderr, "option -v may be specified only once\n");
+               exit(REASON_INVALID_OPT);
+            }
+            opts.verifyOnly = true;
+            break;
+         case 'o':
+            if (opts.outfilename != NULL) {
+               fprintf(stderr, "option -o may be specified only once\n");
+               exit(REASON_INVALID_OPT);
+            }
+            opts.outfilename = optarg;
+            break;
+         case 'x':
+            if (opts.xmlFile) {
+               fprintf(stderr, "option -x may be specified only once\n");
+               exit(REASON_INVALID_OPT);
+            }
+            opts.xmlFile = optarg;
+            break;
+         case 't':
+            if (parseEnd != NULL) {
+               fprintf(stderr, "option -t may be specified only once\n");
+               exit(REASON_INVALID_OPT);
+            }
+            opts.parseTimeout = strtoul(optarg, &parseEnd, 10);
+            if (*parseEnd || parseEnd == optarg) {
+               exit(REASON_INVALID_PARSE_TIMEOUT);
+            }
+            break;
+         case 'c':
+            if (opts.cacheDir != NULL) {
+               fprintf(stderr, "option -c may be specified only once\n");
+               exit(REASON_INVALID_OPT);
+            }
+            opts.cacheDir = optarg;
+            break;
+         case 'C':
+            if (cacheEnd != NULL) {
+               fprintf(stderr, "option -C may be specified only once\n");
+               exit(REASON_INVALID_OPT);
+            }
+            opts.cacheSize = strtoull(optarg, &cacheEnd, 10);
+            if (*cacheEnd || cacheEnd == optarg) {
+               fprintf(stderr, "invalid cache size: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            break;
+         case 'S':
+            if (socketPath != NULL) {
+               fprintf(stderr, "option -S may be specified only once\n");
+               exit(REASON_INVALID_OPT);
+            }
+            socketPath = optarg;
+            break;
+         case 'j':
+            if (workersEnd != NULL) {
+               fprintf(stderr, "option -j may be specified only once\n");
+               exit(REASON_INVALID_OPT);
+            }
+            workers = strtoul(optarg, &workersEnd, 10);
+            if (*workersEnd || workersEnd == optarg || workers <= 0) {
+               fprintf(stderr, "invalid worker count: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            break;
+         case 'd':
+            if (deadlineEnd != NULL) {
+               fprintf(stderr, "option -d may be specified only once\n");
+               exit(REASON_INVALID_OPT);
+            }
+            deadline = strtoul(optarg, &deadlineEnd, 10);
+            if (*deadlineEnd || deadlineEnd == optarg) {
+               fprintf(stderr, "invalid deadline: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            break;
+         case 'm':
+            if (maxInputEnd != NULL) {
+               fprintf(stderr, "option -m may be specified only once\n");
+               exit(REASON_INVALID_OPT);
+            }
+            opts.maxInput = strtoull(optarg, &maxInputEnd, 10);
+            if (*maxInputEnd || maxInputEnd == optarg) {
+               fprintf(stderr, "invalid input size limit: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            break;
+         case 'h':
+            usage(argv[0], 0);
+            break;
+         default:
+            fprintf(stderr, "invalid option -%c\n", optopt);
+            usage(argv[0], REASON_INVALID_OPT);
+      }
+   }
+
+   if (opts.replay != NULL && (opts.outfilename != NULL || opts.verifyOnly)) {
+      fprintf(stderr, "options -o and -v may not be used with --replay\n");
+      exit(REASON_INVALID_OPT);
+   }
+   if (opts.simulate != NULL && (opts.outfilename != NULL || opts.verifyOnly || opts.replay != NULL)) {
+      fprintf(stderr, "options -o, -v and --replay may not be used with --simulate\n");
+      exit(REASON_INVALID_OPT);
+   }
+   if (opts.splitDir != NULL && (opts.outfilename != NULL || opts.verifyOnly || opts.replay != NULL ||
+                                 opts.simulate != NULL)) {
+      fprintf(stderr, "options -o, -v, --replay and --simulate may not be used with --split\n");
+      exit(REASON_INVALID_OPT);
+   }
+   if (opts.splitDir != NULL && (opts.backend != POVXML2C_BACKEND_MAIN || opts.probeFd >= 0)) {
+      fprintf(stderr, "--split requires the main backend and no --probes\n");
+      exit(REASON_INVALID_OPT);
+   }
+   if (costFormat != NULL) {
+      if (opts.xmlFile != NULL || opts.replay != NULL || opts.simulate != NULL || opts.splitDir != NULL ||
+          socketPath != NULL || watchDir != NULL || bundleDir != NULL) {
+         fprintf(stderr, "options -x, -S, --replay, --simulate, --split, --watch and --bundle may not be used with --cost\n");
+         exit(REASON_INVALID_OPT);
+      }
+      if (optind == argc) {
+         fprintf(stderr, "pov-xml2c: no xml files to estimate.\n");
+         exit(REASON_INVALID_OPT);
+      }
+      exit(costPoVs(&opts, costFormat, argv + optind, argc - optind));
+   }
+   if (bundleDir != NULL) {
+      if (opts.xmlFile != NULL || opts.outfilename != NULL || opts.verifyOnly || opts.replay != NULL ||
+          opts.simulate != NULL || opts.splitDir != NULL || socketPath != NULL || watchDir != NULL) {
+         fprintf(stderr, "options -x, -o, -v, -S, --replay, --simulate, --split and --watch may not be used with --bundle\n");
+         exit(REASON_INVALID_OPT);
+      }
+      if (optind == argc) {
+         fprintf(stderr, "pov-xml2c: no xml files to bundle.\n");
+         exit(REASON_INVALID_OPT);
+      }
+      exit(bundlePoVs(&opts, bundleDir, argv + optind, argc - optind));
+   }
+   if (watchDir != NULL) {
+      if (opts.xmlFile != NULL || opts.outfilename != NULL || opts.replay != NULL || opts.simulate != NULL ||
+          opts.splitDir != NULL || socketPath != NULL) {
+         fprintf(stderr, "options -x, -o, -S, --replay, --simulate and --split may not be used with --watch\n");
+         exit(REASON_INVALID_OPT);
+      }
+      exit(runWatch(watchDir, &opts));
+   }
+   if (socketPath != NULL) {
+      if (opts.xmlFile != NULL || opts.outfilename != NULL || opts.replay != NULL || opts.simulate != NULL ||
+          opts.splitDir != NULL) {
+         fprintf(stderr, "options -x, -o, --replay, --simulate and --split may not be used with -S\n");
+         exit(REASON_INVALID_OPT);
+      }
+      exit(runServer(socketPath, &opts, workers, deadline, allowDirs));
+   }
+
+   if (opts.xmlFile == NULL || strcmp(opts.xmlFile, "-") == 0) {
+      //a document piped in on stdin is streamed through the parser
+      if (opts.xmlFile == NULL && isatty(0)) {
+         fprintf(stderr, "pov-xml2c: xmlFile argument is missing.\n");
+         exit(REASON_INVALID_OPT);
+      }
+      xmlFd = 0;
+   }
+   else {
+      xmlFd = open(opts.xmlFile, O_RDONLY);
+      if (xmlFd == -1) {
+         fprintf(stderr, "pov-xml2c: unable to open %s: %s\n", opts.xmlFile, strerror(errno));
+         exit(REASON_XML_MISSING);
+      }
+      //external data is found next to the PoV
+      opts.baseDir = dirname(strdup(opts.xmlFile));
+   }
+
+   exit(convertPoV(xmlFd, &opts));
+}
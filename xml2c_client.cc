@@ -0,0 +1,396 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+/*
+ pov-xml2c-client is a drop in replacement for pov-xml2c that hands the
+ conversion to a resident pov-xml2c -S server.  Output, diagnostics and the
+ exit status are identical to those of a local conversion.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <libgen.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <string>
+#include <map>
+
+#include "xml2c_server.h"
+#include "xml2c_getopt.h"
+
+#include "reasons.h"
+
+using std::string;
+using std::map;
+
+void usage(const char *cmd, int reason) {
+   fprintf(stderr, "usage: %s [options] -x xml-file\n", cmd);
+   fprintf(stderr, "       %s -s\n", cmd);
+   fprintf(stderr, "  Accepts the options of pov-xml2c for a single conversion, which the server applies\n");
+   fprintf(stderr, "  -S Server socket.  Defaults to $%s or %s\n", SERVER_SOCKET_ENV, DEFAULT_SERVER_SOCKET);
+   fprintf(stderr, "  -d Request deadline in milliseconds.  Defaults to the server's\n");
+   fprintf(stderr, "  -P Send the path of the xml file rather than its contents\n");
+   fprintf(stderr, "  -s Print server statistics as json and exit\n");
+   exit(reason);
+}
+
+static bool readFd(int fd, string &data) {
+   char buf[65536];
+   ssize_t n;
+   while ((n = read(fd, buf, sizeof(buf))) != 0) {
+      if (n < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return false;
+      }
+      data.append(buf, n);
+   }
+   return true;
+}
+
+static bool readFile(const char *name, string &data) {
+   int fd = open(name, O_RDONLY);
+   if (fd == -1) {
+      return false;
+   }
+   bool ok = readFd(fd, data);
+   close(fd);
+   return ok;
+}
+
+//as pov-xml2c, each option with a value may be given once
+static void onlyOnce(bool *seen, const char *opt) {
+   if (*seen) {
+      fprintf(stderr, "option %s may be specified only once\n", opt);
+      exit(REASON_INVALID_OPT);
+   }
+   *seen = true;
+}
+
+static bool isNumber(const char *arg, unsigned long long max) {
+   char *end;
+   errno = 0;
+   unsigned long long value = strtoull(arg, &end, 10);
+   return *end == 0 && end != arg && arg[0] != '-' && errno == 0 && value <= max;
+}
+
+//the server resolves paths from its own working directory
+static string absolutePath(const char *path) {
+   char cwd[PATH_MAX];
+   if (path[0] == '/' || getcwd(cwd, sizeof(cwd)) == NULL) {
+      return path;
+   }
+   return string(cwd) + "/" + path;
+}
+
+static void addHeader(string &request, const char *name, const string &value) {
+   if (value.find('\n') != string::npos) {
+      fprintf(stderr, "pov-xml2c-client: %s may not contain a newline\n", name);
+      exit(REASON_INVALID_OPT);
+   }
+   request += string(name) + " " + value + "\n";
+}
+
+static int connectServer(const char *socketPath) {
+   struct sockaddr_un addr;
+   if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+      fprintf(stderr, "socket path too long: %s\n", socketPath);
+      return -1;
+   }
+   int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd == -1) {
+      perror("socket");
+      return -1;
+   }
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, socketPath);
+   if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+      fprintf(stderr, "pov-xml2c-client: unable to connect to %s: %s\n", socketPath, strerror(errno));
+      close(fd);
+      return -1;
+   }
+   return fd;
+}
+
+int main(int argc, char **argv) {
+   int opt;
+   int longIndex;
+   const char *outfilename = NULL;
+   const char *xmlFile = NULL;
+   const char *socketPath = getenv(SERVER_SOCKET_ENV);
+   const char *statsFile = NULL;
+   //the generator options, as request headers
+   string options;
+   bool seen[128];
+   bool probesSeen = false;
+   bool statsJson = false;
+   bool externalData = false;
+   bool verifyOnly = false;
+   bool sendPath = false;
+   bool getStats = false;
+
+   memset(seen, 0, sizeof(seen));
+   while ((opt = getopt_long(argc, argv, XML2C_SHORT_OPTS "Ps", xml2cLongOpts, &longIndex)) != -1) {
+      switch (opt) {
+         case 'v':
+            onlyOnce(&seen[opt], "-v");
+            verifyOnly = true;
+            break;
+         case 'o':
+            onlyOnce(&seen[opt], "-o");
+            outfilename = optarg;
+            break;
+         case 'x':
+            onlyOnce(&seen[opt], "-x");
+            xmlFile = optarg;
+            break;
+         case 't':
+            onlyOnce(&seen[opt], "-t");
+            if (!isNumber(optarg, INT_MAX)) {
+               exit(REASON_INVALID_PARSE_TIMEOUT);
+            }
+            addHeader(options, "timeout", optarg);
+            break;
+         case 'c':
+            onlyOnce(&seen[opt], "-c");
+            addHeader(options, "cache", absolutePath(optarg));
+            break;
+         case 'C':
+            onlyOnce(&seen[opt], "-C");
+            if (!isNumber(optarg, ULLONG_MAX)) {
+               fprintf(stderr, "invalid cache size: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            addHeader(options, "cache-size", optarg);
+            break;
+         case 'S':
+            onlyOnce(&seen[opt], "-S");
+            socketPath = optarg;
+            break;
+         case 'j':
+            //the server's worker count, as pov-xml2c outside server mode
+            //it is checked and has no effect
+            onlyOnce(&seen[opt], "-j");
+            if (!isNumber(optarg, INT_MAX) || strtoul(optarg, NULL, 10) == 0) {
+               fprintf(stderr, "invalid worker count: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            break;
+         case OPT_ALLOW_DIR:
+            //set when the server starts, as -j it has no effect here
+            break;
+         case 'd':
+            onlyOnce(&seen[opt], "-d");
+            if (!isNumber(optarg, ULLONG_MAX)) {
+               fprintf(stderr, "invalid deadline: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            addHeader(options, "deadline", optarg);
+            break;
+         case 'm':
+            onlyOnce(&seen[opt], "-m");
+            if (!isNumber(optarg, ULLONG_MAX)) {
+               fprintf(stderr, "invalid input size limit: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            addHeader(options, "max-input", optarg);
+            break;
+         case OPT_STATS:
+            if (strcmp(optarg, "json") != 0) {
+               fprintf(stderr, "unsupported statistics format: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            statsJson = true;
+            addHeader(options, "stats", optarg);
+            break;
+         case OPT_STATS_FILE:
+            statsFile = optarg;
+            break;
+         case OPT_PROBES:
+            if (probesSeen) {
+               fprintf(stderr, "option --probes may be specified only once\n");
+               exit(REASON_INVALID_OPT);
+            }
+            probesSeen = true;
+            if (!isNumber(optarg, INT_MAX)) {
+               fprintf(stderr, "invalid probe fd: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            addHeader(options, "probes", optarg);
+            break;
+         case OPT_EARLY_WRITES:
+            //on its own, only pass the read immediately ahead of a write
+            if (optarg != NULL && !isNumber(optarg, UINT_MAX)) {
+               fprintf(stderr, "invalid early write limit: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            addHeader(options, "early", optarg != NULL ? optarg : "1");
+            break;
+         case OPT_BACKEND:
+            //sent as its povxml2c_backend value
+            if (strcmp(optarg, "main") == 0) {
+               addHeader(options, "backend", "0");
+            }
+            else if (strcmp(optarg, "resumable") == 0) {
+               addHeader(options, "backend", "1");
+            }
+            else {
+               fprintf(stderr, "unknown backend: %s\n", optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            break;
+         case OPT_FIXED_READS:
+            addHeader(options, "fixed-reads", "1");
+            break;
+         case OPT_RELEASE_VARS:
+            addHeader(options, "release-vars", "1");
+            break;
+         case OPT_EXTERNAL_DATA:
+            externalData = true;
+            addHeader(options, "external-data", "1");
+            break;
+         case OPT_MAX_NODES:
+         case OPT_MAX_DEPTH:
+         case OPT_MAX_PAYLOAD:
+         case OPT_MAX_ALLOC:
+            if (!isNumber(optarg, opt == OPT_MAX_DEPTH ? UINT_MAX : LLONG_MAX)) {
+               fprintf(stderr, "invalid --%s limit: %s\n", xml2cLongOpts[longIndex].name, optarg);
+               exit(REASON_INVALID_OPT);
+            }
+            addHeader(options, xml2cLongOpts[longIndex].name, optarg);
+            break;
+         case OPT_REPLAY:
+         case OPT_SIMULATE:
+         case OPT_SPLIT:
+         case OPT_SPLIT_ACTIONS:
+         case OPT_BUNDLE:
+         case OPT_WATCH:
+         case OPT_COST:
+            //these run the PoV or convert many, rather than generate one
+            fprintf(stderr, "option --%s is not supported by the server, use pov-xml2c\n",
+                    xml2cLongOpts[longIndex].name);
+            exit(REASON_INVALID_OPT);
+         case 'P':
+            sendPath = true;
+            break;
+         case 's':
+            getStats = true;
+            break;
+         case 'h':
+            usage(argv[0], 0);
+            break;
+         default:
+            fprintf(stderr, "invalid option -%c\n", optopt);
+            usage(argv[0], REASON_INVALID_OPT);
+      }
+   }
+   if (socketPath == NULL) {
+      socketPath = DEFAULT_SERVER_SOCKET;
+   }
+
+   string request;
+   string body;
+   if (getStats) {
+      request = "op stats\n";
+   }
+   else {
+      bool fromStdin = xmlFile == NULL || strcmp(xmlFile, "-") == 0;
+      if (fromStdin && (sendPath || (xmlFile == NULL && isatty(0)))) {
+         fprintf(stderr, "pov-xml2c: xmlFile argument is missing.\n");
+         exit(REASON_INVALID_OPT);
+      }
+      request = verifyOnly ? "op verify\n" : "op convert\n";
+      char path[PATH_MAX];
+      if (!fromStdin && realpath(xmlFile, path) == NULL) {
+         fprintf(stderr, "pov-xml2c-client: %s: %s\n", xmlFile, strerror(errno));
+         exit(REASON_XML_MISSING);
+      }
+      if (sendPath) {
+         addHeader(request, "path", path);
+      }
+      else {
+         if (fromStdin ? !readFd(0, body) : !readFile(xmlFile, body)) {
+            fprintf(stderr, "pov-xml2c-client: %s: %s\n", fromStdin ? "stdin" : xmlFile, strerror(errno));
+            exit(REASON_XML_MISSING);
+         }
+         char len[64];
+         snprintf(len, sizeof(len), "length %zu\n", body.size());
+         request += len;
+         if (externalData) {
+            //external data is found next to the PoV, or in the working
+            //directory for stdin
+            addHeader(request, "base", fromStdin ? absolutePath(".") : string(dirname(path)));
+         }
+      }
+      request += options;
+   }
+   request += "\n";
+
+   int fd = connectServer(socketPath);
+   if (fd == -1) {
+      exit(REASON_SERVER_FAIL);
+   }
+   if (!writeAll(fd, request.data(), request.size()) || !writeAll(fd, body.data(), body.size())) {
+      perror("pov-xml2c-client: send");
+      exit(REASON_SERVER_FAIL);
+   }
+
+   map<string, string> hdr;
+   unsigned long long status, outLen, diagLen, statsLen = 0;
+   if (!readHeader(fd, hdr) || !headerValue(hdr, "status", &status) ||
+       !headerValue(hdr, "output", &outLen) || !headerValue(hdr, "diagnostics", &diagLen)) {
+      fprintf(stderr, "pov-xml2c-client: malformed response from server\n");
+      exit(REASON_SERVER_FAIL);
+   }
+   headerValue(hdr, "statistics", &statsLen);
+   string out(outLen, 0);
+   string diag(diagLen, 0);
+   string stats(statsLen, 0);
+   if (!readAll(fd, &out[0], outLen) || !readAll(fd, &diag[0], diagLen) || !readAll(fd, &stats[0], statsLen)) {
+      fprintf(stderr, "pov-xml2c-client: truncated response from server\n");
+      exit(REASON_SERVER_FAIL);
+   }
+   close(fd);
+
+   fwrite(diag.data(), 1, diag.size(), stderr);
+   if (status == REASON_SUCCESS && !verifyOnly) {
+      FILE *outfile = stdout;
+      if (outfilename != NULL && !getStats) {
+         outfile = fopen(outfilename, "w");
+         if (outfile == NULL) {
+            fprintf(stderr, "Failed to open output file\n");
+            exit(1);
+         }
+      }
+      fwrite(out.data(), 1, out.size(), outfile);
+      if (outfile != stdout) {
+         fclose(outfile);
+      }
+   }
+   if (statsJson && stats.size() > 0) {
+      //as pov-xml2c --stats, in their own file unless left on stderr
+      FILE *f = statsFile != NULL ? fopen(statsFile, "w") : stderr;
+      if (f == NULL) {
+         perror(statsFile);
+      }
+      else {
+         fwrite(stats.data(), 1, stats.size(), f);
+         if (f != stderr) {
+            fclose(f);
+         }
+      }
+   }
+   exit(status);
+}
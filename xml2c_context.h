@@ -0,0 +1,144 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_CONTEXT_H
+#define __XML2C_CONTEXT_H
+
+#include <stdio.h>
+#include <libxml/tree.h>
+#include <vector>
+#include <string>
+#include <map>
+
+#include "povxml2c.h"
+#include "logging.h"
+#include "xml2c_bundle.h"
+#include "utils.h"
+
+using std::vector;
+using std::string;
+using std::map;
+
+class Action;
+
+struct Xml2cDiag {
+   int severity;
+   int line;
+   string message;
+};
+
+/*
+ * Everything that belongs to a single conversion.  Nothing in the converter
+ * keeps per conversion state anywhere else, which is what makes the library
+ * reentrant.  The context is also the log sink for the thread running the
+ * conversion.
+ */
+class Xml2cContext : public LogSink {
+private:
+   vector<povxml2c_diag> diagView;
+
+   //disable copy
+   Xml2cContext(const Xml2cContext &c);
+   const Xml2cContext &operator=(const Xml2cContext &c);
+
+public:
+   //options
+   bool verifyOnly;
+   bool echoEnable;
+   int parseTimeout;
+   //the same in milliseconds, for a caller with a deadline of its own
+   unsigned long long deadlineMs;
+   string cacheDir;
+   unsigned long long cacheSize;
+   unsigned long long maxInput;
+   //fd receiving probe records from the generated PoV, -1 for no probes
+   int probeFd;
+   //accept <data file=...> references, resolved against baseDir
+   bool externalData;
+   string baseDir;
+   //reads a write may be hoisted across, 0 to keep document order
+   unsigned int earlyWrites;
+   //one of povxml2c_backend
+   int backend;
+   //read a delimited line matched exactly in full as that many bytes
+   bool fixedReads;
+   //release variables after their last use and drop assignments never read
+   bool releaseVars;
+   //caps on the document and on what converting it may use, 0 for none
+   unsigned long long maxNodes;
+   unsigned int maxDepth;
+   unsigned long long maxPayload;
+   unsigned long long maxAlloc;
+
+   //id counters used to name generated variables
+   unsigned int readId;
+   unsigned int writeId;
+   unsigned int varId;
+   unsigned int valueId;
+   //some read carries a <timeout>, so the timed read helpers are needed
+   bool timedReads;
+   //some read is fused, so the pov_expect helpers are needed
+   bool fusedReads;
+   //resumable backend: session variable slots, and whether libpcre is needed
+   map<string, unsigned int> varSlots;
+   bool stepRegexes;
+
+   //challenge the PoV targets, from <cbid>
+   string cbid;
+   OwnedVector<Action> pov;
+   //set while the PoV is generated into a bundle
+   Xml2cBundle *bundle;
+   vector<Xml2cDiag> diags;
+   //line of the element being processed, attached to diagnostics
+   int currentLine;
+   double deadline;
+   //xml2cAllocBytes when the conversion began
+   unsigned long long allocBase;
+   //REASON_* of the first cap the conversion crossed, REASON_SUCCESS if none
+   int limitReason;
+
+   povxml2c_stats stats;
+   //library setup cost, reported by the first conversion on this context
+   double initWall;
+   double initCpu;
+
+   Xml2cContext();
+   virtual ~Xml2cContext();
+
+   //discard the results of any previous conversion
+   void reset();
+   bool expired();
+   //true once the payload or allocation cap is crossed, which is logged once
+   bool overLimit();
+   void clearDiags();
+   //slot of a variable in the resumable backend's session, allocated on first use
+   unsigned int varSlot(const string &name);
+
+   void message(int severity, const char *text);
+   const povxml2c_diag *diag(size_t idx);
+};
+
+struct povxml2c_ctx : public Xml2cContext {
+};
+
+struct povxml2c_bundle : public Xml2cBundle {
+};
+
+/*
+ * Allocation counter supplied by hosts that count allocations, such as the
+ * pov-xml2c binary.  Absent from the process otherwise.
+ */
+unsigned long long xml2cAllocCount() __attribute__((weak));
+//bytes requested by the calling thread, and the count past which its libxml2
+//allocations fail
+unsigned long long xml2cAllocBytes() __attribute__((weak));
+void xml2cAllocLimit(unsigned long long bytes) __attribute__((weak));
+
+bool buildPoV(Xml2cContext *ctx, xmlNode *pov_xml);
+int generateSource(Xml2cContext *ctx, FILE *outfile);
+//the statements performing the actions, the body of main()
+void generateActions(Xml2cContext *ctx, FILE *outfile);
+
+#endif
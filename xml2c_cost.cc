@@ -0,0 +1,146 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#include <string.h>
+
+#include <set>
+#include <vector>
+
+#include "xml2c_cost.h"
+#include "xml2c_context.h"
+#include "action.h"
+
+using std::set;
+using std::vector;
+
+Xml2cCost::Xml2cCost() : live(0) {
+   memset(&totals, 0, sizeof(totals));
+}
+
+unsigned long long Xml2cCost::varSize(const string &name) {
+   map<string, unsigned long long>::iterator i = vars.find(name);
+   return i != vars.end() ? i->second : 0;
+}
+
+void Xml2cCost::setVar(const string &name, unsigned long long size) {
+   //an assignment replaces the old value
+   live -= varSize(name);
+   live += size;
+   vars[name] = size;
+   if (live > totals.var_peak_bytes) {
+      totals.var_peak_bytes = live;
+   }
+}
+
+void Xml2cCost::dropVar(const string &name) {
+   live -= varSize(name);
+   vars.erase(name);
+}
+
+void Xml2cCost::regex(const char *expr) {
+   int risk = regexRisk(expr);
+   totals.regexes++;
+   if (risk >= 2) {
+      totals.risky_regexes++;
+   }
+   if (risk > totals.regex_risk) {
+      totals.regex_risk = risk;
+   }
+}
+
+int regexRisk(const char *expr) {
+   //for each open group, whether it holds an unbounded repeat so far
+   vector<bool> groups;
+   //the atom just before p is a group holding an unbounded repeat
+   bool repeatedInside = false;
+   unsigned int unbounded = 0;
+   bool backref = false;
+   bool nested = false;
+   for (const char *p = expr; *p; p++) {
+      if (*p == '*' || *p == '+' || *p == '{') {
+         bool unlimited = *p != '{';
+         if (*p == '{') {
+            const char *close = strchr(p, '}');
+            if (close == NULL) {
+               repeatedInside = false;
+               continue;
+            }
+            //{n,} has no upper bound
+            unlimited = close[-1] == ',';
+            p = close;
+         }
+         //lazy and possessive forms repeat just the same
+         if (p[1] == '?' || p[1] == '+') {
+            p++;
+         }
+         nested = nested || repeatedInside;
+         if (unlimited) {
+            unbounded++;
+            for (size_t i = 0; i < groups.size(); i++) {
+               groups[i] = true;
+            }
+         }
+         repeatedInside = false;
+      }
+      else if (*p == '(') {
+         groups.push_back(false);
+         repeatedInside = false;
+      }
+      else if (*p == ')') {
+         repeatedInside = !groups.empty() && groups.back();
+         if (!groups.empty()) {
+            groups.pop_back();
+         }
+      }
+      else if (*p == '\\') {
+         backref = backref || (p[1] >= '1' && p[1] <= '9');
+         if (p[1] != 0) {
+            p++;
+         }
+         repeatedInside = false;
+      }
+      else if (*p == '[') {
+         //a ] straight after [ or [^ is part of the class
+         p++;
+         if (*p == '^') {
+            p++;
+         }
+         if (*p == ']') {
+            p++;
+         }
+         while (*p != 0 && *p != ']') {
+            if (*p == '\\' && p[1] != 0) {
+               p++;
+            }
+            p++;
+         }
+         if (*p == 0) {
+            break;
+         }
+         repeatedInside = false;
+      }
+      else {
+         repeatedInside = false;
+      }
+   }
+   if (nested) {
+      return 3;
+   }
+   if (unbounded > 1 || backref) {
+      return 2;
+   }
+   return unbounded > 0 ? 1 : 0;
+}
+
+void estimateCost(Xml2cContext *ctx, povxml2c_cost *cost) {
+   Xml2cCost c;
+   for (vector<Action*>::iterator i = ctx->pov.begin(); i != ctx->pov.end(); i++) {
+      (*i)->cost(&c);
+      for (set<string>::iterator r = (*i)->releases.begin(); r != (*i)->releases.end(); r++) {
+         c.dropVar(*r);
+      }
+   }
+   *cost = c.totals;
+}
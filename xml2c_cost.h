@@ -0,0 +1,53 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_COST_H
+#define __XML2C_COST_H
+
+#include <map>
+#include <string>
+
+#include "povxml2c.h"
+
+using std::map;
+using std::string;
+
+class Xml2cContext;
+
+/*
+ * Static cost of running a PoV, accumulated by each Action in document order
+ * without running anything.  Quantities that depend on what the service
+ * sends are counted at the least the PoV can see, and reads of that kind are
+ * counted in unknown_reads.  Variable sizes follow the actions so that a
+ * write or a length of a variable assigned earlier has a size too.
+ */
+class Xml2cCost {
+private:
+   //estimated size of each variable's value and their total
+   map<string, unsigned long long> vars;
+   unsigned long long live;
+
+public:
+   povxml2c_cost totals;
+
+   Xml2cCost();
+   //0 for a variable not assigned yet
+   unsigned long long varSize(const string &name);
+   void setVar(const string &name, unsigned long long size);
+   void dropVar(const string &name);
+   void regex(const char *expr);
+};
+
+/*
+ * Backtracking risk of a pcre pattern: 0 without unbounded repetition, 1
+ * with some, 2 with several unbounded repeats or a back reference, 3 with an
+ * unbounded repeat nested inside another repeat.
+ */
+int regexRisk(const char *expr);
+
+//cost of the PoV built in ctx, all but source_bytes
+void estimateCost(Xml2cContext *ctx, povxml2c_cost *cost);
+
+#endif
@@ -6,17 +6,20 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <unistd.h>
 #include "utils.h"
 #include "xml2c_delay.h"
+#include "xml2c_replay.h"
+#include "xml2c_cost.h"
 #include "logging.h"
 
 #include "reasons.h"
 
-Xml2cDelay::Xml2cDelay(xmlNode *n) {
+Xml2cDelay::Xml2cDelay(xmlNode *n, Xml2cContext *ctx) : Action(ctx) {
    unsigned int len;
    char *endptr;
-   char *delayText = getNodeText(n, &len);
-   char first = *delayText;
+   XmlString text(getNodeText(n, &len));
+   char *delayText = text.get();
    if (len == 0) {
       log_fail("<%s> element contains no data at line %d\n", n->name, n->line);
       throw (int)PARSE_ERROR;
@@ -29,11 +32,29 @@ Xml2cDelay::Xml2cDelay(xmlNode *n) {
       }
       endptr++;
    } 
-   xmlFree(delayText);
 }
    
+bool Xml2cDelay::replay(Xml2cReplay *r) {
+   if (!r->simulate) {
+      usleep(msec * 1000);
+   }
+   r->note("%u ms", msec);
+   return true;
+}
+
+void Xml2cDelay::cost(Xml2cCost *c) {
+   c->totals.delay_ms += msec;
+}
+
 void Xml2cDelay::generate(FILE *outfile) {
    fprintf(outfile, "   //*** delay\n");
    fprintf(outfile, "   delay(%u);\n", msec);
 }
 
+
+void Xml2cDelay::generateStep(FILE *outfile) {
+   fprintf(outfile, "      //*** delay\n");
+   fprintf(outfile, "      if (!pov_delay(s, %u, now)) {\n", msec);
+   fprintf(outfile, "         return POV_WANT_TIMER;\n");
+   fprintf(outfile, "      }\n");
+}
@@ -15,8 +15,12 @@ private:
    unsigned int msec;
 
 public:
-   Xml2cDelay(xmlNode *n);
+   Xml2cDelay(xmlNode *n, Xml2cContext *ctx);
    virtual void generate(FILE *outfile);
+   virtual int actionType() {return POVXML2C_ACTION_DELAY;};
+   virtual bool replay(Xml2cReplay *r);
+   virtual void generateStep(FILE *outfile);
+   virtual void cost(Xml2cCost *c);
 };
 
 
@@ -0,0 +1,139 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <libxml/tree.h>
+
+#include "xml2c_extdata.h"
+#include "xml2c_context.h"
+#include "utils.h"
+#include "logging.h"
+
+//external files must live at or below the directory of the PoV
+static bool escapesBaseDir(const char *file) {
+   if (file[0] == '/') {
+      return true;
+   }
+   for (const char *p = file; *p; ) {
+      if (p[0] == '.' && p[1] == '.' && (p[2] == '/' || p[2] == 0)) {
+         return true;
+      }
+      const char *slash = strchr(p, '/');
+      if (slash == NULL) {
+         break;
+      }
+      p = slash + 1;
+   }
+   return false;
+}
+
+static bool parseSize(xmlNode *d, const char *attr, uint64_t *value) {
+   XmlString attrText(xmlGetProp(d, (xmlChar*)attr));
+   char *text = attrText.get();
+   if (text == NULL) {
+      return false;
+   }
+   char *end;
+   errno = 0;
+   *value = strtoull(text, &end, 0);
+   if (*end != 0 || end == text || errno != 0 || text[0] == '-') {
+      log_fail("Invalid %s attribute \"%s\" in <%s> element at line %d\n", attr, text, d->name, d->line);
+      throw (int)PARSE_ERROR;
+   }
+   return true;
+}
+
+ExternalData *ExternalData::fromNode(xmlNode *d, Xml2cContext *ctx) {
+   XmlString fileText(xmlGetProp(d, (xmlChar*)"file"));
+   char *file = fileText.get();
+   if (file == NULL) {
+      return NULL;
+   }
+   Owned<ExternalData> ed(new ExternalData);
+   int fd = -1;
+   try {
+      if (!ctx->externalData) {
+         log_fail("External data reference \"%s\" at line %d requires external data to be enabled\n", file, d->line);
+         throw (int)PARSE_ERROR;
+      }
+      if (escapesBaseDir(file)) {
+         log_fail("External data reference \"%s\" at line %d must be a relative path below the PoV\n", file, d->line);
+         throw (int)PARSE_ERROR;
+      }
+      uint32_t tlen;
+      XmlString text(getNodeText(d, &tlen));
+      if (tlen > 0) {
+         log_fail("<%s> element at line %d has both a file reference and content\n", d->name, d->line);
+         throw (int)PARSE_ERROR;
+      }
+      ed->path = ctx->baseDir.size() > 0 ? ctx->baseDir + "/" + file : string(file);
+
+      fd = open(ed->path.c_str(), O_RDONLY);
+      struct stat sb;
+      if (fd == -1 || fstat(fd, &sb) != 0) {
+         log_fail("Unable to open external data \"%s\" at line %d: %s\n", file, d->line, strerror(errno));
+         throw (int)PARSE_ERROR;
+      }
+      uint64_t size = sb.st_size;
+      uint64_t length;
+      parseSize(d, "offset", &ed->offset);
+      if (ed->offset > size) {
+         log_fail("External data offset %llu at line %d is beyond the end of \"%s\"\n",
+                  (unsigned long long)ed->offset, d->line, file);
+         throw (int)PARSE_ERROR;
+      }
+      if (!parseSize(d, "length", &length)) {
+         length = size - ed->offset;
+      }
+      else if (length > size - ed->offset) {
+         log_fail("External data slice at line %d extends beyond the end of \"%s\"\n", d->line, file);
+         throw (int)PARSE_ERROR;
+      }
+      if (length > UINT32_MAX) {
+         log_fail("External data slice at line %d is larger than 4GB\n", d->line);
+         throw (int)PARSE_ERROR;
+      }
+      ed->length = length;
+
+      if (ed->length > 0) {
+         //mappings start on a page boundary
+         uint64_t pageMask = ~(uint64_t)(sysconf(_SC_PAGESIZE) - 1);
+         uint64_t mapOffset = ed->offset & pageMask;
+         ed->mapLen = ed->length + (ed->offset - mapOffset);
+         ed->map = mmap(NULL, ed->mapLen, PROT_READ, MAP_PRIVATE, fd, mapOffset);
+         if (ed->map == MAP_FAILED) {
+            ed->map = NULL;
+            log_fail("Unable to map external data \"%s\" at line %d: %s\n", file, d->line, strerror(errno));
+            throw (int)PARSE_ERROR;
+         }
+         madvise(ed->map, ed->mapLen, MADV_SEQUENTIAL);
+         ed->bytes = (const uint8_t*)ed->map + (ed->offset - mapOffset);
+      }
+      close(fd);
+   } catch (int ex) {
+      if (fd != -1) {
+         close(fd);
+      }
+      throw ex;
+   }
+   return ed.release();
+}
+
+ExternalData::~ExternalData() {
+   if (map != NULL) {
+      munmap(map, mapLen);
+   }
+}
+
+void ExternalData::print(FILE *outfile) {
+   printAsHexString(outfile, bytes, length);
+}
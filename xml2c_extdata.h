@@ -0,0 +1,53 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_EXTDATA_H
+#define __XML2C_EXTDATA_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <libxml/tree.h>
+#include <string>
+
+using std::string;
+
+class Xml2cContext;
+
+/*
+ * A <data file="..." offset="..." length="..."/> reference to raw bytes in a
+ * file next to the PoV.  This is an extension to cfe-pov.dtd and is only
+ * accepted when external data has been enabled.  The slice is mapped rather
+ * than read, and is only ever copied by printing it into the generated
+ * source.
+ */
+class ExternalData {
+
+private:
+   string path;
+   uint64_t offset;
+   uint32_t length;
+   void *map;
+   size_t mapLen;
+   const uint8_t *bytes;
+
+   ExternalData() : offset(0), length(0), map(NULL), mapLen(0), bytes(NULL) {};
+
+   //disable copy
+   ExternalData(const ExternalData &ed);
+   const ExternalData &operator=(const ExternalData &ed);
+
+public:
+   ~ExternalData();
+
+   //NULL if d carries no file attribute, throws PARSE_ERROR on a bad reference
+   static ExternalData *fromNode(xmlNode *d, Xml2cContext *ctx);
+
+   uint32_t size() {return length;};
+   const uint8_t *data() {return bytes;};
+   //emit the slice as a C string initializer, as printAsHexString
+   void print(FILE *outfile);
+};
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#include <stddef.h>
+
+#include "xml2c_getopt.h"
+
+const struct option xml2cLongOpts[] = {
+   {"stats", required_argument, NULL, OPT_STATS},
+   {"stats-file", required_argument, NULL, OPT_STATS_FILE},
+   {"probes", required_argument, NULL, OPT_PROBES},
+   {"external-data", no_argument, NULL, OPT_EXTERNAL_DATA},
+   {"early-writes", optional_argument, NULL, OPT_EARLY_WRITES},
+   {"replay", required_argument, NULL, OPT_REPLAY},
+   {"backend", required_argument, NULL, OPT_BACKEND},
+   {"bundle", required_argument, NULL, OPT_BUNDLE},
+   {"simulate", required_argument, NULL, OPT_SIMULATE},
+   {"split", required_argument, NULL, OPT_SPLIT},
+   {"split-actions", required_argument, NULL, OPT_SPLIT_ACTIONS},
+   {"watch", required_argument, NULL, OPT_WATCH},
+   {"fixed-reads", no_argument, NULL, OPT_FIXED_READS},
+   {"cost", required_argument, NULL, OPT_COST},
+   {"max-nodes", required_argument, NULL, OPT_MAX_NODES},
+   {"max-depth", required_argument, NULL, OPT_MAX_DEPTH},
+   {"max-payload", required_argument, NULL, OPT_MAX_PAYLOAD},
+   {"max-alloc", required_argument, NULL, OPT_MAX_ALLOC},
+   {"release-vars", no_argument, NULL, OPT_RELEASE_VARS},
+   {"allow-dir", required_argument, NULL, OPT_ALLOW_DIR},
+   {NULL, 0, NULL, 0}
+};
@@ -0,0 +1,43 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_GETOPT_H
+#define __XML2C_GETOPT_H
+
+#include <getopt.h>
+
+/*
+ * The options of pov-xml2c, shared with pov-xml2c-client so that the two
+ * accept the same command lines
+ */
+#define XML2C_SHORT_OPTS "hvt:x:o:c:C:S:j:d:m:"
+
+//long options without a short form
+enum {
+   OPT_STATS = 256,
+   OPT_STATS_FILE,
+   OPT_PROBES,
+   OPT_EXTERNAL_DATA,
+   OPT_EARLY_WRITES,
+   OPT_REPLAY,
+   OPT_BACKEND,
+   OPT_BUNDLE,
+   OPT_SIMULATE,
+   OPT_SPLIT,
+   OPT_SPLIT_ACTIONS,
+   OPT_WATCH,
+   OPT_FIXED_READS,
+   OPT_COST,
+   OPT_MAX_NODES,
+   OPT_MAX_DEPTH,
+   OPT_MAX_PAYLOAD,
+   OPT_MAX_ALLOC,
+   OPT_RELEASE_VARS,
+   OPT_ALLOW_DIR
+};
+
+extern const struct option xml2cLongOpts[];
+
+#endif
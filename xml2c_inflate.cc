@@ -0,0 +1,132 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#include <string.h>
+
+#include "xml2c_inflate.h"
+
+//decompressed bytes handed to the sink at a time
+#define INFLATE_CHUNK (64 * 1024)
+
+InflateFormat detectCompression(const uint8_t *data, size_t len) {
+   static const uint8_t xzMagic[] = {0xfd, '7', 'z', 'X', 'Z', 0};
+   static const uint8_t zstdMagic[] = {0x28, 0xb5, 0x2f, 0xfd};
+   if (len >= 2 && data[0] == 0x1f && data[1] == 0x8b) {
+      return INFLATE_GZIP;
+   }
+   if (len >= sizeof(xzMagic) && memcmp(data, xzMagic, sizeof(xzMagic)) == 0) {
+      return INFLATE_XZ;
+   }
+   if (len >= sizeof(zstdMagic) && memcmp(data, zstdMagic, sizeof(zstdMagic)) == 0) {
+      return INFLATE_ZSTD;
+   }
+   return INFLATE_NONE;
+}
+
+const char *compressionName(InflateFormat format) {
+   switch (format) {
+      case INFLATE_GZIP:
+         return "gzip";
+      case INFLATE_XZ:
+         return "xz";
+      case INFLATE_ZSTD:
+         return "zstd";
+      default:
+         return "uncompressed";
+   }
+}
+
+Xml2cInflate::Xml2cInflate(InflateFormat f) : format(f), ready(false), finished(false), out(INFLATE_CHUNK) {
+   memset(&zs, 0, sizeof(zs));
+   xs = (lzma_stream)LZMA_STREAM_INIT;
+   if (format == INFLATE_GZIP) {
+      //gzip wrapper only
+      ready = inflateInit2(&zs, 15 + 16) == Z_OK;
+   }
+   else if (format == INFLATE_XZ) {
+      ready = lzma_stream_decoder(&xs, UINT64_MAX, LZMA_CONCATENATED) == LZMA_OK;
+   }
+}
+
+Xml2cInflate::~Xml2cInflate() {
+   if (ready && format == INFLATE_GZIP) {
+      inflateEnd(&zs);
+   }
+   else if (ready && format == INFLATE_XZ) {
+      lzma_end(&xs);
+   }
+}
+
+bool Xml2cInflate::inflateGzip(const uint8_t *in, size_t len, InflateSink *sink) {
+   zs.next_in = (Bytef*)in;
+   zs.avail_in = len;
+   do {
+      zs.next_out = (Bytef*)out.data();
+      zs.avail_out = out.size();
+      int rc = inflate(&zs, Z_NO_FLUSH);
+      if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+         return false;
+      }
+      size_t n = out.size() - zs.avail_out;
+      if (n > 0 && !sink->write(out.data(), n)) {
+         return false;
+      }
+      finished = rc == Z_STREAM_END;
+      if (finished && zs.avail_in > 0) {
+         //another member follows, as produced by cat a.gz b.gz
+         if (inflateReset(&zs) != Z_OK) {
+            return false;
+         }
+         finished = false;
+      }
+      else if (rc == Z_BUF_ERROR || finished) {
+         break;
+      }
+   } while (zs.avail_in > 0 || zs.avail_out == 0);
+   return true;
+}
+
+bool Xml2cInflate::inflateXz(const uint8_t *in, size_t len, bool last, InflateSink *sink) {
+   xs.next_in = in;
+   xs.avail_in = len;
+   do {
+      xs.next_out = (uint8_t*)out.data();
+      xs.avail_out = out.size();
+      lzma_ret rc = lzma_code(&xs, last ? LZMA_FINISH : LZMA_RUN);
+      if (rc != LZMA_OK && rc != LZMA_STREAM_END && rc != LZMA_BUF_ERROR) {
+         return false;
+      }
+      size_t n = out.size() - xs.avail_out;
+      if (n > 0 && !sink->write(out.data(), n)) {
+         return false;
+      }
+      if (rc == LZMA_STREAM_END) {
+         finished = true;
+         break;
+      }
+      if (rc == LZMA_BUF_ERROR) {
+         break;
+      }
+   } while (xs.avail_in > 0 || xs.avail_out == 0 || last);
+   return true;
+}
+
+bool Xml2cInflate::feed(const uint8_t *in, size_t len, InflateSink *sink) {
+   if (!ready) {
+      return false;
+   }
+   if (format == INFLATE_GZIP) {
+      return inflateGzip(in, len, sink);
+   }
+   return inflateXz(in, len, false, sink);
+}
+
+bool Xml2cInflate::finish(InflateSink *sink) {
+   if (ready && format == INFLATE_XZ && !finished) {
+      //LZMA_CONCATENATED only reports the end once told there is no more input
+      return inflateXz(NULL, 0, true, sink) && finished;
+   }
+   return ready && finished;
+}
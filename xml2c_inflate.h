@@ -0,0 +1,75 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_INFLATE_H
+#define __XML2C_INFLATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <zlib.h>
+#include <lzma.h>
+#include <vector>
+
+using std::vector;
+
+/*
+ * Compressed PoVs and corpora, recognized by their magic bytes and
+ * decompressed as a stream so that the whole document is never expanded in
+ * memory or on disk.  gzip and xz are supported, concatenated members
+ * included.  zstd is recognized only to be reported, libzstd is not linked.
+ */
+enum InflateFormat {
+   INFLATE_NONE,
+   INFLATE_GZIP,
+   INFLATE_XZ,
+   INFLATE_ZSTD
+};
+
+//bytes needed to recognize every format
+#define INFLATE_MAGIC_MAX 6
+
+InflateFormat detectCompression(const uint8_t *data, size_t len);
+const char *compressionName(InflateFormat format);
+
+//receives decompressed output
+class InflateSink {
+public:
+   virtual ~InflateSink() {};
+   //false stops decompression
+   virtual bool write(const char *data, size_t len) = 0;
+};
+
+class Xml2cInflate {
+private:
+   InflateFormat format;
+   z_stream zs;
+   lzma_stream xs;
+   bool ready;
+   bool finished;
+   vector<char> out;
+
+   bool inflateGzip(const uint8_t *in, size_t len, InflateSink *sink);
+   bool inflateXz(const uint8_t *in, size_t len, bool last, InflateSink *sink);
+
+   //disable copy
+   Xml2cInflate(const Xml2cInflate &i);
+   const Xml2cInflate &operator=(const Xml2cInflate &i);
+
+public:
+   Xml2cInflate(InflateFormat f);
+   ~Xml2cInflate();
+
+   //false if format cannot be decompressed
+   bool ok() const {return ready;};
+   /*
+    * Decompress the next len bytes of input, handing the output to sink in
+    * pieces.  False on corrupt input or when the sink stops.
+    */
+   bool feed(const uint8_t *in, size_t len, InflateSink *sink);
+   //at the end of the input, false unless it ended a complete stream
+   bool finish(InflateSink *sink);
+};
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "xml2c_liveness.h"
+#include "xml2c_context.h"
+#include "logging.h"
+
+using std::set;
+using std::string;
+using std::vector;
+
+//fills assigned with every variable some action assigns
+static void reportUndefined(Xml2cContext *ctx, set<string> &assigned) {
+   set<string> reported;
+   for (vector<Action*>::iterator i = ctx->pov.begin(); i != ctx->pov.end(); i++) {
+      set<string> used;
+      (*i)->uses(used);
+      for (set<string>::iterator u = used.begin(); u != used.end(); u++) {
+         if (assigned.count(*u) == 0 && reported.insert(*u).second) {
+            ctx->currentLine = (*i)->line;
+            log_note("pov-xml2c variable %s is used at line %d before it is assigned\n", u->c_str(), (*i)->line);
+            ctx->stats.undefined_vars++;
+         }
+      }
+      (*i)->defines(assigned);
+   }
+   ctx->currentLine = 0;
+}
+
+void analyzeLiveness(Xml2cContext *ctx) {
+   set<string> assigned;
+   reportUndefined(ctx, assigned);
+   if (!ctx->releaseVars) {
+      return;
+   }
+
+   OwnedVector<Action> &pov = ctx->pov;
+   //variables some later action may still read
+   set<string> live;
+   unsigned int released = 0;
+   unsigned int dead = 0;
+   for (size_t i = pov.size(); i > 0; i--) {
+      Action *a = pov[i - 1];
+      a->releases.clear();
+
+      set<string> defs;
+      a->defines(defs);
+      bool removed = false;
+      for (set<string>::iterator d = defs.begin(); d != defs.end() && !removed; d++) {
+         if (live.count(*d)) {
+            continue;
+         }
+         if (a->actionType() == POVXML2C_ACTION_DECL) {
+            //nothing else happens in a declaration, its own uses go with it
+            pov.erase(pov.begin() + (i - 1));
+            delete a;
+            removed = true;
+            dead++;
+         }
+         else if (a->dropDefinition(*d)) {
+            dead++;
+         }
+         else if (a->actionType() == POVXML2C_ACTION_READ && i < pov.size()) {
+            //the assignment has to run, but its value can go straight away
+            a->releases.insert(*d);
+            released++;
+         }
+      }
+      if (removed) {
+         continue;
+      }
+
+      //a variable the action reassigns is not released after it, whatever
+      //it is built from
+      set<string> used;
+      a->uses(used);
+      defs.clear();
+      a->defines(defs);
+      for (set<string>::iterator u = used.begin(); u != used.end(); u++) {
+         //no point releasing anything once the last action is done
+         if (live.count(*u) == 0 && defs.count(*u) == 0 && assigned.count(*u) && i < pov.size()) {
+            a->releases.insert(*u);
+            released++;
+         }
+      }
+
+      set<string> kills;
+      a->overwrites(kills);
+      for (set<string>::iterator k = kills.begin(); k != kills.end(); k++) {
+         live.erase(*k);
+      }
+      live.insert(used.begin(), used.end());
+   }
+
+   ctx->stats.vars_released = released;
+   ctx->stats.dead_stores = dead;
+   log_note("liveness: %u variables released after their last use, %u assignments never read dropped\n",
+            released, dead);
+}
+
+/*
+ * libpov has no call to remove a variable, but replacing its value with an
+ * empty one frees the buffer behind it
+ */
+void generateReleases(FILE *outfile, Action *a) {
+   for (set<string>::iterator i = a->releases.begin(); i != a->releases.end(); i++) {
+      fprintf(outfile, "   //*** %s is not used again\n", i->c_str());
+      fprintf(outfile, "   putenv(\"%s\", (const unsigned char*)\"\", 0);\n", i->c_str());
+   }
+}
+
+void generateReleaseSteps(FILE *outfile, Xml2cContext *ctx, Action *a) {
+   for (set<string>::iterator i = a->releases.begin(); i != a->releases.end(); i++) {
+      fprintf(outfile, "      pov_set_var(s, %u, NULL, 0);  //%s is not used again\n", ctx->varSlot(*i), i->c_str());
+   }
+}
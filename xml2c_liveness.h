@@ -0,0 +1,29 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_LIVENESS_H
+#define __XML2C_LIVENESS_H
+
+#include <stdio.h>
+
+#include "action.h"
+
+class Xml2cContext;
+
+/*
+ * Report each variable some action uses before any earlier action assigns
+ * it.  With ctx->releaseVars, also walk ctx->pov backward to find the last
+ * use of every variable and record it in that action's releases, drop
+ * declarations nobody reads and read slice assigns overwritten before they
+ * are read.  Runs after scheduling, as it depends on the final order.
+ */
+void analyzeLiveness(Xml2cContext *ctx);
+
+//release the variables of a->releases in the main backend
+void generateReleases(FILE *outfile, Action *a);
+//release the variables of a->releases in the resumable backend's pov_step
+void generateReleaseSteps(FILE *outfile, Xml2cContext *ctx, Action *a);
+
+#endif
@@ -8,11 +8,12 @@
 #include <ctype.h>
 #include "utils.h"
 #include "xml2c_negotiate.h"
+#include "xml2c_replay.h"
 #include "logging.h"
 
 #include "reasons.h"
 
-Xml2cNegotiate::Xml2cNegotiate(xmlNode *n) {
+Xml2cNegotiate::Xml2cNegotiate(xmlNode *n, Xml2cContext *ctx) : Action(ctx) {
    xmlNode *typeNode = findChild(n, "type1");
    if (typeNode == NULL) {
       typeNode = findChild(n, "type2");
@@ -34,7 +35,8 @@ void Xml2cNegotiate::parseType1(xmlNode *type1) {
    xmlNode *ipMaskNode = findChild(type1, "ipmask");
    xmlNode *regMaskNode = findChild(type1, "regmask");
    xmlNode *regNumNode = findChild(type1, "regnum");
-   char *ipmaskStr = getNodeText(ipMaskNode, &len);
+   XmlString ipmaskText(getNodeText(ipMaskNode, &len));
+   char *ipmaskStr = ipmaskText.get();
    if (len == 0) {
       log_fail("<%s> element contains no data at line %d\n", ipMaskNode->name, ipMaskNode->line);
       throw (int)PARSE_ERROR;
@@ -48,7 +50,8 @@ void Xml2cNegotiate::parseType1(xmlNode *type1) {
       endptr++;
    } 
 
-   char *regmaskStr = getNodeText(regMaskNode, &len);
+   XmlString regmaskText(getNodeText(regMaskNode, &len));
+   char *regmaskStr = regmaskText.get();
    if (len == 0) {
       log_fail("<%s> element contains no data at line %d\n", regMaskNode->name, regMaskNode->line);
       throw (int)PARSE_ERROR;
@@ -62,7 +65,8 @@ void Xml2cNegotiate::parseType1(xmlNode *type1) {
       endptr++;
    }
 
-   char *regnumStr = getNodeText(regNumNode, &len);
+   XmlString regnumText(getNodeText(regNumNode, &len));
+   char *regnumStr = regnumText.get();
    if (len == 0) {
       log_fail("<%s> element contains no data at line %d\n", regNumNode->name, regNumNode->line);
       throw (int)PARSE_ERROR;
@@ -80,9 +84,6 @@ void Xml2cNegotiate::parseType1(xmlNode *type1) {
       throw (int)PARSE_ERROR;
    }
 
-   xmlFree(ipmaskStr);
-   xmlFree(regmaskStr);
-   xmlFree(regnumStr);
 }
 
 void Xml2cNegotiate::parseType2(xmlNode *type2) {
@@ -103,27 +104,83 @@ void Xml2cNegotiate::generate(FILE *outfile) {
    }
 }
 
-PovSubmit::PovSubmit(xmlNode *n) {
+//libpov leaves the negotiated values in these variables
+void Xml2cNegotiate::defines(set<string> &vars) {
+   if (povType == 1) {
+      vars.insert("TYPE1_IP");
+      vars.insert("TYPE1_REG");
+   }
+   else if (povType == 2) {
+      vars.insert("TYPE2_ADDR");
+      vars.insert("TYPE2_SIZE");
+      vars.insert("TYPE2_LENGTH");
+   }
+}
+
+//there is no competition framework to negotiate with when replaying
+bool Xml2cNegotiate::replay(Xml2cReplay *r) {
+   if (povType == 1) {
+      r->note("type 1 (ipmask 0x%x, regmask 0x%x, regnum %u) not negotiated", ipmask, regmask, regnum);
+   }
+   else {
+      r->note("type %u not negotiated", povType);
+   }
+   return true;
+}
+
+PovSubmit::PovSubmit(xmlNode *n, Xml2cContext *ctx) : Action(ctx) {
    unsigned int varLen;
    xmlNode *varNode = findChild(n, "var");
-   var = getNodeText(varNode, &varLen);
+   var.reset(getNodeText(varNode, &varLen));
    povType = 0;
 }
 
-PovSubmit::~PovSubmit() {
-   if (var != NULL) {
-      xmlFree(var);
+//only a type 2 submission sends its variable
+void PovSubmit::uses(set<string> &vars) {
+   if (povType == 2 && var.get() != NULL) {
+      vars.insert(var.get());
+   }
+}
+
+bool PovSubmit::replay(Xml2cReplay *r) {
+   if (povType != 2) {
+      r->note("nothing to submit");
+      return true;
+   }
+   if (var.get() == NULL) {
+      r->note("type 2 submission without a variable");
+      return true;
    }
+   const vector<uint8_t> &v = r->getVar(var.get());
+   string hex;
+   for (size_t i = 0; i < v.size(); i++) {
+      char byte[3];
+      snprintf(byte, sizeof(byte), "%02x", v[i]);
+      hex += byte;
+   }
+   r->note("type 2 submission of %zu bytes from %s: %s", v.size(), var.get(), hex.c_str());
+   return true;
 }
 
 void PovSubmit::generate(FILE *outfile) {
    if (povType == 2) {
       fprintf(outfile, "   //*** submitting type 2 POV results\n");
-      if (var != NULL) {
-         fprintf(outfile, "   submit_type2(\"%s\");\n", var);
+      if (var.get() != NULL) {
+         fprintf(outfile, "   submit_type2(\"%s\");\n", var.get());
       }
       else {
          fprintf(outfile, "   submit_type2(NULL);\n");
       }
    }
 }
+
+//a load test has no competition framework to negotiate with
+void Xml2cNegotiate::generateStep(FILE *outfile) {
+   fprintf(outfile, "      //*** type %u negotiation is not performed by the resumable backend\n", povType);
+}
+
+void PovSubmit::generateStep(FILE *outfile) {
+   if (povType == 2) {
+      fprintf(outfile, "      //*** type 2 submission is not performed by the resumable backend\n");
+   }
+}
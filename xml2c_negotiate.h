@@ -9,6 +9,7 @@
 #include <libxml/tree.h>
 
 #include "action.h"
+#include "utils.h"
 
 class Xml2cNegotiate : public Action {
 private:
@@ -22,20 +23,27 @@ private:
    void parseType2(xmlNode *type2);
 
 public:
-   Xml2cNegotiate(xmlNode *n);
+   Xml2cNegotiate(xmlNode *n, Xml2cContext *ctx);
    virtual void generate(FILE *outfile);
+   virtual int actionType() {return POVXML2C_ACTION_NEGOTIATE;};
+   virtual void defines(set<string> &vars);
+   virtual bool replay(Xml2cReplay *r);
+   virtual void generateStep(FILE *outfile);
    unsigned int getType() {return povType;};
 };
 
 class PovSubmit : public Action {
 private:
-   char *var;
+   XmlString var;
    unsigned int povType;
 public:
-   PovSubmit(void) : var(NULL) {};
-   PovSubmit(xmlNode *n);
-   ~PovSubmit();
+   PovSubmit(Xml2cContext *ctx) : Action(ctx), povType(0) {};
+   PovSubmit(xmlNode *n, Xml2cContext *ctx);
    virtual void generate(FILE *outfile);
+   virtual int actionType() {return POVXML2C_ACTION_SUBMIT;};
+   virtual void uses(set<string> &vars);
+   virtual bool replay(Xml2cReplay *r);
+   virtual void generateStep(FILE *outfile);
    void setType(unsigned int type) {povType = type;};
 };
 
@@ -0,0 +1,161 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#include <stdio.h>
+
+#include "xml2c_probe.h"
+
+/*
+ * Emitted once ahead of main.  DECREE offers no clock and no signals, so
+ * timestamps come from rdtsc and the ring is dumped when it fills and at
+ * exit.  Hosted builds of a PoV may define POV_PROBE_SIGNAL to also dump on
+ * that signal.  Timestamps are printed in hex to avoid 64 bit division,
+ * which would pull in libgcc on i386.
+ */
+static const char *probeRuntime =
+   "//**** pov-xml2c timing probes\n"
+   "#ifdef POV_PROBE_SIGNAL\n"
+   "#include <signal.h>\n"
+   "#endif\n"
+   "#define POV_PROBE_RING 256\n"
+   "typedef struct {\n"
+   "   unsigned int action;\n"
+   "   unsigned int line;\n"
+   "   unsigned int kind;\n"
+   "   unsigned int bytes;\n"
+   "   unsigned int matched;\n"
+   "   unsigned long long start;\n"
+   "   unsigned long long end;\n"
+   "} pov_probe;\n"
+   "static pov_probe pov_probe_ring[POV_PROBE_RING];\n"
+   "static pov_probe pov_probe_cur;\n"
+   "static int pov_probe_active;\n"
+   "static unsigned int pov_probe_count;\n"
+   "static unsigned int pov_probe_flushed;\n"
+   "static const char *pov_probe_kinds[] = {\"write\", \"read\", \"decl\", \"delay\", \"negotiate\", \"submit\"};\n"
+   "static inline unsigned long long pov_probe_tsc(void) {\n"
+   "   unsigned int lo, hi;\n"
+   "   __asm__ __volatile__(\"rdtsc\" : \"=a\"(lo), \"=d\"(hi));\n"
+   "   return ((unsigned long long)hi << 32) | lo;\n"
+   "}\n"
+   "static char *pov_probe_str(char *p, const char *s) {\n"
+   "   while (*s) {\n"
+   "      *p++ = *s++;\n"
+   "   }\n"
+   "   return p;\n"
+   "}\n"
+   "static char *pov_probe_hex(char *p, const char *label, unsigned long long v) {\n"
+   "   int shift = 60;\n"
+   "   p = pov_probe_str(p, label);\n"
+   "   *p++ = '0';\n"
+   "   *p++ = 'x';\n"
+   "   while (shift > 0 && ((v >> shift) & 0xf) == 0) {\n"
+   "      shift -= 4;\n"
+   "   }\n"
+   "   for (; shift >= 0; shift -= 4) {\n"
+   "      *p++ = \"0123456789abcdef\"[(v >> shift) & 0xf];\n"
+   "   }\n"
+   "   return p;\n"
+   "}\n"
+   "static char *pov_probe_dec(char *p, const char *label, unsigned int v) {\n"
+   "   char tmp[10];\n"
+   "   int n = 0;\n"
+   "   p = pov_probe_str(p, label);\n"
+   "   do {\n"
+   "      tmp[n++] = '0' + v %% 10;\n"
+   "      v /= 10;\n"
+   "   } while (v);\n"
+   "   while (n) {\n"
+   "      *p++ = tmp[--n];\n"
+   "   }\n"
+   "   return p;\n"
+   "}\n"
+   "static char *pov_probe_format(char *p, const char *tag, pov_probe *r, int done) {\n"
+   "   p = pov_probe_str(p, tag);\n"
+   "   p = pov_probe_dec(p, \" action=\", r->action);\n"
+   "   p = pov_probe_dec(p, \" line=\", r->line);\n"
+   "   p = pov_probe_str(p, \" kind=\");\n"
+   "   p = pov_probe_str(p, pov_probe_kinds[r->kind]);\n"
+   "   p = pov_probe_hex(p, \" start=\", r->start);\n"
+   "   if (done) {\n"
+   "      p = pov_probe_hex(p, \" end=\", r->end);\n"
+   "      p = pov_probe_hex(p, \" cycles=\", r->end - r->start);\n"
+   "      p = pov_probe_dec(p, \" bytes=\", r->bytes);\n"
+   "      p = pov_probe_dec(p, \" matched=\", r->matched);\n"
+   "   }\n"
+   "   *p++ = '\\n';\n"
+   "   return p;\n"
+   "}\n"
+   "static void pov_probe_dump(void) {\n"
+   "   static char buf[4096];\n"
+   "   char *p = buf;\n"
+   "   for (; pov_probe_flushed != pov_probe_count; pov_probe_flushed++) {\n"
+   "      if (p - buf > (int)sizeof(buf) - 256) {\n"
+   "         transmit_all(%d, buf, p - buf);\n"
+   "         p = buf;\n"
+   "      }\n"
+   "      p = pov_probe_format(p, \"probe\", &pov_probe_ring[pov_probe_flushed %% POV_PROBE_RING], 1);\n"
+   "   }\n"
+   "   if (pov_probe_active) {\n"
+   "      //the action in progress, which is the one blocked if we were killed\n"
+   "      p = pov_probe_format(p, \"probe-pending\", &pov_probe_cur, 0);\n"
+   "   }\n"
+   "   if (p != buf) {\n"
+   "      transmit_all(%d, buf, p - buf);\n"
+   "   }\n"
+   "}\n"
+   "#ifdef POV_PROBE_SIGNAL\n"
+   "static void pov_probe_signal(int sig) {\n"
+   "   pov_probe_dump();\n"
+   "}\n"
+   "#endif\n"
+   "static inline void pov_probe_begin(unsigned int action, unsigned int line, unsigned int kind) {\n"
+   "   pov_probe_cur.action = action;\n"
+   "   pov_probe_cur.line = line;\n"
+   "   pov_probe_cur.kind = kind;\n"
+   "   pov_probe_cur.bytes = 0;\n"
+   "   pov_probe_cur.matched = 0;\n"
+   "   pov_probe_active = 1;\n"
+   "   pov_probe_cur.start = pov_probe_tsc();\n"
+   "}\n"
+   "static inline void pov_probe_io(unsigned int bytes, unsigned int matched) {\n"
+   "   pov_probe_cur.bytes = bytes;\n"
+   "   pov_probe_cur.matched = matched;\n"
+   "}\n"
+   "static inline void pov_probe_end(void) {\n"
+   "   pov_probe_cur.end = pov_probe_tsc();\n"
+   "   pov_probe_active = 0;\n"
+   "   pov_probe_ring[pov_probe_count++ %% POV_PROBE_RING] = pov_probe_cur;\n"
+   "   if (pov_probe_count - pov_probe_flushed == POV_PROBE_RING) {\n"
+   "      pov_probe_dump();\n"
+   "   }\n"
+   "}\n";
+
+void generateProbeRuntime(FILE *outfile, int probeFd) {
+   fprintf(outfile, probeRuntime, probeFd, probeFd);
+}
+
+void generateProbeInit(FILE *outfile) {
+   fprintf(outfile, "#ifdef POV_PROBE_SIGNAL\n");
+   fprintf(outfile, "   signal(POV_PROBE_SIGNAL, pov_probe_signal);\n");
+   fprintf(outfile, "#endif\n");
+}
+
+//declarations only touch variables, they are not worth a probe
+bool isProbed(Action *a) {
+   return a->actionType() != POVXML2C_ACTION_DECL;
+}
+
+void generateProbeBegin(FILE *outfile, unsigned int idx, Action *a) {
+   fprintf(outfile, "   pov_probe_begin(%u, %d, %d);\n", idx, a->line, a->actionType());
+}
+
+void generateProbeEnd(FILE *outfile) {
+   fprintf(outfile, "   pov_probe_end();\n");
+}
+
+void generateProbeDump(FILE *outfile) {
+   fprintf(outfile, "   pov_probe_dump();\n");
+}
@@ -0,0 +1,26 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_PROBE_H
+#define __XML2C_PROBE_H
+
+#include <stdio.h>
+
+#include "action.h"
+
+/*
+ * Timing probes compiled into generated PoVs.  Each probed action records
+ * rdtsc timestamps, bytes moved and match outcome into a fixed ring that is
+ * written to a side fd when the ring fills and when the PoV exits.  Nothing
+ * is generated unless probes are enabled.
+ */
+void generateProbeRuntime(FILE *outfile, int probeFd);
+void generateProbeInit(FILE *outfile);
+bool isProbed(Action *a);
+void generateProbeBegin(FILE *outfile, unsigned int idx, Action *a);
+void generateProbeEnd(FILE *outfile);
+void generateProbeDump(FILE *outfile);
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "xml2c_server.h"
+
+bool writeAll(int fd, const void *buf, size_t len) {
+   const char *p = (const char*)buf;
+   while (len > 0) {
+      ssize_t n = write(fd, p, len);
+      if (n < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return false;
+      }
+      p += n;
+      len -= n;
+   }
+   return true;
+}
+
+bool readAll(int fd, void *buf, size_t len) {
+   char *p = (char*)buf;
+   while (len > 0) {
+      ssize_t n = read(fd, p, len);
+      if (n <= 0) {
+         if (n < 0 && errno == EINTR) {
+            continue;
+         }
+         return false;
+      }
+      p += n;
+      len -= n;
+   }
+   return true;
+}
+
+bool parseHeader(const string &block, map<string, string> &hdr) {
+   size_t pos = 0;
+   while (pos < block.size()) {
+      size_t eol = block.find('\n', pos);
+      if (eol == string::npos) {
+         eol = block.size();
+      }
+      if (eol > pos) {
+         size_t sp = block.find(' ', pos);
+         if (sp == string::npos || sp > eol || sp == pos) {
+            return false;
+         }
+         hdr[block.substr(pos, sp - pos)] = block.substr(sp + 1, eol - sp - 1);
+      }
+      pos = eol + 1;
+   }
+   return true;
+}
+
+bool readHeader(int fd, map<string, string> &hdr) {
+   string block;
+   char ch;
+   while (block.size() < MAX_REQUEST_HEADER) {
+      if (!readAll(fd, &ch, 1)) {
+         return false;
+      }
+      if (ch == '\n' && (block.size() == 0 || block[block.size() - 1] == '\n')) {
+         return parseHeader(block, hdr);
+      }
+      block += ch;
+   }
+   return false;
+}
+
+bool headerValue(map<string, string> &hdr, const char *name, unsigned long long *value) {
+   map<string, string>::iterator i = hdr.find(name);
+   if (i == hdr.end()) {
+      return false;
+   }
+   char *endptr;
+   const char *text = i->second.c_str();
+   *value = strtoull(text, &endptr, 10);
+   return *text != 0 && *endptr == 0;
+}
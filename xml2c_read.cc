@@ -18,10 +18,15 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <pcre.h>
 #include <new>
 
 #include "xml2c_read.h"
+#include "xml2c_context.h"
+#include "xml2c_replay.h"
+#include "xml2c_bundle.h"
+#include "xml2c_cost.h"
 #include "utils.h"
 #include "logging.h"
 
@@ -41,25 +46,24 @@ struct Regex {
    uint32_t _len;
    uint32_t group;
    uint32_t ngroups;
-   char *expr;
+   XmlString expr;
    pcre *regex;
    
    Regex(xmlNode *n);
    ~Regex();
-   vector<uint8_t> *match(const uint8_t *buf, uint32_t len, uint32_t *len0);
+   //the group's bytes, NULL if no match.  libpov searches rather than
+   //anchoring, pass 0 as options for that behavior
+   vector<uint8_t> *match(const uint8_t *buf, uint32_t len, uint32_t *len0, int options = PCRE_ANCHORED);
    vector<uint8_t> *match(vector<uint8_t> &buf, uint32_t *len0);
 };
 
-unsigned int Xml2cRead::readId = 0;
-
 Regex::Regex(xmlNode *n) {   
    uint32_t len;
-   expr = NULL;
-   bool parseError = false;
+   regex = NULL;
    try {
       getUintAttribute(n, "group", 0, &group);
-      expr = getNodeText(n, &len);
-      regex = init_regex(expr);
+      expr.reset(getNodeText(n, &len));
+      regex = init_regex(expr.get());
       pcre_fullinfo(regex, NULL, PCRE_INFO_CAPTURECOUNT, &ngroups);
       if (group > ngroups) {
          //attempt to specify a matching group larger than max number of groups
@@ -67,8 +71,8 @@ Regex::Regex(xmlNode *n) {
       }
       ngroups++;
    } catch (int ex) {
-      if (expr != NULL) {
-         xmlFree(expr);
+      if (regex != NULL) {
+         pcre_free(regex);
       }
       throw (int)PARSE_ERROR;
    }
@@ -76,13 +80,12 @@ Regex::Regex(xmlNode *n) {
 
 Regex::~Regex() {
    pcre_free(regex);
-   xmlFree(expr);
 }
 
-vector<uint8_t> *Regex::match(const uint8_t *buf, uint32_t len, uint32_t *len0) {
+vector<uint8_t> *Regex::match(const uint8_t *buf, uint32_t len, uint32_t *len0, int options) {
    vector<uint8_t> *val = NULL;
    int *ovector = new int[ngroups * 3];
-   int rc = pcre_exec(regex, NULL, (const char*)buf, len, 0, PCRE_ANCHORED, ovector, ngroups * 3);
+   int rc = pcre_exec(regex, NULL, (const char*)buf, len, 0, options, ovector, ngroups * 3);
    if (rc > 0) {
       int index  = group * 2;
       val = new vector<uint8_t>(buf + ovector[index], buf + ovector[index + 1]);
@@ -98,60 +101,99 @@ vector<uint8_t> *Regex::match(vector<uint8_t> &buf, uint32_t *len0) {
 
 class MatchPart {
 public:
-   virtual void generate(FILE *outfile, int id, int idx) = 0;
+   virtual ~MatchPart() {};
+   virtual void generate(FILE *outfile, Xml2cContext *ctx, int id, int idx) = 0;
+   //match buf at *ptr, advancing it as the generated code would
+   virtual bool replay(Xml2cReplay *r, const vector<uint8_t> &buf, uint32_t *ptr) = 0;
+   //match s->rd at ptr in the resumable backend, counting a miss in s->failed
+   virtual void generateStep(FILE *outfile, Xml2cContext *ctx, int id, int idx) = 0;
+   //the bytes matched, when known without reading anything first
+   virtual const vector<uint8_t> *exact() {return NULL;};
+   //bytes a successful match consumes, 0 where that depends on the input
+   virtual unsigned long long cost(Xml2cCost *c) = 0;
+   //variables matched against
+   virtual void uses(set<string> &vars) {};
 };
 
+//libpov's data_match and var_match: a prefix match of want at *ptr
+static bool prefixMatch(const vector<uint8_t> &buf, uint32_t *ptr, const uint8_t *want, size_t len) {
+   if (buf.size() - *ptr < len || memcmp(buf.data() + *ptr, want, len) != 0) {
+      return false;
+   }
+   *ptr += len;
+   return true;
+}
+
 class VarMatch : public MatchPart {
-   char *var;
+   XmlString var;
 public:
    VarMatch(xmlNode *n);
-   ~VarMatch();
-   void generate(FILE *outfile, int id, int idx);
+   void generate(FILE *outfile, Xml2cContext *ctx, int id, int idx);
+   bool replay(Xml2cReplay *r, const vector<uint8_t> &buf, uint32_t *ptr);
+   void generateStep(FILE *outfile, Xml2cContext *ctx, int id, int idx);
+   unsigned long long cost(Xml2cCost *c) {return c->varSize(var.get());};
+   void uses(set<string> &vars) {vars.insert(var.get());};
 };
 
 VarMatch::VarMatch(xmlNode *n) {
    uint32_t len;
-   var = getNodeText(n, &len);
+   var.reset(getNodeText(n, &len));
+}
+
+void VarMatch::generate(FILE *outfile, Xml2cContext *ctx, int id, int idx) {
+   fprintf(outfile, "      //**** read match var %s\n", var.get());
+   //it's a pov so we try to match but are permissive after failure
+   fprintf(outfile, "      read_%05d_ptr += var_match(read_%05d + read_%05d_ptr, read_%05d_len - read_%05d_ptr, \"%s\");\n", id, id, id, id, id, var.get());
 }
 
-VarMatch::~VarMatch() {
-   xmlFree(var);
+bool VarMatch::replay(Xml2cReplay *r, const vector<uint8_t> &buf, uint32_t *ptr) {
+   const vector<uint8_t> &v = r->getVar(var.get());
+   if (!prefixMatch(buf, ptr, v.data(), v.size())) {
+      r->note("var %s did not match at offset %u", var.get(), *ptr);
+      return false;
+   }
+   return true;
 }
 
-void VarMatch::generate(FILE *outfile, int id, int idx) {
-   fprintf(outfile, "      //**** read match var %s\n", var);
-   //it's a pov so we try to match but are permissive after failure
-   fprintf(outfile, "      read_%05d_ptr += var_match(read_%05d + read_%05d_ptr, read_%05d_len - read_%05d_ptr, \"%s\");\n", id, id, id, id, id, var);
+void VarMatch::generateStep(FILE *outfile, Xml2cContext *ctx, int id, int idx) {
+   unsigned int slot = ctx->varSlot(var.get());
+   fprintf(outfile, "      //**** read match var %s\n", var.get());
+   fprintf(outfile, "      ptr += pov_match(s, s->rd + ptr, s->rd_len - ptr, s->vars[%u].data, s->vars[%u].len);\n", slot, slot);
 }
 
 class DataMatch : public MatchPart {
-   vector<uint8_t> *matchex;
+   Owned<vector<uint8_t> > matchex;
 public:
    DataMatch(xmlNode *n);
-   ~DataMatch();
-   void generate(FILE *outfile, int id, int idx);
+   void generate(FILE *outfile, Xml2cContext *ctx, int id, int idx);
+   bool replay(Xml2cReplay *r, const vector<uint8_t> &buf, uint32_t *ptr);
+   void generateStep(FILE *outfile, Xml2cContext *ctx, int id, int idx);
+   const vector<uint8_t> *exact() {return matchex.get();};
+   unsigned long long cost(Xml2cCost *c) {return matchex->size();};
 };
 
 DataMatch::DataMatch(xmlNode *n) {
    uint32_t len;
-   matchex = NULL;
    int parseError = false;
-   char *data = getNodeText(n, &len);
-   char *format = (char*)xmlGetProp(n, (xmlChar*)"format");
+   XmlString data(getNodeText(n, &len));
+   XmlString formatText(xmlGetProp(n, (xmlChar*)"format"));
+   char *format = formatText.get();
    try {
       if (format != NULL && strcmp(format, "hex") == 0) {
          //hex data must be exact match
-         matchex = parseHexBinary(data);
+         matchex.reset(parseHexBinary(data.get()));
       }
       else if (format == NULL || strcmp(format, "asciic") == 0) {
          //hex data must be exact match
-         matchex = unescapeAscii(data);
+         matchex.reset(unescapeAscii(data.get()));
       }
       else {
          //should never get here
       }
    } catch (int ex) {
       switch (ex) {
+         case LIMIT_EXCEEDED:
+            throw ex;
          case INVALID_HEX:
             log_fail("Invalid hex data in <%s> element at line %d\n", n->name, n->line);
             break;
@@ -161,50 +203,70 @@ DataMatch::DataMatch(xmlNode *n) {
       }
       parseError = true;
    }
-   xmlFree(format);
-   xmlFree(data);
    if (parseError) {
       throw (int)PARSE_ERROR;
    }
 }
 
-DataMatch::~DataMatch() {
-   xmlFree(matchex);
+//here we do a prefix match
+void DataMatch::generate(FILE *outfile, Xml2cContext *ctx, int id, int idx) {
+   char name[32];
+   snprintf(name, sizeof(name), "match_%05d_%05d", id, idx);
+   fprintf(outfile, "      //**** read match data\n");
+   generateStaticData(ctx, outfile, "unsigned char", name, matchex->data(), matchex->size());
+   fprintf(outfile, "      read_%05d_ptr += data_match(read_%05d + read_%05d_ptr, read_%05d_len - read_%05d_ptr, match_%05d_%05d, %u);\n", id, id, id, id, id, id, idx, matchex->size());
 }
 
-//here we do a prefix match
-void DataMatch::generate(FILE *outfile, int id, int idx) {
+bool DataMatch::replay(Xml2cReplay *r, const vector<uint8_t> &buf, uint32_t *ptr) {
+   if (!prefixMatch(buf, ptr, matchex->data(), matchex->size())) {
+      r->note("data did not match at offset %u", *ptr);
+      return false;
+   }
+   return true;
+}
+
+void DataMatch::generateStep(FILE *outfile, Xml2cContext *ctx, int id, int idx) {
    fprintf(outfile, "      //**** read match data\n");
    fprintf(outfile, "      static unsigned char match_%05d_%05d[] = \n", id, idx);
    printAsHexString(outfile, matchex->data(), matchex->size());
-   fprintf(outfile, "      read_%05d_ptr += data_match(read_%05d + read_%05d_ptr, read_%05d_len - read_%05d_ptr, match_%05d_%05d, %u);\n", id, id, id, id, id, id, idx, matchex->size());
+   fprintf(outfile, "      ptr += pov_match(s, s->rd + ptr, s->rd_len - ptr, match_%05d_%05d, %u);\n", id, idx, matchex->size());
 }
 
 class PcreMatch : public MatchPart {
-   Regex *regex;
+   Owned<Regex> regex;
 public:
    PcreMatch(xmlNode *n);
-   ~PcreMatch();
-   void generate(FILE *outfile, int id, int idx);
+   void generate(FILE *outfile, Xml2cContext *ctx, int id, int idx);
+   bool replay(Xml2cReplay *r, const vector<uint8_t> &buf, uint32_t *ptr);
+   void generateStep(FILE *outfile, Xml2cContext *ctx, int id, int idx);
+   unsigned long long cost(Xml2cCost *c) {c->regex(regex->expr.get()); return 0;};
 };
 
-PcreMatch::PcreMatch(xmlNode *n) {
-   uint32_t len;
-   regex = new Regex(n);
+PcreMatch::PcreMatch(xmlNode *n) : regex(new Regex(n)) {
    //matching is always against group 0
    //should add check to make sure that group is already 0 
    //and throw parse error otherwise
    regex->group = 0;   
 }
 
-PcreMatch::~PcreMatch() {
-   delete regex;
+bool PcreMatch::replay(Xml2cReplay *r, const vector<uint8_t> &buf, uint32_t *ptr) {
+   uint32_t len0;
+   vector<uint8_t> *m = regex->match(buf.data() + *ptr, buf.size() - *ptr, &len0, 0);
+   if (m == NULL) {
+      r->note("pcre did not match at offset %u", *ptr);
+      return false;
+   }
+   //as the generated code, advance by the length of the match
+   *ptr += m->size();
+   delete m;
+   return true;
 }
 
-void PcreMatch::generate(FILE *outfile, int id, int idx) {
-   fprintf(outfile, "      /* read match pcre:\n%s\n*/\n", regex->expr);
-   fprintf(outfile, "      static char read_%05d_%05d_regex[] = \n", id, idx);
-   printAsHexString(outfile, (const unsigned char*)regex->expr, strlen(regex->expr));
+void PcreMatch::generate(FILE *outfile, Xml2cContext *ctx, int id, int idx) {
+   char name[32];
+   snprintf(name, sizeof(name), "read_%05d_%05d_regex", id, idx);
+   fprintf(outfile, "      /* read match pcre:\n%s\n*/\n", regex->expr.get());
+   generateStaticData(ctx, outfile, "char", name, (const uint8_t*)regex->expr.get(), strlen(regex->expr.get()));
    fprintf(outfile, "      static match_result read_%05d_%05d_match;\n", id, idx);
    fprintf(outfile, "      pcre *read_%05d_%05d_pcre = init_regex(read_%05d_%05d_regex);\n", id, idx, id, idx);
    fprintf(outfile, "      if (read_%05d_%05d_pcre != NULL) {\n", id, idx);
@@ -224,21 +286,265 @@ void PcreMatch::generate(FILE *outfile, int id, int idx) {
    fprintf(outfile, "      }\n");
 }
 
-Xml2cRead::Xml2cRead(xmlNode *r, bool echoEnable) {
-   id = readId++;
+//the expression is compiled once and shared by every session
+void PcreMatch::generateStep(FILE *outfile, Xml2cContext *ctx, int id, int idx) {
+   ctx->stepRegexes = true;
+   fprintf(outfile, "      /* read match pcre:\n%s\n*/\n", regex->expr.get());
+   fprintf(outfile, "      static char read_%05d_%05d_regex[] = \n", id, idx);
+   printAsHexString(outfile, (const unsigned char*)regex->expr.get(), strlen(regex->expr.get()));
+   fprintf(outfile, "      static pcre *read_%05d_%05d_pcre;\n", id, idx);
+   fprintf(outfile, "      unsigned int read_%05d_%05d_start, read_%05d_%05d_end;\n", id, idx, id, idx);
+   fprintf(outfile, "      if (pov_pcre(pov_regex(&read_%05d_%05d_pcre, read_%05d_%05d_regex), %d, s->rd + ptr, s->rd_len - ptr,\n", id, idx, id, idx, regex->group);
+   fprintf(outfile, "                   &read_%05d_%05d_start, &read_%05d_%05d_end)) {\n", id, idx, id, idx);
+   fprintf(outfile, "         ptr += read_%05d_%05d_end - read_%05d_%05d_start;\n", id, idx, id, idx);
+   fprintf(outfile, "      }\n");
+   fprintf(outfile, "      else {\n");
+   fprintf(outfile, "         s->failed++;\n");
+   fprintf(outfile, "      }\n");
+}
+
+/*
+ * Emitted once ahead of main when any read carries a <timeout>.  DECREE has
+ * no clock, so the timeout bounds each wait for more input with fdwait rather
+ * than the read as a whole.  A read that times out keeps whatever arrived and
+ * the PoV carries on, just as it does after a failed match.
+ */
+static const char *readRuntime =
+   "//**** pov-xml2c timed reads\n"
+   "static int pov_readable(int fd, unsigned int ms) {\n"
+   "   fd_set fds;\n"
+   "   struct timeval tv;\n"
+   "   int ready = 0;\n"
+   "   FD_ZERO(&fds);\n"
+   "   FD_SET(fd, &fds);\n"
+   "   tv.tv_sec = ms / 1000;\n"
+   "   tv.tv_usec = (ms % 1000) * 1000;\n"
+   "   return fdwait(fd + 1, &fds, NULL, &tv, &ready) == 0 && ready > 0;\n"
+   "}\n"
+   "static unsigned int pov_timed_length_read(int fd, unsigned char *buf, unsigned int len, unsigned int ms) {\n"
+   "   unsigned int total = 0;\n"
+   "   while (total < len && pov_readable(fd, ms)) {\n"
+   "      size_t rx = 0;\n"
+   "      if (receive(fd, buf + total, len - total, &rx) != 0 || rx == 0) {\n"
+   "         break;\n"
+   "      }\n"
+   "      total += rx;\n"
+   "   }\n"
+   "   return total;\n"
+   "}\n"
+   "static unsigned int pov_timed_delimited_read(int fd, unsigned char **buf, unsigned int *len,\n"
+   "                                             const unsigned char *delim, unsigned int dlen, unsigned int ms) {\n"
+   "   unsigned int cap = 256;\n"
+   "   unsigned int n = 0;\n"
+   "   unsigned char *b = (unsigned char*)malloc(cap);\n"
+   "   while (b != NULL && pov_readable(fd, ms)) {\n"
+   "      size_t rx = 0;\n"
+   "      unsigned int i;\n"
+   "      if (n == cap) {\n"
+   "         cap *= 2;\n"
+   "         b = (unsigned char*)realloc(b, cap);\n"
+   "         if (b == NULL) {\n"
+   "            n = 0;\n"
+   "            break;\n"
+   "         }\n"
+   "      }\n"
+   "      if (receive(fd, b + n, 1, &rx) != 0 || rx == 0) {\n"
+   "         break;\n"
+   "      }\n"
+   "      n++;\n"
+   "      if (n < dlen) {\n"
+   "         continue;\n"
+   "      }\n"
+   "      for (i = 0; i < dlen && b[n - dlen + i] == delim[i]; i++) {\n"
+   "      }\n"
+   "      if (i == dlen) {\n"
+   "         break;\n"
+   "      }\n"
+   "   }\n"
+   "   *buf = b;\n"
+   "   *len = n;\n"
+   "   return n;\n"
+   "}\n";
+
+/*
+ * Emitted once ahead of main when a read is fused with its match.  The bytes
+ * are compared with the expected ones as they are received, so a read that
+ * matches keeps no buffer at all.  At the first difference the line so far,
+ * which matched up to there, and the rest of the read are collected on the
+ * heap in *miss, for the match to fail over through the same data_match calls
+ * an unfused read makes.  *rx counts the bytes received.  Return 1 if the
+ * read matched.  A delimited read receives a byte at a
+ * time, as libpov's delimited_read does, so as not to consume input meant
+ * for the next read, and keeps its last dlen bytes in ring to spot the
+ * delimiter.  Should *miss not grow the read stops there.
+ */
+#define EXPECT_STR(x) #x
+#define EXPECT_TEXT(x) EXPECT_STR(x)
+static const char *expectRuntime =
+   "//**** pov-xml2c fused reads\n"
+   "#define POV_EXPECT_MAX 0x40000000u\n"
+   "static int pov_expect_grow(unsigned char **buf, unsigned int *cap, unsigned int need) {\n"
+   "   unsigned int size = *cap < 64 ? 64 : *cap;\n"
+   "   unsigned char *grown;\n"
+   "   if (need <= *cap) {\n"
+   "      return 1;\n"
+   "   }\n"
+   "   if (need > POV_EXPECT_MAX) {\n"
+   "      return 0;\n"
+   "   }\n"
+   "   while (size < need) {\n"
+   "      size *= 2;\n"
+   "   }\n"
+   "   grown = (unsigned char*)realloc(*buf, size);\n"
+   "   if (grown == NULL) {\n"
+   "      return 0;\n"
+   "   }\n"
+   "   *buf = grown;\n"
+   "   *cap = size;\n"
+   "   return 1;\n"
+   "}\n"
+   "static int pov_expect_length(int fd, const unsigned char *expect, unsigned int elen, unsigned int len,\n"
+   "                             unsigned int *rx, unsigned char **miss) {\n"
+   "   unsigned char chunk[" EXPECT_TEXT(EXPECT_CHUNK) "];\n"
+   "   unsigned int got = 0;\n"
+   "   unsigned int cmp;\n"
+   "   size_t n;\n"
+   "   *miss = NULL;\n"
+   "   while (got < len) {\n"
+   "      n = len - got;\n"
+   "      if (*miss == NULL && n > sizeof(chunk)) {\n"
+   "         n = sizeof(chunk);\n"
+   "      }\n"
+   "      if (receive(fd, *miss != NULL ? *miss + got : chunk, n, &n) != 0 || n == 0) {\n"
+   "         break;\n"
+   "      }\n"
+   "      cmp = got < elen ? elen - got : 0;\n"
+   "      if (*miss == NULL && memcmp(chunk, expect + got, cmp < n ? cmp : n) != 0) {\n"
+   "         *miss = (unsigned char*)malloc(len);\n"
+   "         if (*miss == NULL) {\n"
+   "            *rx = 0;\n"
+   "            return 0;\n"
+   "         }\n"
+   "         memcpy(*miss, expect, got);\n"
+   "         memcpy(*miss + got, chunk, n);\n"
+   "      }\n"
+   "      got += n;\n"
+   "   }\n"
+   "   *rx = got;\n"
+   "   return *miss == NULL && got >= elen;\n"
+   "}\n"
+   "static int pov_expect_delimited(int fd, const unsigned char *expect, unsigned int elen,\n"
+   "                                const unsigned char *delim, unsigned int dlen, unsigned char *ring,\n"
+   "                                unsigned int *rx, unsigned char **miss) {\n"
+   "   unsigned int got = 0;\n"
+   "   unsigned int cap = 0;\n"
+   "   unsigned int i;\n"
+   "   unsigned char c;\n"
+   "   size_t n;\n"
+   "   *miss = NULL;\n"
+   "   while (receive(fd, &c, 1, &n) == 0 && n == 1) {\n"
+   "      if (*miss == NULL && got < elen && c != expect[got]) {\n"
+   "         if (!pov_expect_grow(miss, &cap, got + 1)) {\n"
+   "            *rx = 0;\n"
+   "            return 0;\n"
+   "         }\n"
+   "         memcpy(*miss, expect, got);\n"
+   "      }\n"
+   "      if (*miss != NULL) {\n"
+   "         if (!pov_expect_grow(miss, &cap, got + 1)) {\n"
+   "            break;\n"
+   "         }\n"
+   "         (*miss)[got] = c;\n"
+   "      }\n"
+   "      ring[got % dlen] = c;\n"
+   "      got++;\n"
+   "      if (got < dlen) {\n"
+   "         continue;\n"
+   "      }\n"
+   "      for (i = 0; i < dlen && ring[(got - dlen + i) % dlen] == delim[i]; i++) {\n"
+   "      }\n"
+   "      if (i == dlen) {\n"
+   "         break;\n"
+   "      }\n"
+   "   }\n"
+   "   *rx = got;\n"
+   "   return *miss == NULL && got >= elen;\n"
+   "}\n";
+
+/*
+ * Declares read_ID_from and read_ID_to, the bounds of the slice within the
+ * avail bytes the assign sees.  The slice is constant, so the clamping
+ * sliceBounds performs at run time is reduced to what its signs need.
+ */
+static void generateSliceBounds(FILE *outfile, const Slice *slice, int id, const char *avail) {
+   int32_t begin = slice->_begin;
+   int32_t end = slice->_end;
+   fprintf(outfile, "      unsigned int read_%05d_avail = %s;\n", id, avail);
+   if (begin == 0) {
+      fprintf(outfile, "      unsigned int read_%05d_from = 0;\n", id);
+   }
+   else if (begin > 0) {
+      fprintf(outfile, "      unsigned int read_%05d_from = read_%05d_avail < %uu ? read_%05d_avail : %uu;\n", id, id, begin, id, begin);
+   }
+   else {
+      uint32_t back = (uint32_t)-(int64_t)begin;
+      fprintf(outfile, "      unsigned int read_%05d_from = read_%05d_avail > %uu ? read_%05d_avail - %uu : 0;\n", id, id, back, id, back);
+   }
+   if (slice->_maxLen) {
+      fprintf(outfile, "      unsigned int read_%05d_to = read_%05d_avail;\n", id, id);
+      return;
+   }
+   if (end >= 0) {
+      fprintf(outfile, "      unsigned int read_%05d_to = read_%05d_avail < %uu ? read_%05d_avail : %uu;\n", id, id, end, id, end);
+   }
+   else {
+      uint32_t back = (uint32_t)-(int64_t)end;
+      fprintf(outfile, "      unsigned int read_%05d_to = read_%05d_avail > %uu ? read_%05d_avail - %uu : 0;\n", id, id, back, id, back);
+   }
+   //bounds of the same sign in order can never cross
+   if (begin != 0 && ((begin < 0) != (end < 0) || end < begin)) {
+      fprintf(outfile, "      if (read_%05d_to < read_%05d_from) {\n", id, id);
+      fprintf(outfile, "         read_%05d_to = read_%05d_from;\n", id, id);
+      fprintf(outfile, "      }\n");
+   }
+}
+
+void generateReadRuntime(FILE *outfile) {
+   fputs(readRuntime, outfile);
+}
+
+void generateExpectRuntime(FILE *outfile) {
+   fputs(expectRuntime, outfile);
+}
+
+/*
+ * True if the first occurrence of delim in want is at its very end, so that
+ * a delimited read whose buffer matches want returns exactly want.
+ */
+static bool endsWithOnlyDelim(const vector<uint8_t> &want, const vector<uint8_t> &delim) {
+   if (delim.size() == 0 || want.size() < delim.size()) {
+      return false;
+   }
+   for (size_t end = delim.size(); end <= want.size(); end++) {
+      if (memcmp(want.data() + end - delim.size(), delim.data(), delim.size()) == 0) {
+         return end == want.size();
+      }
+   }
+   return false;
+}
+
+Xml2cRead::Xml2cRead(xmlNode *r, Xml2cContext *ctx) : Action(ctx) {
+   id = ctx->readId++;
    bool parseError = false;
-   slice = NULL;
-   varRegex = NULL;
    echo = ECHO_NO;
    invert = false;
-   delim = NULL;
-   var = NULL;
-   lengthVar = NULL;
    readLen = 0;
    lengthIsVar = false;
+   fused = false;
 
-   if (echoEnable) {
-      char *echoAttr = (char*)xmlGetProp(r, (xmlChar*)"echo");
+   if (ctx->echoEnable) {
+      XmlString echoText(xmlGetProp(r, (xmlChar*)"echo"));
+      char *echoAttr = echoText.get();
       if (echoAttr != NULL) {
          if (strcmp(echoAttr, "no") == 0) {
             echo = ECHO_NO;
@@ -250,27 +556,27 @@ Xml2cRead::Xml2cRead(xmlNode *r, bool echoEnable) {
             echo = ECHO_ASCII;
          }
       }
-      xmlFree(echoAttr);
    }
    xmlNode *delimNode = findChild(r, "delim");
    if (delimNode != NULL) {
       //??? What if any restrictions to place on delimiters? content? length?
       uint32_t delimLen;
-      char *delimText = getNodeText(delimNode, &delimLen);
-      char *format = (char*)xmlGetProp(delimNode, (xmlChar*)"format");
+      XmlString delimText(getNodeText(delimNode, &delimLen));
+      XmlString format(xmlGetProp(delimNode, (xmlChar*)"format"));
       try {
-         if (format != NULL && strcmp(format, "hex") == 0) {
-            delim = parseHexBinary(delimText);
+         if (format.get() != NULL && strcmp(format.get(), "hex") == 0) {
+            delim.reset(parseHexBinary(delimText.get()));
          }
          else {
-            delim = unescapeAscii(delimText);
+            delim.reset(unescapeAscii(delimText.get()));
          }
       } catch (int ex) {
+         if (ex == LIMIT_EXCEEDED) {
+            throw ex;
+         }
          parseError = true;
          log_fail("Invalid hex data in <%s> element at line %d\n", delimNode->name, delimNode->line);
       }
-      xmlFree(delimText);
-      xmlFree(format);
    }
 
    if (delimNode == NULL) {
@@ -278,17 +584,16 @@ Xml2cRead::Xml2cRead(xmlNode *r, bool echoEnable) {
       try {
          xmlNode *lengthNode = findChild(r, "length");
 
-         char *isvar = (char*)xmlGetProp(lengthNode, (xmlChar*)"isvar");
-         if (isvar != NULL) {
-            lengthIsVar = strcmp(isvar, "true") == 0;
+         XmlString isvar(xmlGetProp(lengthNode, (xmlChar*)"isvar"));
+         if (isvar.get() != NULL) {
+            lengthIsVar = strcmp(isvar.get(), "true") == 0;
          }
-         xmlFree(isvar);
          if (!lengthIsVar) {
             readLen = getUintChild(r, "length", 0);
          }
          else {
             uint32_t lengthVarLen;
-            lengthVar = getNodeText(lengthNode, &lengthVarLen);
+            lengthVar.reset(getNodeText(lengthNode, &lengthVarLen));
          }
       } catch (int ex) {
          parseError = true;
@@ -300,18 +605,18 @@ Xml2cRead::Xml2cRead(xmlNode *r, bool echoEnable) {
       try {
          uint32_t varLen;
          xmlNode *varNode = findChild(assignNode, "var");
-         var = getNodeText(varNode, &varLen);
+         var.reset(getNodeText(varNode, &varLen));
          xmlNode *sliceNode = findChild(assignNode, "slice");
          if (sliceNode != NULL) {
             int begin, end;
             getIntAttribute(sliceNode, "begin", 0, &begin);
             bool useMax = !getIntAttribute(sliceNode, "end", 0, &end);
-            slice = new Slice(begin, end, useMax);
+            slice.reset(new Slice(begin, end, useMax));
          }
          else {
             //must be a pcre, must have one, can't have both
             xmlNode *pcreNode = findChild(assignNode, "pcre");
-            varRegex = new Regex(pcreNode);
+            varRegex.reset(new Regex(pcreNode));
          }
       } catch (int ex) {
          parseError = true;
@@ -321,11 +626,10 @@ Xml2cRead::Xml2cRead(xmlNode *r, bool echoEnable) {
    
    xmlNode *match = findChild(r, "match");
    if (match != NULL) {
-      char *invertAttr = (char*)xmlGetProp(match, (xmlChar*)"invert");
-      if (invertAttr != NULL) {
-         invert = strcmp(invertAttr, "true") == 0;
+      XmlString invertAttr(xmlGetProp(match, (xmlChar*)"invert"));
+      if (invertAttr.get() != NULL) {
+         invert = strcmp(invertAttr.get(), "true") == 0;
       }
-      xmlFree(invertAttr);
 
       try {
          for (xmlNode *child = match->children; child != NULL; child = child->next) {
@@ -341,6 +645,9 @@ Xml2cRead::Xml2cRead(xmlNode *r, bool echoEnable) {
             }
          }
       } catch (int ex) {
+         if (ex == LIMIT_EXCEEDED) {
+            throw ex;
+         }
          parseError = true;
          log_fail("Error parsing <%s> element at line %d\n", match->name, match->line);
       }
@@ -350,40 +657,213 @@ Xml2cRead::Xml2cRead(xmlNode *r, bool echoEnable) {
       timeout_val = getUintChild(r, "timeout", 0);
       timeout.tv_sec = timeout_val / 1000;
       timeout.tv_usec = (timeout_val % 1000) * 1000;
+      if (timeout_val > 0) {
+         ctx->timedReads = true;
+      }
    } catch (int ex) {
       parseError = true;
    }
    if (parseError) {
       throw (int)PARSE_ERROR;
    }
+
+   //a match of nothing but data is a single run of bytes known up front
+   bool exactMatch = matchParts.size() != 0 && !invert;
+   for (size_t i = 0; i < matchParts.size() && exactMatch; i++) {
+      exactMatch = matchParts[i]->exact() != NULL;
+   }
+   if (exactMatch) {
+      expect.reset(new vector<uint8_t>);
+      for (size_t i = 0; i < matchParts.size(); i++) {
+         const vector<uint8_t> *part = matchParts[i]->exact();
+         expect->insert(expect->end(), part->begin(), part->end());
+      }
+   }
+   if (ctx->fixedReads && expect.get() != NULL && delim.get() != NULL && endsWithOnlyDelim(*expect, *delim)) {
+      //succeeds only on exactly these bytes, so read that many
+      readLen = expect->size();
+      delim.reset();
+   }
+   fused = canFuse();
+   if (fused) {
+      ctx->fusedReads = true;
+   }
+}
+
+bool Xml2cRead::canFuse() {
+   return ctx->backend == POVXML2C_BACKEND_MAIN && expect.get() != NULL && expect->size() > 0 &&
+          var.get() == NULL && timeout_val == 0 && (delim.get() != NULL ? delim->size() > 0
+                                                                        : !lengthIsVar && readLen > 0);
 }
 
+//the members own everything, this only completes their types
 Xml2cRead::~Xml2cRead() {
-   delete slice; 
-   delete varRegex;
+}
 
+void Xml2cRead::uses(set<string> &vars) {
+   if (lengthVar.get() != NULL) {
+      vars.insert(lengthVar.get());
+   }
    for (vector<MatchPart*>::iterator i = matchParts.begin(); i != matchParts.end(); i++) {
-      delete *i;
+      (*i)->uses(vars);
+   }
+}
+
+void Xml2cRead::defines(set<string> &vars) {
+   if (var.get() != NULL) {
+      vars.insert(var.get());
+   }
+}
+
+//a pcre assign that does not match leaves the old value in place
+void Xml2cRead::overwrites(set<string> &vars) {
+   if (var.get() != NULL && slice.get() != NULL) {
+      vars.insert(var.get());
+   }
+}
+
+/*
+ * A slice always succeeds, so dropping it changes nothing the service sees.
+ * A pcre assign that does not match counts as a failed match, so it stays.
+ * Without its assign the read may become a fused one.
+ */
+bool Xml2cRead::dropDefinition(const string &name) {
+   if (var.get() == NULL || slice.get() == NULL || name != var.get()) {
+      return false;
+   }
+   var.reset();
+   slice.reset();
+   fused = canFuse();
+   if (fused) {
+      ctx->fusedReads = true;
+   }
+   return true;
+}
+
+bool Xml2cRead::replay(Xml2cReplay *r) {
+   unsigned int wait = timeout_val > 0 ? timeout_val : DEFAULT_REPLAY_WAIT;
+   vector<uint8_t> buf;
+   bool ok = true;
+   if (delim.get() == NULL) {
+      size_t len = readLen;
+      if (lengthVar.get() != NULL) {
+         const vector<uint8_t> &v = r->getVar(lengthVar.get());
+         len = v.size() >= sizeof(uint32_t) ? *(const uint32_t*)v.data() : 0;
+      }
+      r->readLength(buf, len, wait);
+      if (buf.size() < len) {
+         r->note("short read of %zu of %zu bytes", buf.size(), len);
+         ok = false;
+      }
+      else {
+         r->note("%zu bytes", buf.size());
+      }
+   }
+   else {
+      r->readDelimited(buf, *delim, wait);
+      if (buf.size() < delim->size() ||
+          memcmp(buf.data() + buf.size() - delim->size(), delim->data(), delim->size()) != 0) {
+         r->note("no delimiter in %zu bytes", buf.size());
+         ok = false;
+      }
+      else {
+         r->note("%zu bytes", buf.size());
+      }
    }
 
-   if (delim != NULL) {
-      delete delim;
+   uint32_t ptr = 0;
+   if (matchParts.size() != 0) {
+      bool matched = true;
+      for (vector<MatchPart*>::iterator i = matchParts.begin(); i != matchParts.end() && matched; i++) {
+         matched = (*i)->replay(r, buf, &ptr);
+      }
+      if (matched == invert) {
+         if (invert) {
+            r->note("inverted match succeeded");
+         }
+         ok = false;
+      }
    }
-   if (var != NULL) {
-      xmlFree(var);
+
+   if (var.get() != NULL) {
+      //the generated code hands the assign the start of the buffer, but
+      //only the length that was left unmatched
+      uint32_t avail = buf.size() - ptr;
+      if (slice.get() != NULL) {
+         size_t from, to;
+         sliceBounds(slice->_begin, slice->_maxLen ? INT_MAX : slice->_end, avail, &from, &to);
+         r->setVar(var.get(), buf.data() + from, to - from);
+         r->note("%s is %zu bytes", var.get(), to - from);
+      }
+      else {
+         uint32_t len0;
+         vector<uint8_t> *m = varRegex->match(buf.data(), avail, &len0, 0);
+         if (m != NULL) {
+            r->setVar(var.get(), m->data(), m->size());
+            r->note("%s is %zu bytes", var.get(), m->size());
+            delete m;
+         }
+         else {
+            r->note("pcre assign to %s did not match", var.get());
+            ok = false;
+         }
+      }
    }
-   if (lengthVar != NULL) {
-      xmlFree(lengthVar);
+   return ok;
+}
+
+/*
+ * A read whose length is not fixed by the document counts the fewest bytes
+ * it can return and is counted in unknown_reads.  libpov's delimited_read
+ * receives a byte at a time, length_read as much as is offered.
+ */
+void Xml2cRead::cost(Xml2cCost *c) {
+   unsigned long long bytes;
+   unsigned long long matched = 0;
+   for (vector<MatchPart*>::iterator i = matchParts.begin(); i != matchParts.end(); i++) {
+      matched += (*i)->cost(c);
+   }
+   if (delim.get() == NULL) {
+      bytes = lengthIsVar ? 0 : readLen;
+      if (lengthIsVar) {
+         c->totals.unknown_reads++;
+      }
+      //a fused read receives a chunk at a time
+      c->totals.receives += fused ? (bytes + EXPECT_CHUNK - 1) / EXPECT_CHUNK : 1;
+   }
+   else {
+      if (expect.get() != NULL && endsWithOnlyDelim(*expect, *delim)) {
+         bytes = expect->size();
+      }
+      else {
+         bytes = delim->size() > matched ? delim->size() : matched;
+         c->totals.unknown_reads++;
+      }
+      c->totals.receives += bytes;
+   }
+   c->totals.bytes_read += bytes;
+
+   if (var.get() != NULL) {
+      //as replay, the assign sees what the match left
+      unsigned long long avail = bytes > matched ? bytes - matched : 0;
+      if (slice.get() != NULL) {
+         size_t from, to;
+         sliceBounds(slice->_begin, slice->_maxLen ? INT_MAX : slice->_end, avail, &from, &to);
+         c->setVar(var.get(), to - from);
+      }
+      else {
+         c->regex(varRegex->expr.get());
+         c->setVar(var.get(), avail);
+      }
    }
 }
 
 void Xml2cRead::doRead(FILE *outfile) {
-   if (delim == NULL) {  //then readLen or lengthVar must be set
-      //can't really account for timeouts in PoVs
+   if (delim.get() == NULL) {  //then readLen or lengthVar must be set
       fprintf(outfile, "      //**** length read\n");
-      if (lengthVar != NULL) {
+      if (lengthVar.get() != NULL) {
          fprintf(outfile, "      size_t read_%05d_len_len;\n", id);
-         fprintf(outfile, "      char *read_%05d_len_var = (char*)getenv(\"%s\", &read_%05d_len_len);\n", id, lengthVar, id);
+         fprintf(outfile, "      char *read_%05d_len_var = (char*)getenv(\"%s\", &read_%05d_len_len);\n", id, lengthVar.get(), id);
          fprintf(outfile, "      read_%05d_len = *(unsigned int*)read_%05d_len_var;\n", id, id);
          fprintf(outfile, "      free(read_%05d_len_var);\n", id);
       }
@@ -391,24 +871,95 @@ void Xml2cRead::doRead(FILE *outfile) {
          fprintf(outfile, "      read_%05d_len = %u;\n", id, readLen);
       }
       fprintf(outfile, "      read_%05d = (unsigned char*)malloc(read_%05d_len);\n", id, id);
-      fprintf(outfile, "      int read_%05d_res = length_read(0, read_%05d, read_%05d_len);\n", id, id, id);
-      fprintf(outfile, "      if (read_%05d_res) {} //silence unused variable warning\n", id);
+      if (timeout_val > 0) {
+         //a short read leaves only what arrived for matching
+         fprintf(outfile, "      read_%05d_len = pov_timed_length_read(0, read_%05d, read_%05d_len, %u);\n", id, id, id, timeout_val);
+      }
+      else {
+         fprintf(outfile, "      int read_%05d_res = length_read(0, read_%05d, read_%05d_len);\n", id, id, id);
+         fprintf(outfile, "      if (read_%05d_res) {} //silence unused variable warning\n", id);
+      }
       //do we need code to test for short read? What would we do in any case?
    }
    else {
-      //can't really account for timeouts in PoVs
+      char name[32];
+      snprintf(name, sizeof(name), "read_%05d_delim", id);
       fprintf(outfile, "      //**** delimited read\n");
-      fprintf(outfile, "      static unsigned char read_%05d_delim[] = \n", id);
-      printAsHexString(outfile, delim->data(), delim->size());
+      generateStaticData(ctx, outfile, "unsigned char", name, delim->data(), delim->size());
       fprintf(outfile, "      read_%05d = NULL;\n", id);
       fprintf(outfile, "      read_%05d_len = 0;\n", id);
-      fprintf(outfile, "      int read_%05d_res = delimited_read(0, &read_%05d, &read_%05d_len, read_%05d_delim, %u);\n", id, id, id, id, delim->size());
-      fprintf(outfile, "      if (read_%05d_res) {} //silence unused variable warning\n", id);
+      if (timeout_val > 0) {
+         fprintf(outfile, "      pov_timed_delimited_read(0, &read_%05d, &read_%05d_len, read_%05d_delim, %u, %u);\n", id, id, id, delim->size(), timeout_val);
+      }
+      else {
+         fprintf(outfile, "      int read_%05d_res = delimited_read(0, &read_%05d, &read_%05d_len, read_%05d_delim, %u);\n", id, id, id, id, delim->size());
+         fprintf(outfile, "      if (read_%05d_res) {} //silence unused variable warning\n", id);
+      }
       //do we need code to test for failed read? What would we do in any case?
    }
 }
 
+/*
+ * A fused read is compared with its expected bytes as they arrive.  Each
+ * match part is then checked by the data_match call it has in any other
+ * read, against its piece of the expected bytes, over those bytes when the
+ * read matched and over what was received when it did not, so libpov sees
+ * the same data_match calls as for an unfused read.
+ */
+void Xml2cRead::generateExpect(FILE *outfile) {
+   char name[32];
+   fprintf(outfile, "   do {\n");
+   snprintf(name, sizeof(name), "read_%05d_expect", id);
+   if (delim.get() != NULL) {
+      fprintf(outfile, "      //**** delimited read compared as it is received\n");
+      generateStaticData(ctx, outfile, "unsigned char", name, expect->data(), expect->size());
+      snprintf(name, sizeof(name), "read_%05d_delim", id);
+      generateStaticData(ctx, outfile, "unsigned char", name, delim->data(), delim->size());
+      fprintf(outfile, "      unsigned char read_%05d_ring[%u];\n", id, delim->size());
+   }
+   else {
+      fprintf(outfile, "      //**** length read compared as it is received\n");
+      generateStaticData(ctx, outfile, "unsigned char", name, expect->data(), expect->size());
+   }
+   fprintf(outfile, "      unsigned int read_%05d_rx;\n", id);
+   fprintf(outfile, "      unsigned char *read_%05d_miss;\n", id);
+   fprintf(outfile, "      unsigned char *read_%05d = read_%05d_expect;\n", id, id);
+   fprintf(outfile, "      unsigned int read_%05d_len = %zu;\n", id, expect->size());
+   if (delim.get() != NULL) {
+      fprintf(outfile, "      if (!pov_expect_delimited(0, read_%05d_expect, %zu, read_%05d_delim, %u, read_%05d_ring, &read_%05d_rx, &read_%05d_miss)) {\n",
+              id, expect->size(), id, delim->size(), id, id, id);
+   }
+   else {
+      fprintf(outfile, "      if (!pov_expect_length(0, read_%05d_expect, %zu, %u, &read_%05d_rx, &read_%05d_miss)) {\n",
+              id, expect->size(), readLen, id, id);
+   }
+   //without a buffer the bytes received so far are those expected
+   fprintf(outfile, "         read_%05d = read_%05d_miss != NULL ? read_%05d_miss : read_%05d_expect;\n", id, id, id, id);
+   fprintf(outfile, "         read_%05d_len = read_%05d_rx;\n", id, id);
+   fprintf(outfile, "      }\n");
+   fprintf(outfile, "      unsigned int read_%05d_ptr = 0;\n", id);
+   //the parts are all <data>, each a piece of the expected bytes
+   size_t offset = 0;
+   for (vector<MatchPart*>::iterator i = matchParts.begin(); i != matchParts.end(); i++) {
+      size_t n = (*i)->exact()->size();
+      fprintf(outfile, "      //**** read match data\n");
+      fprintf(outfile, "      read_%05d_ptr += data_match(read_%05d + read_%05d_ptr, read_%05d_len - read_%05d_ptr, read_%05d_expect + %zu, %zu);\n",
+              id, id, id, id, id, id, offset, n);
+      offset += n;
+   }
+   if (ctx->probeFd >= 0) {
+      fprintf(outfile, "      pov_probe_io(read_%05d_rx, read_%05d_ptr);\n", id, id);
+   }
+   fprintf(outfile, "      free(read_%05d_miss);\n", id);
+   fprintf(outfile, "      if (read_%05d_ptr) {}  //silence unused variable warning if any\n", id);
+   fprintf(outfile, "   } while (0);\n");
+}
+
 void Xml2cRead::generate(FILE *outfile) {
+   if (fused) {
+      generateExpect(outfile);
+      return;
+   }
    fprintf(outfile, "   do {\n");
    fprintf(outfile, "      unsigned char *read_%05d;\n", id);
    fprintf(outfile, "      unsigned int read_%05d_len;\n", id);
@@ -420,25 +971,101 @@ void Xml2cRead::generate(FILE *outfile) {
       //do some matching
       uint32_t idx = 0;  //for serializing match components
       for (vector<MatchPart*>::iterator i = matchParts.begin(); i != matchParts.end(); i++) {
-         (*i)->generate(outfile, id, idx);
+         (*i)->generate(outfile, ctx, id, idx);
          idx++;
       }
       //need code to deal with invert
    }
 
-   if (var != NULL) {
-      if (slice != NULL) {
-         fprintf(outfile, "      //**** read assign to var \"%s\" from slice\n", var);
-         fprintf(outfile, "      assign_from_slice(\"%s\", read_%05d, read_%05d_len - read_%05d_ptr, %d, %d, %d);\n", var, id, id, id, slice->_begin, slice->_end, slice->_maxLen);
+   if (var.get() != NULL) {
+      if (slice.get() != NULL) {
+         fprintf(outfile, "      //**** read assign to var \"%s\" from slice\n", var.get());
+         char avail[64];
+         snprintf(avail, sizeof(avail), "read_%05d_len - read_%05d_ptr", id, id);
+         generateSliceBounds(outfile, slice.get(), id, avail);
+         fprintf(outfile, "      putenv(\"%s\", read_%05d + read_%05d_from, read_%05d_to - read_%05d_from);\n", var.get(), id, id, id, id);
       }
       else {  //must be pcre
-         fprintf(outfile, "      //**** read assign to var \"%s\" from pcre: %s\n", var, varRegex->expr);
-         fprintf(outfile, "      static char read_%05d_regex[] = \n", id);
-         printAsHexString(outfile, (const unsigned char*)varRegex->expr, strlen(varRegex->expr));
-         fprintf(outfile, "      assign_from_pcre(\"%s\", read_%05d, read_%05d_len - read_%05d_ptr, read_%05d_regex, %d);\n", var, id, id, id, id, varRegex->group);
+         fprintf(outfile, "      //**** read assign to var \"%s\" from pcre: %s\n", var.get(), varRegex->expr.get());
+         char name[32];
+         snprintf(name, sizeof(name), "read_%05d_regex", id);
+         generateStaticData(ctx, outfile, "char", name, (const uint8_t*)varRegex->expr.get(), strlen(varRegex->expr.get()));
+         fprintf(outfile, "      assign_from_pcre(\"%s\", read_%05d, read_%05d_len - read_%05d_ptr, read_%05d_regex, %d);\n", var.get(), id, id, id, id, varRegex->group);
       }
    }
+   if (ctx->probeFd >= 0) {
+      fprintf(outfile, "      pov_probe_io(read_%05d_len, read_%05d_ptr);\n", id, id);
+   }
    fprintf(outfile, "      free(read_%05d);\n", id);
    fprintf(outfile, "      if (read_%05d_ptr) {}  //silence unused variable warning if any\n", id);
    fprintf(outfile, "   } while (0);\n");
 }
+
+void Xml2cRead::generateStep(FILE *outfile) {
+   if (delim.get() == NULL) {
+      fprintf(outfile, "      //**** length read\n");
+      if (lengthVar.get() != NULL) {
+         unsigned int slot = ctx->varSlot(lengthVar.get());
+         //a variable may be a view at any offset into a read
+         fprintf(outfile, "      unsigned int read_%05d_len = 0;\n", id);
+         fprintf(outfile, "      if (s->vars[%u].len >= sizeof(unsigned int)) {\n", slot);
+         fprintf(outfile, "         memcpy(&read_%05d_len, s->vars[%u].data, sizeof(unsigned int));\n", id, slot);
+         fprintf(outfile, "      }\n");
+      }
+      else {
+         fprintf(outfile, "      unsigned int read_%05d_len = %u;\n", id, readLen);
+      }
+      fprintf(outfile, "      if (!pov_read_length(s, read_%05d_len, %u, now)) {\n", id, timeout_val);
+   }
+   else {
+      fprintf(outfile, "      //**** delimited read\n");
+      fprintf(outfile, "      static unsigned char read_%05d_delim[] = \n", id);
+      printAsHexString(outfile, delim->data(), delim->size());
+      fprintf(outfile, "      if (!pov_read_delim(s, read_%05d_delim, %u, %u, now)) {\n", id, delim->size(), timeout_val);
+   }
+   fprintf(outfile, "         return POV_WANT_READ;\n");
+   fprintf(outfile, "      }\n");
+   fprintf(outfile, "      unsigned int ptr = 0;\n");
+
+   if (matchParts.size() != 0) {
+      if (invert) {
+         fprintf(outfile, "      unsigned int failed = s->failed;\n");
+      }
+      uint32_t idx = 0;
+      for (vector<MatchPart*>::iterator i = matchParts.begin(); i != matchParts.end(); i++) {
+         (*i)->generateStep(outfile, ctx, id, idx);
+         idx++;
+      }
+      if (invert) {
+         //an inverted match fails only if every part matched
+         fprintf(outfile, "      s->failed = s->failed == failed ? failed + 1 : failed;\n");
+      }
+   }
+
+   if (var.get() != NULL) {
+      //as libpov, the assign sees the start of the read but only the
+      //length left unmatched
+      unsigned int slot = ctx->varSlot(var.get());
+      if (slice.get() != NULL) {
+         fprintf(outfile, "      //**** read assign to var \"%s\" from slice\n", var.get());
+         generateSliceBounds(outfile, slice.get(), id, "s->rd_len - ptr");
+         fprintf(outfile, "      pov_adopt(s, %u, read_%05d_from, read_%05d_to);\n", slot, id, id);
+      }
+      else {
+         ctx->stepRegexes = true;
+         fprintf(outfile, "      //**** read assign to var \"%s\" from pcre: %s\n", var.get(), varRegex->expr.get());
+         fprintf(outfile, "      static char read_%05d_regex[] = \n", id);
+         printAsHexString(outfile, (const unsigned char*)varRegex->expr.get(), strlen(varRegex->expr.get()));
+         fprintf(outfile, "      static pcre *read_%05d_pcre;\n", id);
+         fprintf(outfile, "      unsigned int read_%05d_start, read_%05d_end;\n", id, id);
+         fprintf(outfile, "      if (pov_pcre(pov_regex(&read_%05d_pcre, read_%05d_regex), %d, s->rd, s->rd_len - ptr,\n", id, id, varRegex->group);
+         fprintf(outfile, "                   &read_%05d_start, &read_%05d_end)) {\n", id, id);
+         fprintf(outfile, "         pov_adopt(s, %u, read_%05d_start, read_%05d_end);\n", slot, id, id);
+         fprintf(outfile, "      }\n");
+         fprintf(outfile, "      else {\n");
+         fprintf(outfile, "         s->failed++;\n");
+         fprintf(outfile, "      }\n");
+      }
+   }
+   fprintf(outfile, "      if (ptr) {}  //silence unused variable warning if any\n");
+}
@@ -15,6 +15,7 @@
 using std::vector;
 
 #include "action.h"
+#include "utils.h"
 
 class MatchPart;
 struct Slice;
@@ -22,37 +23,58 @@ struct Regex;
 
 class Xml2cRead : public Action {
 private:
-   static unsigned int readId;
    unsigned int id;
    
-   char *var;
-   Slice *slice;
-   Regex *varRegex;
+   XmlString var;
+   Owned<Slice> slice;
+   Owned<Regex> varRegex;
 
-   vector<MatchPart*> matchParts;
+   OwnedVector<MatchPart> matchParts;
 
-   vector<uint8_t> *delim;
+   Owned<vector<uint8_t> > delim;
 
    bool lengthIsVar;
    unsigned int readLen;
-   char *lengthVar;
+   XmlString lengthVar;
 
    unsigned int timeout_val;
    struct timeval timeout;
    int echo;
    bool invert;
    bool povMode;
+   //the concatenated <data> of a match made of nothing else
+   Owned<vector<uint8_t> > expect;
+   //compared with expect as it is received, rather than read into a buffer
+   bool fused;
    
    void doRead(FILE *outfile);
+   void generateExpect(FILE *outfile);
+   bool canFuse();
 
    //disable copy
-   Xml2cRead(const Xml2cRead &rr) {};
-   const Xml2cRead &operator=(const Xml2cRead &rr) {return *this;}
+   Xml2cRead(const Xml2cRead &rr);
+   const Xml2cRead &operator=(const Xml2cRead &rr);
 
 public:
-   Xml2cRead(xmlNode *n, bool echoEnable = true);
+   Xml2cRead(xmlNode *n, Xml2cContext *ctx);
    ~Xml2cRead();
    virtual void generate(FILE *conn);
+   virtual int actionType() {return POVXML2C_ACTION_READ;};
+   virtual void uses(set<string> &vars);
+   virtual void defines(set<string> &vars);
+   virtual void overwrites(set<string> &vars);
+   virtual bool dropDefinition(const string &name);
+   virtual bool replay(Xml2cReplay *r);
+   virtual void generateStep(FILE *outfile);
+   virtual void cost(Xml2cCost *c);
 };
 
+//deadline bounded read helpers, needed once by any PoV with a read <timeout>
+void generateReadRuntime(FILE *outfile);
+//fused read helpers, needed once by any PoV with a fused read
+void generateExpectRuntime(FILE *outfile);
+
+//most bytes a fused length read receives at a time
+#define EXPECT_CHUNK 4096
+
 #endif
@@ -0,0 +1,209 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xml2c_replay.h"
+#include "xml2c_context.h"
+#include "action.h"
+#include "logging.h"
+#include "reasons.h"
+
+const vector<uint8_t> &Xml2cReplay::getVar(const string &name) {
+   return vars[name];
+}
+
+void Xml2cReplay::setVar(const string &name, const uint8_t *data, size_t len) {
+   vars[name].assign(data, data + len);
+   assigned.insert(name);
+}
+
+bool Xml2cReplay::send(const uint8_t *data, size_t len) {
+   sent.insert(sent.end(), data, data + len);
+   if (simulate) {
+      return true;
+   }
+   while (len > 0) {
+      ssize_t n = write(toService, data, len);
+      if (n < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         note("send failed: %s", strerror(errno));
+         return false;
+      }
+      data += n;
+      len -= n;
+   }
+   return true;
+}
+
+static bool readable(int fd, unsigned int ms) {
+   struct pollfd p;
+   p.fd = fd;
+   p.events = POLLIN;
+   int rc;
+   do {
+      rc = poll(&p, 1, ms);
+   } while (rc < 0 && errno == EINTR);
+   return rc > 0;
+}
+
+size_t Xml2cReplay::readLength(vector<uint8_t> &buf, size_t len, unsigned int ms) {
+   if (simulate) {
+      size_t n = len < transcriptLen - transcriptPos ? len : transcriptLen - transcriptPos;
+      buf.assign(transcript + transcriptPos, transcript + transcriptPos + n);
+      transcriptPos += n;
+      return n;
+   }
+   buf.resize(len);
+   size_t total = 0;
+   while (total < len && readable(fromService, ms)) {
+      ssize_t n = read(fromService, buf.data() + total, len - total);
+      if (n <= 0) {
+         break;
+      }
+      total += n;
+   }
+   buf.resize(total);
+   return total;
+}
+
+static bool endsWith(const vector<uint8_t> &buf, const vector<uint8_t> &delim) {
+   return buf.size() >= delim.size() &&
+          memcmp(buf.data() + buf.size() - delim.size(), delim.data(), delim.size()) == 0;
+}
+
+size_t Xml2cReplay::readDelimited(vector<uint8_t> &buf, const vector<uint8_t> &delim, unsigned int ms) {
+   buf.clear();
+   if (simulate) {
+      while (transcriptPos < transcriptLen) {
+         buf.push_back(transcript[transcriptPos++]);
+         if (endsWith(buf, delim)) {
+            break;
+         }
+      }
+      return buf.size();
+   }
+   //a byte at a time so that nothing past the delimiter is consumed
+   uint8_t c;
+   while (readable(fromService, ms) && read(fromService, &c, 1) == 1) {
+      buf.push_back(c);
+      if (endsWith(buf, delim)) {
+         break;
+      }
+   }
+   return buf.size();
+}
+
+void Xml2cReplay::note(const char *fmt, ...) {
+   char *text;
+   va_list ap;
+   va_start(ap, fmt);
+   if (vasprintf(&text, fmt, ap) != -1) {
+      if (detail.size() > 0) {
+         detail += ", ";
+      }
+      detail += text;
+      free(text);
+   }
+   va_end(ap);
+}
+
+void sliceBounds(int32_t begin, int32_t end, size_t len, size_t *from, size_t *to) {
+   int64_t b = begin < 0 ? (int64_t)len + begin : begin;
+   int64_t e = end < 0 ? (int64_t)len + end : end;
+   b = b < 0 ? 0 : (b > (int64_t)len ? len : b);
+   e = e < 0 ? 0 : (e > (int64_t)len ? len : e);
+   *from = b;
+   *to = e < b ? b : e;
+}
+
+string escapeBytes(const uint8_t *data, size_t len) {
+   string s;
+   for (size_t i = 0; i < len; i++) {
+      char c = data[i];
+      if (c == '\n') {
+         s += "\\n";
+      }
+      else if (c == '\r') {
+         s += "\\r";
+      }
+      else if (c == '\t') {
+         s += "\\t";
+      }
+      else if (c == '"' || c == '\\') {
+         s += '\\';
+         s += c;
+      }
+      else if (c >= 0x20 && c < 0x7f) {
+         s += c;
+      }
+      else {
+         char hex[5];
+         snprintf(hex, sizeof(hex), "\\x%02x", data[i]);
+         s += hex;
+      }
+   }
+   return s;
+}
+
+static double monotonicSeconds() {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int replayPoV(Xml2cContext *ctx, Xml2cReplay *r) {
+   static const char *kinds[POVXML2C_ACTION_TYPES] = {"write", "read", "decl", "delay", "negotiate", "submit"};
+   int result = REASON_SUCCESS;
+   double start = monotonicSeconds();
+   log_note("1..%u\n", (unsigned int)ctx->pov.size());
+   for (vector<Action*>::iterator i = ctx->pov.begin(); i != ctx->pov.end(); i++) {
+      Action *a = *i;
+      ctx->currentLine = a->line;
+      r->detail.clear();
+      r->sent.clear();
+      r->assigned.clear();
+      double t0 = monotonicSeconds();
+      bool ok = a->replay(r);
+      double ms = (monotonicSeconds() - t0) * 1000;
+      if (r->simulate) {
+         if (r->sent.size() > 0) {
+            r->note("sends \"%s\"", escapeBytes(r->sent.data(), r->sent.size()).c_str());
+         }
+         for (set<string>::iterator v = r->assigned.begin(); v != r->assigned.end(); v++) {
+            const vector<uint8_t> &value = r->vars[*v];
+            r->note("%s = \"%s\"", v->c_str(), escapeBytes(value.data(), value.size()).c_str());
+         }
+      }
+      if (ok) {
+         log_ok("%s at line %d: %s (%.3f ms)\n", kinds[a->actionType()], a->line, r->detail.c_str(), ms);
+      }
+      else {
+         log_fail("%s at line %d: %s (%.3f ms)\n", kinds[a->actionType()], a->line, r->detail.c_str(), ms);
+         result = REASON_REPLAY_FAIL;
+      }
+   }
+   ctx->currentLine = 0;
+   if (r->simulate) {
+      for (map<string, vector<uint8_t> >::iterator v = r->vars.begin(); v != r->vars.end(); v++) {
+         log_note("# %s = \"%s\"\n", v->first.c_str(), escapeBytes(v->second.data(), v->second.size()).c_str());
+      }
+      if (r->transcriptPos < r->transcriptLen) {
+         log_note("# %zu of %zu transcript bytes were not read\n", r->transcriptLen - r->transcriptPos, r->transcriptLen);
+      }
+   }
+   log_note("# %s %u actions in %.3f ms\n", r->simulate ? "simulated" : "replayed",
+            (unsigned int)ctx->pov.size(), (monotonicSeconds() - start) * 1000);
+   return result;
+}
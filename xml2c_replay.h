@@ -0,0 +1,84 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_REPLAY_H
+#define __XML2C_REPLAY_H
+
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+class Xml2cContext;
+
+//longest a replayed read without a <timeout> waits for more input, in ms
+#define DEFAULT_REPLAY_WAIT 5000
+
+/*
+ * State of a PoV being interpreted against a live service rather than
+ * compiled.  Actions execute through Action::replay, which mirrors the libpov
+ * calls their generated code would make, and describe what happened in
+ * detail for the per action report.
+ *
+ * A simulation runs the same actions against a recorded transcript of the
+ * service's output instead: reads consume the transcript, delays return at
+ * once and sends are captured for the report rather than sent.
+ */
+class Xml2cReplay {
+
+public:
+   int toService;
+   int fromService;
+   bool simulate;
+   const uint8_t *transcript;
+   size_t transcriptLen;
+   size_t transcriptPos;
+   map<string, vector<uint8_t> > vars;
+   //what the last action did, for the report
+   string detail;
+   //bytes sent and variables assigned by the last action
+   vector<uint8_t> sent;
+   set<string> assigned;
+
+   Xml2cReplay(int to, int from) : toService(to), fromService(from), simulate(false),
+                                   transcript(NULL), transcriptLen(0), transcriptPos(0) {};
+   Xml2cReplay(const uint8_t *data, size_t len) : toService(-1), fromService(-1), simulate(true),
+                                                  transcript(data), transcriptLen(len), transcriptPos(0) {};
+
+   //missing variables read as empty, as libpov's getenv
+   const vector<uint8_t> &getVar(const string &name);
+   void setVar(const string &name, const uint8_t *data, size_t len);
+
+   bool send(const uint8_t *data, size_t len);
+   //read until len bytes, eof, or ms of silence
+   size_t readLength(vector<uint8_t> &buf, size_t len, unsigned int ms);
+   //read until delim, eof, or ms of silence
+   size_t readDelimited(vector<uint8_t> &buf, const vector<uint8_t> &delim, unsigned int ms);
+   //append a formatted note to detail
+   void note(const char *fmt, ...);
+};
+
+//python style [begin:end) of a len byte buffer, as libpov's slice helpers
+void sliceBounds(int32_t begin, int32_t end, size_t len, size_t *from, size_t *to);
+
+//bytes for a report, printable ascii as is and C escapes for the rest
+string escapeBytes(const uint8_t *data, size_t len);
+
+/*
+ * Run the actions of the last conversion on ctx, reporting one TAP line with
+ * timing per action through the context diagnostics.  A simulation also
+ * reports the bytes each action sends and the variables it assigns, and
+ * finishes with every variable and any transcript left unread.  Returns
+ * REASON_REPLAY_FAIL if any action failed.
+ */
+int replayPoV(Xml2cContext *ctx, Xml2cReplay *r);
+
+#endif
@@ -0,0 +1,428 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xml2c_resumable.h"
+#include "xml2c_context.h"
+#include "xml2c_liveness.h"
+#include "action.h"
+
+/*
+ * Session state and the non-blocking I/O helpers behind pov_step.  Unlike
+ * the straight-line backend this targets a hosted platform, so it talks to
+ * the service with read and write on a non-blocking fd and keeps variables
+ * per session instead of in libpov's process wide environment.
+ */
+static const char *resumableRuntime =
+   "#include <stdlib.h>\n"
+   "#include <string.h>\n"
+   "#include <errno.h>\n"
+   "#include <unistd.h>\n"
+   "typedef struct {\n"
+   "   unsigned char *data;\n"
+   "   unsigned int len;\n"
+   "   unsigned char *mem;           /* allocation data points into */\n"
+   "} pov_var;\n"
+   "typedef struct pov_session {\n"
+   "   int fd;                       /* non-blocking connection to the service */\n"
+   "   int state;                    /* next action to run */\n"
+   "   int started;                  /* the current action has begun */\n"
+   "   unsigned long long deadline;  /* ms at which the current wait ends, 0 for none */\n"
+   "   unsigned char *in;            /* received but not yet consumed */\n"
+   "   unsigned int in_len;\n"
+   "   unsigned int in_cap;\n"
+   "   int eof;\n"
+   "   unsigned char *out;           /* the write in progress */\n"
+   "   unsigned int out_len;\n"
+   "   unsigned int out_pos;\n"
+   "   unsigned char *rd;            /* result of the last completed read */\n"
+   "   unsigned int rd_len;\n"
+   "   unsigned int failed;          /* matches that did not match */\n"
+   "   pov_var vars[POV_VARS + 1];\n"
+   "} pov_session;\n"
+   "enum {POV_DONE, POV_WANT_READ, POV_WANT_WRITE, POV_WANT_TIMER};\n"
+   "static void pov_session_init(pov_session *s, int fd) {\n"
+   "   memset(s, 0, sizeof(*s));\n"
+   "   s->fd = fd;\n"
+   "}\n"
+   "static void pov_session_free(pov_session *s) {\n"
+   "   unsigned int i;\n"
+   "   for (i = 0; i < sizeof(s->vars) / sizeof(s->vars[0]); i++) {\n"
+   "      free(s->vars[i].mem);\n"
+   "   }\n"
+   "   free(s->in);\n"
+   "   free(s->out);\n"
+   "   free(s->rd);\n"
+   "   memset(s, 0, sizeof(*s));\n"
+   "   s->fd = -1;\n"
+   "}\n"
+   "static void pov_append(unsigned char **buf, unsigned int *len, const unsigned char *data, unsigned int n) {\n"
+   "   if (n == 0) {\n"
+   "      return;\n"
+   "   }\n"
+   "   *buf = (unsigned char*)realloc(*buf, *len + n);\n"
+   "   memcpy(*buf + *len, data, n);\n"
+   "   *len += n;\n"
+   "}\n"
+   "/* takes ownership of data */\n"
+   "static void pov_set_var(pov_session *s, int slot, unsigned char *data, unsigned int len) {\n"
+   "   free(s->vars[slot].mem);\n"
+   "   s->vars[slot].data = s->vars[slot].mem = data;\n"
+   "   s->vars[slot].len = len;\n"
+   "}\n"
+   "static void pov_slice(unsigned int len, int begin, int end, unsigned int *from, unsigned int *to) {\n"
+   "   long long b = begin < 0 ? (long long)len + begin : begin;\n"
+   "   long long e = end < 0 ? (long long)len + end : end;\n"
+   "   b = b < 0 ? 0 : (b > len ? len : b);\n"
+   "   e = e < 0 ? 0 : (e > len ? len : e);\n"
+   "   *from = b;\n"
+   "   *to = e < b ? b : e;\n"
+   "}\n"
+   "static void pov_append_slice(unsigned char **buf, unsigned int *len, pov_var *v, int begin, int end) {\n"
+   "   unsigned int from, to;\n"
+   "   pov_slice(v->len, begin, end, &from, &to);\n"
+   "   pov_append(buf, len, v->data + from, to - from);\n"
+   "}\n"
+   "/* slot becomes s->rd[from:to].  The read buffer itself is handed over\n"
+   "   rather than copied, unless the view is under half of it */\n"
+   "static void pov_adopt(pov_session *s, int slot, unsigned int from, unsigned int to) {\n"
+   "   if ((to - from) * 2 < s->rd_len) {\n"
+   "      unsigned char *v = NULL;\n"
+   "      unsigned int vlen = 0;\n"
+   "      pov_append(&v, &vlen, s->rd + from, to - from);\n"
+   "      pov_set_var(s, slot, v, vlen);\n"
+   "      return;\n"
+   "   }\n"
+   "   free(s->vars[slot].mem);\n"
+   "   s->vars[slot].mem = s->rd;\n"
+   "   s->vars[slot].data = s->rd + from;\n"
+   "   s->vars[slot].len = to - from;\n"
+   "   s->rd = NULL;\n"
+   "   s->rd_len = 0;\n"
+   "}\n"
+   "static unsigned int pov_match(pov_session *s, const unsigned char *buf, unsigned int len,\n"
+   "                              const unsigned char *m, unsigned int mlen) {\n"
+   "   if (mlen > len || memcmp(buf, m, mlen) != 0) {\n"
+   "      s->failed++;\n"
+   "      return 0;\n"
+   "   }\n"
+   "   return mlen;\n"
+   "}\n"
+   "/* 1 once the write is out, or the service is gone, 0 to wait for room */\n"
+   "static int pov_flush(pov_session *s) {\n"
+   "   while (s->out_pos < s->out_len) {\n"
+   "      ssize_t n = write(s->fd, s->out + s->out_pos, s->out_len - s->out_pos);\n"
+   "      if (n < 0 && errno == EINTR) {\n"
+   "         continue;\n"
+   "      }\n"
+   "      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {\n"
+   "         return 0;\n"
+   "      }\n"
+   "      if (n <= 0) {\n"
+   "         break;\n"
+   "      }\n"
+   "      s->out_pos += n;\n"
+   "   }\n"
+   "   free(s->out);\n"
+   "   s->out = NULL;\n"
+   "   s->out_len = s->out_pos = 0;\n"
+   "   s->started = 0;\n"
+   "   return 1;\n"
+   "}\n"
+   "/* 1 if more input arrived */\n"
+   "static int pov_fill(pov_session *s) {\n"
+   "   while (!s->eof) {\n"
+   "      ssize_t n;\n"
+   "      if (s->in_cap - s->in_len < 4096) {\n"
+   "         s->in_cap = s->in_cap * 2 + 4096;\n"
+   "         s->in = (unsigned char*)realloc(s->in, s->in_cap);\n"
+   "      }\n"
+   "      n = read(s->fd, s->in + s->in_len, s->in_cap - s->in_len);\n"
+   "      if (n > 0) {\n"
+   "         s->in_len += n;\n"
+   "         return 1;\n"
+   "      }\n"
+   "      if (n < 0 && errno == EINTR) {\n"
+   "         continue;\n"
+   "      }\n"
+   "      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {\n"
+   "         return 0;\n"
+   "      }\n"
+   "      s->eof = 1;\n"
+   "   }\n"
+   "   return 0;\n"
+   "}\n"
+   "/* 1 if a read should settle for what it has: end of input or its timeout passed */\n"
+   "static int pov_give_up(pov_session *s, unsigned int timeout, unsigned long long now) {\n"
+   "   if (s->eof) {\n"
+   "      return 1;\n"
+   "   }\n"
+   "   if (timeout == 0) {\n"
+   "      return 0;\n"
+   "   }\n"
+   "   if (!s->started) {\n"
+   "      s->started = 1;\n"
+   "      s->deadline = now + timeout;\n"
+   "   }\n"
+   "   return now >= s->deadline;\n"
+   "}\n"
+   "static void pov_take(pov_session *s, unsigned int n) {\n"
+   "   free(s->rd);\n"
+   "   s->rd = (unsigned char*)malloc(n + 1);\n"
+   "   memcpy(s->rd, s->in, n);\n"
+   "   s->rd_len = n;\n"
+   "   memmove(s->in, s->in + n, s->in_len - n);\n"
+   "   s->in_len -= n;\n"
+   "   s->started = 0;\n"
+   "   s->deadline = 0;\n"
+   "}\n"
+   "/* 1 once s->rd holds the read, 0 to wait for input */\n"
+   "static int pov_read_length(pov_session *s, unsigned int len, unsigned int timeout, unsigned long long now) {\n"
+   "   while (s->in_len < len && pov_fill(s)) {\n"
+   "   }\n"
+   "   if (s->in_len < len && !pov_give_up(s, timeout, now)) {\n"
+   "      return 0;\n"
+   "   }\n"
+   "   pov_take(s, s->in_len < len ? s->in_len : len);\n"
+   "   return 1;\n"
+   "}\n"
+   "static int pov_read_delim(pov_session *s, const unsigned char *delim, unsigned int dlen,\n"
+   "                          unsigned int timeout, unsigned long long now) {\n"
+   "   unsigned int i = 0;\n"
+   "   do {\n"
+   "      for (; i + dlen <= s->in_len; i++) {\n"
+   "         if (memcmp(s->in + i, delim, dlen) == 0) {\n"
+   "            pov_take(s, i + dlen);\n"
+   "            return 1;\n"
+   "         }\n"
+   "      }\n"
+   "   } while (pov_fill(s));\n"
+   "   if (!pov_give_up(s, timeout, now)) {\n"
+   "      return 0;\n"
+   "   }\n"
+   "   pov_take(s, s->in_len);\n"
+   "   return 1;\n"
+   "}\n"
+   "static int pov_delay(pov_session *s, unsigned int ms, unsigned long long now) {\n"
+   "   if (!s->started) {\n"
+   "      s->started = 1;\n"
+   "      s->deadline = now + ms;\n"
+   "   }\n"
+   "   if (now < s->deadline) {\n"
+   "      return 0;\n"
+   "   }\n"
+   "   s->started = 0;\n"
+   "   s->deadline = 0;\n"
+   "   return 1;\n"
+   "}\n";
+
+//only PoVs with regular expressions need libpcre
+static const char *resumableRegexRuntime =
+   "#include <pcre.h>\n"
+   "#define POV_PCRE_GROUPS 32\n"
+   "static pcre *pov_regex(pcre **cache, const char *pattern) {\n"
+   "   if (*cache == NULL) {\n"
+   "      const char *error;\n"
+   "      int offset;\n"
+   "      *cache = pcre_compile(pattern, PCRE_DOTALL, &error, &offset, NULL);\n"
+   "   }\n"
+   "   return *cache;\n"
+   "}\n"
+   "/* search as libpov does, 1 with the bounds of group on a match */\n"
+   "static int pov_pcre(pcre *re, int group, const unsigned char *buf, unsigned int len,\n"
+   "                    unsigned int *start, unsigned int *end) {\n"
+   "   int ov[3 * POV_PCRE_GROUPS];\n"
+   "   if (re == NULL || group >= POV_PCRE_GROUPS) {\n"
+   "      return 0;\n"
+   "   }\n"
+   "   if (pcre_exec(re, NULL, (const char*)buf, len, 0, 0, ov, 3 * POV_PCRE_GROUPS) < 0 || ov[2 * group] < 0) {\n"
+   "      return 0;\n"
+   "   }\n"
+   "   *start = ov[2 * group];\n"
+   "   *end = ov[2 * group + 1];\n"
+   "   return 1;\n"
+   "}\n";
+
+/*
+ * Compiled in with -DPOV_DRIVER: connect SESSIONS times to the service and
+ * run the sessions CONCURRENCY at a time on one thread, stepping a session
+ * only once its fd is ready or its timer is due.
+ */
+static const char *resumableDriver =
+   "#ifdef POV_DRIVER\n"
+   "#include <stdio.h>\n"
+   "#include <poll.h>\n"
+   "#include <fcntl.h>\n"
+   "#include <time.h>\n"
+   "#include <netdb.h>\n"
+   "#include <sys/socket.h>\n"
+   "#include <sys/un.h>\n"
+   "#include <signal.h>\n"
+   "static unsigned long long pov_now(void) {\n"
+   "   struct timespec ts;\n"
+   "   clock_gettime(CLOCK_MONOTONIC, &ts);\n"
+   "   return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;\n"
+   "}\n"
+   "/* unix:PATH or HOST:PORT */\n"
+   "static int pov_connect(const char *target) {\n"
+   "   int fd = -1;\n"
+   "   if (strncmp(target, \"unix:\", 5) == 0) {\n"
+   "      struct sockaddr_un addr;\n"
+   "      memset(&addr, 0, sizeof(addr));\n"
+   "      addr.sun_family = AF_UNIX;\n"
+   "      strncpy(addr.sun_path, target + 5, sizeof(addr.sun_path) - 1);\n"
+   "      fd = socket(AF_UNIX, SOCK_STREAM, 0);\n"
+   "      if (fd != -1 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {\n"
+   "         close(fd);\n"
+   "         fd = -1;\n"
+   "      }\n"
+   "   }\n"
+   "   else {\n"
+   "      char host[256];\n"
+   "      const char *port = strrchr(target, ':');\n"
+   "      struct addrinfo hints, *res, *ai;\n"
+   "      if (port == NULL || port - target >= (int)sizeof(host)) {\n"
+   "         return -1;\n"
+   "      }\n"
+   "      memcpy(host, target, port - target);\n"
+   "      host[port - target] = 0;\n"
+   "      memset(&hints, 0, sizeof(hints));\n"
+   "      hints.ai_socktype = SOCK_STREAM;\n"
+   "      if (getaddrinfo(host, port + 1, &hints, &res) != 0) {\n"
+   "         return -1;\n"
+   "      }\n"
+   "      for (ai = res; ai != NULL && fd == -1; ai = ai->ai_next) {\n"
+   "         fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);\n"
+   "         if (fd != -1 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {\n"
+   "            close(fd);\n"
+   "            fd = -1;\n"
+   "         }\n"
+   "      }\n"
+   "      freeaddrinfo(res);\n"
+   "   }\n"
+   "   if (fd != -1) {\n"
+   "      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);\n"
+   "   }\n"
+   "   return fd;\n"
+   "}\n"
+   "int main(int argc, char **argv) {\n"
+   "   unsigned int total, width, started = 0, done = 0, errors = 0, failed = 0, i;\n"
+   "   unsigned long long begin;\n"
+   "   pov_session *ss;\n"
+   "   struct pollfd *pfd;\n"
+   "   int *want;\n"
+   "   if (argc < 2) {\n"
+   "      fprintf(stderr, \"usage: %s unix:PATH|HOST:PORT [SESSIONS [CONCURRENCY]]\\n\", argv[0]);\n"
+   "      return 1;\n"
+   "   }\n"
+   "   total = argc > 2 ? strtoul(argv[2], NULL, 10) : 1;\n"
+   "   width = argc > 3 ? strtoul(argv[3], NULL, 10) : total;\n"
+   "   width = width == 0 ? 1 : width;\n"
+   "   ss = (pov_session*)calloc(width, sizeof(pov_session));\n"
+   "   pfd = (struct pollfd*)calloc(width, sizeof(struct pollfd));\n"
+   "   want = (int*)calloc(width, sizeof(int));\n"
+   "   for (i = 0; i < width; i++) {\n"
+   "      ss[i].fd = -1;\n"
+   "   }\n"
+   "   signal(SIGPIPE, SIG_IGN);\n"
+   "   begin = pov_now();\n"
+   "   while (done < total) {\n"
+   "      unsigned long long now = pov_now();\n"
+   "      int wait = -1;\n"
+   "      for (i = 0; i < width; i++) {\n"
+   "         pov_session *s = &ss[i];\n"
+   "         int ready = 1;\n"
+   "         if (s->fd == -1) {\n"
+   "            int fd;\n"
+   "            pfd[i].fd = -1;\n"
+   "            if (started == total) {\n"
+   "               continue;\n"
+   "            }\n"
+   "            started++;\n"
+   "            fd = pov_connect(argv[1]);\n"
+   "            if (fd == -1) {\n"
+   "               errors++;\n"
+   "               done++;\n"
+   "               continue;\n"
+   "            }\n"
+   "            pov_session_init(s, fd);\n"
+   "         }\n"
+   "         else {\n"
+   "            ready = pfd[i].revents != 0 || (s->deadline != 0 && now >= s->deadline);\n"
+   "         }\n"
+   "         if (ready) {\n"
+   "            want[i] = pov_step(s, now);\n"
+   "            if (want[i] == POV_DONE) {\n"
+   "               failed += s->failed != 0;\n"
+   "               close(s->fd);\n"
+   "               pov_session_free(s);\n"
+   "               pfd[i].fd = -1;\n"
+   "               done++;\n"
+   "               /* start its replacement on the next pass without waiting */\n"
+   "               wait = started < total ? 0 : wait;\n"
+   "               continue;\n"
+   "            }\n"
+   "         }\n"
+   "         pfd[i].fd = s->fd;\n"
+   "         pfd[i].events = want[i] == POV_WANT_READ ? POLLIN : (want[i] == POV_WANT_WRITE ? POLLOUT : 0);\n"
+   "         pfd[i].revents = 0;\n"
+   "         if (s->deadline != 0) {\n"
+   "            int ms = s->deadline > now ? (int)(s->deadline - now) : 0;\n"
+   "            wait = wait == -1 || ms < wait ? ms : wait;\n"
+   "         }\n"
+   "      }\n"
+   "      if (done < total && poll(pfd, width, wait) < 0 && errno != EINTR) {\n"
+   "         perror(\"poll\");\n"
+   "         return 1;\n"
+   "      }\n"
+   "   }\n"
+   "   printf(\"sessions %u, connect errors %u, sessions with failed matches %u, %llu ms\\n\",\n"
+   "          total, errors, failed, pov_now() - begin);\n"
+   "   return failed != 0 || errors != 0;\n"
+   "}\n"
+   "#endif\n";
+
+int generateResumable(Xml2cContext *ctx, FILE *outfile) {
+   //the steps go first so that variable slots and regexes are known by the
+   //time the runtime is emitted
+   char *steps = NULL;
+   size_t stepsLen = 0;
+   FILE *mem = open_memstream(&steps, &stepsLen);
+   if (mem == NULL) {
+      return -1;
+   }
+   ctx->varSlots.clear();
+   ctx->stepRegexes = false;
+   unsigned int state = 0;
+   fprintf(mem, "int pov_step(pov_session *s, unsigned long long now) {\n");
+   fprintf(mem, "   switch (s->state) {\n");
+   for (vector<Action*>::iterator i = ctx->pov.begin(); i != ctx->pov.end(); i++, state++) {
+      fprintf(mem, "   case %u: {\n", state);
+      (*i)->generateStep(mem);
+      generateReleaseSteps(mem, ctx, *i);
+      fprintf(mem, "      s->state = %u;\n", state + 1);
+      fprintf(mem, "   }\n");
+      fprintf(mem, "   /* fall through */\n");
+   }
+   fprintf(mem, "   default:\n");
+   fprintf(mem, "      return POV_DONE;\n");
+   fprintf(mem, "   }\n");
+   fprintf(mem, "}\n");
+   fclose(mem);
+
+   fprintf(outfile, "//**** pov-xml2c resumable PoV, %u states\n", state);
+   fprintf(outfile, "#define POV_VARS %u\n", (unsigned int)ctx->varSlots.size());
+   fputs(resumableRuntime, outfile);
+   if (ctx->stepRegexes) {
+      fputs(resumableRegexRuntime, outfile);
+   }
+   fwrite(steps, 1, stepsLen, outfile);
+   free(steps);
+   fputs(resumableDriver, outfile);
+   return 0;
+}
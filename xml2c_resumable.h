@@ -0,0 +1,25 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_RESUMABLE_H
+#define __XML2C_RESUMABLE_H
+
+#include <stdio.h>
+
+class Xml2cContext;
+
+/*
+ * The resumable backend.  Rather than a DECREE main() that blocks in each
+ * read and write, emit a hosted pov_step(session, now) that runs the actions
+ * as the cases of a switch on session->state and returns POV_WANT_READ,
+ * POV_WANT_WRITE or POV_WANT_TIMER whenever an action cannot finish without
+ * blocking, to be called again once the session's fd is ready or its
+ * deadline has passed.  Every session keeps its own variables and buffers,
+ * so one thread can interleave any number of them.  Compiling the output
+ * with -DPOV_DRIVER adds a poll() based main() that does exactly that.
+ */
+int generateResumable(Xml2cContext *ctx, FILE *outfile);
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "xml2c_schedule.h"
+#include "xml2c_context.h"
+#include "logging.h"
+
+using std::set;
+using std::string;
+using std::vector;
+
+unsigned int countRoundTrips(const vector<Action*> &pov) {
+   unsigned int trips = 0;
+   bool awaiting = false;
+   for (vector<Action*>::const_iterator i = pov.begin(); i != pov.end(); i++) {
+      int type = (*i)->actionType();
+      if (type == POVXML2C_ACTION_READ) {
+         awaiting = true;
+      }
+      else if (type == POVXML2C_ACTION_WRITE && awaiting) {
+         trips++;
+         awaiting = false;
+      }
+   }
+   return trips;
+}
+
+static bool assignsAny(Action *a, const set<string> &vars) {
+   set<string> defs;
+   a->defines(defs);
+   for (set<string>::iterator i = defs.begin(); i != defs.end(); i++) {
+      if (vars.count(*i)) {
+         return true;
+      }
+   }
+   return false;
+}
+
+void scheduleEarlyWrites(Xml2cContext *ctx) {
+   vector<Action*> &pov = ctx->pov;
+   unsigned int before = countRoundTrips(pov);
+   ctx->stats.round_trips = before;
+   if (ctx->earlyWrites == 0) {
+      return;
+   }
+
+   unsigned int moved = 0;
+   for (size_t w = 0; w < pov.size(); w++) {
+      Action *write = pov[w];
+      if (write->actionType() != POVXML2C_ACTION_WRITE) {
+         continue;
+      }
+      set<string> needs;
+      write->uses(needs);
+
+      //walk back over reads and declarations the write does not depend on
+      size_t to = w;
+      size_t dest = w;
+      unsigned int passed = 0;
+      while (to > 0) {
+         Action *prev = pov[to - 1];
+         int type = prev->actionType();
+         if (type != POVXML2C_ACTION_READ && type != POVXML2C_ACTION_DECL) {
+            break;
+         }
+         if (assignsAny(prev, needs)) {
+            break;
+         }
+         if (type == POVXML2C_ACTION_READ) {
+            if (passed == ctx->earlyWrites) {
+               break;
+            }
+            passed++;
+            //only worth moving if it gets ahead of a read
+            dest = to - 1;
+         }
+         to--;
+      }
+      if (dest != w) {
+         pov.erase(pov.begin() + w);
+         pov.insert(pov.begin() + dest, write);
+         moved++;
+      }
+   }
+
+   unsigned int after = countRoundTrips(pov);
+   unsigned int removed = before > after ? before - after : 0;
+   ctx->stats.round_trips = after;
+   ctx->stats.round_trips_removed = removed;
+   log_note("early writes: %u of %u writes issued ahead of reads, %u of %u round trips removed\n",
+            moved, (unsigned int)ctx->stats.actions[POVXML2C_ACTION_WRITE], removed, before);
+}
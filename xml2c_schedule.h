@@ -0,0 +1,30 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_SCHEDULE_H
+#define __XML2C_SCHEDULE_H
+
+#include <vector>
+
+#include "action.h"
+
+using std::vector;
+
+class Xml2cContext;
+
+//read to write turnarounds, each of which costs the PoV a round trip
+unsigned int countRoundTrips(const vector<Action*> &pov);
+
+/*
+ * Reorder ctx->pov so that writes are issued ahead of up to ctx->earlyWrites
+ * preceding reads, as long as none of those reads (or declarations passed on
+ * the way) assigns a variable the write sends.  Writes never pass another
+ * write, a delay, a negotiation or a submission, so the byte stream sent to
+ * the service is unchanged; only its timing relative to the responses
+ * differs.  Records round trips before and after in ctx->stats.
+ */
+void scheduleEarlyWrites(Xml2cContext *ctx);
+
+#endif
@@ -0,0 +1,818 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+/*
+ Server mode keeps warm converters resident.  The DTD is parsed once, then
+ a pool of worker threads each keep a conversion context of their own and
+ convert request after request.  The main thread accepts requests on a unix
+ domain socket, reads them, queues them for the workers and writes back the
+ responses, all from one poll() loop, so no client that is slow to send or
+ to read holds up any other.  A conversion is bounded by its request's
+ deadline through the library's own deadline checks, and the client is
+ answered when the deadline passes even if its worker has yet to notice.
+ Requests may only name files and caches in directories given when the
+ server starts.  Workers share the on disk cache with every other
+ converter.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+#include "povxml2c.h"
+#include "xml2c.h"
+#include "xml2c_server.h"
+#include "logging.h"
+
+#include "reasons.h"
+
+using std::vector;
+using std::deque;
+using std::sort;
+
+#define LATENCY_SAMPLES 4096
+#define RESPONSE_TIMEOUT 5   //seconds to wait on a client that won't read
+
+enum {
+   CONN_READING,
+   CONN_QUEUED,
+   CONN_RUNNING,
+   CONN_WRITING,
+   CONN_CLOSED
+};
+
+struct Connection {
+   int fd;
+   int state;
+   string in;
+   size_t headerLen;
+   unsigned long long bodyLen;
+   map<string, string> hdr;
+   double start;           //msec
+   double deadline;        //msec
+   //a worker holds the request until it posts the outcome back
+   bool converting;
+
+   //the outcome, set by the worker
+   int status;
+   string src;
+   string diag;
+   povxml2c_stats stats;
+
+   //the response and how much of it the client has taken
+   string out;
+   size_t sent;
+   double writeDeadline;   //msec
+
+   Connection(int _fd) : fd(_fd), state(CONN_READING), headerLen(0), bodyLen(0), start(0), deadline(0),
+                         converting(false), status(REASON_SUCCESS), sent(0), writeDeadline(0) {
+      memset(&stats, 0, sizeof(stats));
+   };
+};
+
+//requests handed to the workers, and those they have finished
+struct WorkQueue {
+   pthread_mutex_t lock;
+   pthread_cond_t ready;
+   deque<Connection*> pending;
+   vector<Connection*> done;
+   bool stopping;
+   Xml2cOptions *opts;
+};
+
+struct ServerStats {
+   double started;
+   unsigned long long requests;
+   unsigned long long succeeded;
+   unsigned long long failed;
+   unsigned long long deadlines;
+   unsigned long long rejected;
+   unsigned long long statsRequests;
+   double latency[LATENCY_SAMPLES];
+   unsigned long long samples;
+   //summed over every conversion a worker finished
+   povxml2c_stats conversion;
+};
+
+//collects a worker's own messages along with the conversion's
+class DiagSink : public LogSink {
+private:
+   string *text;
+
+public:
+   DiagSink(string *t) : text(t) {};
+   void message(int, const char *msg) {
+      text->append(msg);
+   };
+};
+
+static int sigPipe[2] = {-1, -1};
+static volatile sig_atomic_t stopping = 0;
+
+static double nowMsec() {
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+//wakes the poll loop, from a signal handler or a worker
+static void wakeServer() {
+   int saved = errno;
+   char ch = 0;
+   if (write(sigPipe[1], &ch, 1)) {}
+   errno = saved;
+}
+
+static void server_stop_handler(int) {
+   stopping = 1;
+   wakeServer();
+}
+
+static void setNonBlocking(int fd, bool nonBlocking) {
+   int flags = fcntl(fd, F_GETFL);
+   if (nonBlocking) {
+      flags |= O_NONBLOCK;
+   }
+   else {
+      flags &= ~O_NONBLOCK;
+   }
+   fcntl(fd, F_SETFL, flags);
+}
+
+//write what the client will take without blocking, closing once it has it all
+static void flushResponse(Connection *c) {
+   while (c->sent < c->out.size()) {
+      ssize_t n = write(c->fd, c->out.data() + c->sent, c->out.size() - c->sent);
+      if (n < 0 && errno == EINTR) {
+         continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+         return;
+      }
+      if (n <= 0) {
+         break;
+      }
+      c->sent += n;
+   }
+   c->state = CONN_CLOSED;
+}
+
+/*
+ * Queues the response on the connection.  As much as the socket takes is
+ * written now, the poll loop writes the rest as the client reads it.
+ */
+static void respond(Connection *c, int status, const string &out, const string &diag,
+                    const string &stats = string()) {
+   char hdr[256];
+   int len = snprintf(hdr, sizeof(hdr), "status %d\noutput %zu\ndiagnostics %zu\n", status, out.size(), diag.size());
+   if (stats.size() > 0) {
+      len += snprintf(hdr + len, sizeof(hdr) - len, "statistics %zu\n", stats.size());
+   }
+   len += snprintf(hdr + len, sizeof(hdr) - len, "\n");
+   c->out.reserve(len + out.size() + diag.size() + stats.size());
+   c->out.assign(hdr, len);
+   c->out += out;
+   c->out += diag;
+   c->out += stats;
+   c->sent = 0;
+   c->state = CONN_WRITING;
+   c->writeDeadline = nowMsec() + RESPONSE_TIMEOUT * 1000.0;
+   flushResponse(c);
+}
+
+static double percentile(vector<double> &sorted, double p) {
+   if (sorted.size() == 0) {
+      return 0;
+   }
+   size_t idx = (size_t)(p * (sorted.size() - 1) + 0.5);
+   return sorted[idx];
+}
+
+static string statsJson(ServerStats *stats, int active, int queued, int workers) {
+   unsigned long long n = stats->samples < LATENCY_SAMPLES ? stats->samples : LATENCY_SAMPLES;
+   vector<double> lat(stats->latency, stats->latency + n);
+   sort(lat.begin(), lat.end());
+   char buf[1024];
+   snprintf(buf, sizeof(buf),
+            "{\"uptime_ms\": %.0f, \"requests\": %llu, \"succeeded\": %llu, \"failed\": %llu, "
+            "\"deadline_exceeded\": %llu, \"rejected\": %llu, \"stats_requests\": %llu, "
+            "\"active\": %d, \"queued\": %d, \"workers\": %d, "
+            "\"latency_ms\": {\"samples\": %llu, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}, "
+            "\"conversion\": ",
+            nowMsec() - stats->started, stats->requests, stats->succeeded, stats->failed,
+            stats->deadlines, stats->rejected, stats->statsRequests,
+            active, queued, workers,
+            n, percentile(lat, 0.5), percentile(lat, 0.9), percentile(lat, 0.99),
+            n ? lat[n - 1] : 0.0);
+   string res = buf;
+   char *conv = povxml2c_stats_json(&stats->conversion);
+   if (conv != NULL) {
+      //drop the trailing newline
+      res.append(conv, strlen(conv) - 1);
+      povxml2c_free_buffer(conv);
+   }
+   else {
+      res += "null";
+   }
+   res += "}\n";
+   return res;
+}
+
+static void recordLatency(ServerStats *stats, double msec) {
+   stats->latency[stats->samples % LATENCY_SAMPLES] = msec;
+   stats->samples++;
+}
+
+/*
+ * The generator options a request carries override the server's own, as
+ * the same options on the pov-xml2c command line would
+ */
+static void requestOptions(map<string, string> &hdr, Xml2cOptions *opts) {
+   unsigned long long value;
+   if (headerValue(hdr, "timeout", &value) && value <= INT_MAX) {
+      opts->parseTimeout = value;
+   }
+   if (headerValue(hdr, "probes", &value) && value <= INT_MAX) {
+      opts->probeFd = value;
+   }
+   if (headerValue(hdr, "early", &value) && value <= UINT_MAX) {
+      opts->earlyWrites = value;
+   }
+   if (headerValue(hdr, "backend", &value) && value <= POVXML2C_BACKEND_RESUMABLE) {
+      opts->backend = value;
+   }
+   if (headerValue(hdr, "fixed-reads", &value)) {
+      opts->fixedReads = value != 0;
+   }
+   if (headerValue(hdr, "release-vars", &value)) {
+      opts->releaseVars = value != 0;
+   }
+   if (headerValue(hdr, "external-data", &value)) {
+      opts->externalData = value != 0;
+   }
+   if (headerValue(hdr, "max-input", &value)) {
+      opts->maxInput = value;
+   }
+   if (headerValue(hdr, "max-nodes", &value) && value <= LLONG_MAX) {
+      opts->maxNodes = value;
+   }
+   if (headerValue(hdr, "max-depth", &value) && value <= UINT_MAX) {
+      opts->maxDepth = value;
+   }
+   if (headerValue(hdr, "max-payload", &value) && value <= LLONG_MAX) {
+      opts->maxPayload = value;
+   }
+   if (headerValue(hdr, "max-alloc", &value) && value <= LLONG_MAX) {
+      opts->maxAlloc = value;
+   }
+   if (headerValue(hdr, "cache-size", &value)) {
+      opts->cacheSize = value;
+   }
+   map<string, string>::iterator i = hdr.find("cache");
+   if (i != hdr.end()) {
+      opts->cacheDir = i->second.c_str();
+   }
+   i = hdr.find("base");
+   if (i != hdr.end() && hdr.find("path") == hdr.end()) {
+      opts->baseDir = i->second.c_str();
+   }
+}
+
+/*
+ * Resolves path, whose last component need not exist yet, as a cache
+ * directory may not.  False if it cannot be resolved.
+ */
+static bool resolvePath(const string &path, string *resolved) {
+   char buf[PATH_MAX];
+   if (realpath(path.c_str(), buf) != NULL) {
+      *resolved = buf;
+      return true;
+   }
+   size_t slash = path.rfind('/');
+   string name = slash == string::npos ? path : path.substr(slash + 1);
+   string dir = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+   if (errno != ENOENT || name == "" || name == "." || name == ".." || realpath(dir.c_str(), buf) == NULL) {
+      return false;
+   }
+   *resolved = buf;
+   if (*resolved != "/") {
+      *resolved += "/";
+   }
+   *resolved += name;
+   return true;
+}
+
+static bool insideDirs(const string &path, const vector<string> &dirs) {
+   for (vector<string>::const_iterator d = dirs.begin(); d != dirs.end(); d++) {
+      if (path.compare(0, d->size(), *d) == 0 &&
+          (path.size() == d->size() || path[d->size()] == '/' || *d == "/")) {
+         return true;
+      }
+   }
+   return false;
+}
+
+/*
+ * A request's path and base must lie within the directories the server was
+ * started with, and its cache within those or the server's own.  Each is
+ * replaced with its resolved form, so that what was checked is what gets
+ * opened.  Returns the name of the first header that fails, NULL if none.
+ */
+static const char *checkPaths(map<string, string> &hdr, const vector<string> &allowed,
+                              const vector<string> &caches) {
+   static const char *names[] = {"path", "base", "cache"};
+   for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+      map<string, string>::iterator h = hdr.find(names[i]);
+      if (h == hdr.end()) {
+         continue;
+      }
+      string resolved;
+      if (!resolvePath(h->second, &resolved) || !insideDirs(resolved, i == 2 ? caches : allowed)) {
+         return names[i];
+      }
+      h->second = resolved;
+   }
+   return NULL;
+}
+
+/*
+ * Runs on a worker thread for one request, leaving the outcome in the
+ * connection for the main thread
+ */
+static void runRequest(povxml2c_ctx *ctx, Connection *c, Xml2cOptions *serverOpts) {
+   Xml2cOptions opts = *serverOpts;
+   string base;
+   int docFd = -1;
+   map<string, string>::iterator path = c->hdr.find("path");
+   if (path != c->hdr.end()) {
+      //external data is found next to the PoV, the path is already resolved
+      base = path->second.substr(0, path->second.rfind('/'));
+      opts.baseDir = base.size() > 0 ? base.c_str() : "/";
+      docFd = open(path->second.c_str(), O_RDONLY);
+      if (docFd == -1) {
+         DiagSink sink(&c->diag);
+         setLogSink(&sink);
+         log_error(path->second.c_str());
+         setLogSink(NULL);
+         c->status = REASON_XML_MISSING;
+         return;
+      }
+   }
+
+   requestOptions(c->hdr, &opts);
+   opts.verifyOnly = c->hdr["op"] == "verify";
+   applyOptions(ctx, &opts);
+   //the library checks the deadline as it parses and builds
+   double left = c->deadline - nowMsec();
+   povxml2c_set_option(ctx, POVXML2C_OPT_DEADLINE_MS, left > 1e15 ? 0 : left < 1 ? 1 : (long long)left);
+
+   char *src = NULL;
+   size_t srcLen = 0;
+   if (docFd != -1) {
+      c->status = convertMapped(ctx, docFd, &src, &srcLen);
+      close(docFd);
+   }
+   else {
+      c->status = povxml2c_convert(ctx, c->in.data() + c->headerLen, c->bodyLen, &src, &srcLen);
+   }
+   if (c->status == REASON_PARSE_TIMEOUT && nowMsec() >= c->deadline) {
+      c->status = REASON_DEADLINE;
+   }
+   for (size_t i = 0; i < povxml2c_diag_count(ctx); i++) {
+      c->diag += povxml2c_diag_get(ctx, i)->message;
+   }
+   if (src != NULL) {
+      c->src.assign(src, srcLen);
+      povxml2c_free_buffer(src);
+   }
+   c->stats = *povxml2c_get_stats(ctx);
+}
+
+static void *workerMain(void *arg) {
+   WorkQueue *q = (WorkQueue*)arg;
+   //the context, and with it libxml2's per thread state, lasts the worker
+   povxml2c_ctx *ctx = povxml2c_new();
+   pthread_mutex_lock(&q->lock);
+   while (true) {
+      while (q->pending.empty() && !q->stopping) {
+         pthread_cond_wait(&q->ready, &q->lock);
+      }
+      if (q->stopping) {
+         break;
+      }
+      Connection *c = q->pending.front();
+      q->pending.pop_front();
+      pthread_mutex_unlock(&q->lock);
+
+      runRequest(ctx, c, q->opts);
+
+      pthread_mutex_lock(&q->lock);
+      q->done.push_back(c);
+      wakeServer();
+   }
+   pthread_mutex_unlock(&q->lock);
+   povxml2c_free(ctx);
+   return NULL;
+}
+
+//answer a request its worker has finished
+static void finishRequest(ServerStats *stats, Connection *c, double now) {
+   if (c->status == REASON_DEADLINE) {
+      stats->deadlines++;
+      c->diag += "not ok - pov-xml2c request deadline exceeded\n";
+   }
+   if (c->status == REASON_SUCCESS) {
+      stats->succeeded++;
+   }
+   else {
+      stats->failed++;
+   }
+   recordLatency(stats, now - c->start);
+   string convStats;
+   if (c->hdr.find("stats") != c->hdr.end()) {
+      char *json = povxml2c_stats_json(&c->stats);
+      if (json != NULL) {
+         convStats = json;
+         povxml2c_free_buffer(json);
+      }
+   }
+   respond(c, c->status, c->status == REASON_SUCCESS ? c->src : string(), c->diag, convStats);
+   string().swap(c->src);
+   string().swap(c->diag);
+}
+
+//answer a request whose deadline passed before its conversion finished
+static void expireRequest(ServerStats *stats, Connection *c, double now, const char *diag) {
+   stats->deadlines++;
+   stats->failed++;
+   recordLatency(stats, now - c->start);
+   respond(c, REASON_DEADLINE, "", diag);
+}
+
+static int openListener(const char *socketPath) {
+   struct sockaddr_un addr;
+   if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+      fprintf(stderr, "socket path too long: %s\n", socketPath);
+      return -1;
+   }
+   int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd == -1) {
+      log_error("socket");
+      return -1;
+   }
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, socketPath);
+   unlink(socketPath);
+   if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+      log_error(socketPath);
+      close(fd);
+      return -1;
+   }
+   setNonBlocking(fd, true);
+   return fd;
+}
+
+/*
+ * Returns true once a complete request has been buffered
+ */
+static bool readRequest(Connection *c, bool *bad) {
+   char buf[65536];
+   *bad = false;
+   while (true) {
+      ssize_t n = read(c->fd, buf, sizeof(buf));
+      if (n < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+         }
+         *bad = true;
+         return false;
+      }
+      if (n == 0) {
+         //client went away before completing its request
+         *bad = c->headerLen == 0 || c->in.size() < c->headerLen + c->bodyLen;
+         break;
+      }
+      c->in.append(buf, n);
+      if (c->headerLen == 0) {
+         size_t end = c->in.find("\n\n");
+         if (end == string::npos) {
+            if (c->in.size() > MAX_REQUEST_HEADER) {
+               *bad = true;
+               return false;
+            }
+            continue;
+         }
+         c->headerLen = end + 2;
+         if (c->headerLen > MAX_REQUEST_HEADER) {
+            *bad = true;
+            return false;
+         }
+         if (!parseHeader(c->in.substr(0, end + 1), c->hdr)) {
+            *bad = true;
+            return false;
+         }
+         const string &op = c->hdr["op"];
+         if (op != "convert" && op != "verify" && op != "stats") {
+            *bad = true;
+            return false;
+         }
+         if (op != "stats" && c->hdr.find("path") == c->hdr.end()) {
+            if (!headerValue(c->hdr, "length", &c->bodyLen) || c->bodyLen > MAX_REQUEST_BODY) {
+               *bad = true;
+               return false;
+            }
+         }
+      }
+   }
+   return c->headerLen != 0 && c->in.size() >= c->headerLen + c->bodyLen;
+}
+
+int runServer(const char *socketPath, Xml2cOptions *opts, int workers, int deadline,
+              const vector<string> &allowDirs) {
+   if (povxml2c_init() != REASON_SUCCESS) {
+      fprintf(stderr, "Failed to parse DTD\n");
+      return REASON_LIBXML_FAIL;
+   }
+
+   //the directories requests may name, and the caches they may use
+   vector<string> allowed;
+   for (vector<string>::const_iterator d = allowDirs.begin(); d != allowDirs.end(); d++) {
+      string resolved;
+      if (!resolvePath(*d, &resolved)) {
+         log_error(d->c_str());
+         return REASON_INVALID_OPT;
+      }
+      allowed.push_back(resolved);
+   }
+   vector<string> caches = allowed;
+   if (opts->cacheDir != NULL) {
+      string resolved;
+      if (resolvePath(opts->cacheDir, &resolved)) {
+         caches.push_back(resolved);
+      }
+   }
+
+   int listenFd = openListener(socketPath);
+   if (listenFd == -1) {
+      return REASON_SERVER_FAIL;
+   }
+   if (pipe(sigPipe) != 0) {
+      log_error("pipe");
+      return REASON_SERVER_FAIL;
+   }
+   setNonBlocking(sigPipe[0], true);
+   setNonBlocking(sigPipe[1], true);
+
+   signal(SIGPIPE, SIG_IGN);
+   signal(SIGINT, server_stop_handler);
+   signal(SIGTERM, server_stop_handler);
+
+   ServerStats *stats = new ServerStats;
+   memset(stats, 0, sizeof(ServerStats));
+   stats->started = nowMsec();
+
+   WorkQueue work;
+   pthread_mutex_init(&work.lock, NULL);
+   pthread_cond_init(&work.ready, NULL);
+   work.stopping = false;
+   work.opts = opts;
+
+   //signals are left to the main thread
+   sigset_t all, saved;
+   sigfillset(&all);
+   pthread_sigmask(SIG_SETMASK, &all, &saved);
+   vector<pthread_t> pool;
+   for (int i = 0; i < workers; i++) {
+      pthread_t t;
+      int err = pthread_create(&t, NULL, workerMain, &work);
+      if (err != 0) {
+         errno = err;
+         log_error("pthread_create");
+         break;
+      }
+      pool.push_back(t);
+   }
+   pthread_sigmask(SIG_SETMASK, &saved, NULL);
+   if (pool.size() == 0) {
+      close(listenFd);
+      unlink(socketPath);
+      delete stats;
+      return REASON_SERVER_FAIL;
+   }
+   workers = pool.size();
+   fprintf(stderr, "# pov-xml2c serving on %s with %d workers\n", socketPath, workers);
+
+   vector<Connection*> conns;
+   deque<Connection*> queue;
+   int active = 0;
+
+   while (!stopping) {
+      vector<struct pollfd> pfds;
+      vector<Connection*> polled;
+      struct pollfd p;
+      p.events = POLLIN;
+      p.revents = 0;
+      p.fd = listenFd;
+      pfds.push_back(p);
+      p.fd = sigPipe[0];
+      pfds.push_back(p);
+      double wake = -1;
+      for (vector<Connection*>::iterator i = conns.begin(); i != conns.end(); i++) {
+         Connection *c = *i;
+         double until = -1;
+         if (c->state == CONN_READING || c->state == CONN_WRITING) {
+            p.fd = c->fd;
+            p.events = c->state == CONN_READING ? POLLIN : POLLOUT;
+            pfds.push_back(p);
+            polled.push_back(c);
+            if (c->state == CONN_WRITING) {
+               until = c->writeDeadline;
+            }
+         }
+         else if (c->state == CONN_QUEUED || c->state == CONN_RUNNING) {
+            until = c->deadline;
+         }
+         if (until >= 0 && (wake < 0 || until < wake)) {
+            wake = until;
+         }
+      }
+      double now = nowMsec();
+      int timeout = -1;
+      if (wake >= 0 && wake < 1e15) {
+         timeout = wake > now ? (int)(wake - now) + 1 : 0;
+      }
+      if (poll(pfds.data(), pfds.size(), timeout) < 0 && errno != EINTR) {
+         log_error("poll");
+         break;
+      }
+      now = nowMsec();
+
+      //new clients
+      if (pfds[0].revents & POLLIN) {
+         int fd;
+         while ((fd = accept(listenFd, NULL, NULL)) != -1) {
+            setNonBlocking(fd, true);
+            conns.push_back(new Connection(fd));
+         }
+      }
+      char drain[64];
+      while (read(sigPipe[0], drain, sizeof(drain)) > 0) {
+      }
+
+      //request data, and clients ready for more of their response
+      for (size_t i = 2; i < pfds.size(); i++) {
+         Connection *c = polled[i - 2];
+         if (pfds[i].revents == 0) {
+            continue;
+         }
+         if (c->state == CONN_WRITING) {
+            flushResponse(c);
+            continue;
+         }
+         bool bad;
+         bool complete = readRequest(c, &bad);
+         if (bad) {
+            stats->rejected++;
+            respond(c, REASON_INVALID_OPT, "", "not ok 1 - malformed pov-xml2c request\n");
+            continue;
+         }
+         if (!complete) {
+            continue;
+         }
+         if (c->hdr["op"] == "stats") {
+            stats->statsRequests++;
+            respond(c, REASON_SUCCESS, statsJson(stats, active, queue.size(), workers), "");
+            continue;
+         }
+         const char *refused = checkPaths(c->hdr, allowed, caches);
+         if (refused != NULL) {
+            stats->rejected++;
+            respond(c, REASON_INVALID_OPT, "",
+                    string("not ok 1 - pov-xml2c request ") + refused + " is outside the directories the server allows\n");
+            continue;
+         }
+         unsigned long long reqDeadline;
+         if (!headerValue(c->hdr, "deadline", &reqDeadline)) {
+            reqDeadline = deadline;
+         }
+         stats->requests++;
+         c->start = now;
+         c->deadline = reqDeadline ? now + reqDeadline : 1e300;
+         c->state = CONN_QUEUED;
+         queue.push_back(c);
+      }
+
+      //finished conversions
+      vector<Connection*> done;
+      pthread_mutex_lock(&work.lock);
+      done.swap(work.done);
+      pthread_mutex_unlock(&work.lock);
+      for (vector<Connection*>::iterator i = done.begin(); i != done.end(); i++) {
+         Connection *c = *i;
+         c->converting = false;
+         active--;
+         povxml2c_stats_add(&stats->conversion, &c->stats);
+         string().swap(c->in);
+         //unless the deadline has already been answered for
+         if (c->state == CONN_RUNNING) {
+            finishRequest(stats, c, now);
+         }
+      }
+
+      //enforce deadlines on requests and on clients slow to read
+      for (vector<Connection*>::iterator i = conns.begin(); i != conns.end(); i++) {
+         Connection *c = *i;
+         if (c->state == CONN_RUNNING && now >= c->deadline) {
+            expireRequest(stats, c, now, "not ok - pov-xml2c request deadline exceeded\n");
+         }
+         else if (c->state == CONN_QUEUED && now >= c->deadline) {
+            queue.erase(std::find(queue.begin(), queue.end(), c));
+            expireRequest(stats, c, now, "not ok - pov-xml2c request deadline exceeded while queued\n");
+         }
+         else if (c->state == CONN_WRITING && now >= c->writeDeadline) {
+            c->state = CONN_CLOSED;
+         }
+      }
+
+      //hand queued requests to idle workers
+      if (queue.size() > 0 && active < workers) {
+         pthread_mutex_lock(&work.lock);
+         while (queue.size() > 0 && active < workers) {
+            Connection *c = queue.front();
+            queue.pop_front();
+            c->state = CONN_RUNNING;
+            c->converting = true;
+            active++;
+            work.pending.push_back(c);
+         }
+         pthread_cond_broadcast(&work.ready);
+         pthread_mutex_unlock(&work.lock);
+      }
+
+      //close answered connections, once no worker still holds them
+      for (vector<Connection*>::iterator i = conns.begin(); i != conns.end(); ) {
+         Connection *c = *i;
+         if (c->state == CONN_CLOSED && c->fd != -1) {
+            close(c->fd);
+            c->fd = -1;
+         }
+         if (c->state == CONN_CLOSED && !c->converting) {
+            delete c;
+            i = conns.erase(i);
+            continue;
+         }
+         i++;
+      }
+   }
+
+   //workers finish the conversion in hand, which the deadline bounds
+   pthread_mutex_lock(&work.lock);
+   work.stopping = true;
+   pthread_cond_broadcast(&work.ready);
+   pthread_mutex_unlock(&work.lock);
+   for (vector<pthread_t>::iterator t = pool.begin(); t != pool.end(); t++) {
+      pthread_join(*t, NULL);
+   }
+   for (vector<Connection*>::iterator i = work.done.begin(); i != work.done.end(); i++) {
+      povxml2c_stats_add(&stats->conversion, &(*i)->stats);
+   }
+   for (vector<Connection*>::iterator i = conns.begin(); i != conns.end(); i++) {
+      if ((*i)->fd != -1) {
+         close((*i)->fd);
+      }
+      delete *i;
+   }
+   pthread_mutex_destroy(&work.lock);
+   pthread_cond_destroy(&work.ready);
+   close(listenFd);
+   close(sigPipe[0]);
+   close(sigPipe[1]);
+   unlink(socketPath);
+   if (opts->statsJson) {
+      writeStats(&stats->conversion, opts);
+   }
+   delete stats;
+   return REASON_SUCCESS;
+}
@@ -0,0 +1,73 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_SERVER_H
+#define __XML2C_SERVER_H
+
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::vector;
+
+struct Xml2cOptions;
+
+#define DEFAULT_SERVER_SOCKET   "/tmp/pov-xml2c.sock"
+#define SERVER_SOCKET_ENV       "POV_XML2C_SOCKET"
+#define DEFAULT_SERVER_WORKERS  4
+#define DEFAULT_SERVER_DEADLINE 30000   //milliseconds
+#define MAX_REQUEST_HEADER      4096
+#define MAX_REQUEST_BODY        (256 * 1024 * 1024)
+
+/*
+ * Wire protocol.  Both requests and responses start with a header of
+ * "name value" lines terminated by an empty line, followed by a body.
+ *
+ * request headers:
+ *    op convert|verify|stats
+ *    path <file>          convert the named file, or
+ *    length <n>           convert the n byte document that follows
+ *    base <dir>           directory external data is found in, without path
+ *
+ * path and base must lie within a directory given to the server with
+ * --allow-dir, and cache within one of those or the server's own -c, or
+ * the request is refused.
+ *    deadline <msec>      overall deadline for this request
+ *    stats json           return the conversion's statistics, as --stats
+ *
+ * and the generator options of pov-xml2c, overriding the server's own:
+ *    timeout <seconds>    as -t
+ *    cache <dir>          as -c
+ *    cache-size <n>       as -C
+ *    max-input <n>        as -m
+ *    max-nodes <n>, max-depth <n>, max-payload <n>, max-alloc <n>
+ *    probes <fd>          as --probes
+ *    early <n>            as --early-writes
+ *    backend <n>          as --backend, its povxml2c_backend value
+ *    fixed-reads 0|1      as --fixed-reads
+ *    release-vars 0|1     as --release-vars
+ *    external-data 0|1    as --external-data
+ *
+ * response headers:
+ *    status <n>           REASON_* code, as the command line exit status
+ *    output <n>           length of generated source that follows
+ *    diagnostics <n>      length of TAP diagnostics that follow the source
+ *    statistics <n>       length of --stats json that follows the diagnostics
+ */
+
+bool writeAll(int fd, const void *buf, size_t len);
+bool readAll(int fd, void *buf, size_t len);
+bool parseHeader(const string &block, map<string, string> &hdr);
+bool readHeader(int fd, map<string, string> &hdr);
+bool headerValue(map<string, string> &hdr, const char *name, unsigned long long *value);
+
+//allowDirs are the directories requests may name, see --allow-dir
+int runServer(const char *socketPath, Xml2cOptions *opts, int workers, int deadline,
+              const vector<string> &allowDirs);
+
+#endif
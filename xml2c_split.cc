@@ -0,0 +1,130 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xml2c_split.h"
+#include "xml2c_context.h"
+#include "xml2c_read.h"
+#include "xml2c_write.h"
+#include "xml2c_liveness.h"
+#include "action.h"
+
+#include "reasons.h"
+
+static size_t chunkCount(Xml2cContext *ctx, unsigned int chunkActions) {
+   return (ctx->pov.size() + chunkActions - 1) / chunkActions;
+}
+
+static void chunkName(size_t chunk, char *name, size_t size) {
+   snprintf(name, size, "pov_chunk_%05zu", chunk);
+}
+
+static void generateDriver(size_t chunks, FILE *outfile) {
+   char name[32];
+   fprintf(outfile, "#include <libpov.h>\n");
+   for (size_t i = 0; i < chunks; i++) {
+      chunkName(i, name, sizeof(name));
+      fprintf(outfile, "void %s(void);\n", name);
+   }
+   fprintf(outfile, "int main(void) {\n");
+   for (size_t i = 0; i < chunks; i++) {
+      chunkName(i, name, sizeof(name));
+      fprintf(outfile, "   %s();\n", name);
+   }
+   fprintf(outfile, "}\n");
+}
+
+/*
+ * The runtimes are static, so each chunk carries only those its own actions
+ * call.  Nothing in a chunk depends on the chunks around it.
+ */
+static void generateChunk(Xml2cContext *ctx, size_t chunk, unsigned int chunkActions, FILE *outfile) {
+   size_t begin = chunk * chunkActions;
+   size_t end = begin + chunkActions;
+   if (end > ctx->pov.size()) {
+      end = ctx->pov.size();
+   }
+   bool writes = false;
+   bool reads = false;
+   for (size_t i = begin; i < end; i++) {
+      writes = writes || ctx->pov[i]->actionType() == POVXML2C_ACTION_WRITE;
+      reads = reads || ctx->pov[i]->actionType() == POVXML2C_ACTION_READ;
+   }
+
+   char name[32];
+   chunkName(chunk, name, sizeof(name));
+   fprintf(outfile, "#include <libpov.h>\n");
+   if (writes) {
+      generateWriteRuntime(outfile);
+   }
+   if (reads && ctx->timedReads) {
+      generateReadRuntime(outfile);
+   }
+   if (reads && ctx->fusedReads) {
+      generateExpectRuntime(outfile);
+   }
+   fprintf(outfile, "//**** pov-xml2c actions %zu to %zu\n", begin, end - 1);
+   fprintf(outfile, "void %s(void) {\n", name);
+   for (size_t i = begin; i < end; i++) {
+      ctx->pov[i]->generate(outfile);
+      generateReleases(outfile, ctx->pov[i]);
+   }
+   fprintf(outfile, "}\n");
+}
+
+static void generateMakefile(size_t chunks, FILE *outfile) {
+   char name[32];
+   fprintf(outfile, "# pov-xml2c: a PoV in %zu separately compiled chunks.  Include from a\n", chunks);
+   fprintf(outfile, "# makefile that sets CC, CFLAGS and LDLIBS for libpov and libcgc, or\n");
+   fprintf(outfile, "# run make -j -f DIR/pov.mk with those set.  Builds DIR/pov.\n");
+   fprintf(outfile, "POV_SPLIT_DIR := $(dir $(lastword $(MAKEFILE_LIST)))\n");
+   fprintf(outfile, "POV_SPLIT_OBJS = $(POV_SPLIT_DIR)pov_main.o");
+   for (size_t i = 0; i < chunks; i++) {
+      chunkName(i, name, sizeof(name));
+      fprintf(outfile, " \\\n\t$(POV_SPLIT_DIR)%s.o", name);
+   }
+   fprintf(outfile, "\n\n");
+   fprintf(outfile, "$(POV_SPLIT_DIR)pov: $(POV_SPLIT_OBJS)\n");
+   fprintf(outfile, "\t$(CC) $(LDFLAGS) -o $@ $(POV_SPLIT_OBJS) $(LDLIBS)\n");
+}
+
+size_t splitUnitCount(Xml2cContext *ctx, unsigned int chunkActions) {
+   if (chunkActions == 0) {
+      return 0;
+   }
+   return chunkCount(ctx, chunkActions) + 2;
+}
+
+int generateSplitUnit(Xml2cContext *ctx, unsigned int chunkActions, size_t idx,
+                      string *name, FILE *outfile) {
+   //probes keep one ring for the whole PoV, and only main() has a body to split
+   if (ctx->backend != POVXML2C_BACKEND_MAIN || ctx->probeFd >= 0 ||
+       idx >= splitUnitCount(ctx, chunkActions)) {
+      return REASON_INVALID_OPT;
+   }
+   size_t chunks = chunkCount(ctx, chunkActions);
+   try {
+      if (idx == 0) {
+         *name = "pov_main.c";
+         generateDriver(chunks, outfile);
+      }
+      else if (idx <= chunks) {
+         char base[32];
+         chunkName(idx - 1, base, sizeof(base));
+         *name = string(base) + ".c";
+         generateChunk(ctx, idx - 1, chunkActions, outfile);
+      }
+      else {
+         *name = "pov.mk";
+         generateMakefile(chunks, outfile);
+      }
+   } catch (int ex) {
+      return REASON_XML_CONTENT;
+   }
+   return REASON_SUCCESS;
+}
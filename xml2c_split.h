@@ -0,0 +1,31 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_SPLIT_H
+#define __XML2C_SPLIT_H
+
+#include <stdio.h>
+#include <string>
+
+using std::string;
+
+class Xml2cContext;
+
+/*
+ * A PoV generated as several translation units rather than one main(), so
+ * that a PoV of many thousands of actions compiles in parallel and without
+ * one enormous function.  Unit 0 is the driver, pov_main.c, which calls
+ * one function per chunk of at most chunkActions consecutive actions.  Each
+ * chunk is in its own pov_chunk_NNNNN.c, and the last unit is pov.mk, a
+ * makefile fragment building them.  Chunks are cut at fixed action
+ * indices, so changing an action in place leaves every other unit as it
+ * was.
+ */
+size_t splitUnitCount(Xml2cContext *ctx, unsigned int chunkActions);
+//generate unit idx into outfile, setting its file name.  Returns a REASON_* code
+int generateSplitUnit(Xml2cContext *ctx, unsigned int chunkActions, size_t idx,
+                      string *name, FILE *outfile);
+
+#endif
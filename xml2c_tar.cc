@@ -0,0 +1,266 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+using std::string;
+
+#include "xml2c_tar.h"
+#include "xml2c_inflate.h"
+
+#include "reasons.h"
+
+#define TAR_BLOCK 512
+//largest GNU long name or pax header accepted
+#define TAR_META_MAX 65536
+
+static bool endsWith(const string &s, const char *suffix) {
+   size_t n = strlen(suffix);
+   return s.size() > n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+//an octal header field, or base 256 when the top bit of the first byte is set
+static uint64_t headerNumber(const uint8_t *field, size_t len) {
+   uint64_t v = 0;
+   if (field[0] & 0x80) {
+      v = field[0] & 0x7f;
+      for (size_t i = 1; i < len; i++) {
+         v = (v << 8) | field[i];
+      }
+      return v;
+   }
+   size_t i = 0;
+   while (i < len && field[i] == ' ') {
+      i++;
+   }
+   for (; i < len && field[i] >= '0' && field[i] <= '7'; i++) {
+      v = (v << 3) | (field[i] - '0');
+   }
+   return v;
+}
+
+static bool checksumValid(const uint8_t *header) {
+   uint64_t sum = 0;
+   for (size_t i = 0; i < TAR_BLOCK; i++) {
+      //the checksum field counts as spaces
+      sum += (i >= 148 && i < 156) ? ' ' : header[i];
+   }
+   return sum == headerNumber(header + 148, 8);
+}
+
+//a NUL padded header field as a string
+static string headerString(const uint8_t *field, size_t len) {
+   size_t n = 0;
+   while (n < len && field[n] != 0) {
+      n++;
+   }
+   return string((const char*)field, n);
+}
+
+/*
+ * Splits the archive into headers and member contents as the bytes arrive,
+ * in pieces of any size.
+ */
+class TarReader : public InflateSink {
+private:
+   TarHandler *handler;
+   unsigned long long maxMember;
+   uint8_t header[TAR_BLOCK];
+   size_t headerLen;
+   int zeroBlocks;
+   //the entry being read
+   char type;
+   string name;
+   bool wanted;
+   string content;
+   uint64_t remaining;
+   size_t padding;
+   //name for the next entry from a GNU long name or pax header
+   string longName;
+
+   bool parseHeader();
+   bool entryDone();
+
+public:
+   int result;
+   bool ended;
+
+   TarReader(TarHandler *h, unsigned long long max) : handler(h), maxMember(max), headerLen(0),
+      zeroBlocks(0), type(0), wanted(false), remaining(0), padding(0), result(REASON_SUCCESS), ended(false) {};
+   bool write(const char *data, size_t n);
+   //the input stopped between entries
+   bool atBoundary() {return headerLen == 0 && remaining == 0 && padding == 0;};
+};
+
+bool TarReader::parseHeader() {
+   bool zero = true;
+   for (size_t i = 0; i < TAR_BLOCK && zero; i++) {
+      zero = header[i] == 0;
+   }
+   if (zero) {
+      //two zero blocks end the archive
+      ended = ++zeroBlocks == 2;
+      return true;
+   }
+   zeroBlocks = 0;
+   if (!checksumValid(header)) {
+      fprintf(stderr, "pov-xml2c: corrupt tar header\n");
+      result = REASON_XML_BAD;
+      return false;
+   }
+   type = header[156];
+   remaining = headerNumber(header + 124, 12);
+   padding = (TAR_BLOCK - remaining % TAR_BLOCK) % TAR_BLOCK;
+   content.clear();
+   if (type == 'L' || type == 'x') {
+      if (remaining > TAR_META_MAX) {
+         fprintf(stderr, "pov-xml2c: tar extended header too large\n");
+         result = REASON_XML_BAD;
+         return false;
+      }
+      wanted = false;
+   }
+   else {
+      name = longName;
+      if (name.empty()) {
+         string prefix = headerString(header + 345, 155);
+         name = headerString(header, 100);
+         if (!prefix.empty()) {
+            name = prefix + "/" + name;
+         }
+      }
+      longName.clear();
+      wanted = (type == '0' || type == 0 || type == '7') &&
+               (endsWith(name, ".xml") || endsWith(name, ".povxml"));
+      if (wanted && maxMember != 0 && remaining > maxMember) {
+         fprintf(stderr, "pov-xml2c: %s exceeds the %llu byte limit\n", name.c_str(), maxMember);
+         result = REASON_INPUT_LIMIT;
+         return false;
+      }
+   }
+   if (remaining == 0) {
+      return entryDone();
+   }
+   return true;
+}
+
+bool TarReader::entryDone() {
+   if (type == 'L') {
+      longName = content.c_str();
+   }
+   else if (type == 'x') {
+      //records of the form "LENGTH path=NAME\n"
+      size_t pos = 0;
+      while (pos < content.size()) {
+         size_t space = content.find(' ', pos);
+         unsigned long recLen = strtoul(content.c_str() + pos, NULL, 10);
+         if (space == string::npos || recLen == 0 || pos + recLen > content.size()) {
+            break;
+         }
+         string record = content.substr(space + 1, pos + recLen - space - 2);
+         if (record.compare(0, 5, "path=") == 0) {
+            longName = record.substr(5);
+         }
+         pos += recLen;
+      }
+   }
+   else if (wanted) {
+      result = handler->member(name.c_str(), content.data(), content.size());
+   }
+   content.clear();
+   return result == REASON_SUCCESS;
+}
+
+bool TarReader::write(const char *data, size_t n) {
+   while (n > 0 && !ended) {
+      size_t take;
+      if (remaining > 0) {
+         take = remaining < n ? remaining : n;
+         if (wanted || type == 'L' || type == 'x') {
+            content.append(data, take);
+         }
+         remaining -= take;
+         if (remaining == 0 && !entryDone()) {
+            return false;
+         }
+      }
+      else if (padding > 0) {
+         take = padding < n ? padding : n;
+         padding -= take;
+      }
+      else {
+         take = TAR_BLOCK - headerLen < n ? TAR_BLOCK - headerLen : n;
+         memcpy(header + headerLen, data, take);
+         headerLen += take;
+         if (headerLen == TAR_BLOCK) {
+            headerLen = 0;
+            if (!parseHeader()) {
+               return false;
+            }
+         }
+      }
+      data += take;
+      n -= take;
+   }
+   return true;
+}
+
+//keeps the first block of decompressed output, then stops
+class TarPeek : public InflateSink {
+public:
+   string block;
+   bool write(const char *data, size_t n) {
+      size_t take = TAR_BLOCK - block.size() < n ? TAR_BLOCK - block.size() : n;
+      block.append(data, take);
+      return block.size() < TAR_BLOCK;
+   };
+};
+
+static bool ustarHeader(const char *data, size_t len) {
+   return len >= TAR_BLOCK && memcmp(data + 257, "ustar", 5) == 0 && checksumValid((const uint8_t*)data);
+}
+
+bool isTarArchive(const char *data, size_t len) {
+   InflateFormat format = detectCompression((const uint8_t*)data, len);
+   if (format == INFLATE_NONE) {
+      return ustarHeader(data, len);
+   }
+   Xml2cInflate inflater(format);
+   TarPeek peek;
+   inflater.feed((const uint8_t*)data, len, &peek);
+   return ustarHeader(peek.block.data(), peek.block.size());
+}
+
+int readTarArchive(const char *data, size_t len, unsigned long long maxMember, TarHandler *handler) {
+   InflateFormat format = detectCompression((const uint8_t*)data, len);
+   TarReader reader(handler, maxMember);
+   bool ok;
+   if (format == INFLATE_NONE) {
+      ok = reader.write(data, len);
+   }
+   else {
+      Xml2cInflate inflater(format);
+      ok = inflater.feed((const uint8_t*)data, len, &reader);
+      //the end of archive blocks need not end the compressed stream
+      ok = ok && (reader.ended || inflater.finish(&reader));
+      if (!ok && reader.result == REASON_SUCCESS) {
+         fprintf(stderr, "pov-xml2c: failed to decompress %s archive\n", compressionName(format));
+         return REASON_XML_BAD;
+      }
+   }
+   if (!ok) {
+      return reader.result;
+   }
+   if (!reader.ended && !reader.atBoundary()) {
+      fprintf(stderr, "pov-xml2c: truncated tar archive\n");
+      return REASON_XML_BAD;
+   }
+   return REASON_SUCCESS;
+}
@@ -0,0 +1,35 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_TAR_H
+#define __XML2C_TAR_H
+
+#include <stddef.h>
+
+/*
+ * Tar archives of PoVs, plain or gzip or xz compressed, read straight from
+ * memory and decompressed as they are read, so that no member is ever
+ * extracted to disk.  Each regular member named *.xml or *.povxml is handed
+ * to the handler whole; everything else in the archive is skipped.
+ */
+class TarHandler {
+public:
+   virtual ~TarHandler() {};
+   //a REASON_* code, anything but REASON_SUCCESS ends the archive
+   virtual int member(const char *name, const char *data, size_t len) = 0;
+};
+
+//true if data, once decompressed, starts with a ustar header
+bool isTarArchive(const char *data, size_t len);
+
+/*
+ * Hand each PoV in the archive at data to handler in turn.  Members larger
+ * than maxMember bytes are refused, 0 for no limit.  Returns the first
+ * status other than REASON_SUCCESS from the handler, or a REASON_* code of
+ * its own for a corrupt or truncated archive.
+ */
+int readTarArchive(const char *data, size_t len, unsigned long long maxMember, TarHandler *handler);
+
+#endif
@@ -15,28 +15,38 @@
 #include <limits.h>
 
 #include "xml2c_var.h"
+#include "xml2c_context.h"
+#include "xml2c_extdata.h"
+#include "xml2c_replay.h"
+#include "xml2c_bundle.h"
+#include "xml2c_cost.h"
 #include "utils.h"
 #include "logging.h"
 
 #include "reasons.h"
 
 class Xml2cValue {
-private:
-   static uint32_t serial;
 protected:
    uint32_t id;
+   Xml2cContext *ctx;
    void printName(FILE *outfile);
 public:
-   Xml2cValue();
+   Xml2cValue(Xml2cContext *ctx);
    virtual ~Xml2cValue() {};
    virtual void doDecls(FILE *outfile) = 0;
    virtual void generate(FILE *outfile, int varno) = 0;
+   //append the value to out, as the generated append_* call would
+   virtual void replay(Xml2cReplay *r, vector<uint8_t> &out) = 0;
+   //append the value to the resumable backend's value buffer
+   virtual void generateStep(FILE *outfile, Xml2cContext *ctx) = 0;
+   //bytes the value adds, from the sizes known so far
+   virtual unsigned long long estimate(Xml2cCost *c) = 0;
+   //variables the value is built from
+   virtual void uses(set<string> &vars) {};
 };
 
-uint32_t Xml2cValue::serial = 0;
-
-Xml2cValue::Xml2cValue() {
-   id = serial++;
+Xml2cValue::Xml2cValue(Xml2cContext *_ctx) : ctx(_ctx) {
+   id = ctx->valueId++;
 }
 
 void Xml2cValue::printName(FILE *outfile) {
@@ -48,18 +58,36 @@ private:
    vector<uint8_t> data;
 
 public:
-   Xml2cValueData(const vector<uint8_t> &);
+   Xml2cValueData(Xml2cContext *ctx, const vector<uint8_t> &);
    void doDecls(FILE *outfile);
    void generate(FILE *outfile, int varno);
+   void replay(Xml2cReplay *r, vector<uint8_t> &out);
+   void generateStep(FILE *outfile, Xml2cContext *ctx);
+   unsigned long long estimate(Xml2cCost *c) {return data.size();};
+};
+
+//a mapped file slice, declared straight from the mapping
+class Xml2cValueExternal : public Xml2cValueData {
+private:
+   Owned<ExternalData> ext;
+public:
+   Xml2cValueExternal(Xml2cContext *ctx, ExternalData *_ext) : Xml2cValueData(ctx, vector<uint8_t>()), ext(_ext) {};
+   void doDecls(FILE *outfile);
+   void replay(Xml2cReplay *r, vector<uint8_t> &out) {out.insert(out.end(), ext->data(), ext->data() + ext->size());};
+   unsigned long long estimate(Xml2cCost *c) {return ext->size();};
 };
 
 class Xml2cValueVar : public Xml2cValue {
 private:
    string name;
 public:
-   Xml2cValueVar(const char *_name);
+   Xml2cValueVar(Xml2cContext *ctx, const char *_name);
    void doDecls(FILE *outfile) {};
    void generate(FILE *outfile, int varno);
+   void replay(Xml2cReplay *r, vector<uint8_t> &out);
+   void generateStep(FILE *outfile, Xml2cContext *ctx);
+   unsigned long long estimate(Xml2cCost *c) {return c->varSize(name);};
+   void uses(set<string> &vars) {vars.insert(name);};
 };
 
 class Xml2cValueSubstr : public Xml2cValue {
@@ -68,25 +96,37 @@ private:
    int32_t begin;
    int32_t end;
 public:
-   Xml2cValueSubstr(const char *_name, int32_t _begin, int32_t _end);
+   Xml2cValueSubstr(Xml2cContext *ctx, const char *_name, int32_t _begin, int32_t _end);
    void doDecls(FILE *outfile) {};
    void generate(FILE *outfile, int varno);
+   void replay(Xml2cReplay *r, vector<uint8_t> &out);
+   void generateStep(FILE *outfile, Xml2cContext *ctx);
+   unsigned long long estimate(Xml2cCost *c);
+   void uses(set<string> &vars) {vars.insert(name);};
 };
 
-Xml2cValueData::Xml2cValueData(const vector<uint8_t> &_data) {
+Xml2cValueData::Xml2cValueData(Xml2cContext *ctx, const vector<uint8_t> &_data) : Xml2cValue(ctx) {
    data.insert(data.end(), _data.begin(), _data.end());
 }
 
 void Xml2cValueData::doDecls(FILE *outfile) {
-   fprintf(outfile, "      static unsigned char ");
-   printName(outfile);
-   fprintf(outfile, "[] = \n");
-   printAsHexString(outfile, data.data(), data.size());
+   char name[32];
+   snprintf(name, sizeof(name), "dvar_%08d", id);
+   generateStaticData(ctx, outfile, "unsigned char", name, data.data(), data.size());
    fprintf(outfile, "      static unsigned int ");
    printName(outfile);
    fprintf(outfile, "_len = %u;\n", data.size());
 }
 
+void Xml2cValueExternal::doDecls(FILE *outfile) {
+   char name[32];
+   snprintf(name, sizeof(name), "dvar_%08d", id);
+   generateStaticData(ctx, outfile, "unsigned char", name, ext->data(), ext->size());
+   fprintf(outfile, "      static unsigned int ");
+   printName(outfile);
+   fprintf(outfile, "_len = %u;\n", ext->size());
+}
+
 void Xml2cValueData::generate(FILE *outfile, int varno) {
    fprintf(outfile, "      var_%05d = append_buf(var_%05d, &var_%05d_len, ", varno, varno, varno);
    printName(outfile);
@@ -95,7 +135,20 @@ void Xml2cValueData::generate(FILE *outfile, int varno) {
    fprintf(outfile, "_len);\n");
 }
 
-Xml2cValueVar::Xml2cValueVar(const char *_name) {
+void Xml2cValueData::replay(Xml2cReplay *r, vector<uint8_t> &out) {
+   out.insert(out.end(), data.begin(), data.end());
+}
+
+void Xml2cValueData::generateStep(FILE *outfile, Xml2cContext *ctx) {
+   doDecls(outfile);
+   fprintf(outfile, "      pov_append(&value, &value_len, ");
+   printName(outfile);
+   fprintf(outfile, ", ");
+   printName(outfile);
+   fprintf(outfile, "_len);\n");
+}
+
+Xml2cValueVar::Xml2cValueVar(Xml2cContext *ctx, const char *_name) : Xml2cValue(ctx) {
    name = _name;
 }
 
@@ -103,7 +156,17 @@ void Xml2cValueVar::generate(FILE *outfile, int varno) {
    fprintf(outfile, "      var_%05d = append_var(\"%s\", var_%05d, &var_%05d_len);\n", varno, name.c_str(), varno, varno);
 }
 
-Xml2cValueSubstr::Xml2cValueSubstr(const char *_name, int32_t _begin, int32_t _end) {
+void Xml2cValueVar::replay(Xml2cReplay *r, vector<uint8_t> &out) {
+   const vector<uint8_t> &v = r->getVar(name);
+   out.insert(out.end(), v.begin(), v.end());
+}
+
+void Xml2cValueVar::generateStep(FILE *outfile, Xml2cContext *ctx) {
+   unsigned int slot = ctx->varSlot(name);
+   fprintf(outfile, "      pov_append(&value, &value_len, s->vars[%u].data, s->vars[%u].len);  //%s\n", slot, slot, name.c_str());
+}
+
+Xml2cValueSubstr::Xml2cValueSubstr(Xml2cContext *ctx, const char *_name, int32_t _begin, int32_t _end) : Xml2cValue(ctx) {
    name = _name;
    begin = _begin;
    end = _end;
@@ -113,81 +176,129 @@ void Xml2cValueSubstr::generate(FILE *outfile, int varno) {
    fprintf(outfile, "      var_%05d = append_slice(\"%s\", %d, %d, var_%05d, &var_%05d_len);\n", varno, name.c_str(), begin, end, varno, varno);
 }
 
-unsigned int Xml2cVar::varId = 0;
+void Xml2cValueSubstr::replay(Xml2cReplay *r, vector<uint8_t> &out) {
+   const vector<uint8_t> &v = r->getVar(name);
+   size_t from, to;
+   sliceBounds(begin, end, v.size(), &from, &to);
+   out.insert(out.end(), v.begin() + from, v.begin() + to);
+}
 
-Xml2cVar::Xml2cVar(xmlNode *r) {
-   id = varId++;
+void Xml2cValueSubstr::generateStep(FILE *outfile, Xml2cContext *ctx) {
+   fprintf(outfile, "      pov_append_slice(&value, &value_len, &s->vars[%u], %d, %d);  //%s\n", ctx->varSlot(name), begin, end, name.c_str());
+}
+
+unsigned long long Xml2cValueSubstr::estimate(Xml2cCost *c) {
+   size_t from, to;
+   sliceBounds(begin, end, c->varSize(name), &from, &to);
+   return to - from;
+}
+
+Xml2cVar::Xml2cVar(xmlNode *r, Xml2cContext *ctx) : Action(ctx) {
+   id = ctx->varId++;
    bool parseError = false;
    uint32_t nameLen;
    xmlNode *nameNode = findChild(r, "var");
-   char *cname = getNodeText(nameNode, &nameLen);
-   name = cname;
+   XmlString cname(getNodeText(nameNode, &nameLen));
+   name = cname.get();
    
    xmlNode *valueNode = findChild(r, "value");
 
    for (xmlNode *d = valueNode->children; d; d = d->next) {
       if (strcmp((char*)d->name, "data") == 0) {
-         char *format = (char*)xmlGetProp(d, (xmlChar*)"format");
+         ExternalData *ext = NULL;
+         try {
+            ext = ExternalData::fromNode(d, ctx);
+         } catch (int ex) {
+            parseError = true;
+            continue;
+         }
+         if (ext != NULL) {
+            if (ext->size() > 0) {
+               values.push_back(new Xml2cValueExternal(ctx, ext));
+            }
+            else {
+               delete ext;
+            }
+            continue;
+         }
+         XmlString format(xmlGetProp(d, (xmlChar*)"format"));
          unsigned int tlen;
-         char *dataString = getNodeText(d, &tlen);
+         XmlString dataString(getNodeText(d, &tlen));
          if (tlen > 0) {
             try {
-               if (format != NULL && strcmp(format, "hex") == 0) {
-                  unsigned int hlen;
-                  vector<uint8_t> *hex = parseHexBinary(dataString);
+               if (format.get() != NULL && strcmp(format.get(), "hex") == 0) {
+                  Owned<vector<uint8_t> > hex(parseHexBinary(dataString.get()));
                   if (hex->size() != 0) {
-                     Xml2cValueData *d = new Xml2cValueData(*hex);
+                     Xml2cValueData *d = new Xml2cValueData(ctx, *hex);
                      values.push_back(d);
-                     delete hex;
                   }
                   else {
                      //this is a problem that should have been reported in utils.cc
                   }
                }
                else { //default format is "ascii"
-                  vector<uint8_t> *asc = unescapeAscii((char*)dataString);
-                  Xml2cValueData *d = new Xml2cValueData(*asc);
+                  Owned<vector<uint8_t> > asc(unescapeAscii(dataString.get()));
+                  Xml2cValueData *d = new Xml2cValueData(ctx, *asc);
                   values.push_back(d);
-                  delete asc;
                }
             } catch (int ex) {
+               if (ex == LIMIT_EXCEEDED) {
+                  throw ex;
+               }
                log_fail("Invalid hex data in <%s> element at line %d\n", d->name, d->line);
                parseError = true;
             }
          }
-         xmlFree(format);
-         xmlFree(dataString);
       }
       else if (strcmp((char*)d->name, "var") == 0) {
          uint32_t tlen;
-         char *varName = getNodeText(d, &tlen);
-         Xml2cValueVar *v = new Xml2cValueVar(varName);
+         XmlString varName(getNodeText(d, &tlen));
+         Xml2cValueVar *v = new Xml2cValueVar(ctx, varName.get());
          values.push_back(v);
-         xmlFree(varName);
       }
       else if (strcmp((char*)d->name, "substr") == 0) {
          uint32_t tlen;
 
-         char *varName = getStringChild(d, "var", NULL, &tlen);
+         XmlString varName(getStringChild(d, "var", NULL, &tlen));
          int32_t begin = getIntChild(d, "begin", 0);
          int32_t end = getIntChild(d, "end", INT_MAX);
 
-         Xml2cValueSubstr *s = new Xml2cValueSubstr(varName, begin, end);
+         Xml2cValueSubstr *s = new Xml2cValueSubstr(ctx, varName.get(), begin, end);
          values.push_back(s);
-         xmlFree(varName);
       }
    }
-   xmlFree(cname);
    if (parseError) {
       throw (int)PARSE_ERROR;
    }
 }
 
+//the members own everything, this only completes their types
 Xml2cVar::~Xml2cVar() {
+}   
+
+bool Xml2cVar::replay(Xml2cReplay *r) {
+   vector<uint8_t> value;
    for (vector<Xml2cValue*>::iterator i = values.begin(); i != values.end(); i++) {
-      delete *i;
+      (*i)->replay(r, value);
    }
-}   
+   r->setVar(name, value.data(), value.size());
+   r->note("%s is %zu bytes", name.c_str(), value.size());
+   return true;
+}
+
+void Xml2cVar::uses(set<string> &vars) {
+   for (vector<Xml2cValue*>::iterator i = values.begin(); i != values.end(); i++) {
+      (*i)->uses(vars);
+   }
+}
+
+void Xml2cVar::cost(Xml2cCost *c) {
+   unsigned long long size = 0;
+   for (vector<Xml2cValue*>::iterator i = values.begin(); i != values.end(); i++) {
+      size += (*i)->estimate(c);
+   }
+   c->setVar(name, size);
+}
 
 void Xml2cVar::generate(FILE *outfile) {
    fprintf(outfile, "   do {\n");
@@ -210,3 +321,14 @@ void Xml2cVar::generate(FILE *outfile) {
 
    fprintf(outfile, "   } while (0);\n");
 }
+
+//the value is built before the old one is released, it may refer to itself
+void Xml2cVar::generateStep(FILE *outfile) {
+   fprintf(outfile, "      //*** variable declaration for %s\n", name.c_str());
+   fprintf(outfile, "      unsigned char *value = NULL;\n");
+   fprintf(outfile, "      unsigned int value_len = 0;\n");
+   for (vector<Xml2cValue*>::iterator i = values.begin(); i != values.end(); i++) {
+      (*i)->generateStep(outfile, ctx);
+   }
+   fprintf(outfile, "      pov_set_var(s, %u, value, value_len);\n", ctx->varSlot(name));
+}
@@ -13,6 +13,7 @@
 #include <string>
 
 #include "action.h"
+#include "utils.h"
 
 using std::vector;
 using std::string;
@@ -22,21 +23,25 @@ class Xml2cValue;
 class Xml2cVar : public Action {
 
 private:
-   static unsigned int varId;
-
    unsigned int id;   
    string name;
    //value may consist of a sequence of data and var expansions
-   vector<Xml2cValue*> values;
+   OwnedVector<Xml2cValue> values;
    
    //disable copy constructor and assignment
-   Xml2cVar(const Xml2cVar &rv) {};
-   const Xml2cVar &operator=(const Xml2cVar &rv) {return *this;};
+   Xml2cVar(const Xml2cVar &rv);
+   const Xml2cVar &operator=(const Xml2cVar &rv);
    
 public:
-   Xml2cVar(xmlNode *n);
+   Xml2cVar(xmlNode *n, Xml2cContext *ctx);
    ~Xml2cVar();
    virtual void generate(FILE *outfile);
+   virtual int actionType() {return POVXML2C_ACTION_DECL;};
+   virtual void uses(set<string> &vars);
+   virtual void defines(set<string> &vars) {vars.insert(name);};
+   virtual bool replay(Xml2cReplay *r);
+   virtual void generateStep(FILE *outfile);
+   virtual void cost(Xml2cCost *c);
 };
 
 
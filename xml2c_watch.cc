@@ -0,0 +1,262 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+/*
+ Watch mode keeps one warm converter resident over a directory of PoVs that
+ are being edited.  inotify reports each save and a PoV is reconverted once
+ it has been quiet for WATCH_DEBOUNCE_MSEC, so the burst of events an editor
+ makes for one save, or several saves in quick succession, cost a single
+ conversion.  Source is written next to the PoV through a temporary file and
+ a rename, so a compiler never sees a partial file, and a failed conversion
+ leaves the last good source in place.
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include <map>
+#include <string>
+
+#include "povxml2c.h"
+#include "xml2c.h"
+#include "xml2c_watch.h"
+#include "logging.h"
+
+#include "reasons.h"
+
+using std::map;
+using std::string;
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+static volatile sig_atomic_t stopping = 0;
+
+static void watch_stop_handler(int) {
+   stopping = 1;
+}
+
+static double nowMsec() {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+//true for a PoV, setting source to the name of the file generated from it
+static bool isPoV(const char *name, string *source) {
+   static const char *exts[] = {".xml", ".povxml"};
+   size_t len = strlen(name);
+   //editors keep their backup and lock files hidden
+   if (name[0] == '.') {
+      return false;
+   }
+   for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++) {
+      size_t n = strlen(exts[i]);
+      if (len > n && strcmp(name + len - n, exts[i]) == 0) {
+         *source = string(name, len - n) + ".c";
+         return true;
+      }
+   }
+   return false;
+}
+
+static bool olderThan(const struct stat &a, const struct stat &b) {
+   return a.st_mtim.tv_sec < b.st_mtim.tv_sec ||
+          (a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec < b.st_mtim.tv_nsec);
+}
+
+/*
+ * Queue every PoV in dir whose source is missing or older than the PoV, as
+ * make would see it.  With -v there is no source, so every PoV is queued.
+ */
+static void scanDir(const string &dir, map<string, double> &pending, double due) {
+   DIR *d = opendir(dir.c_str());
+   if (d == NULL) {
+      return;
+   }
+   struct dirent *e;
+   while ((e = readdir(d)) != NULL) {
+      string source;
+      struct stat pov;
+      struct stat src;
+      if (!isPoV(e->d_name, &source) || stat((dir + "/" + e->d_name).c_str(), &pov) != 0 ||
+          !S_ISREG(pov.st_mode)) {
+         continue;
+      }
+      if (stat((dir + "/" + source).c_str(), &src) != 0 || olderThan(src, pov)) {
+         pending[e->d_name] = due;
+      }
+   }
+   closedir(d);
+}
+
+//numbered here, each conversion restarts the numbering of its diagnostics
+static unsigned int reported = 0;
+
+static void report(bool ok, const char *fmt, ...) {
+   va_list va;
+   va_start(va, fmt);
+   fprintf(stderr, "%s %u - ", ok ? "ok" : "not ok", ++reported);
+   vfprintf(stderr, fmt, va);
+   va_end(va);
+}
+
+//convert one PoV and report it as a TAP line with its latency
+static void convertOne(povxml2c_ctx *ctx, Xml2cOptions *opts, const string &dir, const string &name,
+                       povxml2c_stats *total) {
+   string source;
+   isPoV(name.c_str(), &source);
+   string path = dir + "/" + name;
+   double start = nowMsec();
+   int fd = open(path.c_str(), O_RDONLY);
+   if (fd == -1) {
+      //renamed or removed again before it settled
+      return;
+   }
+   struct stat sb;
+   void *map = NULL;
+   if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0) {
+      map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   }
+   close(fd);
+   if (map == MAP_FAILED) {
+      report(false, "%s: unable to read: %s\n", name.c_str(), strerror(errno));
+      return;
+   }
+
+   char *src = NULL;
+   size_t srcLen = 0;
+   int result = povxml2c_convert(ctx, map != NULL ? (const char*)map : "", map != NULL ? sb.st_size : 0,
+                                 &src, &srcLen);
+   if (map != NULL) {
+      munmap(map, sb.st_size);
+   }
+   for (size_t i = 0; i < povxml2c_diag_count(ctx); i++) {
+      fputs(povxml2c_diag_get(ctx, i)->message, stderr);
+   }
+   povxml2c_stats_add(total, povxml2c_get_stats(ctx));
+   if (src != NULL) {
+      bool written = writeIfChanged((dir + "/" + source).c_str(), src, srcLen);
+      povxml2c_free_buffer(src);
+      if (!written) {
+         report(false, "%s: unable to write %s: %s\n", name.c_str(), source.c_str(), strerror(errno));
+         return;
+      }
+   }
+   double ms = nowMsec() - start;
+   if (result == REASON_SUCCESS) {
+      report(true, "%s: %s (%.3f ms)\n", name.c_str(), opts->verifyOnly ? "valid" : source.c_str(), ms);
+   }
+   else {
+      report(false, "%s: status %d (%.3f ms)\n", name.c_str(), result, ms);
+   }
+}
+
+int runWatch(const char *dir, Xml2cOptions *opts) {
+   if (povxml2c_init() != REASON_SUCCESS) {
+      fprintf(stderr, "Failed to parse DTD\n");
+      return REASON_LIBXML_FAIL;
+   }
+   int inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (inotifyFd == -1) {
+      log_error("inotify_init1");
+      return REASON_SERVER_FAIL;
+   }
+   if (inotify_add_watch(inotifyFd, dir, WATCH_EVENTS | IN_ONLYDIR) == -1) {
+      fprintf(stderr, "pov-xml2c: unable to watch %s: %s\n", dir, strerror(errno));
+      close(inotifyFd);
+      return REASON_XML_MISSING;
+   }
+
+   povxml2c_ctx *ctx = povxml2c_new();
+   applyOptions(ctx, opts);
+   povxml2c_set_base_dir(ctx, dir);
+   povxml2c_stats total;
+   memset(&total, 0, sizeof(total));
+
+   signal(SIGINT, watch_stop_handler);
+   signal(SIGTERM, watch_stop_handler);
+
+   //when each changed PoV is due to be converted
+   map<string, double> pending;
+   scanDir(dir, pending, 0);
+   fprintf(stderr, "# watching %s, %zu PoVs out of date\n", dir, pending.size());
+
+   int result = REASON_SUCCESS;
+   bool watching = true;
+   while (watching && !stopping) {
+      double now = nowMsec();
+      int timeout = -1;
+      for (map<string, double>::iterator i = pending.begin(); i != pending.end() && !stopping;) {
+         if (i->second <= now) {
+            convertOne(ctx, opts, dir, i->first, &total);
+            pending.erase(i++);
+            continue;
+         }
+         int wait = (int)(i->second - now) + 1;
+         if (timeout == -1 || wait < timeout) {
+            timeout = wait;
+         }
+         i++;
+      }
+
+      struct pollfd pfd = {inotifyFd, POLLIN, 0};
+      int n = poll(&pfd, 1, timeout);
+      if (n < 0 && errno != EINTR) {
+         log_error("poll");
+         result = REASON_SERVER_FAIL;
+         break;
+      }
+      if (n <= 0) {
+         continue;
+      }
+
+      char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+      ssize_t len;
+      while ((len = read(inotifyFd, buf, sizeof(buf))) > 0) {
+         const struct inotify_event *ev;
+         for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ev->len) {
+            ev = (const struct inotify_event*)p;
+            string source;
+            if (ev->mask & IN_Q_OVERFLOW) {
+               //events were lost, fall back to comparing times
+               scanDir(dir, pending, nowMsec() + WATCH_DEBOUNCE_MSEC);
+            }
+            else if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+               //a removal is followed by IN_IGNORED
+               if (watching) {
+                  report(false, "%s was removed\n", dir);
+               }
+               result = REASON_XML_MISSING;
+               watching = false;
+            }
+            else if (ev->len > 0 && isPoV(ev->name, &source)) {
+               //every further save pushes the conversion back
+               pending[ev->name] = nowMsec() + WATCH_DEBOUNCE_MSEC;
+            }
+         }
+      }
+   }
+
+   signal(SIGINT, SIG_DFL);
+   signal(SIGTERM, SIG_DFL);
+   close(inotifyFd);
+   if (opts->statsJson) {
+      writeStats(&total, opts);
+   }
+   povxml2c_free(ctx);
+   return result;
+}
@@ -0,0 +1,21 @@
+/*
+ * Id:             $Id$
+ * Last Updated:   $LastChangedDate$
+ */
+
+#ifndef __XML2C_WATCH_H
+#define __XML2C_WATCH_H
+
+struct Xml2cOptions;
+
+//quiet period after the last change to a file before it is converted
+#define WATCH_DEBOUNCE_MSEC 10
+
+/*
+ * Convert every *.xml and *.povxml file in dir whose source is missing or
+ * older than it, then keep converting each one as it is saved until
+ * interrupted.  Returns REASON_SUCCESS when stopped by SIGINT or SIGTERM.
+ */
+int runWatch(const char *dir, Xml2cOptions *opts);
+
+#endif
@@ -16,20 +16,78 @@
 #include <unistd.h>
 
 #include "xml2c_write.h"
+#include "xml2c_context.h"
+#include "xml2c_replay.h"
+#include "xml2c_bundle.h"
+#include "xml2c_cost.h"
 #include "utils.h"
 #include "logging.h"
 
 #include "reasons.h"
 
-unsigned int Xml2cWrite::writeId = 0;
+/*
+ * Emitted once ahead of main when the PoV writes anything.  Each write hands
+ * its static arrays and variables to pov_transmit_iov as a segment list.  A
+ * write is still a single transmit_all, as a service may take it in a single
+ * receive: a lone segment goes out as it is, several are gathered into one
+ * buffer sized once rather than grown segment by segment.  Should that
+ * buffer not be available the segments go out one by one, in order.
+ */
+static const char *writeRuntime =
+   "//**** pov-xml2c scatter-gather transmit\n"
+   "typedef struct {\n"
+   "   unsigned char *base;\n"
+   "   size_t len;\n"
+   "} pov_iovec;\n"
+   "static size_t pov_transmit_iov(int fd, pov_iovec *iov, unsigned int count) {\n"
+   "   size_t total = 0;\n"
+   "   unsigned int used = 0;\n"
+   "   unsigned int last = 0;\n"
+   "   unsigned int i;\n"
+   "   for (i = 0; i < count; i++) {\n"
+   "      if (iov[i].base != NULL && iov[i].len > 0) {\n"
+   "         total += iov[i].len;\n"
+   "         last = i;\n"
+   "         used++;\n"
+   "      }\n"
+   "   }\n"
+   "   if (used == 1) {\n"
+   "      transmit_all(fd, iov[last].base, iov[last].len);\n"
+   "   }\n"
+   "   else if (used > 1) {\n"
+   "      unsigned char *buf = (unsigned char*)malloc(total);\n"
+   "      size_t pos = 0;\n"
+   "      for (i = 0; i < count; i++) {\n"
+   "         if (iov[i].base != NULL && iov[i].len > 0) {\n"
+   "            if (buf == NULL) {\n"
+   "               transmit_all(fd, iov[i].base, iov[i].len);\n"
+   "            }\n"
+   "            else {\n"
+   "               memcpy(buf + pos, iov[i].base, iov[i].len);\n"
+   "               pos += iov[i].len;\n"
+   "            }\n"
+   "         }\n"
+   "      }\n"
+   "      if (buf != NULL) {\n"
+   "         transmit_all(fd, buf, total);\n"
+   "         free(buf);\n"
+   "      }\n"
+   "   }\n"
+   "   return total;\n"
+   "}\n";
+
+void generateWriteRuntime(FILE *outfile) {
+   fputs(writeRuntime, outfile);
+}
 
-Xml2cWrite::Xml2cWrite(xmlNode *w, bool echoEnable) {
-   id = writeId++;
+Xml2cWrite::Xml2cWrite(xmlNode *w, Xml2cContext *ctx) : Action(ctx) {
+   id = ctx->writeId++;
    bool parseError = false;
    echo = ECHO_NO;
 
-   if (echoEnable) {
-      char *echoAttr = (char*)xmlGetProp(w, (xmlChar*)"echo");
+   if (ctx->echoEnable) {
+      XmlString echoText(xmlGetProp(w, (xmlChar*)"echo"));
+      char *echoAttr = echoText.get();
       if (echoAttr != NULL) {
          if (strcmp(echoAttr, "no") == 0) {
             echo = ECHO_NO;
@@ -41,52 +99,73 @@ Xml2cWrite::Xml2cWrite(xmlNode *w, bool echoEnable) {
             echo = ECHO_ASCII;
          }
       }
-      xmlFree(echoAttr);
    }
    
    vector<uint8_t> *el = NULL;
    for (xmlNode *d = w->children; d; d = d->next) {
       if (strcmp((char*)d->name, "data") == 0) {
-         char *format = (char*)xmlGetProp(d, (xmlChar*)"format");
+         ExternalData *ext = NULL;
+         try {
+            ext = ExternalData::fromNode(d, ctx);
+         } catch (int ex) {
+            parseError = true;
+            continue;
+         }
+         if (ext != NULL) {
+            el = NULL;
+            if (ext->size() == 0) {
+               delete ext;
+               continue;
+            }
+            externals.push_back(ext);
+            WriteSegment seg;
+            seg.ext = ext;
+            segments.push_back(seg);
+            continue;
+         }
+         XmlString formatText(xmlGetProp(d, (xmlChar*)"format"));
+         char *format = formatText.get();
          unsigned int tlen;
-         char *dataString = getNodeText(d, &tlen);
+         XmlString text(getNodeText(d, &tlen));
+         char *dataString = text.get();
          if (tlen > 0) {
             if (el == NULL) {
                el = new vector<uint8_t>;
-               data.push_back(el);
+               buffers.push_back(el);
+               WriteSegment seg;
+               seg.data = el;
+               segments.push_back(seg);
             }
             try {
                if (format != NULL && strcmp(format, "hex") == 0) {
-                  unsigned int hlen;
-                  vector<uint8_t> *hex = parseHexBinary(dataString);
+                  Owned<vector<uint8_t> > hex(parseHexBinary(dataString));
                   if (hex->size() > 0) {
                      el->insert(el->end(), hex->begin(), hex->end());
-                     delete hex;
                   }
                   else {
                      //this is a problem that should have been reported in utils.cc
                   }
                }
                else { //format defaults to ascii
-                  vector<uint8_t> *asc = unescapeAscii((char*)dataString);
+                  Owned<vector<uint8_t> > asc(unescapeAscii(dataString));
                   el->insert(el->end(), asc->begin(), asc->end());
-                  delete asc;
                }
             } catch (int ex) {
+               if (ex == LIMIT_EXCEEDED) {
+                  throw ex;
+               }
                log_fail("Invalid hex data in <%s> element at line %d\n", d->name, d->line);
                parseError = true;
             }
          }
-         xmlFree(format);
-         xmlFree(dataString);
       }
       else if (strcmp((char*)d->name, "var") == 0) {
          el = NULL;
          uint32_t tlen;
-         char *varName = getNodeText(d, &tlen);
-         vars.push_back(varName);
-         data.push_back(NULL); 
-         xmlFree(varName);
+         XmlString varName(getNodeText(d, &tlen));
+         WriteSegment seg;
+         seg.var = varName.get();
+         segments.push_back(seg);
       }
    }
 
@@ -95,9 +174,62 @@ Xml2cWrite::Xml2cWrite(xmlNode *w, bool echoEnable) {
    }
 }
 
-Xml2cWrite::~Xml2cWrite() {
-   for (vector< vector<uint8_t>* >::iterator i = data.begin(); i != data.end(); i++) {
-      delete *i;
+void Xml2cWrite::uses(set<string> &vars) {
+   for (vector<WriteSegment>::iterator i = segments.begin(); i != segments.end(); i++) {
+      if (i->data == NULL && i->ext == NULL) {
+         vars.insert(i->var);
+      }
+   }
+}
+
+bool Xml2cWrite::replay(Xml2cReplay *r) {
+   //the segments go out in one send, just as pov_transmit_iov sends them
+   vector<uint8_t> out;
+   for (vector<WriteSegment>::iterator i = segments.begin(); i != segments.end(); i++) {
+      const uint8_t *data;
+      size_t len;
+      if (i->data != NULL) {
+         data = i->data->data();
+         len = i->data->size();
+      }
+      else if (i->ext != NULL) {
+         data = i->ext->data();
+         len = i->ext->size();
+      }
+      else {
+         const vector<uint8_t> &v = r->getVar(i->var);
+         data = v.data();
+         len = v.size();
+      }
+      out.insert(out.end(), data, data + len);
+   }
+   if (out.size() > 0 && !r->send(out.data(), out.size())) {
+      return false;
+   }
+   r->note("%zu bytes", out.size());
+   return true;
+}
+
+//one transmit_all per write, a variable is assumed not to be empty
+void Xml2cWrite::cost(Xml2cCost *c) {
+   bool sends = false;
+   for (vector<WriteSegment>::iterator i = segments.begin(); i != segments.end(); i++) {
+      unsigned long long len;
+      if (i->data != NULL) {
+         len = i->data->size();
+      }
+      else if (i->ext != NULL) {
+         len = i->ext->size();
+      }
+      else {
+         len = c->varSize(i->var);
+         sends = true;
+      }
+      sends = sends || len > 0;
+      c->totals.bytes_written += len;
+   }
+   if (sends) {
+      c->totals.transmits++;
    }
 }
 
@@ -106,39 +238,79 @@ void Xml2cWrite::generate(FILE *outfile) {
    fprintf(outfile, "      //*** writing data\n");
    //loop to add static declarations for all the static bits
    unsigned int idx = 0;
-   for (vector< vector<uint8_t>* >::iterator i = data.begin(); i != data.end(); i++) {
-      if (*i != NULL) {
-         fprintf(outfile, "      static unsigned char write_%05d_%05d[] = \n", id, idx);
-         printAsHexString(outfile, (*i)->data(), (*i)->size());
-         fprintf(outfile, "      static unsigned int write_%05d_%05d_len = %u;\n", id, idx, (*i)->size());
+   for (vector<WriteSegment>::iterator i = segments.begin(); i != segments.end(); i++) {
+      char name[32];
+      snprintf(name, sizeof(name), "write_%05d_%05d", id, idx);
+      if (i->data != NULL) {
+         generateStaticData(ctx, outfile, "unsigned char", name, i->data->data(), i->data->size());
+         fprintf(outfile, "      static unsigned int write_%05d_%05d_len = %u;\n", id, idx, i->data->size());
+      }
+      else if (i->ext != NULL) {
+         generateStaticData(ctx, outfile, "unsigned char", name, i->ext->data(), i->ext->size());
+         fprintf(outfile, "      static unsigned int write_%05d_%05d_len = %u;\n", id, idx, i->ext->size());
       }
       idx++;
    }
 
-   fprintf(outfile, "      unsigned char *write_%05d = NULL;\n", id);
-   fprintf(outfile, "      unsigned int write_%05d_len = 0;\n", id);
-
-   //loop again to paste it all together
-
+   //one segment per static array or variable, sent in order without
+   //pasting them together
+   unsigned int count = segments.size();
+   fprintf(outfile, "      pov_iovec write_%05d_iov[%u];\n", id, count > 0 ? count : 1);
    idx = 0;
-   vector<string>::iterator s = vars.begin();
-   for (vector< vector<uint8_t>* >::iterator i = data.begin(); i != data.end(); i++) {
-      if (*i == NULL) {
-         //expand a variable
-         fprintf(outfile, "      write_%05d = append_var(\"%s\", write_%05d, &write_%05d_len);\n", id, s->c_str(), id, id);
-         s++;
+   for (vector<WriteSegment>::iterator i = segments.begin(); i != segments.end(); i++) {
+      if (i->data == NULL && i->ext == NULL) {
+         //libpov hands out a copy of the variable
+         fprintf(outfile, "      write_%05d_iov[%u].base = (unsigned char*)getenv(\"%s\", &write_%05d_iov[%u].len);\n", id, idx, i->var.c_str(), id, idx);
       }
       else {
-         fprintf(outfile, "      write_%05d = append_buf(write_%05d, &write_%05d_len, write_%05d_%05d, write_%05d_%05d_len);\n", id, id, id, id, idx, id, idx);
+         fprintf(outfile, "      write_%05d_iov[%u].base = write_%05d_%05d;\n", id, idx, id, idx);
+         fprintf(outfile, "      write_%05d_iov[%u].len = write_%05d_%05d_len;\n", id, idx, id, idx);
+      }
+      idx++;
+   }
+   if (ctx->probeFd >= 0) {
+      fprintf(outfile, "      pov_probe_io(pov_transmit_iov(1, write_%05d_iov, %u), 0);\n", id, count);
+   }
+   else {
+      fprintf(outfile, "      pov_transmit_iov(1, write_%05d_iov, %u);\n", id, count);
+   }
+   idx = 0;
+   for (vector<WriteSegment>::iterator i = segments.begin(); i != segments.end(); i++) {
+      if (i->data == NULL && i->ext == NULL) {
+         fprintf(outfile, "      free(write_%05d_iov[%u].base);\n", id, idx);
       }
       idx++;
    }
-   fprintf(outfile, "      if (write_%05d_len > 0) {\n", id);
-   fprintf(outfile, "         transmit_all(1, write_%05d, write_%05d_len);\n", id, id);
-   fprintf(outfile, "      }\n");
-   fprintf(outfile, "      free(write_%05d);\n", id);
 
    fprintf(outfile, "   } while (0);\n");
 
 }
 
+//collect the write into the session's output once, then send what the
+//socket will take each time the session is stepped
+void Xml2cWrite::generateStep(FILE *outfile) {
+   fprintf(outfile, "      //*** writing data\n");
+   fprintf(outfile, "      if (!s->started) {\n");
+   unsigned int idx = 0;
+   for (vector<WriteSegment>::iterator i = segments.begin(); i != segments.end(); i++, idx++) {
+      if (i->data == NULL && i->ext == NULL) {
+         unsigned int slot = ctx->varSlot(i->var);
+         fprintf(outfile, "         pov_append(&s->out, &s->out_len, s->vars[%u].data, s->vars[%u].len);  //%s\n", slot, slot, i->var.c_str());
+         continue;
+      }
+      uint32_t len = i->data != NULL ? i->data->size() : i->ext->size();
+      fprintf(outfile, "         static unsigned char write_%05d_%05d[] = \n", id, idx);
+      if (i->data != NULL) {
+         printAsHexString(outfile, i->data->data(), len);
+      }
+      else {
+         i->ext->print(outfile);
+      }
+      fprintf(outfile, "         pov_append(&s->out, &s->out_len, write_%05d_%05d, %u);\n", id, idx, len);
+   }
+   fprintf(outfile, "         s->started = 1;\n");
+   fprintf(outfile, "      }\n");
+   fprintf(outfile, "      if (!pov_flush(s)) {\n");
+   fprintf(outfile, "         return POV_WANT_WRITE;\n");
+   fprintf(outfile, "      }\n");
+}
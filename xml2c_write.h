@@ -6,35 +6,54 @@
 #ifndef __XML2C_WRITE_H
 #define __XML2C_WRITE_H
 
+#include <stdio.h>
 #include <libxml/tree.h>
 #include <stdint.h>
 #include <vector>
 #include <string>
 
 #include "action.h"
+#include "xml2c_extdata.h"
+#include "utils.h"
 
 using std::vector;
 using std::string;
 
+//exactly one of data, ext or var describes the segment, data and ext are
+//owned by the write
+struct WriteSegment {
+   vector<uint8_t> *data;
+   ExternalData *ext;
+   string var;
+
+   WriteSegment() : data(NULL), ext(NULL) {};
+};
+
 class Xml2cWrite : public Action {
 
 private:
-   static unsigned int writeId;
-
    unsigned int id;   
    
-   vector< vector<uint8_t>* > data;
-   vector<string> vars;
+   OwnedVector<vector<uint8_t> > buffers;
+   OwnedVector<ExternalData> externals;
+   vector<WriteSegment> segments;
    int echo;
 
    //disable copy
-   Xml2cWrite(const Xml2cWrite &rr) {};
-   const Xml2cWrite &operator=(const Xml2cWrite &rr) {return *this;}
+   Xml2cWrite(const Xml2cWrite &rr);
+   const Xml2cWrite &operator=(const Xml2cWrite &rr);
    
 public:
-   Xml2cWrite(xmlNode *n, bool echoEnable = true);
-   ~Xml2cWrite();
+   Xml2cWrite(xmlNode *n, Xml2cContext *ctx);
    virtual void generate(FILE *outfile);
+   virtual int actionType() {return POVXML2C_ACTION_WRITE;};
+   virtual void uses(set<string> &vars);
+   virtual bool replay(Xml2cReplay *r);
+   virtual void generateStep(FILE *outfile);
+   virtual void cost(Xml2cCost *c);
 };
 
+//pov_transmit_iov and its segment type, needed once by any PoV that writes
+void generateWriteRuntime(FILE *outfile);
+
 #endif